@@ -16,6 +16,7 @@
  *   along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <sched.h>
 #include "array.h"
 #include "mpiutil.h"
 
@@ -35,6 +36,7 @@ USE (rcsid);
 **************************************************************/
 
 static double _maxsize = -1;
+static int _evict = 0;
 static double _totalsize = 0;
 static double _overheadsize = 0;
 static ARRAY *_multistats = NULL;
@@ -55,7 +57,7 @@ void ReportMultiStats(void) {
     MULTI *ma = *pma;
     if (ma == NULL) continue;
     if (ma->numelem > 0) {
-      MPrintf(0, "idx=%d, id=%s, nd=%d, hs=%d, ne=%d, me=%d, ts=%g, os=%g, ms=%g, isize=%d, esize=%d, lock=%x\n", i, ma->id, ma->ndim, ma->hsize, ma->numelem, ma->maxelem, ma->totalsize, ma->overheadsize, ma->maxsize, ma->isize, ma->esize, ma->lock);
+      MPrintf(0, "idx=%d, id=%s, nd=%d, hs=%d, ne=%d, me=%d, ts=%g, os=%g, ms=%g, isize=%d, esize=%d, lock=%x, nh=%lld, nm=%lld, nv=%lld\n", i, ma->id, ma->ndim, ma->hsize, ma->numelem, ma->maxelem, ma->totalsize, ma->overheadsize, ma->maxsize, ma->isize, ma->esize, ma->lock, ma->nhit, ma->nmiss, ma->nevict);
     }
   }
 }
@@ -73,6 +75,14 @@ void RemoveMultiLocks(void) {
       free(ma->lock);
       ma->lock = NULL;
     }
+    if (ma->array == NULL) {
+      if (ma->slock) {
+	DestroyLock(ma->slock);
+	free(ma->slock);
+	ma->slock = NULL;
+      }
+      continue;
+    }
     for (int j = 0; j < ma->hsize; j++) {
       ARRAY *a = &ma->array[j];
       if (a->lock) {
@@ -145,7 +155,7 @@ int ArrayInit(ARRAY *a, int esize, int block) {
   a->bsize = ((int)esize)*((int)block);
   a->dim = 0;
   a->data = NULL;
-#if USE_MPI == 2
+#ifdef USE_OPENMP
   a->lock = (LOCK *) malloc(sizeof(LOCK));
   if (0 != InitLock(a->lock)) {
     free(a->lock);
@@ -446,6 +456,12 @@ int SMultiInit(MULTI *ma, int esize, int ndim, int *block, char *id) {
   ma->maxsize = -1;
   ma->totalsize = 0;
   ma->clean_mode = -1;
+  ma->evict = -1;
+  ma->hand = 0;
+  ma->keep = 0;
+  ma->nhit = 0;
+  ma->nmiss = 0;
+  ma->nevict = 0;
   ma->ndim = ndim;
   ma->esize = esize;
   ma->block = (unsigned short *) malloc(sizeof(unsigned short)*ndim);
@@ -495,6 +511,8 @@ void *SMultiGet(MULTI *ma, int *k, LOCK **lock) {
 **              pointer to the element just set.
 ** SIDE EFFECT: 
 ** NOTE:        if d == NULL, returns an uninitialized element.
+**              the table is never cleaned here, whether or not it is
+**              marked to keep.
 */    
 void *SMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
 		void (*InitData)(void *, int),
@@ -596,6 +614,8 @@ typedef struct _MDATA_ {
   int *index;
   LOCK *lock;
   void *data;
+  struct _MDATA_ *next;
+  unsigned char ref;
 } MDATA;
 
 void InitMDataData(void *p, int n) {
@@ -607,6 +627,8 @@ void InitMDataData(void *p, int n) {
     d[i].index = NULL;
     d[i].data = NULL;
     d[i].lock = NULL;
+    d[i].next = NULL;
+    d[i].ref = 0;
   }
 }
 
@@ -658,9 +680,20 @@ static int Hash2(int *id, ub4 length, ub4 initval, int n, int m) {
   return (int) (c & m);
 }
 
+/* size counters are updated without locks from several threads */
+static void AtomicAddDouble(double *x, double d) {
+  double a, b;
+
+  __atomic_load(x, &a, __ATOMIC_RELAXED);
+  do {
+    b = a + d;
+  } while (!__atomic_compare_exchange(x, &a, &b, 0,
+				      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
 void AddMultiSize(MULTI *ma, int size) {
-  ma->totalsize += size;
-  _totalsize += size;
+  AtomicAddDouble(&(ma->totalsize), size);
+  if (!ma->keep) AtomicAddDouble(&_totalsize, size);
 }
 
 void LimitMultiSize(MULTI *ma, double r) {
@@ -670,6 +703,23 @@ void LimitMultiSize(MULTI *ma, double r) {
     ma->maxsize = r;
   }
 }
+
+void SetMultiEvict(MULTI *ma, int m) {
+  if (ma == NULL) {
+    _evict = m;
+  } else {
+    ma->evict = m;
+  }
+}
+
+/* 
+** entries of a table marked to keep are never cleaned or evicted, as
+** pointers to them are held for long. its size does not count toward
+** the global limit either.
+*/
+void SetMultiKeep(MULTI *ma, int m) {
+  ma->keep = m;
+}
   
 int NMultiInit(MULTI *ma, int esize, int ndim, int *block, char *id) {
   int i, n, s;
@@ -677,6 +727,11 @@ int NMultiInit(MULTI *ma, int esize, int ndim, int *block, char *id) {
   ma->maxsize = -1;
   ma->totalsize = 0;
   ma->clean_mode = -1;
+  ma->evict = -1;
+  ma->keep = 0;
+  ma->nhit = 0;
+  ma->nmiss = 0;
+  ma->nevict = 0;
   ma->ndim = ndim;
   ma->isize = sizeof(int)*ndim;
   ma->esize = esize;
@@ -694,7 +749,7 @@ int NMultiInit(MULTI *ma, int esize, int ndim, int *block, char *id) {
   for (i = 0; i < n; i++) {
     ArrayInit(&(ma->array[i]), sizeof(MDATA), 8);
   }
-#if USE_MPI == 2
+#ifdef USE_OPENMP
   ma->lock = (LOCK *) malloc(sizeof(LOCK));
   if (0 != InitLock(ma->lock)) {
     free(ma->lock);
@@ -735,6 +790,30 @@ void *NMultiGet(MULTI *ma, int *k, LOCK **lock) {
   return NULL;
 }
 
+int NMultiWalk(MULTI *ma, int (*f)(int *, void *, void *), void *arg) {
+  ARRAY *a;
+  MDATA *pt;
+  DATA *p;
+  int i, j, m, n;
+
+  n = 0;
+  for (i = 0; i < ma->hsize; i++) {
+    a = &(ma->array[i]);
+    p = a->data;
+    j = 0;
+    while (p) {
+      pt = (MDATA *) p->dptr;
+      for (m = 0; m < a->block && j < a->dim; j++, m++) {
+	if (f(pt->index, pt->data, arg) < 0) return n;
+	n++;
+	pt++;
+      }
+      p = p->next;
+    }
+  }
+  return n;
+}
+
 void *NMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
 		void (*InitData)(void *, int),
 		void (*FreeElem)(void *)) {
@@ -744,7 +823,8 @@ void *NMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
   DATA *p, *p0;
 #pragma omp critical
   {
-    if (ma->maxsize > 0 && ma->totalsize >= ma->maxsize) {
+    if (ma->keep) {
+    } else if (ma->maxsize > 0 && ma->totalsize >= ma->maxsize) {
       ma->clean_mode = 0;
       NMultiFreeData(ma, FreeElem);
     } else if (_maxsize > 0 &&
@@ -768,7 +848,7 @@ void *NMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
       a->data->dptr = malloc(a->bsize);
       size += a->bsize;
       ma->totalsize += size;
-      _totalsize += size;
+      if (!ma->keep) _totalsize += size;
       InitMDataData(a->data->dptr, a->block);
       a->data->next = NULL;
       pt = (MDATA *) a->data->dptr;
@@ -846,7 +926,7 @@ void *NMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
       p->dptr = malloc(a->bsize);
       size += a->bsize;
       ma->totalsize += size;
-      _totalsize += size;
+      if (!ma->keep) _totalsize += size;
       InitMDataData(p->dptr, a->block);
       p->next = NULL;
       pt = (MDATA *) p->dptr;
@@ -854,7 +934,7 @@ void *NMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
   }
 
   size = sizeof(LOCK);
-#if USE_MPI == 2
+#ifdef USE_OPENMP
   pt->lock = (LOCK *) malloc(sizeof(LOCK));
   if (0 != InitLock(pt->lock)) {
     free(pt->lock);
@@ -867,7 +947,7 @@ void *NMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
   size += ma->esize + ma->isize;
   ma->totalsize += size;
   ma->numelem++;
-  _totalsize += size;
+  if (!ma->keep) _totalsize += size;
   if (InitData) InitData(pt->data, 1);
   if (d) memcpy(pt->data, d, ma->esize);
   if (lock) *lock = pt->lock;  
@@ -957,7 +1037,7 @@ int NMultiFreeData(MULTI *ma, void (*FreeElem)(void *)) {
       NMultiFreeDataOnly(a, FreeElem);
       if (a->lock) ReleaseLock(a->lock);
     }
-    _totalsize -= ma->totalsize;
+    if (!ma->keep) _totalsize -= ma->totalsize;
     ma->totalsize = 0;
     ma->numelem = 0;
   }
@@ -984,6 +1064,712 @@ int NMultiFree(MULTI *ma, void (*FreeElem)(void *)) {
   return 0;
 }
 
+/*
+** the CMulti implementation keeps one singly linked chain of MDATA
+** per hash bucket. new entries are pushed onto the chain head with a
+** compare-and-swap, so lookups never lock and insertions only retry
+** when another thread pushed onto the same bucket in the meantime.
+** size accounting is atomic, and the size limits are checked without
+** entering a critical section.
+** when the size limit is reached, either the whole table is cleared,
+** or, in the eviction mode, a CLOCK sweep over the buckets drops only
+** the entries not accessed since the previous sweep.
+** each entry is one fixed size record holding the MDATA, the index 
+** and the data, carved out of slabs owned by the table. records of
+** evicted entries are recycled through a free list, and the slabs are
+** only released as a whole when the table is cleared.
+** entries unlinked by a clean may still be read by other threads. they
+** are kept in a batch tagged with the epoch of the clean, and released
+** only after every thread has passed a quiescent point, where it holds
+** no entry pointer, in a later epoch. the quiescent points are the work
+** item boundaries of SkipOMP and SkipMPICost.
+*/
+
+/*
+** STRUCT:      MSLAB
+** PURPOSE:     a chunk of fixed size records for CMulti entries.
+** FIELDS:      {char *buf},
+**              the records, following the header in the same block.
+**              {int n},
+**              number of records in the chunk.
+**              {int used},
+**              number of records handed out, may exceed n.
+**              {MSLAB *next},
+**              the previously allocated chunk.
+** NOTE:        
+*/
+typedef struct _MSLAB_ {
+  char *buf;
+  int n;
+  int used;
+  struct _MSLAB_ *next;
+} MSLAB;
+
+#define MSLAB_MINREC 64
+#define MSLAB_MAXSIZE (1<<20)
+#define MSLAB_ALIGN(n) ((((n)+7)/8)*8)
+
+/*
+** STRUCT:      MRETIRED
+** PURPOSE:     entries and slabs unlinked from a CMulti table by one 
+**              clean, waiting for the readers to move on.
+** FIELDS:      {long long epoch},
+**              epoch of the clean.
+**              {int sgen},
+**              slab generation of the table at the time of the clean.
+**              {MDATA *chain},
+**              chains detached from the hash table.
+**              {MSLAB *slab},
+**              slabs detached with them.
+**              {ARRAY evicted},
+**              entries unlinked by an eviction sweep.
+**              {void (*rfree)(void *)},
+**              releases the data of an entry.
+**              {MRETIRED *next},
+**              the batch of the next clean.
+** NOTE:        
+*/
+typedef struct _MRETIRED_ {
+  long long epoch;
+  int sgen;
+  MDATA *chain;
+  MSLAB *slab;
+  ARRAY evicted;
+  void (*rfree)(void *);
+  struct _MRETIRED_ *next;
+} MRETIRED;
+
+/* 
+** the quiescent epochs of the threads, each on its own cache line. 
+** a single slot is used until InitMultiEpoch is called.
+*/
+#define MEPOCH_STRIDE 8
+static long long _mepoch = 1;
+static long long _mquiet0[MEPOCH_STRIDE];
+static long long *_mquiet = _mquiet0;
+static int _nmquiet = 1;
+
+void InitMultiEpoch(int nt) {
+  int i;
+
+  if (nt <= _nmquiet) return;
+  _mquiet = (long long *) malloc(sizeof(long long)*MEPOCH_STRIDE*nt);
+  for (i = 0; i < nt; i++) {
+    _mquiet[i*MEPOCH_STRIDE] = 0;
+  }
+  _nmquiet = nt;
+}
+
+static int MultiThread(int *nt) {
+#ifdef USE_OPENMP
+  if (nt) *nt = omp_get_num_threads();
+  return omp_get_thread_num();
+#else
+  if (nt) *nt = 1;
+  return 0;
+#endif
+}
+
+/* the calling thread holds no pointer into any CMulti table */
+void MultiQuiescent(void) {
+  int t;
+
+  t = MultiThread(NULL);
+  if (t >= _nmquiet) return;
+  __atomic_store_n(&(_mquiet[t*MEPOCH_STRIDE]),
+		   __atomic_load_n(&_mepoch, __ATOMIC_SEQ_CST),
+		   __ATOMIC_SEQ_CST);
+}
+
+/* 
+** whether no thread can hold a pointer unlinked in epoch e. outside a
+** parallel region only the calling thread can.
+*/
+static int MultiEpochPassed(long long e) {
+  int i, t, nt;
+
+  t = MultiThread(&nt);
+  if (nt > _nmquiet) return 0;
+  if (nt == 1) {
+    return __atomic_load_n(&(_mquiet[t*MEPOCH_STRIDE]),
+			   __ATOMIC_SEQ_CST) >= e;
+  }
+  for (i = 0; i < nt; i++) {
+    if (__atomic_load_n(&(_mquiet[i*MEPOCH_STRIDE]),
+			__ATOMIC_SEQ_CST) < e) return 0;
+  }
+  return 1;
+}
+
+/* 
+** whether other threads may hold pointers into the tables. outside a
+** parallel region, or with a single thread, unlinked entries can be 
+** freed at once instead of retired.
+*/
+static int MultiShared(void) {
+#ifdef USE_OPENMP
+  return omp_in_parallel() && omp_get_num_threads() > 1;
+#else
+  return 0;
+#endif
+}
+
+int CMultiInit(MULTI *ma, int esize, int ndim, int *block, char *id) {
+  int i, n, s;
+  strncpy(ma->id, id, MULTI_IDLEN-1);
+  ma->maxsize = -1;
+  ma->totalsize = 0;
+  ma->overheadsize = 0;
+  ma->numelem = 0;
+  ma->clean_mode = -1;
+  ma->ndim = ndim;
+  ma->isize = sizeof(int)*ndim;
+  ma->esize = esize;
+  s = sizeof(unsigned short)*ndim;
+  ma->block = (unsigned short *) malloc(s);
+  for (i = 0; i < ndim; i++) ma->block[i] = block[i];
+  ma->overheadsize += s;
+  n = HashSize(ma->ndim);
+  ma->hsize = n;
+  ma->hmask = ma->hsize-1;
+  s = sizeof(MDATA *)*n;
+  ma->head = (MDATA **) malloc(s);
+  for (i = 0; i < n; i++) {
+    ma->head[i] = NULL;
+  }
+  ma->overheadsize += s;
+  AtomicAddDouble(&_overheadsize, ma->overheadsize);
+  ma->keep = 0;
+  ma->doff = MSLAB_ALIGN(sizeof(MDATA) + ma->isize);
+  ma->rsize = ma->doff + MSLAB_ALIGN(ma->esize);
+  ma->slab = NULL;
+  ma->frec = NULL;
+  ma->retired = NULL;
+  ma->sgen = 0;
+  ma->nins = 0;
+  ma->swap = 0;
+  ma->evict = -1;
+  ma->hand = 0;
+  ma->nhit = 0;
+  ma->nmiss = 0;
+  ma->nevict = 0;
+  ma->array = NULL;
+#ifdef USE_OPENMP
+  ma->lock = (LOCK *) malloc(sizeof(LOCK));
+  if (0 != InitLock(ma->lock)) {
+    free(ma->lock);
+    ma->lock = NULL;
+  }
+  ma->slock = (LOCK *) malloc(sizeof(LOCK));
+  if (0 != InitLock(ma->slock)) {
+    free(ma->slock);
+    ma->slock = NULL;
+  }
+#else
+  ma->lock = NULL;
+  ma->slock = NULL;
+#endif
+  if (_multistats != NULL) {
+    ArrayAppend(_multistats, &ma, InitPointerData);    
+  }
+  return 0;
+}
+
+/* 
+** take a record from the free list, or from the current slab. a new
+** slab twice as large as the last one is pushed when it is used up.
+*/
+static MDATA *CMultiAlloc(MULTI *ma) {
+  MDATA *p;
+  MSLAB *b, *c;
+  int i, n, s;
+
+  if (__atomic_load_n(&(ma->frec), __ATOMIC_RELAXED)) {
+    if (ma->slock) SetLock(ma->slock);
+    p = ma->frec;
+    if (p) ma->frec = p->next;
+    if (ma->slock) ReleaseLock(ma->slock);
+    if (p) return p;
+  }
+  b = __atomic_load_n(&(ma->slab), __ATOMIC_ACQUIRE);
+  while (1) {
+    if (b) {
+      i = __atomic_fetch_add(&(b->used), 1, __ATOMIC_RELAXED);
+      if (i < b->n) return (MDATA *) (b->buf + ((size_t) i)*ma->rsize);
+      n = 2*b->n;
+    } else {
+      n = MSLAB_MINREC;
+    }
+    if (n*ma->rsize > MSLAB_MAXSIZE) {
+      n = Max(MSLAB_MINREC, MSLAB_MAXSIZE/ma->rsize);
+    }
+    s = sizeof(MSLAB) + n*ma->rsize;
+    c = (MSLAB *) malloc(s);
+    c->buf = (char *) (c+1);
+    c->n = n;
+    c->used = 1;
+    c->next = b;
+    if (__atomic_compare_exchange_n(&(ma->slab), &b, c, 0,
+				    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      AtomicAddDouble(&(ma->overheadsize), s);
+      AtomicAddDouble(&_overheadsize, s);
+      return (MDATA *) c->buf;
+    }
+    free(c);
+  }
+}
+
+/* put records on the free list, p to t linked through next */
+static void CMultiRecycle(MULTI *ma, MDATA *p, MDATA *t) {
+  if (ma->slock) SetLock(ma->slock);
+  t->next = ma->frec;
+  ma->frec = p;
+  if (ma->slock) ReleaseLock(ma->slock);
+}
+
+static void CMultiFreeSlabs(MULTI *ma, MSLAB *b) {
+  MSLAB *c;
+  double s;
+
+  s = 0.0;
+  while (b) {
+    c = b->next;
+    s += sizeof(MSLAB) + ((double) b->n)*ma->rsize;
+    free(b);
+    b = c;
+  }
+  AtomicAddDouble(&(ma->overheadsize), -s);
+  AtomicAddDouble(&_overheadsize, -s);
+}
+
+/* the lock of an entry is only created when it is first asked for */
+static LOCK *CMultiLock(MULTI *ma, MDATA *p) {
+  LOCK *x, *x0;
+
+  x = __atomic_load_n(&(p->lock), __ATOMIC_ACQUIRE);
+  if (x || ma->lock == NULL) return x;
+  x = (LOCK *) malloc(sizeof(LOCK));
+  if (0 != InitLock(x)) {
+    free(x);
+    return NULL;
+  }
+  x0 = NULL;
+  if (!__atomic_compare_exchange_n(&(p->lock), &x0, x, 0,
+				   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    DestroyLock(x);
+    free(x);
+    return x0;
+  }
+  AddMultiSize(ma, sizeof(LOCK));
+  return x;
+}
+
+/* search the chain from p up to, but not including, p1 */
+static MDATA *CMultiFind(MDATA *p, MDATA *p1, int *k, int isize) {
+  while (p && p != p1) {
+    if (memcmp(p->index, k, isize) == 0) {
+      if (!p->ref) __atomic_store_n(&(p->ref), 1, __ATOMIC_RELAXED);
+      return p;
+    }
+    p = p->next;
+  }
+  return NULL;
+}
+
+/* 
+** release the data and locks of a chain of entries, returns the last
+** entry. the records themselves belong to the slabs.
+*/
+static MDATA *CMultiReleaseChain(MDATA *p, void (*FreeElem)(void *)) {
+  MDATA *t;
+
+  t = NULL;
+  while (p) {
+    if (p->lock) {
+      DestroyLock(p->lock);
+      free(p->lock);
+      p->lock = NULL;
+    }
+    if (FreeElem) FreeElem(p->data);
+    t = p;
+    p = p->next;
+  }
+  return t;
+}
+
+/* a new batch for the entries unlinked by a clean, last in the list */
+static MRETIRED *CMultiRetire(MULTI *ma, void (*FreeElem)(void *)) {
+  MRETIRED *r, **pr;
+
+  r = (MRETIRED *) malloc(sizeof(MRETIRED));
+  r->epoch = 0;
+  r->sgen = ma->sgen;
+  r->chain = NULL;
+  r->slab = NULL;
+  ArrayInit(&(r->evicted), sizeof(MDATA *), 1024);
+  r->rfree = FreeElem;
+  r->next = NULL;
+  for (pr = &(ma->retired); *pr; pr = &((*pr)->next));
+  *pr = r;
+  return r;
+}
+
+/* 
+** release the batches whose readers have all moved on, oldest first.
+** records of evicted entries are recycled, unless their slabs have been
+** retired since. if all is set, everything is released.
+*/
+static void CMultiReclaim(MULTI *ma, int all) {
+  MRETIRED *r;
+  MDATA **pp, *p, *q, *t;
+  int i;
+
+  while (ma->retired) {
+    r = ma->retired;
+    if (!all && !MultiEpochPassed(r->epoch)) break;
+    ma->retired = r->next;
+    q = NULL;
+    t = NULL;
+    for (i = 0; i < r->evicted.dim; i++) {
+      pp = (MDATA **) ArrayGet(&(r->evicted), i);
+      p = *pp;
+      p->next = NULL;
+      CMultiReleaseChain(p, r->rfree);
+      p->next = q;
+      q = p;
+      if (t == NULL) t = p;
+    }
+    if (q && r->sgen == ma->sgen) CMultiRecycle(ma, q, t);
+    ArrayFree(&(r->evicted), NULL);
+    CMultiReleaseChain(r->chain, r->rfree);
+    CMultiFreeSlabs(ma, r->slab);
+    free(r);
+  }
+}
+
+/* 
+** inserts take a record and push it onto a chain while nins is raised.
+** a clean swapping out the chains and slabs raises swap, and waits 
+** until no insert is in flight. inserts arriving meanwhile wait for
+** the swap to finish, so no record of a retired slab is handed out or
+** linked into the new chains.
+*/
+static void CMultiEnter(MULTI *ma) {
+  while (1) {
+    __atomic_add_fetch(&(ma->nins), 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&(ma->swap), __ATOMIC_SEQ_CST)) return;
+    __atomic_sub_fetch(&(ma->nins), 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&(ma->swap), __ATOMIC_ACQUIRE)) sched_yield();
+  }
+}
+
+static void CMultiLeave(MULTI *ma) {
+  __atomic_sub_fetch(&(ma->nins), 1, __ATOMIC_RELEASE);
+}
+
+/* 
+** detach all chains and slabs from the hash table. if r is set, they 
+** are retired in a batch of the next epoch, so that threads still 
+** holding element pointers obtained before the clean do not touch 
+** freed memory. otherwise everything is freed immediately.
+*/
+static void CMultiDetach(MULTI *ma, int r, void (*FreeElem)(void *)) {
+  MDATA *p, *q, *t;
+  MSLAB *b;
+  MRETIRED *rb;
+  double d, z;
+  int i;
+
+  CMultiReclaim(ma, !r);
+  __atomic_store_n(&(ma->swap), 1, __ATOMIC_SEQ_CST);
+  while (__atomic_load_n(&(ma->nins), __ATOMIC_SEQ_CST)) sched_yield();
+  z = 0.0;
+  __atomic_exchange(&(ma->totalsize), &z, &d, __ATOMIC_ACQ_REL);
+  if (!ma->keep) AtomicAddDouble(&_totalsize, -d);
+  __atomic_store_n(&(ma->numelem), 0, __ATOMIC_RELAXED);
+  q = NULL;
+  t = NULL;
+  for (i = 0; i < ma->hsize; i++) {
+    if (__atomic_load_n(&(ma->head[i]), __ATOMIC_RELAXED) == NULL) continue;
+    p = __atomic_exchange_n(&(ma->head[i]), NULL, __ATOMIC_ACQ_REL);
+    if (p == NULL) continue;
+    if (!r) {
+      CMultiReleaseChain(p, FreeElem);
+      continue;
+    }
+    if (t) t->next = p;
+    else q = p;
+    for (t = p; t->next; t = t->next);
+  }
+  if (ma->slock) SetLock(ma->slock);
+  ma->frec = NULL;
+  b = __atomic_exchange_n(&(ma->slab), NULL, __ATOMIC_ACQ_REL);
+  if (ma->slock) ReleaseLock(ma->slock);
+  ma->sgen++;
+  __atomic_store_n(&(ma->swap), 0, __ATOMIC_RELEASE);
+  if (r) {
+    rb = CMultiRetire(ma, FreeElem);
+    rb->chain = q;
+    rb->slab = b;
+    rb->epoch = __atomic_add_fetch(&_mepoch, 1, __ATOMIC_SEQ_CST);
+  } else {
+    CMultiFreeSlabs(ma, b);
+  }
+}
+
+/*
+** one CLOCK sweep of at most one revolution, starting from the bucket
+** where the last sweep stopped. accessed entries have their reference
+** bit cleared and survive, the others are unlinked until the table size
+** drops to tgt. entries whose lock is held by a thread still computing
+** them are skipped. the data size of an entry is not known, the table
+** average is used instead. unlinked entries are retired in a batch of
+** the next epoch, as other threads may still be reading them.
+*/
+static void CMultiEvict(MULTI *ma, double tgt, void (*FreeElem)(void *)) {
+  MDATA *p, *q, *r, **ph;
+  MRETIRED *rb;
+  double s;
+  int i, n;
+
+  CMultiReclaim(ma, !MultiShared());
+  n = ma->numelem;
+  if (n <= 0) return;
+  s = ma->totalsize/n;
+  rb = CMultiRetire(ma, FreeElem);
+  n = 0;
+  for (i = 0; i < ma->hsize && ma->totalsize - n*s > tgt; i++) {
+    ph = &(ma->head[ma->hand]);
+    ma->hand = (ma->hand + 1) & ma->hmask;
+    q = NULL;
+    p = __atomic_load_n(ph, __ATOMIC_ACQUIRE);
+    while (p) {
+      r = p->next;
+      if (p->ref) {
+	__atomic_store_n(&(p->ref), 0, __ATOMIC_RELAXED);
+	q = p;
+	p = r;
+	continue;
+      }
+      if (p->lock) {
+	if (TryLock(p->lock)) {
+	  q = p;
+	  p = r;
+	  continue;
+	}
+	ReleaseLock(p->lock);
+      }
+      if (q == NULL) {
+	q = p;
+	if (!__atomic_compare_exchange_n(ph, &q, r, 0, __ATOMIC_RELEASE,
+					 __ATOMIC_ACQUIRE)) {
+	  /* new entries were pushed in front, p is further down now */
+	  while (q->next != p) q = q->next;
+	  __atomic_store_n(&(q->next), r, __ATOMIC_RELEASE);
+	} else {
+	  q = NULL;
+	}
+      } else {
+	__atomic_store_n(&(q->next), r, __ATOMIC_RELEASE);
+      }
+      ArrayAppend(&(rb->evicted), &p, NULL);
+      n++;
+      p = r;
+      if (ma->totalsize - n*s <= tgt) break;
+    }
+  }
+  __atomic_sub_fetch(&(ma->numelem), n, __ATOMIC_RELAXED);
+  AtomicAddDouble(&(ma->totalsize), -n*s);
+  AtomicAddDouble(&_totalsize, -n*s);
+  ma->nevict += n;
+  rb->epoch = __atomic_add_fetch(&_mepoch, 1, __ATOMIC_SEQ_CST);
+  if (!MultiShared()) CMultiReclaim(ma, 1);
+}
+
+static void CMultiClean(MULTI *ma, int mode, void (*FreeElem)(void *)) {
+  int clean;
+  double tgt;
+
+  if (ma->lock && TryLock(ma->lock)) return;
+  if (ma->evict > 0 || (ma->evict < 0 && _evict > 0)) {
+    /* evict down to 3/4 of the limit, so that sweeps are not too often */
+    if (mode == 0) {
+      tgt = 0.75*ma->maxsize;
+    } else {
+      tgt = ma->totalsize - (_totalsize - 0.75*_maxsize);
+    }
+    CMultiEvict(ma, tgt, FreeElem);
+    if (ma->lock) ReleaseLock(ma->lock);
+    return;
+  }
+  clean = 1;
+  if (mode == 0) {
+    if (ma->totalsize < ma->maxsize) clean = 0;
+    if (clean) {
+      MPrintf(-1,
+	      "clean0 %s t=%g o=%g m=%g tt=%g to=%g tm=%g\n",
+	      ma->id, ma->totalsize, ma->overheadsize, ma->maxsize,	    
+	      _totalsize, _overheadsize, _maxsize);
+    }
+  } else {
+    if (_totalsize < _maxsize && ma->totalsize <= 0.1*_totalsize) clean = 0;
+    if (clean) {
+      MPrintf(-1,
+	      "clean1: %s t=%g o=%g m=%g tt=%g to=%g tm=%g\n",
+	      ma->id, ma->totalsize, ma->overheadsize, ma->maxsize,
+	      _totalsize, _overheadsize, _maxsize);
+    }
+  }
+  if (clean) {
+    ma->clean_thread = MyRankMPI();
+    CMultiDetach(ma, MultiShared(), FreeElem);
+  }
+  if (ma->lock) ReleaseLock(ma->lock);
+}
+
+void *CMultiGet(MULTI *ma, int *k, LOCK **lock) {
+  MDATA *p;
+  int h;
+
+  h = Hash2(k, ma->ndim, 0, ma->ndim, ma->hmask);
+  p = __atomic_load_n(&(ma->head[h]), __ATOMIC_ACQUIRE);
+  p = CMultiFind(p, NULL, k, ma->isize);
+  if (p == NULL) {
+#ifdef PERFORM_STATISTICS
+    __atomic_add_fetch(&(ma->nmiss), 1, __ATOMIC_RELAXED);
+#endif
+    return NULL;
+  }
+#ifdef PERFORM_STATISTICS
+  __atomic_add_fetch(&(ma->nhit), 1, __ATOMIC_RELAXED);
+#endif
+  if (lock) *lock = CMultiLock(ma, p);
+  return p->data;
+}
+
+void *CMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
+		void (*InitData)(void *, int),
+		void (*FreeElem)(void *)) {
+  MDATA *p, *q, *h0, *h1, **ph;
+  int h;
+
+  if (ma->keep) {
+  } else if (ma->maxsize > 0 && ma->totalsize >= ma->maxsize) {
+    CMultiClean(ma, 0, FreeElem);
+  } else if (_maxsize > 0 &&
+	     _totalsize >= _maxsize &&
+	     ma->totalsize > 0.1*_totalsize) {
+    CMultiClean(ma, 1, FreeElem);
+  }
+  h = Hash2(k, ma->ndim, 0, ma->ndim, ma->hmask);
+  ph = &(ma->head[h]);
+  h0 = __atomic_load_n(ph, __ATOMIC_ACQUIRE);
+  p = CMultiFind(h0, NULL, k, ma->isize);
+  if (p) {
+#ifdef PERFORM_STATISTICS
+    __atomic_add_fetch(&(ma->nhit), 1, __ATOMIC_RELAXED);
+#endif
+    if (d) memcpy(p->data, d, ma->esize);
+    if (lock) *lock = CMultiLock(ma, p);
+    return p->data;
+  }
+#ifdef PERFORM_STATISTICS
+  __atomic_add_fetch(&(ma->nmiss), 1, __ATOMIC_RELAXED);
+#endif
+
+  CMultiEnter(ma);
+  /* a clean may have swapped the chains since the search */
+  h1 = __atomic_load_n(ph, __ATOMIC_ACQUIRE);
+  if (h1 != h0) {
+    q = CMultiFind(h1, h0, k, ma->isize);
+    if (q) {
+      CMultiLeave(ma);
+      if (d) memcpy(q->data, d, ma->esize);
+      if (lock) *lock = CMultiLock(ma, q);
+      return q->data;
+    }
+    h0 = h1;
+  }
+  p = CMultiAlloc(ma);
+  p->index = (int *) (p+1);
+  memcpy(p->index, k, ma->isize);
+  p->data = ((char *) p) + ma->doff;
+  if (InitData) InitData(p->data, 1);
+  if (d) memcpy(p->data, d, ma->esize);
+  p->lock = NULL;
+  p->ref = 1;
+  p->next = h0;
+  while (!__atomic_compare_exchange_n(ph, &(p->next), p, 0,
+				      __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+    /* 
+    ** the head has moved, only the entries pushed since the last 
+    ** attempt need to be checked for the same index.
+    */
+    q = CMultiFind(p->next, h0, k, ma->isize);
+    if (q) {
+      CMultiRecycle(ma, p, p);
+      CMultiLeave(ma);
+      if (d) memcpy(q->data, d, ma->esize);
+      if (lock) *lock = CMultiLock(ma, q);
+      return q->data;
+    }
+    h0 = p->next;
+  }
+  CMultiLeave(ma);
+  __atomic_add_fetch(&(ma->numelem), 1, __ATOMIC_RELAXED);
+  AddMultiSize(ma, ma->rsize);
+  if (lock) *lock = CMultiLock(ma, p);
+  return p->data;
+}
+
+/*
+** call f on every entry in the table, stop when f returns a negative
+** value. the table must not be modified concurrently.
+*/
+int CMultiWalk(MULTI *ma, int (*f)(int *, void *, void *), void *arg) {
+  MDATA *p;
+  int i, n;
+
+  n = 0;
+  for (i = 0; i < ma->hsize; i++) {
+    for (p = ma->head[i]; p; p = p->next) {
+      if (f(p->index, p->data, arg) < 0) return n;
+      n++;
+    }
+  }
+  return n;
+}
+
+int CMultiFreeData(MULTI *ma, void (*FreeElem)(void *)) {
+  if (ma->lock) SetLock(ma->lock);
+  CMultiDetach(ma, 0, FreeElem);
+  ma->clean_mode = -1;
+  if (ma->lock) ReleaseLock(ma->lock);
+  return 0;
+}
+
+int CMultiFree(MULTI *ma, void (*FreeElem)(void *)) {
+  if (!ma) return 0;
+  if (ma->ndim <= 0) return 0;
+  CMultiFreeData(ma, FreeElem);
+  free(ma->head);
+  ma->head = NULL;
+  free(ma->block);
+  ma->block = NULL;
+  if (ma->lock) {
+    DestroyLock(ma->lock);
+    free(ma->lock);  
+    ma->lock = NULL;
+  }
+  if (ma->slock) {
+    DestroyLock(ma->slock);
+    free(ma->slock);  
+    ma->slock = NULL;
+  }
+  ma->ndim = 0;
+  return 0;
+}
+
 int MMultiInit(MULTI *ma, int esize, int ndim, int *block, char *id) {
   int i, n;
 
@@ -991,6 +1777,12 @@ int MMultiInit(MULTI *ma, int esize, int ndim, int *block, char *id) {
   ma->maxsize = -1;
   ma->totalsize = 0;
   ma->clean_mode = -1;
+  ma->evict = -1;
+  ma->hand = 0;
+  ma->keep = 0;
+  ma->nhit = 0;
+  ma->nmiss = 0;
+  ma->nevict = 0;
   ma->ndim = ndim;
   ma->ndim1 = ndim-1;
   ma->isize = sizeof(unsigned short)*ndim;
@@ -1074,6 +1866,7 @@ void *MMultiGet(MULTI *ma, int *k, LOCK **lock) {
   return NULL;
 }
 
+/* like SMultiSet, the table is never cleaned here. */
 void *MMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
 		void (*InitData)(void *, int),
 		void (*FreeElem)(void *)) {
@@ -80,7 +80,7 @@
 
 #include "global.h"
 
-#define USE_NMULTI 1
+#define USE_NMULTI 2
 
 /* choose MULTI implementation */
 #if USE_NMULTI == 1
@@ -89,18 +89,28 @@
 #define MultiSet NMultiSet
 #define MultiFreeData NMultiFreeData
 #define MultiFree NMultiFree
+#define MultiWalk NMultiWalk
+#elif USE_NMULTI == 2
+#define MultiInit CMultiInit
+#define MultiGet CMultiGet
+#define MultiSet CMultiSet
+#define MultiFreeData CMultiFreeData
+#define MultiFree CMultiFree
+#define MultiWalk CMultiWalk
 #elif USE_NMULTI == 0
 #define MultiInit SMultiInit
 #define MultiGet SMultiGet
 #define MultiSet SMultiSet
 #define MultiFreeData SMultiFreeData
 #define MultiFree SMultiFree
+#define MultiWalk(ma, f, arg) (-1) /* not supported */
 #else
 #define MultiInit MMultiInit
 #define MultiGet MMultiGet
 #define MultiSet MMultiSet
 #define MultiFreeData MMultiFreeData
 #define MultiFree MMultiFree
+#define MultiWalk(ma, f, arg) (-1) /* not supported */
 #endif /*USE_NMULTI*/
 
 
@@ -151,6 +161,34 @@ typedef struct _ARRAY_ {
 **              {ARRAY *array},
 **              the multi-dimensional array is implemented as array 
 **              of arrays. 
+**              {MDATA **head},
+**              bucket heads of the lock-free hash chains (CMulti).
+**              {MRETIRED *retired},
+**              batches of chains, slabs and evicted entries unlinked by
+**              the cleans, waiting for the readers to move on (CMulti).
+**              {int evict},
+**              what to do when the size limit is reached, 0 clears 
+**              the whole table, 1 evicts cold entries only (CMulti),
+**              -1 follows the global setting of SetMultiEvict.
+**              {int keep},
+**              if set, the table is exempt from the size limits and
+**              is only cleared by MultiFreeData.
+**              {long long nhit, nmiss, nevict},
+**              number of lookups found, not found, and entries evicted.
+**              lookups are only counted with PERFORM_STATISTICS.
+**              {MSLAB *slab},
+**              chunks the entry records are carved from (CMulti).
+**              {int sgen},
+**              incremented whenever the slabs are swapped out.
+**              {int nins, swap},
+**              number of inserts in flight, and whether a clean is 
+**              swapping out the chains and slabs (CMulti).
+**              {MDATA *frec},
+**              free list of recycled entry records (CMulti).
+**              {int rsize, doff},
+**              size of an entry record, and offset of its data.
+**              {LOCK *slock},
+**              protects the free list of records.
 ** NOTE:        
 */
 typedef struct _MULTI_ {
@@ -166,7 +204,15 @@ typedef struct _MULTI_ {
   int isf, hsize, hmask, aidx;
   ARRAY *array;
   ARRAY *ia, *da;
-  LOCK *lock;
+  struct _MDATA_ **head;
+  struct _MRETIRED_ *retired;
+  int evict, hand, keep;
+  long long nhit, nmiss, nevict;
+  struct _MSLAB_ *slab;
+  struct _MDATA_ *frec;
+  int rsize, doff, sgen;
+  volatile int nins, swap;
+  LOCK *lock, *slock;
 } MULTI;
 
 typedef struct _IDXARY_ {
@@ -177,6 +223,8 @@ typedef struct _IDXARY_ {
 void InitMultiStats(void);
 void ReportMultiStats(void);
 void RemoveMultiLocks(void);
+void InitMultiEpoch(int nt);
+void MultiQuiescent(void);
 int   ArrayInit(ARRAY *a, int esize, int block);
 void *ArrayGet(ARRAY *a, int i);
 void *ArraySet(ARRAY *a, int i, void *d, 
@@ -212,6 +260,7 @@ int   NMultiFree(MULTI *ma,
 		 void (*FreeElem)(void *));
 int   NMultiFreeDataOnly(ARRAY *a, void (*FreeElem)(void *));
 int   NMultiFreeData(MULTI *ma, void (*FreeElem)(void *));
+int   NMultiWalk(MULTI *ma, int (*f)(int *, void *, void *), void *arg);
 
 /*
 ** yet another implementation of MULTI array
@@ -224,8 +273,24 @@ void *MMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
 int   MMultiFree(MULTI *ma, 
 		 void (*FreeElem)(void *));
 int   MMultiFreeData(MULTI *ma, void (*FreeElem)(void *));
+
+/*
+** lock-free implementation of MULTI array, insertions into
+** different (and same) hash buckets proceed concurrently.
+*/
+int   CMultiInit(MULTI *ma, int esize, int ndim, int *block, char *id);
+void *CMultiGet(MULTI *ma, int *k, LOCK **lock);
+void *CMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
+		void (*InitData)(void *, int),
+		void (*FreeElem)(void *));
+int   CMultiFree(MULTI *ma, 
+		 void (*FreeElem)(void *));
+int   CMultiFreeData(MULTI *ma, void (*FreeElem)(void *));
+int   CMultiWalk(MULTI *ma, int (*f)(int *, void *, void *), void *arg);
 void AddMultiSize(MULTI *ma, int size);
 void LimitMultiSize(MULTI *ma, double d);
+void SetMultiEvict(MULTI *ma, int m);
+void SetMultiKeep(MULTI *ma, int m);
 
 void  InitIntData(void *p, int n);
 void  InitDoubleData(void *p, int n);
@@ -204,6 +204,13 @@
 		  INT, DOUBLEV, INT, DOUBLE, DOUBLEV, INT,\
 		  A1,A2,A3,A4,A5,A6,A7,A8,A9,A10,A11)
 
+     PROTOCCALLSFSUB9(DSPMV, dspmv, STRING, INT, DOUBLE, DOUBLEV,\
+		      DOUBLEV, INT, DOUBLE, DOUBLEV, INT)
+#define DSPMV(A1,A2,A3,A4,A5,A6,A7,A8,A9)\
+     CCALLSFSUB9(DSPMV, dspmv, STRING, INT, DOUBLE, DOUBLEV,\
+		 DOUBLEV, INT, DOUBLE, DOUBLEV, INT,\
+		 A1,A2,A3,A4,A5,A6,A7,A8,A9)
+
      PROTOCCALLSFSUB12(DSPEVD, dspevd, STRING, STRING, INT, DOUBLEV,\
 		       DOUBLEV, DOUBLEV, INT, DOUBLEV, INT, INTV, INT,\
 		       INTV)
@@ -181,7 +181,6 @@
 #define MULTI_IDLEN 64
 
 /* orbital */
-#define MAXRP      3000  /* maximum radial mesh */
 #define DMAXRP     1200  /* default radial mesh points */
 #define GRIDASYMP  36    /* no. points in one wavelength near infinity */
 #define GRIDRATIO  1.1   /* ratio of successive mesh near origin */
@@ -227,6 +226,11 @@
 #define ANGZCUT            1E-5
 #define MIXCUT             1E-5
 #define MIXCUT2            1.0
+#define SMALLHAM           256
+#define HAMCFGBLOCK        64
+#define DAVIDSONNMIN       2000
+#define DAVIDSONTOL        1E-7
+#define DAVIDSONMAXITER    200
 #define NPRINCIPLE         2
 #define MAXDN              3
 #define MBCLOSE            8        
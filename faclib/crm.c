@@ -1641,7 +1641,7 @@ int RateTable(char *fn, int nc, char *sc[], int md) {
   NCOMPLEX *c, *cp;
   double *d, rtmp,  e0, abt;
   double **dce[4], **dtr[4], **drr[4], **dci[4], **dai[4];
-  FILE *f;
+  TFILE *f;
 
   edist = GetEleDist(&i);
   pdist = GetPhoDist(&j);
@@ -3497,7 +3497,7 @@ int SpecTable(char *fn, int rrc, double strength_threshold) {
   LBLOCK *blk, *iblk, *fblk;
   BLK_RATE *brts, *brdev;
   int k, m, j;
-  FILE *f;
+  TFILE *f;
   double e, a, e0;
   int i, p, q, ib, iuta;
   double smax, s, b, c;
@@ -4093,7 +4093,7 @@ int SetCERates(int inv) {
   F_HEADER fh;
   CE_HEADER h;
   CE_RECORD r;
-  FILE *f;
+  MFILE *f;
   double e, bte, bms;
   float *cs;
   double data[2+(1+MAXNUSR)*2];
@@ -4111,18 +4111,18 @@ int SetCERates(int inv) {
   for (k = 0; k < ions->dim; k++) {
     ion = (ION *) ArrayGet(ions, k);
     ArrayFree(ion->ce_rates, FreeBlkRateData);
-    f = fopen(ion->dbfiles[DB_CE-1], "r");
+    f = MapFile(ion->dbfiles[DB_CE-1]);
     if (f == NULL) {
       printf("File %s does not exist, skipping.\n", ion->dbfiles[DB_CE-1]);
       continue;
     }
-    n = ReadFHeader(f, &fh, &swp);
+    n = MapFHeader(f, &fh, &swp);
     for (nb = 0; nb < fh.nblocks; nb++) {
-      n = ReadCEHeader(f, &h, swp);
+      n = MapCEHeader(f, &h, swp);
       eusr = h.usr_egrid;
       if (h.nele == ion->nele-1) {
 	if (k > 0 || ion0.nionized > 0) {
-	  fseek(f, h.length, SEEK_CUR);
+	  MapSeek(f, h.length, SEEK_CUR);
 	  continue;
 	}
       }
@@ -4135,7 +4135,7 @@ int SetCERates(int inv) {
       }
       x[m] = eusr[m-1]/(data[0]/HARTREE_EV+eusr[m-1]);
       for (i = 0; i < h.ntransitions; i++) {
-	n = ReadCERecord(f, &r, swp, &h);
+	n = MapCERecord(f, &r, swp, &h);
 	rt.i = r.lower;
 	rt.f = r.upper;
 	j1 = ion->j[r.lower];
@@ -4150,27 +4150,25 @@ int SetCERates(int inv) {
 	CERate(&(rt.dir), &(rt.inv), inv, j1, j2, e, m,
 	       data, rt.i, rt.f);
 	AddRate(ion, ion->ce_rates, &rt, 0);
-	if (h.qk_mode == QK_FIT) free(r.params);
-	free(r.strength);
       }
       free(h.tegrid);
       free(h.egrid);
       free(h.usr_egrid);
     }
-    fclose(f);
+    UnmapFile(f);
     
     if (k == 0 && ion0.nionized > 0) {
-      f = fopen(ion0.dbfiles[DB_CE-1], "r");
+      f = MapFile(ion0.dbfiles[DB_CE-1]);
       if (f == NULL) {
 	printf("File %s does not exist, skipping.\n", ion0.dbfiles[DB_CE-1]);
 	continue;
       }
-      n = ReadFHeader(f, &fh, &swp);
+      n = MapFHeader(f, &fh, &swp);
       for (nb = 0; nb < fh.nblocks; nb++) {
-	n = ReadCEHeader(f, &h, swp);
+	n = MapCEHeader(f, &h, swp);
 	eusr = h.usr_egrid;
 	if (h.nele != ion0.nele) {
-	  fseek(f, h.length, SEEK_CUR);
+	  MapSeek(f, h.length, SEEK_CUR);
 	  continue;
 	}
 	m = h.n_usr;
@@ -4182,19 +4180,11 @@ int SetCERates(int inv) {
         }
 	x[m] = eusr[m-1]/(data[0]/HARTREE_EV+eusr[m-1]);
 	for (i = 0; i < h.ntransitions; i++) {
-	  n = ReadCERecord(f, &r, swp, &h);
+	  n = MapCERecord(f, &r, swp, &h);
 	  p = IonizedIndex(r.lower, 0);
-	  if (p < 0) {
-	    if (h.qk_mode == QK_FIT) free(r.params);
-	    free(r.strength);
-	    continue;
-	  }
+	  if (p < 0) continue;
 	  q = IonizedIndex(r.upper, 0);
-	  if (q < 0) {
-	    if (h.qk_mode == QK_FIT) free(r.params);
-	    free(r.strength);
-	    continue;
-	  }
+	  if (q < 0) continue;
 	  rt.i = ion0.ionized_map[1][p];
 	  rt.f = ion0.ionized_map[1][q];
 	  j1 = ion->j[rt.i];
@@ -4209,14 +4199,12 @@ int SetCERates(int inv) {
 	  CERate(&(rt.dir), &(rt.inv), inv, j1, j2, e, m,
 		 data, rt.i, rt.f);
 	  AddRate(ion, ion->ce_rates, &rt, 0);
-	  if (h.qk_mode == QK_FIT) free(r.params);
-	  free(r.strength);
 	}
 	free(h.tegrid);
 	free(h.egrid);
 	free(h.usr_egrid);
       }
-      fclose(f);
+      UnmapFile(f);
     }
   }
 
@@ -4389,7 +4377,7 @@ int SetCIRates(int inv) {
   CI_HEADER h;
   CI_RECORD r;
   double e;
-  FILE *f;  
+  MFILE *f;  
   int swp;
 
   if (ion0.n < 0.0) return 0;
@@ -4401,24 +4389,24 @@ int SetCIRates(int inv) {
   for (k = 0; k < ions->dim; k++) {
     ion = (ION *) ArrayGet(ions, k);
     ArrayFree(ion->ci_rates, FreeBlkRateData);
-    f = fopen(ion->dbfiles[DB_CI-1], "r");
+    f = MapFile(ion->dbfiles[DB_CI-1]);
     if (f == NULL) {
       printf("File %s does not exist, skipping.\n", ion->dbfiles[DB_CI-1]);
       continue;
     }
-    n = ReadFHeader(f, &fh, &swp);
+    n = MapFHeader(f, &fh, &swp);
     for (nb = 0; nb < fh.nblocks; nb++) {
-      n = ReadCIHeader(f, &h, swp);
+      n = MapCIHeader(f, &h, swp);
       m = h.nparams;
       if (h.nele != ion->nele) {
-	fseek(f, h.length, SEEK_CUR);
+	MapSeek(f, h.length, SEEK_CUR);
 	free(h.tegrid);
 	free(h.egrid);
 	free(h.usr_egrid);
 	continue;
       }
       for (i = 0; i < h.ntransitions; i++) {
-	n = ReadCIRecord(f, &r, swp, &h);
+	n = MapCIRecord(f, &r, swp, &h);
 	rt.i = r.b;
 	rt.f = r.f;
 	j1 = ion->j[r.b];
@@ -4427,14 +4415,12 @@ int SetCIRates(int inv) {
 	CIRate(&(rt.dir), &(rt.inv), inv, j1, j2, e, m, r.params,
 	       rt.i, rt.f);
 	AddRate(ion, ion->ci_rates, &rt, 0);
-	free(r.params);
-	free(r.strength);
       }
       free(h.tegrid);
       free(h.egrid);
       free(h.usr_egrid);
     }
-    fclose(f);
+    UnmapFile(f);
   }
   return 0;
 }
@@ -4449,7 +4435,7 @@ int SetRRRates(int inv) {
   RR_HEADER h;
   RR_RECORD r;
   double e;
-  FILE *f;  
+  MFILE *f;  
   int swp;
   float *cs;
   double data[1+MAXNUSR*4];
@@ -4465,21 +4451,21 @@ int SetRRRates(int inv) {
   for (k = 0; k < ions->dim; k++) {
     ion = (ION *) ArrayGet(ions, k);
     ArrayFree(ion->rr_rates, FreeBlkRateData);
-    f = fopen(ion->dbfiles[DB_RR-1], "r");
+    f = MapFile(ion->dbfiles[DB_RR-1]);
     if (f == NULL) {
       printf("File %s does not exist, skipping.\n", ion->dbfiles[DB_RR-1]);
       continue;
     }
-    n = ReadFHeader(f, &fh, &swp);
+    n = MapFHeader(f, &fh, &swp);
     for (nb = 0; nb < fh.nblocks; nb++) {
-      n = ReadRRHeader(f, &h, swp);
+      n = MapRRHeader(f, &h, swp);
       if (h.nparams <= 0) {
 	printf("RR QkMode in %s must be in QK_FIT, nb=%d\n", 
 	       ion->dbfiles[DB_RR-1], nb);
 	exit(1);
       }
       if (h.nele != ion->nele) {
-	fseek(f, h.length, SEEK_CUR);
+	MapSeek(f, h.length, SEEK_CUR);
 	free(h.tegrid);
 	free(h.egrid);
 	free(h.usr_egrid);
@@ -4491,7 +4477,7 @@ int SetRRRates(int inv) {
       logx = x + m;
       p = logx + m;
       for (i = 0; i < h.ntransitions; i++) {
-	n = ReadRRRecord(f, &r, swp, &h);
+	n = MapRRRecord(f, &r, swp, &h);
 	rt.i = r.f;
 	rt.f = r.b;
 	j1 = ion->j[r.f];
@@ -4516,14 +4502,12 @@ int SetRRRates(int inv) {
 	RRRate(&(rt.dir), &(rt.inv), inv, j1, j2, e, m, data,
 	       rt.i, rt.f);
 	AddRate(ion, ion->rr_rates, &rt, 0);
-	free(r.params);
-	free(r.strength);
       }
       free(h.tegrid);
       free(h.egrid);
       free(h.usr_egrid);
     }
-    fclose(f);
+    UnmapFile(f);
     ExtrapolateRR(ion, inv);
   }
   return 0;
@@ -4794,7 +4778,7 @@ int DRStrength(char *fn, int nele, int mode, int ilev0) {
   F_HEADER fhdr;
   int k, m, t, p, n, vnl, vn, vl;
   int mp, tp;
-  FILE *f;
+  TFILE *f;
   
   if (ion0.atom <= 0) {
     printf("ERROR: Blocks not set, exitting\n");
@@ -16,8 +16,16 @@
  *   along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "dbase.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 static char *rcsid="$Id$";
 #if __GNUC__ == 2
 #define USE(var) static void * use_##var = (&use_##var, (void *) &var) 
@@ -25,22 +33,8 @@ USE (rcsid);
 #endif
 
 static int version_read[NDB];
+static int zip_read[NDB];
 static F_HEADER fheader[NDB];
-static EN_HEADER en_header;
-static ENF_HEADER enf_header;
-static TR_HEADER tr_header;
-static TRF_HEADER trf_header;
-static CE_HEADER ce_header;
-static CEF_HEADER cef_header;
-static CEMF_HEADER cemf_header;
-static RR_HEADER rr_header;
-static AI_HEADER ai_header;
-static AIM_HEADER aim_header;
-static CI_HEADER ci_header;
-static CIM_HEADER cim_header;
-static SP_HEADER sp_header;
-static RT_HEADER rt_header;
-static DR_HEADER dr_header;
 
 static EN_SRECORD *mem_en_table = NULL;
 static int mem_en_table_size = 0;
@@ -50,12 +44,13 @@ static int iground;
 static int iuta = 0;
 static int utaci = 1;
 static int itrf = 0;
+static int izip = 0;
 
 static double born_mass = 1.0;
 static FORM_FACTOR bform = {0.0, -1, NULL, NULL, NULL};
 
 #define _WSF0(sv, f) {					\
-    n = fwrite(&(sv), sizeof(sv), 1, f);		\
+    n = TWrite(&(sv), sizeof(sv), 1, f);		\
     if (n != 1) return 0;				\
     m += sizeof(sv);					\
   }while(0)
@@ -65,7 +60,7 @@ static FORM_FACTOR bform = {0.0, -1, NULL, NULL, NULL};
     m += sizeof(sv);					\
   }while(0)
 #define _WSF1(sv, s, k, f) {				\
-    n = fwrite(sv, s, k, f);				\
+    n = TWrite(sv, s, k, f);				\
     if ((n) != (k)) return 0;				\
     m += (s)*(k);					\
   }while(0)
@@ -79,6 +74,389 @@ static FORM_FACTOR bform = {0.0, -1, NULL, NULL, NULL};
 #define RSF0(sv) _RSF0(sv, f)
 #define RSF1(sv, s, k) _RSF1(sv, s, k, f)
 
+static int FlushTFile(TFILE *f) {
+  long n;
+
+  if (f->nbuf > 0) {
+    n = fwrite(f->buf, 1, f->nbuf, f->f);
+    if (n != f->nbuf) return -1;
+  }
+  f->nbuf = 0;
+  f->ihdr = -1;
+  return 0;
+}
+
+static size_t TWrite(void *p, size_t s, size_t k, TFILE *f) {
+  long n;
+
+  n = s*k;
+  if (f->nbuf + n > f->mbuf) {
+    if (f->nbuf > 0 && f->nbuf + n > MAXWBUF) {
+      if (FlushTFile(f) < 0) return 0;
+    }
+    if (f->nbuf + n > f->mbuf) {
+      f->mbuf = Max(Min(2*f->mbuf, MAXWBUF), f->nbuf + n);
+      f->buf = realloc(f->buf, f->mbuf);
+      if (f->buf == NULL) return 0;
+    }
+  }
+  memcpy(f->buf + f->nbuf, p, n);
+  f->nbuf += n;
+  return k;
+}
+
+/* the records of CE, RR, CI and AI tables may be compressed, such files
+ * carry the major version ZVERSION. a compressed record is a varint 
+ * length followed by the body, in which the level indices are zigzag
+ * varints, and the floats are xor'ed with the previous one and stored
+ * without the leading zero bytes, low byte first, the byte counts
+ * being packed two to a control byte. */
+static unsigned char *zbuf = NULL;
+static long nzbuf = 0;
+#pragma omp threadprivate(zbuf, nzbuf)
+
+static unsigned char *ZBuffer(long n) {
+  if (n > nzbuf) {
+    nzbuf = Max(n, 2*nzbuf);
+    zbuf = realloc(zbuf, nzbuf);
+  }
+  return zbuf;
+}
+
+static unsigned char *PutUVarint(unsigned char *p, unsigned int u) {
+  while (u >= 0x80) {
+    *p++ = (u & 0x7F) | 0x80;
+    u >>= 7;
+  }
+  *p++ = u;
+  return p;
+}
+
+static unsigned char *GetUVarint(unsigned char *p, unsigned char *e,
+				 unsigned int *u) {
+  int s;
+
+  *u = 0;
+  for (s = 0; s < 32 && p < e; s += 7) {
+    *u |= ((unsigned int) (*p & 0x7F)) << s;
+    if (!(*p++ & 0x80)) return p;
+  }
+  return NULL;
+}
+
+static unsigned char *PutVarint(unsigned char *p, int i) {
+  if (i < 0) return PutUVarint(p, (((unsigned int) (-(i+1)))<<1) | 1);
+  return PutUVarint(p, ((unsigned int) i)<<1);
+}
+
+static unsigned char *GetVarint(unsigned char *p, unsigned char *e,
+				int *i) {
+  unsigned int u;
+
+  p = GetUVarint(p, e, &u);
+  if (p == NULL) return NULL;
+  if (u & 1) *i = -((int) (u>>1)) - 1;
+  else *i = (int) (u>>1);
+  return p;
+}
+
+/* u is the bit pattern of the previous float. */
+static unsigned char *PutFloats(unsigned char *p, float *x, int n,
+				unsigned int *u) {
+  int i, j, k;
+  unsigned int v, d;
+  unsigned char *c;
+
+  for (i = 0; i < n; i += 2) {
+    c = p++;
+    *c = 0;
+    for (j = i; j < i+2 && j < n; j++) {
+      memcpy(&v, x+j, sizeof(float));
+      d = v ^ *u;
+      *u = v;
+      for (k = 0; d; k++) {
+	*p++ = d & 0xFF;
+	d >>= 8;
+      }
+      *c |= k << (4*(j-i));
+    }
+  }
+  return p;
+}
+
+static unsigned char *GetFloats(unsigned char *p, unsigned char *e,
+				float *x, int n, unsigned int *u) {
+  int i, j, k, nb;
+  unsigned int d;
+  unsigned char c;
+
+  for (i = 0; i < n; i += 2) {
+    if (p >= e) return NULL;
+    c = *p++;
+    for (j = i; j < i+2 && j < n; j++) {
+      nb = (c >> (4*(j-i))) & 0xF;
+      if (nb > 4 || p+nb > e) return NULL;
+      d = 0;
+      for (k = 0; k < nb; k++) {
+	d |= ((unsigned int) p[k]) << (8*k);
+      }
+      p += nb;
+      *u ^= d;
+      memcpy(x+j, u, sizeof(float));
+    }
+  }
+  return p;
+}
+
+/* the largest size of a body with ni indices and nf floats in nc
+ * PutFloats calls. */
+#define ZSIZE(ni, nf, nc) (5*(ni)+5*(long)(nf)+(nc))
+
+static int WriteZRecord(TFILE *f, unsigned char *z, long nz) {
+  unsigned char c[5], *p;
+  long n;
+
+  p = PutUVarint(c, nz);
+  n = p - c;
+  if (TWrite(c, 1, n, f) != (size_t) n) return 0;
+  if (nz > 0 && TWrite(z, 1, nz, f) != (size_t) nz) return 0;
+  return n + nz;
+}
+
+/* the body of the compressed record at the current position of f, 
+ * its size is returned in nz, and the bytes read in m. */
+static unsigned char *ReadZRecord(FILE *f, long *nz, int *m) {
+  unsigned char c[5], *z;
+  int k;
+  unsigned int u;
+
+  for (k = 0; k < 5; k++) {
+    if (fread(c+k, 1, 1, f) != 1) return NULL;
+    if (!(c[k] & 0x80)) break;
+  }
+  if (GetUVarint(c, c+k+1, &u) == NULL) return NULL;
+  z = ZBuffer(u);
+  if (u > 0 && fread(z, 1, u, f) != u) return NULL;
+  *nz = u;
+  *m = k+1+u;
+  return z;
+}
+
+static unsigned char *MapZRecord(MFILE *f, long *nz, int *m) {
+  unsigned char *p, *e;
+  unsigned int u;
+
+  p = (unsigned char *) f->p + f->pos;
+  e = (unsigned char *) f->p + f->size;
+  p = GetUVarint(p, e, &u);
+  if (p == NULL || u > e-p) return NULL;
+  *nz = u;
+  *m = (p - ((unsigned char *) f->p + f->pos)) + u;
+  f->pos += *m;
+  return p;
+}
+
+/* the scratch array of n floats owned by f. */
+static float *MapBuffer(MFILE *f, long n) {
+  n *= sizeof(float);
+  if (n > f->nbuf) {
+    if (f->buf) free(f->buf);
+    f->buf = malloc(n);
+    f->nbuf = n;
+  }
+  return (float *) f->buf;
+}
+
+static int EncodeCERecord(TFILE *f, CE_RECORD *r) {
+  unsigned char *z, *p;
+  unsigned int u;
+  int m0, m1;
+
+  if (f->h.ce.msub) {
+    m0 = r->nsub;
+  } else if (f->h.ce.qk_mode == QK_FIT) {
+    m0 = f->h.ce.nparams * r->nsub;
+  } else m0 = 0;
+  m1 = f->h.ce.n_usr * r->nsub;
+  z = ZBuffer(ZSIZE(3, 3+m0+m1, 4));
+  p = PutVarint(z, r->lower);
+  p = PutVarint(p, r->upper);
+  p = PutVarint(p, r->nsub);
+  u = 0;
+  p = PutFloats(p, &(r->bethe), 1, &u);
+  p = PutFloats(p, r->born, 2, &u);
+  if (m0) p = PutFloats(p, r->params, m0, &u);
+  p = PutFloats(p, r->strength, m1, &u);
+  return WriteZRecord(f, z, p-z);
+}
+
+/* the arrays of the decoded records are allocated unless mf is given,
+ * in which case they are placed in its scratch buffer. */
+static int DecodeCERecord(unsigned char *p, long nz, CE_RECORD *r,
+			  CE_HEADER *h, MFILE *mf) {
+  unsigned char *e;
+  unsigned int u;
+  int m0, m1;
+  float *x;
+
+  e = p + nz;
+  p = GetVarint(p, e, &(r->lower));
+  if (p) p = GetVarint(p, e, &(r->upper));
+  if (p) p = GetVarint(p, e, &(r->nsub));
+  if (p == NULL || r->nsub < 0) return 0;
+  u = 0;
+  p = GetFloats(p, e, &(r->bethe), 1, &u);
+  if (p) p = GetFloats(p, e, r->born, 2, &u);
+  if (p == NULL) return 0;
+  if (h->msub) {
+    m0 = r->nsub;
+  } else if (h->qk_mode == QK_FIT) {
+    m0 = h->nparams * r->nsub;
+  } else m0 = 0;
+  m1 = h->n_usr * r->nsub;
+  if (mf) {
+    x = MapBuffer(mf, m0+m1);
+    r->params = m0?x:NULL;
+    r->strength = x + m0;
+  } else {
+    r->params = m0?((float *) malloc(sizeof(float)*m0)):NULL;
+    r->strength = (float *) malloc(sizeof(float)*m1);
+  }
+  if (m0) p = GetFloats(p, e, r->params, m0, &u);
+  if (p) p = GetFloats(p, e, r->strength, m1, &u);
+  if (p != e) {
+    if (!mf) {
+      if (r->params) free(r->params);
+      free(r->strength);
+    }
+    return 0;
+  }
+  return 1;
+}
+
+static int EncodeRRRecord(TFILE *f, RR_RECORD *r) {
+  unsigned char *z, *p;
+  unsigned int u;
+  int m0, m1;
+
+  if (f->h.rr.qk_mode == QK_FIT) m0 = f->h.rr.nparams;
+  else m0 = 0;
+  m1 = f->h.rr.n_usr;
+  z = ZBuffer(ZSIZE(3, m0+m1, 2));
+  p = PutVarint(z, r->b);
+  p = PutVarint(p, r->f);
+  p = PutVarint(p, r->kl);
+  u = 0;
+  if (m0) p = PutFloats(p, r->params, m0, &u);
+  p = PutFloats(p, r->strength, m1, &u);
+  return WriteZRecord(f, z, p-z);
+}
+
+static int DecodeRRRecord(unsigned char *p, long nz, RR_RECORD *r,
+			  RR_HEADER *h, MFILE *mf) {
+  unsigned char *e;
+  unsigned int u;
+  int m0, m1;
+  float *x;
+
+  e = p + nz;
+  p = GetVarint(p, e, &(r->b));
+  if (p) p = GetVarint(p, e, &(r->f));
+  if (p) p = GetVarint(p, e, &(r->kl));
+  if (p == NULL) return 0;
+  if (h->qk_mode == QK_FIT) m0 = h->nparams;
+  else m0 = 0;
+  m1 = h->n_usr;
+  if (mf) {
+    x = MapBuffer(mf, m0+m1);
+    r->params = m0?x:NULL;
+    r->strength = x + m0;
+  } else {
+    r->params = m0?((float *) malloc(sizeof(float)*m0)):NULL;
+    r->strength = (float *) malloc(sizeof(float)*m1);
+  }
+  u = 0;
+  if (m0) p = GetFloats(p, e, r->params, m0, &u);
+  if (p) p = GetFloats(p, e, r->strength, m1, &u);
+  if (p != e) {
+    if (!mf) {
+      if (r->params) free(r->params);
+      free(r->strength);
+    }
+    return 0;
+  }
+  return 1;
+}
+
+static int EncodeCIRecord(TFILE *f, CI_RECORD *r) {
+  unsigned char *z, *p;
+  unsigned int u;
+
+  z = ZBuffer(ZSIZE(3, f->h.ci.nparams+f->h.ci.n_usr, 2));
+  p = PutVarint(z, r->b);
+  p = PutVarint(p, r->f);
+  p = PutVarint(p, r->kl);
+  u = 0;
+  p = PutFloats(p, r->params, f->h.ci.nparams, &u);
+  p = PutFloats(p, r->strength, f->h.ci.n_usr, &u);
+  return WriteZRecord(f, z, p-z);
+}
+
+static int DecodeCIRecord(unsigned char *p, long nz, CI_RECORD *r,
+			  CI_HEADER *h, MFILE *mf) {
+  unsigned char *e;
+  unsigned int u;
+  float *x;
+
+  e = p + nz;
+  p = GetVarint(p, e, &(r->b));
+  if (p) p = GetVarint(p, e, &(r->f));
+  if (p) p = GetVarint(p, e, &(r->kl));
+  if (p == NULL) return 0;
+  if (mf) {
+    x = MapBuffer(mf, h->nparams+h->n_usr);
+    r->params = x;
+    r->strength = x + h->nparams;
+  } else {
+    r->params = (float *) malloc(sizeof(float)*h->nparams);
+    r->strength = (float *) malloc(sizeof(float)*h->n_usr);
+  }
+  u = 0;
+  p = GetFloats(p, e, r->params, h->nparams, &u);
+  if (p) p = GetFloats(p, e, r->strength, h->n_usr, &u);
+  if (p != e) {
+    if (!mf) {
+      free(r->params);
+      free(r->strength);
+    }
+    return 0;
+  }
+  return 1;
+}
+
+static int EncodeAIRecord(TFILE *f, AI_RECORD *r) {
+  unsigned char z[ZSIZE(2, 1, 1)], *p;
+  unsigned int u;
+
+  p = PutVarint(z, r->b);
+  p = PutVarint(p, r->f);
+  u = 0;
+  p = PutFloats(p, &(r->rate), 1, &u);
+  return WriteZRecord(f, z, p-z);
+}
+
+static int DecodeAIRecord(unsigned char *p, long nz, AI_RECORD *r) {
+  unsigned char *e;
+  unsigned int u;
+
+  e = p + nz;
+  p = GetVarint(p, e, &(r->b));
+  if (p) p = GetVarint(p, e, &(r->f));
+  u = 0;
+  if (p) p = GetFloats(p, e, &(r->rate), 1, &u);
+  return p == e;
+}
+
 void *ReallocNew(void *p, int s) {
   void *q;
 
@@ -169,6 +547,10 @@ void SetTRF(int m) {
   itrf = m;
 }
 
+void SetTableCompression(int m) {
+  izip = m;
+}
+
 void SetUTA(int m, int mci) {
   iuta = m;
   utaci = mci;
@@ -1190,7 +1572,7 @@ int ReadDRRecordOld(FILE *f, DR_RECORD *r, int swp) {
   return sizeof(DR_RECORD);
 }   
 
-int WriteFHeader(FILE *f, F_HEADER *fh) {
+int WriteFHeader(TFILE *f, F_HEADER *fh) {
   int n, m = 0;
 
   WSF0(fh->tsession);
@@ -1224,7 +1606,15 @@ int ReadFHeader(FILE *f, F_HEADER *fh, int *swp) {
     SwapEndianFHeader(fh);
   }
 
+  if (fh->version > ZVERSION) {
+    printf("unknown table version %d.%d.%d\n", 
+	   fh->version, fh->sversion, fh->ssversion);
+    return 0;
+  }
   SetVersionRead(fh->type, fh->version*100+fh->sversion*10+fh->ssversion);
+  if (fh->type > 0 && fh->type <= NDB) {
+    zip_read[fh->type-1] = (fh->version == ZVERSION);
+  }
   if (fh->type == DB_TR && itrf >= 0) {
     if (VersionLE(fh, 1, 0, 6)) itrf = 1;
     else itrf = 0;
@@ -1233,7 +1623,7 @@ int ReadFHeader(FILE *f, F_HEADER *fh, int *swp) {
   return m;
 }
 
-int WriteENHeader(FILE *f, EN_HEADER *h) {
+int WriteENHeader(TFILE *f, EN_HEADER *h) {
   int n, m = 0;
 
   WSF0(h->position);
@@ -1244,7 +1634,7 @@ int WriteENHeader(FILE *f, EN_HEADER *h) {
   return m;
 }
 
-int WriteENFHeader(FILE *f, ENF_HEADER *h) {
+int WriteENFHeader(TFILE *f, ENF_HEADER *h) {
   int n, m = 0;
 
   WSF0(h->position);
@@ -1258,7 +1648,7 @@ int WriteENFHeader(FILE *f, ENF_HEADER *h) {
   return m;
 }
 
-int WriteTRHeader(FILE *f, TR_HEADER *h) {
+int WriteTRHeader(TFILE *f, TR_HEADER *h) {
   int n, m = 0;
 
   WSF0(h->position);
@@ -1272,7 +1662,7 @@ int WriteTRHeader(FILE *f, TR_HEADER *h) {
   return m;
 }
 
-int WriteTRFHeader(FILE *f, TRF_HEADER *h) {
+int WriteTRFHeader(TFILE *f, TRF_HEADER *h) {
   int n, m = 0;
 
   WSF0(h->position);
@@ -1289,7 +1679,7 @@ int WriteTRFHeader(FILE *f, TRF_HEADER *h) {
   return m;
 }
 
-int WriteCEHeader(FILE *f, CE_HEADER *h) {
+int WriteCEHeader(TFILE *f, CE_HEADER *h) {
   int n, m = 0;
 
   WSF0(h->position);
@@ -1313,7 +1703,7 @@ int WriteCEHeader(FILE *f, CE_HEADER *h) {
   return m;
 }
 
-int WriteCEFHeader(FILE *f, CEF_HEADER *h) {
+int WriteCEFHeader(TFILE *f, CEF_HEADER *h) {
   int n, m = 0;
 
   WSF0(h->position);
@@ -1332,7 +1722,7 @@ int WriteCEFHeader(FILE *f, CEF_HEADER *h) {
   return m;
 }
 
-int WriteCEMFHeader(FILE *f, CEMF_HEADER *h) {
+int WriteCEMFHeader(TFILE *f, CEMF_HEADER *h) {
   int n, m = 0;
 
   WSF0(h->position);
@@ -1355,7 +1745,7 @@ int WriteCEMFHeader(FILE *f, CEMF_HEADER *h) {
   return m;
 }
 
-int WriteRRHeader(FILE *f, RR_HEADER *h) {
+int WriteRRHeader(TFILE *f, RR_HEADER *h) {
   int n, m = 0;
   
   WSF0(h->position);
@@ -1377,7 +1767,7 @@ int WriteRRHeader(FILE *f, RR_HEADER *h) {
   return m;
 }
 
-int WriteAIHeader(FILE *f, AI_HEADER *h) {
+int WriteAIHeader(TFILE *f, AI_HEADER *h) {
   int n, m = 0;
  
   WSF0(h->position);
@@ -1391,7 +1781,7 @@ int WriteAIHeader(FILE *f, AI_HEADER *h) {
   return m;
 }
 
-int WriteAIMHeader(FILE *f, AIM_HEADER *h) {
+int WriteAIMHeader(TFILE *f, AIM_HEADER *h) {
   int n, m = 0;
     
   WSF0(h->position);
@@ -1405,7 +1795,7 @@ int WriteAIMHeader(FILE *f, AIM_HEADER *h) {
   return m;
 }
 
-int WriteCIHeader(FILE *f, CI_HEADER *h) {
+int WriteCIHeader(TFILE *f, CI_HEADER *h) {
   int n, m = 0;
 
   WSF0(h->position);
@@ -1427,7 +1817,7 @@ int WriteCIHeader(FILE *f, CI_HEADER *h) {
   return m;
 }
 
-int WriteCIMHeader(FILE *f, CIM_HEADER *h) {
+int WriteCIMHeader(TFILE *f, CIM_HEADER *h) {
   int n, m = 0;
     
   WSF0(h->position);
@@ -1444,7 +1834,7 @@ int WriteCIMHeader(FILE *f, CIM_HEADER *h) {
   return m;
 }
 
-int WriteSPHeader(FILE *f, SP_HEADER *h) {
+int WriteSPHeader(TFILE *f, SP_HEADER *h) {
   int i, n, m = 0;
      
   WSF0(h->position);
@@ -1468,7 +1858,7 @@ int WriteSPHeader(FILE *f, SP_HEADER *h) {
   return m;
 }
 
-int WriteRTHeader(FILE *f, RT_HEADER *h) {
+int WriteRTHeader(TFILE *f, RT_HEADER *h) {
   int n, m = 0;
          
   WSF0(h->position);
@@ -1486,7 +1876,7 @@ int WriteRTHeader(FILE *f, RT_HEADER *h) {
   return m;
 }
 
-int WriteDRHeader(FILE *f, DR_HEADER *h) {
+int WriteDRHeader(TFILE *f, DR_HEADER *h) {
   int n, m = 0;
          
   WSF0(h->position);
@@ -1501,12 +1891,13 @@ int WriteDRHeader(FILE *f, DR_HEADER *h) {
   return m;
 }
 
-int WriteENRecord(FILE *f, EN_RECORD *r) {
+int WriteENRecord(TFILE *f, EN_RECORD *r) {
   int i, n, m = 0;
 
-  if (en_header.length == 0) {
-    fheader[DB_EN-1].nblocks++;
-    n = WriteENHeader(f, &en_header);
+  if (f->h.en.length == 0) {
+    f->fh.nblocks++;
+    f->ihdr = f->nbuf;
+    n = WriteENHeader(f, &(f->h.en));
   }
   
   WSF0(r->p);
@@ -1534,36 +1925,38 @@ int WriteENRecord(FILE *f, EN_RECORD *r) {
   WSF1(r->sname, sizeof(char), LSNAME);
   WSF1(r->name, sizeof(char), LNAME);
 
-  en_header.nlevels += 1;
-  en_header.length += m;
+  f->h.en.nlevels += 1;
+  f->h.en.length += m;
 
   return m;
 }
 
-int WriteENFRecord(FILE *f, ENF_RECORD *r) {
+int WriteENFRecord(TFILE *f, ENF_RECORD *r) {
   int n, m = 0;
 
-  if (enf_header.length == 0) {
-    fheader[DB_ENF-1].nblocks++;
-    n = WriteENFHeader(f, &enf_header);
+  if (f->h.enf.length == 0) {
+    f->fh.nblocks++;
+    f->ihdr = f->nbuf;
+    n = WriteENFHeader(f, &(f->h.enf));
   }
   
   WSF0(r->ilev);
   WSF0(r->energy);
   WSF0(r->pbasis);
   
-  enf_header.nlevels += 1;
-  enf_header.length += m;
+  f->h.enf.nlevels += 1;
+  f->h.enf.length += m;
 
   return m;
 }
 
-int WriteTRRecord(FILE *f, TR_RECORD *r, TR_EXTRA *rx) {
+int WriteTRRecord(TFILE *f, TR_RECORD *r, TR_EXTRA *rx) {
   int n, m = 0;
 
-  if (tr_header.length == 0) {
-    fheader[DB_TR-1].nblocks++;
-    n = WriteTRHeader(f, &tr_header);
+  if (f->h.tr.length == 0) {
+    f->fh.nblocks++;
+    f->ihdr = f->nbuf;
+    n = WriteTRHeader(f, &(f->h.tr));
   }
   
   WSF0(r->lower);
@@ -1576,37 +1969,47 @@ int WriteTRRecord(FILE *f, TR_RECORD *r, TR_EXTRA *rx) {
     WSF0(rx->sci);
   }
 
-  tr_header.ntransitions += 1;
-  tr_header.length += m;
+  f->h.tr.ntransitions += 1;
+  f->h.tr.length += m;
 
   return m;
 }
 
-int WriteTRFRecord(FILE *f, TRF_RECORD *r) {
+int WriteTRFRecord(TFILE *f, TRF_RECORD *r) {
   int n, m = 0;
 
-  if (trf_header.length == 0) {
-    fheader[DB_TRF-1].nblocks++;
-    n = WriteTRFHeader(f, &trf_header);
+  if (f->h.trf.length == 0) {
+    f->fh.nblocks++;
+    f->ihdr = f->nbuf;
+    n = WriteTRFHeader(f, &(f->h.trf));
   }
   
   WSF0(r->lower);
   WSF0(r->upper);
-  WSF1(r->strength, sizeof(float), 2*abs(trf_header.multipole)+1);
+  WSF1(r->strength, sizeof(float), 2*abs(f->h.trf.multipole)+1);
 
-  trf_header.ntransitions += 1;
-  trf_header.length += m;
+  f->h.trf.ntransitions += 1;
+  f->h.trf.length += m;
 
   return m;
 }
 
-int WriteCERecord(FILE *f, CE_RECORD *r) {
+int WriteCERecord(TFILE *f, CE_RECORD *r) {
   int n;
   int m0, m = 0;
 
-  if (ce_header.length == 0) {
-    fheader[DB_CE-1].nblocks++;
-    n = WriteCEHeader(f, &ce_header);
+  if (f->h.ce.length == 0) {
+    f->fh.nblocks++;
+    f->ihdr = f->nbuf;
+    n = WriteCEHeader(f, &(f->h.ce));
+  }
+
+  if (f->fh.version == ZVERSION) {
+    m = EncodeCERecord(f, r);
+    if (m == 0) return 0;
+    f->h.ce.ntransitions += 1;
+    f->h.ce.length += m;
+    return m;
   }
   
   WSF0(r->lower);
@@ -1615,30 +2018,31 @@ int WriteCERecord(FILE *f, CE_RECORD *r) {
   WSF0(r->bethe);
   WSF1(r->born, sizeof(float), 2);
 
-  if (ce_header.msub) {
+  if (f->h.ce.msub) {
     m0 = r->nsub;
-  } else if (ce_header.qk_mode == QK_FIT) {
-    m0 = ce_header.nparams * r->nsub;
+  } else if (f->h.ce.qk_mode == QK_FIT) {
+    m0 = f->h.ce.nparams * r->nsub;
   } else m0 = 0;
   if (m0) {
     WSF1(r->params, sizeof(float), m0);
   }
-  m0 = ce_header.n_usr * r->nsub;
+  m0 = f->h.ce.n_usr * r->nsub;
   WSF1(r->strength, sizeof(float), m0);
 
-  ce_header.ntransitions += 1;
-  ce_header.length += m;
+  f->h.ce.ntransitions += 1;
+  f->h.ce.length += m;
 
   return m;
 }
 
-int WriteCEFRecord(FILE *f, CEF_RECORD *r) {
+int WriteCEFRecord(TFILE *f, CEF_RECORD *r) {
   int n;
   int m0, m = 0;
 
-  if (cef_header.length == 0) {
-    fheader[DB_CEF-1].nblocks++;
-    n = WriteCEFHeader(f, &cef_header);
+  if (f->h.cef.length == 0) {
+    f->fh.nblocks++;
+    f->ihdr = f->nbuf;
+    n = WriteCEFHeader(f, &(f->h.cef));
   }
   
   WSF0(r->lower);
@@ -1646,90 +2050,110 @@ int WriteCEFRecord(FILE *f, CEF_RECORD *r) {
   WSF0(r->bethe);
   WSF1(r->born, sizeof(float), 2);
 
-  m0 = cef_header.n_egrid;
+  m0 = f->h.cef.n_egrid;
   WSF1(r->strength, sizeof(float), m0);
   
-  cef_header.ntransitions += 1;
-  cef_header.length += m;
+  f->h.cef.ntransitions += 1;
+  f->h.cef.length += m;
 
   return m;
 }
 
-int WriteCEMFRecord(FILE *f, CEMF_RECORD *r) {
+int WriteCEMFRecord(TFILE *f, CEMF_RECORD *r) {
   int n;
   int m0, m = 0;
 
-  if (cemf_header.length == 0) {
-    fheader[DB_CEMF-1].nblocks++;
-    n = WriteCEMFHeader(f, &cemf_header);
+  if (f->h.cemf.length == 0) {
+    f->fh.nblocks++;
+    f->ihdr = f->nbuf;
+    n = WriteCEMFHeader(f, &(f->h.cemf));
   }
   
   WSF0(r->lower);
   WSF0(r->upper);
   
-  m0 = cemf_header.n_thetagrid * cemf_header.n_phigrid;
+  m0 = f->h.cemf.n_thetagrid * f->h.cemf.n_phigrid;
   WSF1(r->bethe, sizeof(float), m0);  
   WSF1(r->born, sizeof(float), m0+1);
 
-  m0 = cemf_header.n_egrid * m0;
+  m0 = f->h.cemf.n_egrid * m0;
   WSF1(r->strength, sizeof(float), m0);
   
-  cemf_header.ntransitions += 1;
-  cemf_header.length += m;
+  f->h.cemf.ntransitions += 1;
+  f->h.cemf.length += m;
 
   return m;
 }
 
-int WriteRRRecord(FILE *f, RR_RECORD *r) {
+int WriteRRRecord(TFILE *f, RR_RECORD *r) {
   int n;
   int m = 0, m0;
 
-  if (rr_header.length == 0) {
-    fheader[DB_RR-1].nblocks++;
-    n = WriteRRHeader(f, &rr_header);
+  if (f->h.rr.length == 0) {
+    f->fh.nblocks++;
+    f->ihdr = f->nbuf;
+    n = WriteRRHeader(f, &(f->h.rr));
+  }
+
+  if (f->fh.version == ZVERSION) {
+    m = EncodeRRRecord(f, r);
+    if (m == 0) return 0;
+    f->h.rr.ntransitions += 1;
+    f->h.rr.length += m;
+    return m;
   }
 
   WSF0(r->b);
   WSF0(r->f);
   WSF0(r->kl);
 
-  if (rr_header.qk_mode == QK_FIT) {
-    m0 = rr_header.nparams;
+  if (f->h.rr.qk_mode == QK_FIT) {
+    m0 = f->h.rr.nparams;
     WSF1(r->params, sizeof(float), m0);
   }
-  m0 = rr_header.n_usr;
+  m0 = f->h.rr.n_usr;
   WSF1(r->strength, sizeof(float), m0);
 
-  rr_header.ntransitions += 1;
-  rr_header.length += m;
+  f->h.rr.ntransitions += 1;
+  f->h.rr.length += m;
 
   return m;
 }
 
-int WriteAIRecord(FILE *f, AI_RECORD *r) {
+int WriteAIRecord(TFILE *f, AI_RECORD *r) {
   int n, m = 0;
 
-  if (ai_header.length == 0) {
-    fheader[DB_AI-1].nblocks++;
-    WriteAIHeader(f, &ai_header);
+  if (f->h.ai.length == 0) {
+    f->fh.nblocks++;
+    f->ihdr = f->nbuf;
+    WriteAIHeader(f, &(f->h.ai));
+  }
+
+  if (f->fh.version == ZVERSION) {
+    m = EncodeAIRecord(f, r);
+    if (m == 0) return 0;
+    f->h.ai.ntransitions += 1;
+    f->h.ai.length += m;
+    return m;
   }
   
   WSF0(r->b);
   WSF0(r->f);
   WSF0(r->rate);
 
-  ai_header.ntransitions += 1;
-  ai_header.length += m;
+  f->h.ai.ntransitions += 1;
+  f->h.ai.length += m;
 
   return m;
 }
 
-int WriteAIMRecord(FILE *f, AIM_RECORD *r) {
+int WriteAIMRecord(TFILE *f, AIM_RECORD *r) {
   int n, m = 0;
 
-  if (aim_header.length == 0) {
-    fheader[DB_AIM-1].nblocks++;
-    WriteAIMHeader(f, &aim_header);
+  if (f->h.aim.length == 0) {
+    f->fh.nblocks++;
+    f->ihdr = f->nbuf;
+    WriteAIMHeader(f, &(f->h.aim));
   }
 
   WSF0(r->b);
@@ -1737,62 +2161,73 @@ int WriteAIMRecord(FILE *f, AIM_RECORD *r) {
   WSF0(r->nsub);
   WSF1(r->rate, sizeof(float), r->nsub);
   
-  aim_header.ntransitions += 1;
-  aim_header.length += m;
+  f->h.aim.ntransitions += 1;
+  f->h.aim.length += m;
 
   return m;
 }
 
-int WriteCIRecord(FILE *f, CI_RECORD *r) {
+int WriteCIRecord(TFILE *f, CI_RECORD *r) {
   int n;
   int m = 0, m0;
 
-  if (ci_header.length == 0) {
-    fheader[DB_CI-1].nblocks++;
-    WriteCIHeader(f, &ci_header);
+  if (f->h.ci.length == 0) {
+    f->fh.nblocks++;
+    f->ihdr = f->nbuf;
+    WriteCIHeader(f, &(f->h.ci));
+  }
+
+  if (f->fh.version == ZVERSION) {
+    m = EncodeCIRecord(f, r);
+    if (m == 0) return 0;
+    f->h.ci.ntransitions += 1;
+    f->h.ci.length += m;
+    return m;
   }
 
   WSF0(r->b);
   WSF0(r->f);
   WSF0(r->kl);
-  m0 = ci_header.nparams;
+  m0 = f->h.ci.nparams;
   WSF1(r->params, sizeof(float), m0);
-  m0 = ci_header.n_usr;
+  m0 = f->h.ci.n_usr;
   WSF1(r->strength, sizeof(float), m0);
 
-  ci_header.ntransitions += 1;
-  ci_header.length += m;
+  f->h.ci.ntransitions += 1;
+  f->h.ci.length += m;
 
   return m;
 }
 
-int WriteCIMRecord(FILE *f, CIM_RECORD *r) {
+int WriteCIMRecord(TFILE *f, CIM_RECORD *r) {
   int n;
   int m = 0, m0;
 
-  if (cim_header.length == 0) {
-    fheader[DB_CIM-1].nblocks++;
-    WriteCIMHeader(f, &cim_header);
+  if (f->h.cim.length == 0) {
+    f->fh.nblocks++;
+    f->ihdr = f->nbuf;
+    WriteCIMHeader(f, &(f->h.cim));
   }
 
   WSF0(r->b);
   WSF0(r->f);
   WSF0(r->nsub);
-  m0 = r->nsub*cim_header.n_usr;
+  m0 = r->nsub*f->h.cim.n_usr;
   WSF1(r->strength, sizeof(float), m0);
   
-  cim_header.ntransitions += 1;
-  cim_header.length += m;
+  f->h.cim.ntransitions += 1;
+  f->h.cim.length += m;
 
   return m;
 }
 
-int WriteSPRecord(FILE *f, SP_RECORD *r, SP_EXTRA *rx) {
+int WriteSPRecord(TFILE *f, SP_RECORD *r, SP_EXTRA *rx) {
   int n, m = 0;
 
-  if (sp_header.length == 0) {
-    fheader[DB_SP-1].nblocks++;
-    WriteSPHeader(f, &sp_header);
+  if (f->h.sp.length == 0) {
+    f->fh.nblocks++;
+    f->ihdr = f->nbuf;
+    WriteSPHeader(f, &(f->h.sp));
   }
   
   WSF0(r->lower);
@@ -1805,17 +2240,18 @@ int WriteSPRecord(FILE *f, SP_RECORD *r, SP_EXTRA *rx) {
     WSF0(rx->sdev);
   }
 
-  sp_header.ntransitions += 1;
-  sp_header.length += m;
+  f->h.sp.ntransitions += 1;
+  f->h.sp.length += m;
   return m;
 }
 
-int WriteRTRecord(FILE *f, RT_RECORD *r) {
+int WriteRTRecord(TFILE *f, RT_RECORD *r) {
   int i, n, m = 0;
 
-  if (rt_header.length == 0) {
-    fheader[DB_RT-1].nblocks++;
-    WriteRTHeader(f, &rt_header);
+  if (f->h.rt.length == 0) {
+    f->fh.nblocks++;
+    f->ihdr = f->nbuf;
+    WriteRTHeader(f, &(f->h.rt));
   }
 
   WSF0(r->dir);
@@ -1832,18 +2268,19 @@ int WriteRTRecord(FILE *f, RT_RECORD *r) {
   for (i++; i < LNCOMPLEX; i++) r->icomplex[i] = '\0';
   WSF1(r->icomplex, sizeof(char), LNCOMPLEX);
 
-  rt_header.ntransitions += 1;
-  rt_header.length += m;
+  f->h.rt.ntransitions += 1;
+  f->h.rt.length += m;
 
   return m;
 }
 
-int WriteDRRecord(FILE *f, DR_RECORD *r) {
+int WriteDRRecord(TFILE *f, DR_RECORD *r) {
   int n, m = 0;
 
-  if (dr_header.length == 0) {
-    fheader[DB_DR-1].nblocks++;
-    WriteDRHeader(f, &dr_header);
+  if (f->h.dr.length == 0) {
+    f->fh.nblocks++;
+    f->ihdr = f->nbuf;
+    WriteDRHeader(f, &(f->h.dr));
   }
 
   WSF0(r->ilev);
@@ -1858,8 +2295,8 @@ int WriteDRRecord(FILE *f, DR_RECORD *r) {
   WSF0(r->ai);
   WSF0(r->total_rate);
 
-  dr_header.ntransitions += 1;
-  dr_header.length += m;
+  f->h.dr.ntransitions += 1;
+  f->h.dr.length += m;
   
   return m;
 }
@@ -2140,9 +2577,17 @@ int ReadCEMFHeader(FILE *f, CEMF_HEADER *h, int swp) {
 
 int ReadCERecord(FILE *f, CE_RECORD *r, int swp, CE_HEADER *h) {
   int i, n, m = 0, m0;
+  long nz;
+  unsigned char *z;
   
   if (version_read[DB_CE-1] < 109) return ReadCERecordOld(f, r, swp, h);
 
+  if (zip_read[DB_CE-1]) {
+    z = ReadZRecord(f, &nz, &m);
+    if (z == NULL || !DecodeCERecord(z, nz, r, h, NULL)) return 0;
+    return m;
+  }
+
   RSF0(r->lower);
   RSF0(r->upper);
   RSF0(r->nsub);
@@ -2279,9 +2724,17 @@ int ReadRRHeader(FILE *f, RR_HEADER *h, int swp) {
 
 int ReadRRRecord(FILE *f, RR_RECORD *r, int swp, RR_HEADER *h) {
   int i, n, m = 0, m0;
+  long nz;
+  unsigned char *z;
   
   if (version_read[DB_RR-1] < 109) return ReadRRRecordOld(f, r, swp, h);
 
+  if (zip_read[DB_RR-1]) {
+    z = ReadZRecord(f, &nz, &m);
+    if (z == NULL || !DecodeRRRecord(z, nz, r, h, NULL)) return 0;
+    return m;
+  }
+
   RSF0(r->b);
   RSF0(r->f);
   RSF0(r->kl);
@@ -2364,9 +2817,17 @@ int ReadAIMHeader(FILE *f, AIM_HEADER *h, int swp) {
 
 int ReadAIRecord(FILE *f, AI_RECORD *r, int swp) {
   int n, m = 0;
+  long nz;
+  unsigned char *z;
 
   if (version_read[DB_AI-1] < 109) return ReadAIRecordOld(f, r, swp);
 
+  if (zip_read[DB_AI-1]) {
+    z = ReadZRecord(f, &nz, &m);
+    if (z == NULL || !DecodeAIRecord(z, nz, r)) return 0;
+    return m;
+  }
+
   RSF0(r->b);
   RSF0(r->f);
   RSF0(r->rate);
@@ -2444,9 +2905,17 @@ int ReadCIHeader(FILE *f, CI_HEADER *h, int swp) {
 
 int ReadCIRecord(FILE *f, CI_RECORD *r, int swp, CI_HEADER *h) {
   int i, n, m = 0, m0;
+  long nz;
+  unsigned char *z;
   
   if (version_read[DB_CI-1] < 109) return ReadCIRecordOld(f, r, swp, h);
 
+  if (zip_read[DB_CI-1]) {
+    z = ReadZRecord(f, &nz, &m);
+    if (z == NULL || !DecodeCIRecord(z, nz, r, h, NULL)) return 0;
+    return m;
+  }
+
   RSF0(r->b);
   RSF0(r->f);
   RSF0(r->kl);
@@ -2668,11 +3137,305 @@ int ReadDRRecord(FILE *f, DR_RECORD *r, int swp) {
   if (swp) SwapEndianDRRecord(r);
   
   return m;
-} 
+}
+
+MFILE *MapFile(char *fn) {
+  MFILE *f;
+  struct stat st;
+  int fd;
+  long n, k;
+
+  fd = open(fn, O_RDONLY);
+  if (fd < 0) return NULL;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return NULL;
+  }
+  f = (MFILE *) malloc(sizeof(MFILE));
+  f->size = st.st_size;
+  f->pos = 0;
+  f->p = NULL;
+  f->mapped = 0;
+  f->buf = NULL;
+  f->nbuf = 0;
+  f->fp = NULL;
+  f->old[0] = NULL;
+  f->old[1] = NULL;
+  if (f->size > 0) {
+    f->p = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (f->p == MAP_FAILED) {
+      /* cannot be mapped, read it in. */
+      f->p = malloc(f->size);
+      for (n = 0; n < f->size; n += k) {
+	k = read(fd, f->p+n, f->size-n);
+	if (k <= 0) break;
+      }
+      f->size = n;
+    } else {
+      f->mapped = 1;
+      madvise(f->p, f->size, MADV_SEQUENTIAL);
+    }
+  }
+  close(fd);
+  return f;
+}
+
+static void FreeMapOld(MFILE *f) {
+  if (f->old[0]) free(f->old[0]);
+  if (f->old[1]) free(f->old[1]);
+  f->old[0] = NULL;
+  f->old[1] = NULL;
+}
+
+void UnmapFile(MFILE *f) {
+  if (f == NULL) return;
+  FreeMapOld(f);
+  if (f->fp) fclose(f->fp);
+  if (f->p) {
+    if (f->mapped) munmap(f->p, f->size);
+    else free(f->p);
+  }
+  if (f->buf) free(f->buf);
+  free(f);
+}
+
+int MapSeek(MFILE *f, long offset, int whence) {
+  long p;
+
+  if (whence == SEEK_SET) p = offset;
+  else if (whence == SEEK_CUR) p = f->pos + offset;
+  else p = f->size + offset;
+  if (p < 0 || p > f->size) return -1;
+  f->pos = p;
+  return 0;
+}
+
+/* a stream on the mapping at the current position, the headers and
+ * the records of the old formats are read through it. */
+static FILE *MapStream(MFILE *f) {
+  if (f->size == 0) return NULL;
+  if (f->fp == NULL) {
+    f->fp = fmemopen(f->p, f->size, "r");
+    if (f->fp == NULL) return NULL;
+  }
+  fseek(f->fp, f->pos, SEEK_SET);
+  return f->fp;
+}
+
+#define _MSF0(sv, f) {						\
+    if ((f)->pos + (long) sizeof(sv) > (f)->size) return 0;	\
+    memcpy(&(sv), (f)->p + (f)->pos, sizeof(sv));		\
+    (f)->pos += sizeof(sv);					\
+    m += sizeof(sv);						\
+  }while(0)
+#define _MSF1(sv, s, k, f) {					\
+    if ((f)->pos + (long) (s)*(k) > (f)->size) return 0;	\
+    memcpy(sv, (f)->p + (f)->pos, (s)*(k));			\
+    (f)->pos += (s)*(k);					\
+    m += (s)*(k);						\
+  }while(0)
+#define MSF0(sv) _MSF0(sv, f)
+#define MSF1(sv, s, k) _MSF1(sv, s, k, f)
+
+/* the two float arrays at the current position, na and nb long.
+ * they point into the mapping unless they need to be swapped or
+ * are misaligned, in which case they are copied into f->buf. */
+static long MapFloats(MFILE *f, float **a, int na, float **b, int nb,
+		      int swp) {
+  long i, n;
+  char *q;
+  float *x;
+
+  if (na < 0 || nb < 0) return -1;
+  n = sizeof(float)*((long) na + nb);
+  if (f->pos + n > f->size) return -1;
+  q = f->p + f->pos;
+  if (swp || ((size_t) q)%sizeof(float)) {
+    q = (char *) MapBuffer(f, na+nb);
+    memcpy(q, f->p + f->pos, n);
+    if (swp) {
+      x = (float *) q;
+      for (i = 0; i < na+nb; i++) {
+	SwapEndian((char *) &(x[i]), sizeof(float));
+      }
+    }
+  }
+  *a = na > 0?(float *) q:NULL;
+  *b = ((float *) q) + na;
+  f->pos += n;
+  return n;
+}
+
+int MapFHeader(MFILE *f, F_HEADER *fh, int *swp) {
+  FILE *fp;
+  int m;
+
+  fp = MapStream(f);
+  if (fp == NULL) return 0;
+  m = ReadFHeader(fp, fh, swp);
+  f->pos = ftell(fp);
+  return m;
+}
+
+int MapCEHeader(MFILE *f, CE_HEADER *h, int swp) {
+  FILE *fp;
+  int m;
+
+  fp = MapStream(f);
+  if (fp == NULL) return 0;
+  m = ReadCEHeader(fp, h, swp);
+  f->pos = ftell(fp);
+  return m;
+}
+
+int MapCERecord(MFILE *f, CE_RECORD *r, int swp, CE_HEADER *h) {
+  long n, nz;
+  int m = 0, m0;
+  FILE *fp;
+  unsigned char *z;
+
+  FreeMapOld(f);
+  if (version_read[DB_CE-1] < 109) {
+    fp = MapStream(f);
+    if (fp == NULL) return 0;
+    m = ReadCERecordOld(fp, r, swp, h);
+    f->pos = ftell(fp);
+    if (m == 0) return 0;
+    if (h->msub || h->qk_mode == QK_FIT) f->old[0] = r->params;
+    else r->params = NULL;
+    f->old[1] = r->strength;
+    return m;
+  }
+
+  if (zip_read[DB_CE-1]) {
+    z = MapZRecord(f, &nz, &m);
+    if (z == NULL || !DecodeCERecord(z, nz, r, h, f)) return 0;
+    return m;
+  }
+
+  MSF0(r->lower);
+  MSF0(r->upper);
+  MSF0(r->nsub);
+  MSF0(r->bethe);
+  MSF1(r->born, sizeof(float), 2);
+
+  if (swp) SwapEndianCERecord(r);
+
+  if (h->msub) {
+    m0 = r->nsub;
+  }  else if (h->qk_mode == QK_FIT) {
+    m0 = h->nparams * r->nsub;
+  } else m0 = 0;
+  n = MapFloats(f, &(r->params), m0, &(r->strength),
+		h->n_usr*r->nsub, swp);
+  if (n < 0) return 0;
+
+  return m+n;
+}
+
+int MapRRHeader(MFILE *f, RR_HEADER *h, int swp) {
+  FILE *fp;
+  int m;
+
+  fp = MapStream(f);
+  if (fp == NULL) return 0;
+  m = ReadRRHeader(fp, h, swp);
+  f->pos = ftell(fp);
+  return m;
+}
+
+int MapRRRecord(MFILE *f, RR_RECORD *r, int swp, RR_HEADER *h) {
+  long n, nz;
+  int m = 0, m0;
+  FILE *fp;
+  unsigned char *z;
+
+  FreeMapOld(f);
+  if (version_read[DB_RR-1] < 109) {
+    fp = MapStream(f);
+    if (fp == NULL) return 0;
+    m = ReadRRRecordOld(fp, r, swp, h);
+    f->pos = ftell(fp);
+    if (m == 0) return 0;
+    if (h->qk_mode == QK_FIT) f->old[0] = r->params;
+    else r->params = NULL;
+    f->old[1] = r->strength;
+    return m;
+  }
+
+  if (zip_read[DB_RR-1]) {
+    z = MapZRecord(f, &nz, &m);
+    if (z == NULL || !DecodeRRRecord(z, nz, r, h, f)) return 0;
+    return m;
+  }
+
+  MSF0(r->b);
+  MSF0(r->f);
+  MSF0(r->kl);
+
+  if (swp) SwapEndianRRRecord(r);
+
+  if (h->qk_mode == QK_FIT) m0 = h->nparams;
+  else m0 = 0;
+  n = MapFloats(f, &(r->params), m0, &(r->strength), h->n_usr, swp);
+  if (n < 0) return 0;
+
+  return m+n;
+}
+
+int MapCIHeader(MFILE *f, CI_HEADER *h, int swp) {
+  FILE *fp;
+  int m;
+
+  fp = MapStream(f);
+  if (fp == NULL) return 0;
+  m = ReadCIHeader(fp, h, swp);
+  f->pos = ftell(fp);
+  return m;
+}
+
+int MapCIRecord(MFILE *f, CI_RECORD *r, int swp, CI_HEADER *h) {
+  long n, nz;
+  int m = 0;
+  FILE *fp;
+  unsigned char *z;
+
+  FreeMapOld(f);
+  if (version_read[DB_CI-1] < 109) {
+    fp = MapStream(f);
+    if (fp == NULL) return 0;
+    m = ReadCIRecordOld(fp, r, swp, h);
+    f->pos = ftell(fp);
+    if (m == 0) return 0;
+    f->old[0] = r->params;
+    f->old[1] = r->strength;
+    return m;
+  }
+
+  if (zip_read[DB_CI-1]) {
+    z = MapZRecord(f, &nz, &m);
+    if (z == NULL || !DecodeCIRecord(z, nz, r, h, f)) return 0;
+    return m;
+  }
+
+  MSF0(r->b);
+  MSF0(r->f);
+  MSF0(r->kl);
+
+  if (swp) SwapEndianCIRecord(r);
+
+  n = MapFloats(f, &(r->params), h->nparams, &(r->strength),
+		h->n_usr, swp);
+  if (n < 0) return 0;
+
+  return m+n;
+}
+ 
   
-FILE *OpenFile(char *fn, F_HEADER *fhdr) {
+TFILE *OpenFile(char *fn, F_HEADER *fhdr) {
   int ihdr;
   FILE *f;
+  TFILE *tf;
 
   ihdr = fhdr->type - 1;
 
@@ -2699,27 +3462,50 @@ FILE *OpenFile(char *fn, F_HEADER *fhdr) {
     exit(1);
   }
 
+  if (fheader[ihdr].nblocks == 0) {
+    if (izip && (fhdr->type == DB_CE || fhdr->type == DB_RR ||
+		 fhdr->type == DB_CI || fhdr->type == DB_AI)) {
+      fheader[ihdr].version = ZVERSION;
+    } else {
+      fheader[ihdr].version = VERSION;
+    }
+  }
   fheader[ihdr].type = fhdr->type;
   strncpy(fheader[ihdr].symbol, fhdr->symbol, 2);
   fheader[ihdr].atom = fhdr->atom;
-  WriteFHeader(f, &(fheader[ihdr]));
-
-  return f;
-}
-
-int CloseFile(FILE *f, F_HEADER *fhdr) {
-  int ihdr;
+  tf = (TFILE *) malloc(sizeof(TFILE));
+  tf->f = f;
+  tf->buf = NULL;
+  tf->nbuf = 0;
+  tf->mbuf = 0;
+  tf->ihdr = -1;
+  memset(&(tf->h), 0, sizeof(tf->h));
+  memcpy(&(tf->fh), &(fheader[ihdr]), sizeof(F_HEADER));
+  WriteFHeader(tf, &(tf->fh));
+  FlushTFile(tf);
+
+  return tf;
+}
+
+int CloseFile(TFILE *f, F_HEADER *fhdr) {
+  int ihdr, r;
  
   ihdr = fhdr->type-1;
-  fseek(f, 0, SEEK_SET);
+  r = FlushTFile(f);
   fheader[ihdr].type = fhdr->type;
+  fheader[ihdr].nblocks = f->fh.nblocks;
+  fseek(f->f, 0, SEEK_SET);
   WriteFHeader(f, &(fheader[ihdr]));
+  if (FlushTFile(f) < 0) r = -1;
   
-  fclose(f);
-  return 0;
+  if (fclose(f->f) != 0) r = -1;
+  if (f->buf) free(f->buf);
+  free(f);
+  if (r < 0) printf("write error in CloseFile\n");
+  return r;
 }
 
-int InitFile(FILE *f, F_HEADER *fhdr, void *rhdr) {
+int InitFile(TFILE *f, F_HEADER *fhdr, void *rhdr) {
   EN_HEADER *en_hdr;
   ENF_HEADER *enf_hdr;
   TR_HEADER *tr_hdr;
@@ -2741,115 +3527,115 @@ int InitFile(FILE *f, F_HEADER *fhdr, void *rhdr) {
   if (f == NULL) return 0;
   
   ihdr = fhdr->type - 1;
-  fseek(f, 0, SEEK_END);
-  p = ftell(f);
+  fseek(f->f, 0, SEEK_END);
+  p = ftell(f->f) + f->nbuf;
 
   switch (fhdr->type) {
   case DB_EN:
     en_hdr = (EN_HEADER *) rhdr;
-    en_header.position = p;
-    en_header.length = 0;
-    en_header.nele = en_hdr->nele;
-    en_header.nlevels = 0;
+    f->h.en.position = p;
+    f->h.en.length = 0;
+    f->h.en.nele = en_hdr->nele;
+    f->h.en.nlevels = 0;
     break;
   case DB_TR:
     tr_hdr = (TR_HEADER *) rhdr;
-    memcpy(&tr_header, tr_hdr, sizeof(TR_HEADER));
-    tr_header.position = p;
-    tr_header.length = 0;
-    tr_header.ntransitions = 0;
+    memcpy(&(f->h.tr), tr_hdr, sizeof(TR_HEADER));
+    f->h.tr.position = p;
+    f->h.tr.length = 0;
+    f->h.tr.ntransitions = 0;
     break;
   case DB_CE:
     ce_hdr = (CE_HEADER *) rhdr;
-    memcpy(&ce_header, ce_hdr, sizeof(CE_HEADER));
-    ce_header.position = p;
-    ce_header.length = 0;
-    ce_header.ntransitions = 0;
+    memcpy(&(f->h.ce), ce_hdr, sizeof(CE_HEADER));
+    f->h.ce.position = p;
+    f->h.ce.length = 0;
+    f->h.ce.ntransitions = 0;
     break;
   case DB_RR:
     rr_hdr = (RR_HEADER *) rhdr;
-    memcpy(&rr_header, rr_hdr, sizeof(RR_HEADER));
-    rr_header.position = p;
-    rr_header.length = 0;
-    rr_header.ntransitions = 0;
+    memcpy(&(f->h.rr), rr_hdr, sizeof(RR_HEADER));
+    f->h.rr.position = p;
+    f->h.rr.length = 0;
+    f->h.rr.ntransitions = 0;
     break;
   case DB_AI:
     ai_hdr = (AI_HEADER *) rhdr;
-    memcpy(&ai_header, ai_hdr, sizeof(AI_HEADER));
-    ai_header.position = p;
-    ai_header.length = 0;
-    ai_header.ntransitions = 0;
+    memcpy(&(f->h.ai), ai_hdr, sizeof(AI_HEADER));
+    f->h.ai.position = p;
+    f->h.ai.length = 0;
+    f->h.ai.ntransitions = 0;
     break;
   case DB_CI:    
     ci_hdr = (CI_HEADER *) rhdr;
-    memcpy(&ci_header, ci_hdr, sizeof(CI_HEADER));
-    ci_header.position = p;
-    ci_header.length = 0;
-    ci_header.ntransitions = 0;
+    memcpy(&(f->h.ci), ci_hdr, sizeof(CI_HEADER));
+    f->h.ci.position = p;
+    f->h.ci.length = 0;
+    f->h.ci.ntransitions = 0;
     break;
   case DB_SP:
     sp_hdr = (SP_HEADER *) rhdr;
-    memcpy(&sp_header, sp_hdr, sizeof(SP_HEADER));
-    sp_header.position = p;
-    sp_header.length = 0;
-    sp_header.ntransitions = 0;
+    memcpy(&(f->h.sp), sp_hdr, sizeof(SP_HEADER));
+    f->h.sp.position = p;
+    f->h.sp.length = 0;
+    f->h.sp.ntransitions = 0;
     break;
   case DB_RT:
     rt_hdr = (RT_HEADER *) rhdr;
-    memcpy(&rt_header, rt_hdr, sizeof(RT_HEADER));
-    rt_header.position = p;
-    rt_header.length = 0;
-    rt_header.ntransitions = 0;
+    memcpy(&(f->h.rt), rt_hdr, sizeof(RT_HEADER));
+    f->h.rt.position = p;
+    f->h.rt.length = 0;
+    f->h.rt.ntransitions = 0;
     break;
   case DB_DR:
     dr_hdr = (DR_HEADER *) rhdr;
-    memcpy(&dr_header, dr_hdr, sizeof(DR_HEADER));
-    dr_header.position = p;
-    dr_header.length = 0;
-    dr_header.ntransitions = 0;
+    memcpy(&(f->h.dr), dr_hdr, sizeof(DR_HEADER));
+    f->h.dr.position = p;
+    f->h.dr.length = 0;
+    f->h.dr.ntransitions = 0;
     break;
   case DB_AIM:
     aim_hdr = (AIM_HEADER *) rhdr;
-    memcpy(&aim_header, aim_hdr, sizeof(AIM_HEADER));
-    aim_header.position = p;
-    aim_header.length = 0;
-    aim_header.ntransitions = 0;
+    memcpy(&(f->h.aim), aim_hdr, sizeof(AIM_HEADER));
+    f->h.aim.position = p;
+    f->h.aim.length = 0;
+    f->h.aim.ntransitions = 0;
     break;
   case DB_CIM:
     cim_hdr = (CIM_HEADER *) rhdr;
-    memcpy(&cim_header, cim_hdr, sizeof(CIM_HEADER));
-    cim_header.position = p;
-    cim_header.length = 0;
-    cim_header.ntransitions = 0;
+    memcpy(&(f->h.cim), cim_hdr, sizeof(CIM_HEADER));
+    f->h.cim.position = p;
+    f->h.cim.length = 0;
+    f->h.cim.ntransitions = 0;
     break;
   case DB_ENF:
     enf_hdr = (ENF_HEADER *) rhdr;
-    memcpy(&enf_header, enf_hdr, sizeof(ENF_HEADER));
-    enf_header.position = p;
-    enf_header.length = 0;
-    enf_header.nele = enf_hdr->nele;
-    enf_header.nlevels = 0;
+    memcpy(&(f->h.enf), enf_hdr, sizeof(ENF_HEADER));
+    f->h.enf.position = p;
+    f->h.enf.length = 0;
+    f->h.enf.nele = enf_hdr->nele;
+    f->h.enf.nlevels = 0;
     break;
   case DB_TRF:
     trf_hdr = (TRF_HEADER *) rhdr;
-    memcpy(&trf_header, trf_hdr, sizeof(TRF_HEADER));
-    trf_header.position = p;
-    trf_header.length = 0;
-    trf_header.ntransitions = 0;
+    memcpy(&(f->h.trf), trf_hdr, sizeof(TRF_HEADER));
+    f->h.trf.position = p;
+    f->h.trf.length = 0;
+    f->h.trf.ntransitions = 0;
     break;
   case DB_CEF:
     cef_hdr = (CEF_HEADER *) rhdr;
-    memcpy(&cef_header, cef_hdr, sizeof(CEF_HEADER));
-    cef_header.position = p;
-    cef_header.length = 0;
-    cef_header.ntransitions = 0;
+    memcpy(&(f->h.cef), cef_hdr, sizeof(CEF_HEADER));
+    f->h.cef.position = p;
+    f->h.cef.length = 0;
+    f->h.cef.ntransitions = 0;
     break;
   case DB_CEMF:
     cemf_hdr = (CEMF_HEADER *) rhdr;
-    memcpy(&cemf_header, cemf_hdr, sizeof(CEMF_HEADER));
-    cemf_header.position = p;
-    cemf_header.length = 0;
-    cemf_header.ntransitions = 0;
+    memcpy(&(f->h.cemf), cemf_hdr, sizeof(CEMF_HEADER));
+    f->h.cemf.position = p;
+    f->h.cemf.length = 0;
+    f->h.cemf.ntransitions = 0;
     break;
   default:
     break;
@@ -2858,106 +3644,71 @@ int InitFile(FILE *f, F_HEADER *fhdr, void *rhdr) {
   return 0;
 }
 
-int DeinitFile(FILE *f, F_HEADER *fhdr) {
-  int n;
-
-  if (f == NULL || fhdr->type <= 0) return 0;
-
-  switch (fhdr->type) {
+static int WriteBlockHeader(TFILE *f, int type) {
+  switch (type) {
   case DB_EN:
-    fseek(f, en_header.position, SEEK_SET);
-    if (en_header.length > 0) {
-      n = WriteENHeader(f, &en_header);
-    }
-    break;
+    return WriteENHeader(f, &(f->h.en));
+  case DB_ENF:
+    return WriteENFHeader(f, &(f->h.enf));
   case DB_TR:
-    fseek(f, tr_header.position, SEEK_SET);
-    if (tr_header.length > 0) {
-      n = WriteTRHeader(f, &tr_header);
-    }
-    break;
+    return WriteTRHeader(f, &(f->h.tr));
+  case DB_TRF:
+    return WriteTRFHeader(f, &(f->h.trf));
   case DB_CE:
-    fseek(f, ce_header.position, SEEK_SET);
-    if (ce_header.length > 0) {
-      n = WriteCEHeader(f, &ce_header);
-    }
-    break;
+    return WriteCEHeader(f, &(f->h.ce));
+  case DB_CEF:
+    return WriteCEFHeader(f, &(f->h.cef));
+  case DB_CEMF:
+    return WriteCEMFHeader(f, &(f->h.cemf));
   case DB_RR:
-    fseek(f, rr_header.position, SEEK_SET);
-    if (rr_header.length > 0) {
-      n = WriteRRHeader(f, &rr_header);
-    }
-    break;
+    return WriteRRHeader(f, &(f->h.rr));
   case DB_AI:
-    fseek(f, ai_header.position, SEEK_SET);
-    if (ai_header.length > 0) {
-      n = WriteAIHeader(f, &ai_header);
-    }
-    break;
+    return WriteAIHeader(f, &(f->h.ai));
+  case DB_AIM:
+    return WriteAIMHeader(f, &(f->h.aim));
   case DB_CI:
-    fseek(f, ci_header.position, SEEK_SET);
-    if (ci_header.length > 0) {
-      n = WriteCIHeader(f, &ci_header);
-    }
-    break;
+    return WriteCIHeader(f, &(f->h.ci));
+  case DB_CIM:
+    return WriteCIMHeader(f, &(f->h.cim));
   case DB_SP:
-    fseek(f, sp_header.position, SEEK_SET);
-    if (sp_header.length > 0) {
-      n = WriteSPHeader(f, &sp_header);
-    }
-    break;
+    return WriteSPHeader(f, &(f->h.sp));
   case DB_RT:
-    fseek(f, rt_header.position, SEEK_SET);
-    if (rt_header.length > 0) {
-      n = WriteRTHeader(f, &rt_header);
-    }
-    break;
+    return WriteRTHeader(f, &(f->h.rt));
   case DB_DR:
-    fseek(f, dr_header.position, SEEK_SET);
-    if (dr_header.length > 0) {
-      n = WriteDRHeader(f, &dr_header);
-    }
-    break;
-  case DB_AIM:
-    fseek(f, aim_header.position, SEEK_SET);
-    if (aim_header.length > 0) {
-      n = WriteAIMHeader(f, &aim_header);
-    }
-    break;
-  case DB_CIM:
-    fseek(f, cim_header.position, SEEK_SET);
-    if (cim_header.length > 0) {
-      n = WriteCIMHeader(f, &cim_header);
-    }
-    break;
-  case DB_ENF:
-    fseek(f, enf_header.position, SEEK_SET);
-    if (enf_header.length > 0) {
-      n = WriteENFHeader(f, &enf_header);
-    }
-    break;
-  case DB_TRF:
-    fseek(f, trf_header.position, SEEK_SET);
-    if (trf_header.length > 0) {
-      n = WriteTRFHeader(f, &trf_header);
-    }
-    break;
-  case DB_CEF:
-    fseek(f, cef_header.position, SEEK_SET);
-    if (cef_header.length > 0) {
-      n = WriteCEFHeader(f, &cef_header);
-    }
-    break;
-  case DB_CEMF:
-    fseek(f, cemf_header.position, SEEK_SET);
-    if (cemf_header.length > 0) {
-      n = WriteCEMFHeader(f, &cemf_header);
-    }
-    break;
+    return WriteDRHeader(f, &(f->h.dr));
   default:
-    break;
+    return 0;
+  }
+}
+
+/* all block headers begin with position and length, so they can be
+ * read through any member of the union. the header is patched in 
+ * the buffer if it has not been flushed yet, otherwise in the file. */
+int DeinitFile(TFILE *f, F_HEADER *fhdr) {
+  long n;
+
+  if (f == NULL || fhdr->type <= 0) return 0;
+
+  if (f->h.en.length > 0) {
+    if (f->ihdr >= 0) {
+      n = f->nbuf;
+      f->nbuf = f->ihdr;
+      WriteBlockHeader(f, fhdr->type);
+      f->nbuf = n;
+      if (FlushTFile(f) < 0) goto ERROR;
+    } else {
+      if (FlushTFile(f) < 0) goto ERROR;
+      fseek(f->f, f->h.en.position, SEEK_SET);
+      WriteBlockHeader(f, fhdr->type);
+      if (FlushTFile(f) < 0) goto ERROR;
+      fseek(f->f, 0, SEEK_END);
+    }
   }
   return 0;
+
+ ERROR:
+  printf("write error in DeinitFile\n");
+  return -1;
 }
 
 int PrintTable(char *ifn, char *ofn, int v) {
@@ -3103,13 +3854,240 @@ static int StrTrimCmp(char *s1, char *s2) {
   }
   return 0;
 }
-   
+
+
+/* a hash of the string with the leading and trailing blanks removed,
+ * so that strings equal under StrTrimCmp have equal hashes. */
+static unsigned int StrTrimHash(char *s, unsigned int h) {
+  int i, j;
+
+  i = 0;
+  while (s[i] == ' ' || s[i] == '\t') i++;
+  j = strlen(s);
+  while (j > i && (s[j-1] == ' ' || s[j-1] == '\t')) j--;
+  for (; i < j; i++) {
+    h ^= (unsigned char) s[i];
+    h *= 16777619U;
+  }
+  h ^= 0xFF;
+  h *= 16777619U;
+  return h;
+}
+
+static int LevelNameKey(char *nc, char *cnr, char *cr) {
+  unsigned int h;
+
+  h = StrTrimHash(nc, 2166136261U);
+  h = StrTrimHash(cnr, h);
+  h = StrTrimHash(cr, h);
+  return (int) (h & 0x7FFFFFFF);
+}
+
+static int CompareIdxRecord(const void *p1, const void *p2) {
+  IDX_RECORD *r1, *r2;
+
+  r1 = (IDX_RECORD *) p1;
+  r2 = (IDX_RECORD *) p2;
+  if (r1->k0 < r2->k0) return -1;
+  else if (r1->k0 > r2->k0) return 1;
+  if (r1->offset < r2->offset) return -1;
+  else if (r1->offset > r2->offset) return 1;
+  return 0;
+}
+
+static int CompareIdxKey(const void *p1, const void *p2) {
+  IDX_RECORD *r1, *r2;
+
+  r1 = (IDX_RECORD *) p1;
+  r2 = (IDX_RECORD *) p2;
+  if (r1->k0 < r2->k0) return -1;
+  else if (r1->k0 > r2->k0) return 1;
+  if (r1->k1 < r2->k1) return -1;
+  else if (r1->k1 > r2->k1) return 1;
+  if (r1->offset < r2->offset) return -1;
+  else if (r1->offset > r2->offset) return 1;
+  return 0;
+}
+
+/* the first record with (k0, k1) not less than the given pair.
+ * k1 < 0 finds the first record of k0. */
+static int SearchIdx(IDX_RECORD *r, int n, int k0, int k1) {
+  int i0, i1, i;
+
+  i0 = 0;
+  i1 = n;
+  while (i0 < i1) {
+    i = (i0+i1)/2;
+    if (r[i].k0 < k0 || (r[i].k0 == k0 && r[i].k1 < k1)) i0 = i+1;
+    else i1 = i;
+  }
+  return i0;
+}
+
+/* map the index of table fn, if there is one that matches it. */
+static MFILE *OpenIdx(char *fn, F_HEADER *fh, IDX_RECORD **r, int *n) {
+  char ifn[1024];
+  struct stat st;
+  IDX_HEADER h;
+  MFILE *f;
+
+  if (stat(fn, &st) < 0) return NULL;
+  snprintf(ifn, 1024, "%s.idx", fn);
+  f = MapFile(ifn);
+  if (f == NULL) return NULL;
+  if (f->size < (long) sizeof(IDX_HEADER)) {
+    UnmapFile(f);
+    return NULL;
+  }
+  memcpy(&h, f->p, sizeof(IDX_HEADER));
+  if (h.magic != IDX_MAGIC || h.type != fh->type ||
+      h.tsession != fh->tsession || h.size != (long) st.st_size ||
+      f->size != (long) (sizeof(IDX_HEADER) +
+			 sizeof(IDX_RECORD)*h.nsec*(long) h.n)) {
+    UnmapFile(f);
+    return NULL;
+  }
+  *r = (IDX_RECORD *) (f->p + sizeof(IDX_HEADER));
+  *n = h.n;
+  return f;
+}
+
+int IndexTable(char *fn) {
+  F_HEADER fh;
+  EN_HEADER eh;
+  EN_RECORD er;
+  TR_HEADER th;
+  TR_RECORD tr;
+  TR_EXTRA tx;
+  AI_HEADER ah;
+  AI_RECORD ar;
+  IDX_HEADER h;
+  IDX_RECORD *r, *q;
+  FILE *f;
+  char ifn[1024];
+  int n, i, k, m, swp;
+  long p;
+
+  f = fopen(fn, "r");
+  if (f == NULL) {
+    printf("cannot open file %s\n", fn);
+    return -1;
+  }
+  n = ReadFHeader(f, &fh, &swp);
+  if (n == 0) {
+    fclose(f);
+    return 0;
+  }
+  if (fh.type != DB_EN && fh.type != DB_TR && fh.type != DB_AI) {
+    printf("cannot index table of type %d\n", fh.type);
+    fclose(f);
+    return -1;
+  }
+
+  m = 0;
+  r = NULL;
+  q = NULL;
+  for (i = 0; i < fh.nblocks; i++) {
+    switch (fh.type) {
+    case DB_EN:
+      n = ReadENHeader(f, &eh, swp);
+      if (n == 0) break;
+      r = realloc(r, sizeof(IDX_RECORD)*(m+eh.nlevels));
+      q = realloc(q, sizeof(IDX_RECORD)*(m+eh.nlevels));
+      for (k = 0; k < eh.nlevels; k++, m++) {
+	p = ftell(f);
+	n = ReadENRecord(f, &er, swp);
+	if (n == 0) break;
+	r[m].k0 = er.ilev;
+	r[m].k1 = eh.nele;
+	r[m].aux = 0;
+	r[m].offset = p;
+	q[m].k0 = eh.nele;
+	q[m].k1 = LevelNameKey(er.ncomplex, er.sname, er.name);
+	q[m].aux = er.ilev;
+	q[m].offset = p;
+      }
+      break;
+    case DB_TR:
+      n = ReadTRHeader(f, &th, swp);
+      if (n == 0) break;
+      r = realloc(r, sizeof(IDX_RECORD)*(m+th.ntransitions));
+      for (k = 0; k < th.ntransitions; k++, m++) {
+	p = ftell(f);
+	n = ReadTRRecord(f, &tr, &tx, swp);
+	if (n == 0) break;
+	r[m].k0 = tr.upper;
+	r[m].k1 = tr.lower;
+	r[m].aux = th.multipole;
+	r[m].offset = p;
+      }
+      break;
+    case DB_AI:
+      n = ReadAIHeader(f, &ah, swp);
+      if (n == 0) break;
+      free(ah.egrid);
+      r = realloc(r, sizeof(IDX_RECORD)*(m+ah.ntransitions));
+      for (k = 0; k < ah.ntransitions; k++, m++) {
+	p = ftell(f);
+	n = ReadAIRecord(f, &ar, swp);
+	if (n == 0) break;
+	r[m].k0 = ar.b;
+	r[m].k1 = ar.f;
+	r[m].aux = 0;
+	r[m].offset = p;
+      }
+      break;
+    }
+    if (n == 0) break;
+  }
+  fseek(f, 0, SEEK_END);
+  p = ftell(f);
+  fclose(f);
+
+  h.magic = IDX_MAGIC;
+  h.type = fh.type;
+  h.tsession = fh.tsession;
+  h.size = p;
+  h.n = m;
+  h.nsec = 1;
+  if (m > 0) {
+    qsort(r, m, sizeof(IDX_RECORD), CompareIdxRecord);
+  }
+  if (q) {
+    h.nsec = 2;
+    r = realloc(r, sizeof(IDX_RECORD)*2*m);
+    memcpy(r+m, q, sizeof(IDX_RECORD)*m);
+    free(q);
+    if (m > 0) {
+      qsort(r+m, m, sizeof(IDX_RECORD), CompareIdxKey);
+    }
+  }
+
+  snprintf(ifn, 1024, "%s.idx", fn);
+  f = fopen(ifn, "wb");
+  if (f == NULL) {
+    printf("cannot open file %s\n", ifn);
+    if (r) free(r);
+    return -1;
+  }
+  n = fwrite(&h, sizeof(IDX_HEADER), 1, f);
+  if (m > 0) {
+    n = fwrite(r, sizeof(IDX_RECORD), h.nsec*m, f);
+  }
+  fclose(f);
+  if (r) free(r);
+
+  return m;
+}
+
 int FindLevelByName(char *fn, int nele, char *nc, char *cnr, char *cr) {
   F_HEADER fh;  
   EN_HEADER h;
   EN_RECORD r;
+  IDX_RECORD *ri;
+  MFILE *fi;
   FILE *f;
-  int n, k;
+  int n, k, m, ni;
   int swp;
   
   f = fopen(fn, "r");
@@ -3129,6 +4107,28 @@ int FindLevelByName(char *fn, int nele, char *nc, char *cnr, char *cr) {
     return -1;
   }
 
+  fi = OpenIdx(fn, &fh, &ri, &ni);
+  if (fi) {
+    ri += ni;
+    m = LevelNameKey(nc, cnr, cr);
+    for (k = SearchIdx(ri, ni, nele, m); 
+	 k < ni && ri[k].k0 == nele && ri[k].k1 == m; k++) {
+      fseek(f, ri[k].offset, SEEK_SET);
+      n = ReadENRecord(f, &r, swp);
+      if (n == 0) break;
+      if (StrTrimCmp(r.ncomplex, nc) == 0 &&
+	  StrTrimCmp(r.sname, cnr) == 0 &&
+	  StrTrimCmp(r.name, cr) == 0) {
+	UnmapFile(fi);
+	fclose(f);
+	return r.ilev;
+      }
+    }
+    UnmapFile(fi);
+    fclose(f);
+    return -1;
+  }
+
   while (1) {
     n = ReadENHeader(f, &h, swp);
     if (n == 0) break;
@@ -3155,8 +4155,10 @@ int LevelInfor(char *fn, int ilev, EN_RECORD *r0) {
   F_HEADER fh;  
   EN_HEADER h;
   EN_RECORD r;
+  IDX_RECORD *ri;
+  MFILE *fi;
   FILE *f;
-  int n, i, k, nlevels;
+  int n, i, k, nlevels, ni;
   int swp, sr;
   
   f = fopen(fn, "r");
@@ -3178,6 +4180,20 @@ int LevelInfor(char *fn, int ilev, EN_RECORD *r0) {
   else sr = SIZE_EN_RECORD;
 
   if (ilev >= 0) {
+    fi = OpenIdx(fn, &fh, &ri, &ni);
+    if (fi) {
+      k = SearchIdx(ri, ni, ilev, -1);
+      n = 0;
+      if (k < ni && ri[k].k0 == ilev) {
+	fseek(f, ri[k].offset, SEEK_SET);
+	n = ReadENRecord(f, &r, swp);
+      }
+      UnmapFile(fi);
+      fclose(f);
+      if (n == 0 || r.ilev != ilev) return -1;
+      memcpy(r0, &r, sizeof(EN_RECORD));
+      return 0;
+    }
     k = ilev;
     nlevels = 0;
     for (i = 0; i < fh.nblocks; i++) {
@@ -3398,6 +4414,207 @@ int MemENFTable(char *fn) {
   return 0;
 }    
 
+/* the records of the CE, TR, RR, CI and AI tables are printed in chunks
+ * of NPCHUNK. the records of a chunk are formatted in parallel into 
+ * a buffer for each thread, and the buffers are written in order. */
+#define NPCHUNK 16384
+
+typedef struct _PBUF_ {
+  char *s;
+  long n;
+  long m;
+} PBUF;
+
+/* the records of a chunk, and what is needed to print them. */
+typedef struct _PRINT_CHUNK_ {
+  void *h;
+  void *r;
+  void *rx;
+  int v;
+  double bte;
+  double bms;
+} PRINT_CHUNK;
+
+typedef void (*PRINT_RECORD)(PBUF *b, PRINT_CHUNK *c, int i);
+
+static char *PBufReserve(PBUF *b, long k) {
+  if (b->n + k > b->m) {
+    b->m = Max(2*b->m, b->n + k + 4096);
+    b->s = realloc(b->s, b->m);
+  }
+  return b->s + b->n;
+}
+
+static long double P10(int k) {
+  static const long double t[28] = {
+    1E0L, 1E1L, 1E2L, 1E3L, 1E4L, 1E5L, 1E6L, 1E7L, 1E8L, 1E9L, 1E10L,
+    1E11L, 1E12L, 1E13L, 1E14L, 1E15L, 1E16L, 1E17L, 1E18L, 1E19L,
+    1E20L, 1E21L, 1E22L, 1E23L, 1E24L, 1E25L, 1E26L, 1E27L
+  };
+
+  if (k < 28) return t[k];
+  return powl(10.0L, k);
+}
+
+/* x formatted as by printf with "%w.pE" into s, the length is returned.
+ * the non-finite and subnormal values, the precisions above 9, and the
+ * values too close to a rounding tie to be decided in long double are 
+ * left to sprintf, so that the output is the same. */
+static int FormatE(char *s, int w, int p, double x) {
+  unsigned long long u, d, d0, d1;
+  long double y, r;
+  double a;
+  int e, k, n, i;
+  char c[32], *q;
+
+  memcpy(&u, &x, sizeof(u));
+  k = (u>>52)&0x7FF;
+  if (p > 9 || k == 0x7FF || (k == 0 && (u<<1))) {
+    return sprintf(s, "%*.*E", w, p, x);
+  }
+  q = c;
+  if (u>>63) *q++ = '-';
+  a = fabs(x);
+  d0 = (unsigned long long) P10(p);
+  d1 = 10*d0;
+  if (k == 0) {
+    e = 0;
+    d = 0;
+  } else {
+    e = (int) floor(log10(a));
+    for (i = 0; i < 3; i++) {
+      k = p - e;
+      if (k >= 0) y = a*P10(k);
+      else y = a/P10(-k);
+      d = (unsigned long long) y;
+      if (d < d0) e--;
+      else if (d >= d1) e++;
+      else break;
+    }
+    if (i == 3) return sprintf(s, "%*.*E", w, p, x);
+    r = y - d;
+    if (fabsl(r - 0.5L) < 1E-6L) return sprintf(s, "%*.*E", w, p, x);
+    if (r > 0.5L) d++;
+    if (d == d1) {
+      d = d0;
+      e++;
+    }
+  }
+  for (i = p; i > 0; i--) {
+    q[i+1] = '0' + d%10;
+    d /= 10;
+  }
+  q[0] = '0' + d;
+  if (p > 0) {
+    q[1] = '.';
+    q += p+2;
+  } else {
+    q++;
+  }
+  *q++ = 'E';
+  if (e < 0) {
+    *q++ = '-';
+    e = -e;
+  } else {
+    *q++ = '+';
+  }
+  if (e >= 100) {
+    *q++ = '0' + e/100;
+    e %= 100;
+  }
+  *q++ = '0' + e/10;
+  *q++ = '0' + e%10;
+  n = q - c;
+  k = 0;
+  if (n < w) {
+    k = w - n;
+    memset(s, ' ', k);
+  }
+  memcpy(s+k, c, n);
+  return n+k;
+}
+
+/* i formatted as by printf with "%wd". */
+static int FormatD(char *s, int w, int i) {
+  char c[16];
+  unsigned int u;
+  int n, k;
+
+  u = i < 0?-((unsigned int) i):(unsigned int) i;
+  n = 16;
+  do {
+    c[--n] = '0' + u%10;
+    u /= 10;
+  } while (u);
+  if (i < 0) c[--n] = '-';
+  n = 16 - n;
+  k = 0;
+  if (n < w) {
+    k = w - n;
+    memset(s, ' ', k);
+  }
+  memcpy(s+k, c+16-n, n);
+  return n+k;
+}
+
+/* append x as "%w.pE" followed by the character t, if it is not 0. */
+static void PBufE(PBUF *b, int w, int p, double x, char t) {
+  char *s;
+
+  s = PBufReserve(b, Max(w, p+8) + 32);
+  b->n += FormatE(s, w, p, x);
+  if (t) b->s[b->n++] = t;
+}
+
+static void PBufD(PBUF *b, int w, int i, char t) {
+  char *s;
+
+  s = PBufReserve(b, Max(w, 12) + 2);
+  b->n += FormatD(s, w, i);
+  if (t) b->s[b->n++] = t;
+}
+
+static void PBufS(PBUF *b, char *t) {
+  long k;
+  
+  k = strlen(t);
+  memcpy(PBufReserve(b, k), t, k);
+  b->n += k;
+}
+
+/* format the records 0 to n-1 of c with pr, and write them to f. */
+static void PrintRecords(FILE *f, PRINT_CHUNK *c, int n, PRINT_RECORD pr) {
+  PBUF *b;
+  int i, t, nt;
+
+  nt = 1;
+#ifdef _OPENMP
+  nt = omp_get_max_threads();
+#endif
+  if (n < 64) nt = 1;
+  b = (PBUF *) calloc(nt, sizeof(PBUF));
+#pragma omp parallel default(shared) private(i, t) num_threads(nt)
+  {
+    int i0, i1, mt;
+    t = 0;
+    mt = 1;
+#ifdef _OPENMP
+    t = omp_get_thread_num();
+    mt = omp_get_num_threads();
+#endif
+    i0 = ((long) n)*t/mt;
+    i1 = ((long) n)*(t+1)/mt;
+    for (i = i0; i < i1; i++) {
+      pr(b+t, c, i);
+    }
+  }
+  for (t = 0; t < nt; t++) {
+    if (b[t].n > 0) fwrite(b[t].s, 1, b[t].n, f);
+    if (b[t].s) free(b[t].s);
+  }
+  free(b);
+}
+
 int PrintENTable(FILE *f1, FILE *f2, int v, int swp) {
   EN_HEADER h;
   EN_RECORD r;
@@ -3498,16 +4715,77 @@ double OscillatorStrength(int m, double e, double s, double *ga) {
   return x;
 }  
 
+static void PrintTRRecord(PBUF *b, PRINT_CHUNK *c, int i) {
+  TR_HEADER *h;
+  TR_RECORD *r;
+  TR_EXTRA *rx;
+  double e, a, gf;
+
+  h = (TR_HEADER *) c->h;
+  r = ((TR_RECORD *) c->r) + i;
+  rx = ((TR_EXTRA *) c->rx) + i;
+  if (iuta) {
+    if (c->v) {
+      e = rx->energy;
+      gf = OscillatorStrength(h->multipole, e, r->strength, &a);
+      a /= (mem_en_table[r->upper].j + 1.0);
+      a *= RATE_AU;
+      PBufD(b, 5, r->upper, ' ');
+      PBufD(b, 4, mem_en_table[r->upper].j, ' ');
+      PBufD(b, 5, r->lower, ' ');
+      PBufD(b, 4, mem_en_table[r->lower].j, ' ');
+      PBufE(b, 13, 6, (e*HARTREE_EV), ' ');
+      PBufE(b, 11, 4, (rx->sdev*HARTREE_EV), ' ');
+      PBufE(b, 13, 6, gf, ' ');
+      PBufE(b, 13, 6, a, ' ');
+      PBufE(b, 13, 6, r->strength, ' ');
+      PBufE(b, 10, 3, rx->sci, '\n');
+    } else {
+      e = rx->energy;
+      PBufD(b, 5, r->upper, ' ');
+      PBufD(b, 5, r->lower, ' ');
+      PBufE(b, 13, 6, e, ' ');
+      PBufE(b, 11, 4, rx->sdev, ' ');
+      PBufE(b, 13, 6, r->strength, ' ');
+      PBufE(b, 10, 3, rx->sci, '\n');
+    }
+  } else {
+    if (c->v) {
+      e = mem_en_table[r->upper].energy - mem_en_table[r->lower].energy;
+      gf = OscillatorStrength(h->multipole, e, (double)r->strength, &a);
+      a /= (mem_en_table[r->upper].j + 1.0);
+      a *= RATE_AU;
+      PBufD(b, 6, r->upper, ' ');
+      PBufD(b, 2, mem_en_table[r->upper].j, ' ');
+      PBufD(b, 6, r->lower, ' ');
+      PBufD(b, 2, mem_en_table[r->lower].j, ' ');
+      PBufE(b, 13, 6, (e*HARTREE_EV), ' ');
+      PBufE(b, 13, 6, gf, ' ');
+      PBufE(b, 13, 6, a, ' ');
+      PBufE(b, 13, 6, r->strength, '\n');
+    } else {
+      PBufD(b, 6, r->upper, ' ');
+      PBufD(b, 6, r->lower, ' ');
+      PBufE(b, 13, 6, r->strength, '\n');
+    }
+  }
+}
+
 int PrintTRTable(FILE *f1, FILE *f2, int v, int swp) {
   TR_HEADER h;
-  TR_RECORD r;
-  TR_EXTRA rx;
-  int n, i;
+  TR_RECORD *r;
+  TR_EXTRA *rx;
+  PRINT_CHUNK c;
+  int n, i, m;
   int nb;
-  double e, a, gf;
 
   nb = 0;
   
+  r = (TR_RECORD *) malloc(sizeof(TR_RECORD)*NPCHUNK);
+  c.r = r;
+  rx = (TR_EXTRA *) malloc(sizeof(TR_EXTRA)*NPCHUNK);
+  c.rx = rx;
+  c.v = v;
   while (1) {
     n = ReadTRHeader(f1, &h, swp);
     if (n == 0) break;
@@ -3519,44 +4797,21 @@ int PrintTRTable(FILE *f1, FILE *f2, int v, int swp) {
     fprintf(f2, "GAUGE\t= %d\n", (int)h.gauge);
     fprintf(f2, "MODE\t= %d\n", (int)h.mode);
 
-    for (i = 0; i < h.ntransitions; i++) {
-      n = ReadTRRecord(f1, &r, &rx, swp);
-      if (n == 0) break;
-      if (iuta) {
-	if (v) {
-	  e = rx.energy;
-	  gf = OscillatorStrength(h.multipole, e, r.strength, &a);
-	  a /= (mem_en_table[r.upper].j + 1.0);
-	  a *= RATE_AU;
-	  fprintf(f2, "%5d %4d %5d %4d %13.6E %11.4E %13.6E %13.6E %13.6E %10.3E\n",
-		  r.upper, mem_en_table[r.upper].j, 
-		  r.lower, mem_en_table[r.lower].j,
-		  (e*HARTREE_EV), 
-		  (rx.sdev*HARTREE_EV), gf, a, r.strength, rx.sci);
-	} else {
-	  e = rx.energy;
-	  fprintf(f2, "%5d %5d %13.6E %11.4E %13.6E %10.3E\n",
-		  r.upper, r.lower, e, rx.sdev, r.strength, rx.sci);
-	}
-      } else {
-	if (v) {
-	  e = mem_en_table[r.upper].energy - mem_en_table[r.lower].energy;
-	  gf = OscillatorStrength(h.multipole, e, (double)r.strength, &a);
-	  a /= (mem_en_table[r.upper].j + 1.0);
-	  a *= RATE_AU;
-	  fprintf(f2, "%6d %2d %6d %2d %13.6E %13.6E %13.6E %13.6E\n",
-		  r.upper, mem_en_table[r.upper].j,
-		  r.lower, mem_en_table[r.lower].j,
-		  (e*HARTREE_EV), gf, a, r.strength);
-	} else {
-	  fprintf(f2, "%6d %6d %13.6E\n", 
-		  r.upper, r.lower, r.strength);
-	}
+    c.h = &h;
+    for (i = 0; i < h.ntransitions; i += m) {
+      for (m = 0; m < NPCHUNK && i+m < h.ntransitions; m++) {
+	n = ReadTRRecord(f1, r+m, rx+m, swp);
+	if (n == 0) break;
       }
+      PrintRecords(f2, &c, m, PrintTRRecord);
+      if (n == 0) break;
     }
     nb += 1;
   }
 
+  free(r);
+  free(rx);
+
   return nb;
 }
 
@@ -3617,8 +4872,10 @@ int TRBranch(char *fn, int upper, int lower,
   TR_HEADER h;
   TR_RECORD r;
   TR_EXTRA rx;
+  IDX_RECORD *ri;
+  MFILE *fi;
   FILE *f;
-  int n, i, k;
+  int n, i, k, ni;
   double a, b, c, e;
   int swp;
  
@@ -3645,20 +4902,39 @@ int TRBranch(char *fn, int upper, int lower,
   
   a = 0.0;
   c = 0.0;
-  for (i = 0; i < fh.nblocks; i++) {
-    n = ReadTRHeader(f, &h, swp);
-    if (n == 0) break;
-    for (k = 0; k < h.ntransitions; k++) {
+  fi = OpenIdx(fn, &fh, &ri, &ni);
+  if (fi) {
+    for (k = SearchIdx(ri, ni, upper, -1); 
+	 k < ni && ri[k].k0 == upper; k++) {
+      fseek(f, ri[k].offset, SEEK_SET);
       n = ReadTRRecord(f, &r, &rx, swp);
       if (n == 0) break;
-      if (r.upper == upper) {
-	e = mem_en_table[r.upper].energy - mem_en_table[r.lower].energy;
-	OscillatorStrength(h.multipole, e, r.strength, &b);
-	b /= (mem_en_table[r.upper].j + 1.0);
-	b *= RATE_AU;
-	a += b;
-	if (r.lower == lower) {
-	  c += b;
+      e = mem_en_table[r.upper].energy - mem_en_table[r.lower].energy;
+      OscillatorStrength(ri[k].aux, e, r.strength, &b);
+      b /= (mem_en_table[r.upper].j + 1.0);
+      b *= RATE_AU;
+      a += b;
+      if (r.lower == lower) {
+	c += b;
+      }
+    }
+    UnmapFile(fi);
+  } else {
+    for (i = 0; i < fh.nblocks; i++) {
+      n = ReadTRHeader(f, &h, swp);
+      if (n == 0) break;
+      for (k = 0; k < h.ntransitions; k++) {
+	n = ReadTRRecord(f, &r, &rx, swp);
+	if (n == 0) break;
+	if (r.upper == upper) {
+	  e = mem_en_table[r.upper].energy - mem_en_table[r.lower].energy;
+	  OscillatorStrength(h.multipole, e, r.strength, &b);
+	  b /= (mem_en_table[r.upper].j + 1.0);
+	  b *= RATE_AU;
+	  a += b;
+	  if (r.lower == lower) {
+	    c += b;
+	  }
 	}
       }
     }
@@ -3678,18 +4954,86 @@ int TRBranch(char *fn, int upper, int lower,
   return 0;
 }
   
+static void PrintCERecord(PBUF *b, PRINT_CHUNK *c, int i) {
+  CE_HEADER *h;
+  CE_RECORD *r;
+  int k, t, p1, p2;
+  float a, e;
+  double be;
+
+  h = (CE_HEADER *) c->h;
+  r = ((CE_RECORD *) c->r) + i;
+  be = 0.0;
+  if (c->v) {
+    e = mem_en_table[r->upper].energy - mem_en_table[r->lower].energy;
+    PBufD(b, 6, r->lower, ' ');
+    PBufD(b, 2, mem_en_table[r->lower].j, ' ');
+    PBufD(b, 6, r->upper, ' ');
+    PBufD(b, 2, mem_en_table[r->upper].j, ' ');
+    PBufE(b, 11, 4, e*HARTREE_EV, ' ');
+    PBufD(b, 0, r->nsub, '\n');
+    PBufE(b, 11, 4, r->bethe, ' ');
+    PBufE(b, 11, 4, r->born[0], ' ');
+    PBufE(b, 11, 4, r->born[1]*HARTREE_EV, '\n');
+    be = (e + c->bte)/c->bms;
+  } else {
+    PBufD(b, 6, r->lower, ' ');
+    PBufD(b, 6, r->upper, ' ');
+    PBufD(b, 0, r->nsub, '\n');
+    PBufE(b, 11, 4, r->bethe, ' ');
+    PBufE(b, 11, 4, r->born[0], ' ');
+    PBufE(b, 11, 4, r->born[1], '\n');
+  }
+
+  p1 = 0;
+  p2 = 0;
+  for (k = 0; k < r->nsub; k++) {
+    if (h->msub) {
+      PBufE(b, 11, 4, r->params[k], '\n');
+    } else if (h->qk_mode == QK_FIT) {
+      for (t = 0; t < h->nparams; t++) {
+	PBufE(b, 11, 4, r->params[p1], ' ');
+	p1++;
+      }
+      PBufS(b, "\n");
+    }
+    for (t = 0; t < h->n_usr; t++) {
+      if (c->v) {
+	a = h->usr_egrid[t];
+	if (h->usr_egrid_type == 1) a += be;
+	a *= 2.0*(1.0 + 0.5*FINE_STRUCTURE_CONST2 * a);
+	a = PI * AREA_AU20/a;
+	if (!h->msub) a /= (mem_en_table[r->lower].j+1.0);
+	a *= r->strength[p2];
+	PBufE(b, 11, 4, h->usr_egrid[t]*HARTREE_EV, ' ');
+	PBufE(b, 11, 4, r->strength[p2], ' ');
+	PBufE(b, 11, 4, a, '\n');
+      } else {
+	PBufE(b, 11, 4, h->usr_egrid[t], ' ');
+	PBufE(b, 11, 4, r->strength[p2], '\n');
+      }
+      p2++;
+    }
+    if (k < r->nsub-1) {
+      PBufS(b, "--------------------------------------------\n");
+    }
+  }
+}
+
 int PrintCETable(FILE *f1, FILE *f2, int v, int swp) {
   CE_HEADER h;
-  CE_RECORD r;
-  int n, i, t;
+  CE_RECORD *r;
+  PRINT_CHUNK c;
+  int n, i;
   int nb;
-  int m, k, p1, p2;
-  float a, e;
-  double bte, bms, be;
+  int m, k;
 
   nb = 0;
-  BornFormFactorTE(&bte);
-  bms = BornMass();  
+  BornFormFactorTE(&(c.bte));
+  c.bms = BornMass();  
+  r = (CE_RECORD *) malloc(sizeof(CE_RECORD)*NPCHUNK);
+  c.r = r;
+  c.v = v;
   while (1) {
     n = ReadCEHeader(f1, &h, swp);
     if (n == 0) break;
@@ -3730,60 +5074,18 @@ int PrintCETable(FILE *f1, FILE *f2, int v, int swp) {
       }
     }
     
-    for (i = 0; i < h.ntransitions; i++) {
-      n = ReadCERecord(f1, &r, swp, &h);
-      if (n == 0) break;
-      if (v) {
-	e = mem_en_table[r.upper].energy - mem_en_table[r.lower].energy;
-	fprintf(f2, "%6d %2d %6d %2d %11.4E %d\n",
-		r.lower, mem_en_table[r.lower].j,
-		r.upper, mem_en_table[r.upper].j,
-		e*HARTREE_EV, r.nsub);
-	fprintf(f2, "%11.4E %11.4E %11.4E\n", 
-		r.bethe, r.born[0], r.born[1]*HARTREE_EV);
-      } else {
-	fprintf(f2, "%6d %6d %d\n", 
-		r.lower, r.upper, r.nsub);
-	fprintf(f2, "%11.4E %11.4E %11.4E\n", 
-		r.bethe, r.born[0], r.born[1]);
+    c.h = &h;
+    for (i = 0; i < h.ntransitions; i += m) {
+      for (m = 0; m < NPCHUNK && i+m < h.ntransitions; m++) {
+	n = ReadCERecord(f1, r+m, swp, &h);
+	if (n == 0) break;
       }
-      
-      be = (e + bte)/bms;
-      p1 = 0;
-      p2 = 0;
-      for (k = 0; k < r.nsub; k++) {
-	if (h.msub) {
-	  fprintf(f2, "%11.4E\n", r.params[k]);
-	} else if (h.qk_mode == QK_FIT) {
-	  for (t = 0; t < h.nparams; t++) {
-	    fprintf(f2, "%11.4E ", r.params[p1]);
-	    p1++;
-	  }
-	  fprintf(f2, "\n");
-	}
-	for (t = 0; t < h.n_usr; t++) {
-	  if (v) {
-	    a = h.usr_egrid[t];
-	    if (h.usr_egrid_type == 1) a += be;
-	    a *= 2.0*(1.0 + 0.5*FINE_STRUCTURE_CONST2 * a);
-	    a = PI * AREA_AU20/a;
-	    if (!h.msub) a /= (mem_en_table[r.lower].j+1.0);
-	    a *= r.strength[p2];
-	    fprintf(f2, "%11.4E %11.4E %11.4E\n",
-		    h.usr_egrid[t]*HARTREE_EV,
-		    r.strength[p2], a);
-	  } else {
-	    fprintf(f2, "%11.4E %11.4E\n", h.usr_egrid[t], r.strength[p2]);
-	  }
-	  p2++;
-	}
-	if (k < r.nsub-1) {
-	  fprintf(f2, "--------------------------------------------\n");
-	}
-      }      
-      fflush(f2);
-      if (h.msub || h.qk_mode == QK_FIT) free(r.params);
-      free(r.strength);
+      PrintRecords(f2, &c, m, PrintCERecord);
+      for (k = 0; k < m; k++) {
+	if (h.msub || h.qk_mode == QK_FIT) free(r[k].params);
+	free(r[k].strength);
+      }
+      if (n == 0) break;
     }
     free(h.tegrid);
     free(h.egrid);
@@ -3791,6 +5093,8 @@ int PrintCETable(FILE *f1, FILE *f2, int v, int swp) {
     nb += 1;
   }
 
+  free(r);
+
   return nb;
 }
   
@@ -3986,14 +5290,77 @@ int PrintCEMFTable(FILE *f1, FILE *f2, int v, int swp) {
   return nb;
 }
 
+static void PrintRRRecord(PBUF *b, PRINT_CHUNK *c, int i) {
+  RR_HEADER *h;
+  RR_RECORD *r;
+  int t;
+  float e, eph, ee, phi, rr;
+
+  h = (RR_HEADER *) c->h;
+  r = ((RR_RECORD *) c->r) + i;
+  e = 0.0;
+  if (c->v) {
+    e = mem_en_table[r->f].energy - mem_en_table[r->b].energy;
+    PBufD(b, 6, r->b, ' ');
+    PBufD(b, 2, mem_en_table[r->b].j, ' ');
+    PBufD(b, 6, r->f, ' ');
+    PBufD(b, 2, mem_en_table[r->f].j, ' ');
+    PBufE(b, 11, 4, (e*HARTREE_EV), ' ');
+    PBufD(b, 2, r->kl, '\n');
+  } else {
+    PBufD(b, 6, r->b, ' ');
+    PBufD(b, 6, r->f, ' ');
+    PBufD(b, 2, r->kl, '\n');
+  }
+      
+  if (h->qk_mode == QK_FIT) {
+    for (t = 0; t < h->nparams; t++) {
+      if (c->v && t == h->nparams-1) {
+	PBufE(b, 11, 4, r->params[t]*HARTREE_EV, ' ');
+      } else {
+	PBufE(b, 11, 4, r->params[t], ' ');
+      }
+    }
+    PBufS(b, "\n");
+  }
+      
+  for (t = 0; t < h->n_usr; t++) {
+    if (c->v) {
+      if (h->usr_egrid_type == 0) {
+	eph = h->usr_egrid[t];
+	ee = eph - e;
+      } else {
+	ee = h->usr_egrid[t];
+	eph = ee + e;
+      }
+      phi = FINE_STRUCTURE_CONST2*ee;
+      phi = 2.0*PI*FINE_STRUCTURE_CONST*r->strength[t]*AREA_AU20;
+      rr = phi * pow(FINE_STRUCTURE_CONST*eph, 2) / (2.0*ee);
+      rr /= 1.0+0.5*FINE_STRUCTURE_CONST2*ee;
+      phi /= (mem_en_table[r->b].j + 1.0);
+      rr /= (mem_en_table[r->f].j + 1.0);
+      PBufE(b, 11, 4, h->usr_egrid[t]*HARTREE_EV, ' ');
+      PBufE(b, 11, 4, rr, ' ');
+      PBufE(b, 11, 4, phi, ' ');
+      PBufE(b, 11, 4, r->strength[t], '\n');
+    } else {
+      PBufE(b, 11, 4, h->usr_egrid[t], ' ');
+      PBufE(b, 11, 4, r->strength[t], '\n');
+    }
+  }
+}
+
 int PrintRRTable(FILE *f1, FILE *f2, int v, int swp) {
   RR_HEADER h;
-  RR_RECORD r;
-  int n, i, t;
+  RR_RECORD *r;
+  PRINT_CHUNK c;
+  int n, i;
   int nb, k, m;
-  float e, eph, ee, phi, rr;
 
   nb = 0;
+  r = (RR_RECORD *) malloc(sizeof(RR_RECORD)*NPCHUNK);
+  c.r = r;
+  c.v = v;
   while (1) {
     n = ReadRRHeader(f1, &h, swp);
     if (n == 0) break;
@@ -4031,55 +5398,18 @@ int PrintRRTable(FILE *f1, FILE *f2, int v, int swp) {
       }
     }
     
-    for (i = 0; i < h.ntransitions; i++) {
-      n = ReadRRRecord(f1, &r, swp, &h);
-      if (n == 0) break;
-
-      if (v) {
-	e = mem_en_table[r.f].energy - mem_en_table[r.b].energy;
-	fprintf(f2, "%6d %2d %6d %2d %11.4E %2d\n",
-		r.b, mem_en_table[r.b].j, 
-		r.f, mem_en_table[r.f].j,
-		(e*HARTREE_EV), r.kl);
-	
-      } else {
-	fprintf(f2, "%6d %6d %2d\n", r.b, r.f, r.kl);
-      }
-      
-      if (h.qk_mode == QK_FIT) {
-	for (t = 0; t < h.nparams; t++) {
-	  if (v && t == h.nparams-1) {
-	    fprintf(f2, "%11.4E ", r.params[t]*HARTREE_EV);
-	  } else {
-	    fprintf(f2, "%11.4E ", r.params[t]);
-	  }
-	}
-	fprintf(f2, "\n");
+    c.h = &h;
+    for (i = 0; i < h.ntransitions; i += m) {
+      for (m = 0; m < NPCHUNK && i+m < h.ntransitions; m++) {
+	n = ReadRRRecord(f1, r+m, swp, &h);
+	if (n == 0) break;
       }
-      
-      for (t = 0; t < h.n_usr; t++) {
-	if (v) {
-	  if (h.usr_egrid_type == 0) {
-	    eph = h.usr_egrid[t];
-	    ee = eph - e;
-	  } else {
-	    ee = h.usr_egrid[t];
-	    eph = ee + e;
-	  }
-	  phi = FINE_STRUCTURE_CONST2*ee;
-	  phi = 2.0*PI*FINE_STRUCTURE_CONST*r.strength[t]*AREA_AU20;
-	  rr = phi * pow(FINE_STRUCTURE_CONST*eph, 2) / (2.0*ee);
-	  rr /= 1.0+0.5*FINE_STRUCTURE_CONST2*ee;
-	  phi /= (mem_en_table[r.b].j + 1.0);
-	  rr /= (mem_en_table[r.f].j + 1.0);
-	  fprintf(f2, "%11.4E %11.4E %11.4E %11.4E\n",
-		  h.usr_egrid[t]*HARTREE_EV, rr, phi, r.strength[t]);
-	} else {
-	  fprintf(f2, "%11.4E %11.4E\n", h.usr_egrid[t], r.strength[t]);
-	}
+      PrintRecords(f2, &c, m, PrintRRRecord);
+      for (k = 0; k < m; k++) {
+	if (h.qk_mode == QK_FIT) free(r[k].params);
+	free(r[k].strength);
       }
-      if (h.qk_mode == QK_FIT) free(r.params);
-      free(r.strength);
+      if (n == 0) break;
     }
 
     free(h.tegrid);
@@ -4089,18 +5419,51 @@ int PrintRRTable(FILE *f1, FILE *f2, int v, int swp) {
     nb++;
   }
 
+  free(r);
+
   return nb;
 }
 
+static void PrintAIRecord(PBUF *b, PRINT_CHUNK *c, int i) {
+  AI_HEADER *h;
+  AI_RECORD *r;
+  float e, sdr, er;
+
+  h = (AI_HEADER *) c->h;
+  r = ((AI_RECORD *) c->r) + i;
+  if (c->v) {
+    e = mem_en_table[r->b].energy - mem_en_table[r->f].energy;
+    if (e < 0) er = e - h->emin;
+    else er = e;
+    sdr = 0.5*(mem_en_table[r->b].j + 1.0);
+    sdr *= PI*PI*r->rate/(er*(mem_en_table[r->f].j + 1.0));
+    sdr *= AREA_AU20*HARTREE_EV;
+    PBufD(b, 6, r->b, ' ');
+    PBufD(b, 2, mem_en_table[r->b].j, ' ');
+    PBufD(b, 6, r->f, ' ');
+    PBufD(b, 2, mem_en_table[r->f].j, ' ');
+    PBufE(b, 11, 4, e*HARTREE_EV, ' ');
+    PBufE(b, 11, 4, (RATE_AU*r->rate), ' ');
+    PBufE(b, 11, 4, sdr, '\n');
+  } else {
+    PBufD(b, 6, r->b, ' ');
+    PBufD(b, 6, r->f, ' ');
+    PBufE(b, 15, 8, r->rate, '\n');
+  }
+}
+
 int PrintAITable(FILE *f1, FILE *f2, int v, int swp) {
   AI_HEADER h;
-  AI_RECORD r;
-  int n, i;
+  AI_RECORD *r;
+  PRINT_CHUNK c;
+  int n, i, m;
   int nb;
-  float e, sdr, er;
   
   nb = 0;
   
+  r = (AI_RECORD *) malloc(sizeof(AI_RECORD)*NPCHUNK);
+  c.r = r;
+  c.v = v;
   while (1) {
     n = ReadAIHeader(f1, &h, swp);
     if (n == 0) break;
@@ -4118,29 +5481,22 @@ int PrintAITable(FILE *f1, FILE *f2, int v, int swp) {
       }
     }
        
-    for (i = 0; i < h.ntransitions; i++) {
-      n = ReadAIRecord(f1, &r, swp);
-      if (n == 0) break;
-      if (v) {
-	e = mem_en_table[r.b].energy - mem_en_table[r.f].energy;
-	if (e < 0) er = e - h.emin;
-	else er = e;
-	sdr = 0.5*(mem_en_table[r.b].j + 1.0);
-	sdr *= PI*PI*r.rate/(er*(mem_en_table[r.f].j + 1.0));
-	sdr *= AREA_AU20*HARTREE_EV;
-	fprintf(f2, "%6d %2d %6d %2d %11.4E %11.4E %11.4E\n",
-		r.b, mem_en_table[r.b].j,
-		r.f, mem_en_table[r.f].j,
-		e*HARTREE_EV, (RATE_AU*r.rate), sdr);
-      } else {
-	fprintf(f2, "%6d %6d %15.8E\n", r.b, r.f, r.rate);
+    c.h = &h;
+    for (i = 0; i < h.ntransitions; i += m) {
+      for (m = 0; m < NPCHUNK && i+m < h.ntransitions; m++) {
+	n = ReadAIRecord(f1, r+m, swp);
+	if (n == 0) break;
       }
+      PrintRecords(f2, &c, m, PrintAIRecord);
+      if (n == 0) break;
     }
     
     free(h.egrid);
     nb++;
   }
 
+  free(r);
+
   return nb;
 }
 
@@ -4149,8 +5505,10 @@ int AIBranch(char *fn, int ib, int ia,
   F_HEADER fh;
   AI_HEADER h;
   AI_RECORD r;
+  IDX_RECORD *ri;
+  MFILE *fi;
   FILE *f;
-  int n, i, k;
+  int n, i, k, ni;
   double a, b, c, e;
   int swp;
     
@@ -4177,22 +5535,37 @@ int AIBranch(char *fn, int ib, int ia,
    
   a = 0.0;
   c = 0.0;
-  for (i = 0; i < fh.nblocks; i++) {
-    n = ReadAIHeader(f, &h, swp);
-    if (n == 0) break;
-    for (k = 0; k < h.ntransitions; k++) {
+  fi = OpenIdx(fn, &fh, &ri, &ni);
+  if (fi) {
+    for (k = SearchIdx(ri, ni, ib, -1); k < ni && ri[k].k0 == ib; k++) {
+      fseek(f, ri[k].offset, SEEK_SET);
       n = ReadAIRecord(f, &r, swp);
       if (n == 0) break;
-      if (r.b == ib) {
-	e = mem_en_table[r.b].energy - mem_en_table[r.f].energy;
-	b = RATE_AU*r.rate;
-	a += b;
-	if (r.f == ia) {
-	  c += b;
-	}
+      b = RATE_AU*r.rate;
+      a += b;
+      if (r.f == ia) {
+	c += b;
       }
-    }    
-    free(h.egrid);
+    }
+    UnmapFile(fi);
+  } else {
+    for (i = 0; i < fh.nblocks; i++) {
+      n = ReadAIHeader(f, &h, swp);
+      if (n == 0) break;
+      for (k = 0; k < h.ntransitions; k++) {
+	n = ReadAIRecord(f, &r, swp);
+	if (n == 0) break;
+	if (r.b == ib) {
+	  e = mem_en_table[r.b].energy - mem_en_table[r.f].energy;
+	  b = RATE_AU*r.rate;
+	  a += b;
+	  if (r.f == ia) {
+	    c += b;
+	  }
+	}
+      }    
+      free(h.egrid);
+    }
   }
   
   *pa = c;
@@ -4265,18 +5638,66 @@ int PrintAIMTable(FILE *f1, FILE *f2, int v, int swp) {
   return nb;
 }
 
+static void PrintCIRecord(PBUF *b, PRINT_CHUNK *c, int i) {
+  CI_HEADER *h;
+  CI_RECORD *r;
+  int t;
+  float e, a;
+  double be;
+
+  h = (CI_HEADER *) c->h;
+  r = ((CI_RECORD *) c->r) + i;
+  be = 0.0;
+  if (c->v) {
+    e = mem_en_table[r->f].energy - mem_en_table[r->b].energy;
+    PBufD(b, 6, r->b, ' ');
+    PBufD(b, 2, mem_en_table[r->b].j, ' ');
+    PBufD(b, 6, r->f, ' ');
+    PBufD(b, 2, mem_en_table[r->f].j, ' ');
+    PBufE(b, 11, 4, e*HARTREE_EV, ' ');
+    PBufD(b, 2, r->kl, '\n');
+    be = (e + c->bte)/c->bms;
+  } else {
+    PBufD(b, 6, r->b, ' ');
+    PBufD(b, 6, r->f, ' ');
+    PBufD(b, 2, r->kl, '\n');
+  }
+      
+  for (t = 0; t < h->nparams; t++) {
+    PBufE(b, 11, 4, r->params[t], ' ');
+  }
+  PBufS(b, "\n");
+  for (t = 0; t < h->n_usr; t++) {
+    if (c->v) {
+      a = h->usr_egrid[t];
+      if (h->usr_egrid_type == 1) a += be;
+      a *= 1.0 + 0.5*FINE_STRUCTURE_CONST2*a;
+      a = AREA_AU20/(2.0*a*(mem_en_table[r->b].j + 1.0));
+      a *= r->strength[t];
+      PBufE(b, 11, 4, h->usr_egrid[t]*HARTREE_EV, ' ');
+      PBufE(b, 11, 4, r->strength[t], ' ');
+      PBufE(b, 11, 4, a, '\n');
+    } else {
+      PBufE(b, 11, 4, h->usr_egrid[t], ' ');
+      PBufE(b, 11, 4, r->strength[t], '\n');
+    }
+  }
+}
+
 int PrintCITable(FILE *f1, FILE *f2, int v, int swp) {
   CI_HEADER h;
-  CI_RECORD r;
-  int n, i, t;
-  int nb, m;
-  float e, a;
-  double bte, bms, be;
+  CI_RECORD *r;
+  PRINT_CHUNK c;
+  int n, i;
+  int nb, k, m;
 
   nb = 0;
  
-  BornFormFactorTE(&bte);
-  bms = BornMass(); 
+  BornFormFactorTE(&(c.bte));
+  c.bms = BornMass(); 
+  r = (CI_RECORD *) malloc(sizeof(CI_RECORD)*NPCHUNK);
+  c.r = r;
+  c.v = v;
   while (1) {
     n = ReadCIHeader(f1, &h, swp);
     if (n == 0) break;
@@ -4314,40 +5735,18 @@ int PrintCITable(FILE *f1, FILE *f2, int v, int swp) {
       }
     }
 
-    for (i = 0; i < h.ntransitions; i++) {
-      n = ReadCIRecord(f1, &r, swp, &h);
-      if (n == 0) break;
-      
-      if (v) {
-	e = mem_en_table[r.f].energy - mem_en_table[r.b].energy;
-	fprintf(f2, "%6d %2d %6d %2d %11.4E %2d\n",
-		r.b, mem_en_table[r.b].j,
-		r.f, mem_en_table[r.f].j,
-		e*HARTREE_EV, r.kl);
-      } else {
-	fprintf(f2, "%6d %6d %2d\n", r.b, r.f, r.kl);
+    c.h = &h;
+    for (i = 0; i < h.ntransitions; i += m) {
+      for (m = 0; m < NPCHUNK && i+m < h.ntransitions; m++) {
+	n = ReadCIRecord(f1, r+m, swp, &h);
+	if (n == 0) break;
       }
-      
-      for (t = 0; t < h.nparams; t++) {
-	fprintf(f2, "%11.4E ", r.params[t]);
+      PrintRecords(f2, &c, m, PrintCIRecord);
+      for (k = 0; k < m; k++) {
+	free(r[k].params); 
+	free(r[k].strength);
       }
-      fprintf(f2, "\n");
-      be = (e + bte)/bms;
-      for (t = 0; t < h.n_usr; t++) {
-	if (v) {
-	  a = h.usr_egrid[t];
-	  if (h.usr_egrid_type == 1) a += be;
-	  a *= 1.0 + 0.5*FINE_STRUCTURE_CONST2*a;
-	  a = AREA_AU20/(2.0*a*(mem_en_table[r.b].j + 1.0));
-	  a *= r.strength[t];
-	  fprintf(f2, "%11.4E %11.4E %11.4E\n",
-		  h.usr_egrid[t]*HARTREE_EV, r.strength[t], a);
-	} else {
-	  fprintf(f2, "%11.4E %11.4E\n", h.usr_egrid[t], r.strength[t]);
-	}
-      }
-      free(r.params); 
-      free(r.strength);
+      if (n == 0) break;
     }
     
     free(h.tegrid);
@@ -4357,6 +5756,8 @@ int PrintCITable(FILE *f1, FILE *f2, int v, int swp) {
     nb++;
   }
 
+  free(r);
+
   return nb;
 }
 
@@ -4702,7 +6103,8 @@ int AppendTable(char *fn) {
 int JoinTable(char *fn1, char *fn2, char *fn) {
   F_HEADER fh1, fh2;
   FILE *f1, *f2, *f;
-  int n, swp1, swp2;
+  TFILE tf;
+  int n, swp1, swp2, z1;
 #define NBUF 8192
   char buf[NBUF];
 
@@ -4717,6 +6119,7 @@ int JoinTable(char *fn1, char *fn2, char *fn) {
     fclose(f2);
     return 0;
   }
+  z1 = zip_read[fh1.type-1];
   n = ReadFHeader(f2, &fh2, &swp2);
   if (n == 0) {
     fclose(f1);
@@ -4735,12 +6138,27 @@ int JoinTable(char *fn1, char *fn2, char *fn) {
     printf("Files %s and %s are for different element\n", fn1, fn2);
     return -1;
   }
+  if (z1 != zip_read[fh2.type-1]) {
+    printf("Files %s and %s have different compression\n", fn1, fn2);
+    return -1;
+  }
 
   f = fopen(fn, "w");
   if (f == NULL) return -1;
   fh1.nblocks += fh2.nblocks;
   
-  WriteFHeader(f, &fh1);
+  tf.f = f;
+  tf.buf = NULL;
+  tf.nbuf = 0;
+  tf.mbuf = 0;
+  tf.ihdr = -1;
+  WriteFHeader(&tf, &fh1);
+  n = FlushTFile(&tf);
+  free(tf.buf);
+  if (n < 0) {
+    printf("write error\n");
+    return -1;
+  }
   while (1) {
     n = fread(buf, 1, NBUF, f1);
     if (n > 0) {
@@ -4786,7 +6204,8 @@ int AdjustEnergy(int nlevs, int *ilevs, double *e,
 		 char *efn0, char *efn1, char *afn0, char *afn1) {
   int i, k, k0, k1, n, ig, swp, nb;
   double ae0, ae1, e0, e1;
-  FILE *f0, *f1;
+  FILE *f0;
+  TFILE *f1;
   F_HEADER efh, afh;
   AI_HEADER ah;
   AI_RECORD ar;
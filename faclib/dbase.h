@@ -45,12 +45,20 @@
 #define LSNAME      24
 #define LNAME       56
 
+/* size beyond which the buffered block of an output table is
+ * written out before the block is complete. */
+#define MAXWBUF     67108864
+
 typedef struct _FORM_FACTOR_ {  
   double te;
   int nk;
   double *k, *logk, *fk;
 } FORM_FACTOR;
 
+/* a CE, RR, CI or AI table with compressed records carries the major
+ * version ZVERSION, readers reject higher versions. */
+#define ZVERSION 2
+
 typedef struct _F_HEADER_ {
   long int tsession;
   int version;
@@ -412,6 +420,79 @@ typedef struct _DR_RECORD_ {
   float total_rate;
 } DR_RECORD;  
 
+/* the optional index of an EN, TR or AI table, written by IndexTable
+ * into the file fn.idx. it is used only if the table's session time 
+ * and size agree with those recorded in the header. the records of
+ * each section are sorted by k0, then k1 for the EN name section, and
+ * then by the offset. for EN, the first section has k0=ilev, k1=nele,
+ * and the second k0=nele, k1=hash of the names, aux=ilev. for TR, 
+ * k0=upper, k1=lower, aux=multipole. for AI, k0=b, k1=f. */
+#define IDX_MAGIC 0x49434146
+typedef struct _IDX_HEADER_ {
+  int magic;
+  int type;
+  long int tsession;
+  long int size;
+  int n;
+  int nsec;
+} IDX_HEADER;
+
+typedef struct _IDX_RECORD_ {
+  int k0;
+  int k1;
+  int aux;
+  long int offset;
+} IDX_RECORD;
+
+/* an output table. the records of a block are serialized into buf
+ * and written with a single fwrite when the block is finished, the 
+ * file and block headers being kept here rather than in static 
+ * variables, so that different tables can be written at the same time.
+ * ihdr is the offset of the block header in buf, or -1 once it has 
+ * been flushed. */
+typedef struct _TFILE_ {
+  FILE *f;
+  F_HEADER fh;
+  char *buf;
+  long nbuf;
+  long mbuf;
+  long ihdr;
+  union {
+    EN_HEADER en;
+    ENF_HEADER enf;
+    TR_HEADER tr;
+    TRF_HEADER trf;
+    CE_HEADER ce;
+    CEF_HEADER cef;
+    CEMF_HEADER cemf;
+    RR_HEADER rr;
+    AI_HEADER ai;
+    AIM_HEADER aim;
+    CI_HEADER ci;
+    CIM_HEADER cim;
+    SP_HEADER sp;
+    RT_HEADER rt;
+    DR_HEADER dr;
+  } h;
+} TFILE;
+
+/* a binary data file mapped into memory. the record arrays returned by
+ * the Map*Record functions point into the mapping, or into buffers 
+ * owned by the MFILE when they have to be byte-swapped, aligned, or 
+ * read from an old format. they are valid until the next record is 
+ * read from the file.
+ */
+typedef struct _MFILE_ {
+  char *p;
+  long size;
+  long pos;
+  int mapped;
+  char *buf;
+  long nbuf;
+  FILE *fp;
+  void *old[2];
+} MFILE;
+
 /* these read functions interface with the binary data files.
  * they can be used in custom c/c++ codes to read the binary 
  * files directly. to do so, copy consts.h, dbase.h, and dbase.c
@@ -451,6 +532,20 @@ int ReadRTRecord(FILE *f, RT_RECORD *r, int swp);
 int ReadDRHeader(FILE *f, DR_HEADER *h, int swp);
 int ReadDRRecord(FILE *f, DR_RECORD *r, int swp);
 
+/* the same for a mapped file. the headers are read as by the Read* 
+ * functions, the arrays of a record are not allocated and must not 
+ * be freed. */
+MFILE *MapFile(char *fn);
+void UnmapFile(MFILE *f);
+int MapSeek(MFILE *f, long offset, int whence);
+int MapFHeader(MFILE *f, F_HEADER *fh, int *swp);
+int MapCEHeader(MFILE *f, CE_HEADER *h, int swp);
+int MapCERecord(MFILE *f, CE_RECORD *r, int swp, CE_HEADER *h);
+int MapRRHeader(MFILE *f, RR_HEADER *h, int swp);
+int MapRRRecord(MFILE *f, RR_RECORD *r, int swp, RR_HEADER *h);
+int MapCIHeader(MFILE *f, CI_HEADER *h, int swp);
+int MapCIRecord(MFILE *f, CI_RECORD *r, int swp, CI_HEADER *h);
+
 void CEMF2CEFHeader(CEMF_HEADER *mh, CEF_HEADER *h);
 void CEMF2CEFRecord(CEMF_RECORD *mr, CEF_RECORD *r, CEMF_HEADER *mh, 
 		    int ith, int iph);
@@ -465,96 +560,96 @@ int IBaseFromENRecord(EN_RECORD *r);
 /* these are the write functions, which shouldn't be of much interest.
  * unless one needs to format the external data into FAC binary format.
  */
-int WriteFHeader(FILE *f, F_HEADER *fh);
-int WriteENHeader(FILE *f, EN_HEADER *h);
-int WriteENFHeader(FILE *f, ENF_HEADER *h);
-int WriteTRHeader(FILE *f, TR_HEADER *h);
-int WriteTRFHeader(FILE *f, TRF_HEADER *h);
-int WriteCEHeader(FILE *f, CE_HEADER *h);
-int WriteCEFHeader(FILE *f, CEF_HEADER *h);
-int WriteCEMFHeader(FILE *f, CEMF_HEADER *h);
-int WriteRRHeader(FILE *f, RR_HEADER *h);
-int WriteAIHeader(FILE *f, AI_HEADER *h);
-int WriteAIMHeader(FILE *f, AIM_HEADER *h);
-int WriteCIHeader(FILE *f, CI_HEADER *h);
-int WriteCIMHeader(FILE *f, CIM_HEADER *h);
-int WriteSPHeader(FILE *f, SP_HEADER *h);
-int WriteRTHeader(FILE *f, RT_HEADER *h);
-int WriteDRHeader(FILE *f, DR_HEADER *h);
+int WriteFHeader(TFILE *f, F_HEADER *fh);
+int WriteENHeader(TFILE *f, EN_HEADER *h);
+int WriteENFHeader(TFILE *f, ENF_HEADER *h);
+int WriteTRHeader(TFILE *f, TR_HEADER *h);
+int WriteTRFHeader(TFILE *f, TRF_HEADER *h);
+int WriteCEHeader(TFILE *f, CE_HEADER *h);
+int WriteCEFHeader(TFILE *f, CEF_HEADER *h);
+int WriteCEMFHeader(TFILE *f, CEMF_HEADER *h);
+int WriteRRHeader(TFILE *f, RR_HEADER *h);
+int WriteAIHeader(TFILE *f, AI_HEADER *h);
+int WriteAIMHeader(TFILE *f, AIM_HEADER *h);
+int WriteCIHeader(TFILE *f, CI_HEADER *h);
+int WriteCIMHeader(TFILE *f, CIM_HEADER *h);
+int WriteSPHeader(TFILE *f, SP_HEADER *h);
+int WriteRTHeader(TFILE *f, RT_HEADER *h);
+int WriteDRHeader(TFILE *f, DR_HEADER *h);
 
 int CheckEndian(F_HEADER *fh);
 void SwapEndian(char *p, int size);
 int SwapEndianFHeader(F_HEADER *h);
 int InitDBase(void);
 int ReinitDBase(int m);
-FILE *OpenFile(char *fn, F_HEADER *fhdr);
-int CloseFile(FILE *f, F_HEADER *fhdr);
-int InitFile(FILE *f, F_HEADER *fhdr, void *rhdr);
-int DeinitFile(FILE *f, F_HEADER *fhdr);
+TFILE *OpenFile(char *fn, F_HEADER *fhdr);
+int CloseFile(TFILE *f, F_HEADER *fhdr);
+int InitFile(TFILE *f, F_HEADER *fhdr, void *rhdr);
+int DeinitFile(TFILE *f, F_HEADER *fhdr);
 int PrintTable(char *ifn, char *ofn, int v);
 int FreeMemENTable(void);
 int MemENTable(char *fn);
 int MemENFTable(char *fn);
 EN_SRECORD *GetMemENTable(int *s);
 EN_SRECORD *GetMemENFTable(int *s);
-int WriteENRecord(FILE *f, EN_RECORD *r);
-int WriteENFRecord(FILE *f, ENF_RECORD *r);
+int WriteENRecord(TFILE *f, EN_RECORD *r);
+int WriteENFRecord(TFILE *f, ENF_RECORD *r);
 int PrintENTable(FILE *f1, FILE *f2, int v, int swp);
 int PrintENFTable(FILE *f1, FILE *f2, int v, int swp);
 int SwapEndianENHeader(EN_HEADER *h);
 int SwapEndianENRecord(EN_RECORD *r);
 int SwapEndianENFHeader(ENF_HEADER *h);
 int SwapEndianENFRecord(ENF_RECORD *r);
-int WriteTRRecord(FILE *f, TR_RECORD *r, TR_EXTRA *rx);
+int WriteTRRecord(TFILE *f, TR_RECORD *r, TR_EXTRA *rx);
 double OscillatorStrength(int m, double e, double s, double *ga);
 int PrintTRTable(FILE *f1, FILE *f2, int v, int swp);
 int SwapEndianTRHeader(TR_HEADER *h);
 int SwapEndianTRRecord(TR_RECORD *r, TR_EXTRA *rx);
-int WriteTRFRecord(FILE *f, TRF_RECORD *r);
+int WriteTRFRecord(TFILE *f, TRF_RECORD *r);
 int PrintTRFTable(FILE *f1, FILE *f2, int v, int swp);
 int SwapEndianTRFHeader(TRF_HEADER *h);
 int SwapEndianTRFRecord(TRF_RECORD *r);
-int WriteCERecord(FILE *f, CE_RECORD *r);
+int WriteCERecord(TFILE *f, CE_RECORD *r);
 int PrintCETable(FILE *f1, FILE *f2, int v, int swp);
 int SwapEndianCEHeader(CE_HEADER *h);
 int SwapEndianCERecord(CE_RECORD *r);
-int WriteCEFRecord(FILE *f, CEF_RECORD *r);
+int WriteCEFRecord(TFILE *f, CEF_RECORD *r);
 int PrintCEFTable(FILE *f1, FILE *f2, int v, int swp);
 int SwapEndianCEFHeader(CEF_HEADER *h);
 int SwapEndianCEFRecord(CEF_RECORD *r);
-int WriteCEMFRecord(FILE *f, CEMF_RECORD *r);
+int WriteCEMFRecord(TFILE *f, CEMF_RECORD *r);
 int PrintCEMFTable(FILE *f1, FILE *f2, int v, int swp);
 int SwapEndianCEMFHeader(CEMF_HEADER *h);
 int SwapEndianCEMFRecord(CEMF_RECORD *r);
-int WriteRRRecord(FILE *f, RR_RECORD *r);
+int WriteRRRecord(TFILE *f, RR_RECORD *r);
 int PrintRRTable(FILE *f1, FILE *f2, int v, int swp);
 int SwapEndianRRHeader(RR_HEADER *h);
 int SwapEndianRRRecord(RR_RECORD *r);
-int WriteAIRecord(FILE *f, AI_RECORD *r);
+int WriteAIRecord(TFILE *f, AI_RECORD *r);
 int PrintAITable(FILE *f1, FILE *f2, int v, int swp);
 int SwapEndianAIHeader(AI_HEADER *h);
 int SwapEndianAIRecord(AI_RECORD *r);
-int WriteAIMRecord(FILE *f, AIM_RECORD *r);
+int WriteAIMRecord(TFILE *f, AIM_RECORD *r);
 int PrintAIMTable(FILE *f1, FILE *f2, int v, int swp);
 int SwapEndianAIMHeader(AIM_HEADER *h);
 int SwapEndianAIMRecord(AIM_RECORD *r);
-int WriteCIRecord(FILE *f, CI_RECORD *r);
+int WriteCIRecord(TFILE *f, CI_RECORD *r);
 int PrintCITable(FILE *f1, FILE *f2, int v, int swp);
 int SwapEndianCIHeader(CI_HEADER *h);
 int SwapEndianCIRecord(CI_RECORD *r);
-int WriteCIMRecord(FILE *f, CIM_RECORD *r);
+int WriteCIMRecord(TFILE *f, CIM_RECORD *r);
 int PrintCIMTable(FILE *f1, FILE *f2, int v, int swp);
 int SwapEndianCIMHeader(CIM_HEADER *h);
 int SwapEndianCIMRecord(CIM_RECORD *r);
-int WriteSPRecord(FILE *f, SP_RECORD *r, SP_EXTRA *rx);
+int WriteSPRecord(TFILE *f, SP_RECORD *r, SP_EXTRA *rx);
 int PrintSPTable(FILE *f1, FILE *f2, int v, int swp);
 int SwapEndianSPHeader(SP_HEADER *h);
 int SwapEndianSPRecord(SP_RECORD *r, SP_EXTRA *rx);
-int WriteRTRecord(FILE *f, RT_RECORD *r);
+int WriteRTRecord(TFILE *f, RT_RECORD *r);
 int PrintRTTable(FILE *f1, FILE *f2, int v, int swp);
 int SwapEndianRTHeader(RT_HEADER *h);
 int SwapEndianRTRecord(RT_RECORD *r);
-int WriteDRRecord(FILE *f, DR_RECORD *r);
+int WriteDRRecord(TFILE *f, DR_RECORD *r);
 int PrintDRTable(FILE *f1, FILE *f2, int v, int swp);
 int SwapEndianDRHeader(DR_HEADER *h);
 int SwapEndianDRRecord(DR_RECORD *r);
@@ -563,8 +658,10 @@ double IonRadiation(char *fn, int k, int m);
 void SetUTA(int m, int mci);
 int IsUTA(void);
 void SetTRF(int m);
+void SetTableCompression(int m);
 int AppendTable(char *fn);
 int JoinTable(char *fn1, char *fn2, char *fn);
+int IndexTable(char *fn);
 int TRBranch(char *fn, int i, int j, double *te, double *pa, double *ta);
 int AIBranch(char *fn, int i, int j, double *te, double *pa, double *ta);
 int LevelInfor(char *fn, int ilev, EN_RECORD *r0);
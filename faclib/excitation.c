@@ -27,6 +27,7 @@ USE (rcsid);
 
 #define MAXMSUB  32
 #define NPARAMS  4
+#define NCEBLOCK 4096
 
 static int qk_mode;
 static double qk_fit_tolerance;
@@ -67,6 +68,7 @@ static double gos1[NKINT];
 static double gos2[NKINT];
 static double gost[NKINT];
 static double gosint[NKINT];
+#pragma omp threadprivate(xusr,log_xusr,kint,log_kint,gos1,gos2,gost,gosint)
 static double xborn = XBORN;
 static double xborn0 = XBORN0;
 static double xborn1 = XBORN1;
@@ -489,7 +491,6 @@ int CERadialPk(CEPK **pk, int ie, int k0, int k1, int k) {
     }
   }
 
-  (*pk)->nkl = t;
   (*pk)->nkappa = m;
   if (pw_type == 0) {
     (*pk)->kappa0 = ReallocNew(kappa0, sizeof(short)*m);
@@ -500,6 +501,8 @@ int CERadialPk(CEPK **pk, int ie, int k0, int k1, int k) {
   }
   (*pk)->pkd = ReallocNew(pkd, sizeof(double)*q);
   (*pk)->pke = ReallocNew(pke, sizeof(double)*q);  
+#pragma omp flush
+  (*pk)->nkl = t;
 
   if (locked) ReleaseLock(lock);
 #pragma omp flush
@@ -1073,8 +1076,7 @@ double *CERadialQkTable(int k0, int k1, int k2, int k3, int k) {
     mk = GetMaxKMBPT();
     if (k/2 <= mk) t = nqk*2 + 1;
   }
-  *p = (double *) malloc(sizeof(double)*t);
-  rqc = *p;
+  rqc = (double *) malloc(sizeof(double)*t);
 
   ptr = rqc;
   for (ite = 0; ite < n_tegrid; ite++) {
@@ -1094,6 +1096,7 @@ double *CERadialQkTable(int k0, int k1, int k2, int k3, int k) {
       ptr += n_egrid1;
     }
   }
+  *p = rqc;
 
 #ifdef PERFORM_STATISTICS
   stop = clock();
@@ -1153,8 +1156,7 @@ double *CERadialQkMSubTable(int k0, int k1, int k2, int k3, int k, int kp) {
     q[iq] = q[iq-1] + 2;
   }  
   nqk = nq*n_tegrid*n_egrid1;
-  *p = (double *) malloc(sizeof(double)*(nqk+1));
-  rqc = *p;
+  rqc = (double *) malloc(sizeof(double)*(nqk+1));
   if (xborn == 0) {
     for (ie = 0; ie < n_egrid1; ie++) {
       e1 = egrid[ie];
@@ -1410,6 +1412,7 @@ double *CERadialQkMSubTable(int k0, int k1, int k2, int k3, int k, int kp) {
   }    
   rqc[nqk] = type1;
   if (type2 != 1) rqc[nqk] = type2;
+  *p = rqc;
 
 #ifdef PERFORM_STATISTICS
   stop = clock();
@@ -2448,6 +2451,127 @@ int CollisionStrength(double *qkt, double *params, double *e, double *bethe,
   }
 }
 
+/* the distorted wave continua of the partial waves up to kl_cb are 
+   needed by every allowed transition at all energy points. solve them 
+   in one parallel pass before the transition loop. */
+static int PrepCEContinua(void) {
+  int t, kl, nk, ne, ie, i, *kappa;
+  double *e;
+
+  if (xborn == 0 || xborn < -1E30) return 0;
+  kappa = malloc(sizeof(int)*2*pw_scratch.nkl);
+  nk = 0;
+  for (t = 0; t < pw_scratch.nkl; t++) {
+    kl = pw_scratch.kl[t];
+    if (kl > pw_scratch.kl_cb || kl > pw_scratch.max_kl) break;
+    kappa[nk++] = -(kl+1);
+    if (kl > 0 && kl < pw_scratch.qr) kappa[nk++] = kl;
+  }
+  e = malloc(sizeof(double)*n_egrid*(n_tegrid+1));
+  ne = 0;
+  for (ie = 0; ie < n_egrid; ie++) {
+    e[ne++] = egrid[ie];
+    for (i = 0; i < n_tegrid; i++) {
+      e[ne++] = egrid[ie] + tegrid[i];
+    }
+  }
+  t = SolveContinua(nk, kappa, ne, e);
+  free(kappa);
+  free(e);
+  return t;
+}
+
+/* compute the record of the transition r->lower -> r->upper. the
+   params and strength arrays are allocated here and freed by the caller.
+   r->nsub is set to 0 if the record is not to be written. */
+static void CollisionStrengthRecord(CE_RECORD *r, int msub, int iuta) {
+  double qkc[MAXMSUB*MAXNUSR];
+  double params[MAXMSUB*NPARAMS];
+  double e, bethe[3];
+  int k, m, ip, iempty;
+
+  r->nsub = 0;
+  r->params = NULL;
+  r->strength = NULL;
+  if (iuta) {
+    k = CollisionStrengthUTA(qkc, params, &e, bethe, r->lower, r->upper);
+  } else {
+    k = CollisionStrength(qkc, params, &e, bethe, r->lower, r->upper, msub);
+  }
+  if (k <= 0) return;
+
+  m = n_usr*k;
+  iempty = 1;
+  for (ip = 0; ip < m; ip++) {
+    if ((float) qkc[ip]) {
+      iempty = 0;
+      break;
+    }
+  }
+  if (iempty) return;
+
+  r->bethe = bethe[0];
+  r->born[0] = bethe[1];
+  r->born[1] = bethe[2];
+  r->nsub = k;
+  r->strength = (float *) malloc(sizeof(float)*m);
+  for (ip = 0; ip < m; ip++) {
+    r->strength[ip] = (float) qkc[ip];
+  }
+  if (msub) {
+    r->params = (float *) malloc(sizeof(float)*k);
+    for (m = 0; m < k; m++) {
+      r->params[m] = (float) params[m];
+    }
+  } else if (qk_mode == QK_FIT) {
+    m = NPARAMS*k;
+    r->params = (float *) malloc(sizeof(float)*m);
+    for (ip = 0; ip < m; ip++) {
+      r->params[ip] = (float) params[ip];
+    }
+  }
+}
+
+/* the transitions of a block, see PairBlock */
+typedef struct _CE_BLOCK_ {
+  int nlow, *low, nup, *up, nc;
+  double e0, e1;
+  int msub, iuta;
+  CE_RECORD *rb;
+} CE_BLOCK;
+
+static int CEBlockPair(int n, int i, int j, void *p) {
+  CE_BLOCK *b;
+  LEVEL *lev1, *lev2;
+  int ilow, iup;
+  double e;
+
+  b = (CE_BLOCK *) p;
+  lev1 = GetLevel(b->low[i]);
+  lev2 = GetLevel(b->up[j]);
+  e = lev2->energy - lev1->energy;
+  ilow = b->low[i];
+  iup = b->up[j];
+  if (i < b->nlow-b->nc || j < b->nup-b->nc) {
+    if (e < 0) {
+      ilow = b->up[j];
+      iup = b->low[i];
+      e = -e;
+    }
+  }
+  if (e < b->e0 || e >= b->e1) return 0;
+  b->rb[n].lower = ilow;
+  b->rb[n].upper = iup;
+  return 1;
+}
+
+static void CEBlockRecord(int k, void *p) {
+  CE_BLOCK *b;
+
+  b = (CE_BLOCK *) p;
+  CollisionStrengthRecord(b->rb+k, b->msub, b->iuta);
+}
+
 int SaveExcitation(int nlow, int *low, int nup, int *up, int msub, char *fn) {
 #ifdef PERFORM_STATISTICS
   STRUCT_TIMING structt;
@@ -2458,23 +2582,21 @@ int SaveExcitation(int nlow, int *low, int nup, int *up, int msub, char *fn) {
   SYMMETRY *sym;
   STATE *st;
   CONFIG *cfg;
-  int i, j, k, n, m, ie, ip;
-  FILE *f;
-  double qkc[MAXMSUB*MAXNUSR];
-  double params[MAXMSUB*NPARAMS];
+  int i, j, k, n, m, ie;
+  TFILE *f;
   int *alev;
-  int nsub;
   LEVEL *lev1, *lev2;
-  CE_RECORD r;
+  CE_RECORD *rb;
+  CE_BLOCK cb;
   CE_HEADER ce_hdr;
   F_HEADER fhdr;
   ARRAY subte;
   int isub, n_tegrid0, n_egrid0, n_usr0;
-  int te_set, e_set, usr_set, iempty, iuta;
+  int te_set, e_set, usr_set, iuta;
   double emin, emax, e, c;
   double e0, e1, te0, ei;
-  double rmin, rmax, bethe[3];
-  int nc, ilow, iup;
+  double rmin, rmax;
+  int nc, nb;
 
   iuta = IsUTA();
   if (iuta && msub) {
@@ -2603,6 +2725,15 @@ int SaveExcitation(int nlow, int *low, int nup, int *up, int msub, char *fn) {
   strcpy(fhdr.symbol, GetAtomicSymbol());
   fhdr.atom = GetAtomicNumber();
   f = OpenFile(fn, &fhdr);
+  rb = (CE_RECORD *) malloc(sizeof(CE_RECORD)*NCEBLOCK);
+  cb.nlow = nlow;
+  cb.low = low;
+  cb.nup = nup;
+  cb.up = up;
+  cb.nc = nc;
+  cb.msub = msub;
+  cb.iuta = iuta;
+  cb.rb = rb;
   for (isub = 1; isub < subte.dim; isub++) {
     e1 = *((double *) ArrayGet(&subte, isub));
     if (isub == subte.dim-1) e1 = e1*1.001;
@@ -2718,80 +2849,24 @@ int SaveExcitation(int nlow, int *low, int nup, int *up, int msub, char *fn) {
     ce_hdr.usr_egrid = usr_egrid;
 
     InitFile(f, &fhdr, &ce_hdr);  
-    nsub = 1;
-    if (msub) {
-      r.params = (float *) malloc(sizeof(float)*nsub);
-    } else if (qk_mode == QK_FIT) {
-      m = ce_hdr.nparams * nsub;
-      r.params = (float *) malloc(sizeof(float)*m);
-    }
-    m = ce_hdr.n_usr * nsub;
-    r.strength = (float *) malloc(sizeof(float)*m);
-    
-    for (i = 0; i < nlow; i++) {
-      lev1 = GetLevel(low[i]);
-      for (j = 0; j < nup; j++) {
-	lev2 = GetLevel(up[j]);
-	e = lev2->energy - lev1->energy;	
-	ilow = low[i];
-	iup = up[j];
-	if (i < nlow-nc || j < nup-nc) {
-	  if (e < 0) {
-	    ilow = up[j];
-	    iup = low[i];
-	    e = -e;
-	  }
-	}	    
-	if (e < e0 || e >= e1) continue;
-	if (iuta) {
-	  k = CollisionStrengthUTA(qkc, params, &e, bethe, ilow, iup);
-	} else {
-	  k = CollisionStrength(qkc, params, &e, bethe, ilow, iup, msub); 
-	}
-	if (k < 0) continue;
-	r.bethe = bethe[0];
-	r.born[0] = bethe[1];
-	r.born[1] = bethe[2];
-	r.lower = ilow;
-	r.upper = iup;
-	r.nsub = k;
-	if (r.nsub > nsub) {
-	  r.params = (float *) realloc(r.params, sizeof(float)*r.nsub);
-	  m = ce_hdr.n_usr * r.nsub;
-	  r.strength = (float *) realloc(r.strength, sizeof(float)*m);
-	  nsub = r.nsub;
-	}
+    PrepCEContinua();
 
-	if (msub) {
-	  for (m = 0; m < r.nsub; m++) {
-	    r.params[m] = (float) params[m];
-	  }
-	} else if (qk_mode == QK_FIT) {
-	  ip = 0;
-	  for (m = 0; m < r.nsub; m++) {
-	    for (ie = 0; ie < ce_hdr.nparams; ie++) {
-	      r.params[ip] = (float) params[ip];
-	      ip++;
-	    }
-	  }
-	}
-      
-	ip = 0;
-	iempty = 1;
-	for (m = 0; m < r.nsub; m++) {
-	  for (ie = 0; ie < ce_hdr.n_usr; ie++) {
-	    r.strength[ip] = (float) qkc[ip];
-	    if (r.strength[ip]) iempty = 0;
-	    ip++;
-	  }
-	}
-	if (iempty == 0) {
-	  WriteCERecord(f, &r);
+    /* transitions are taken in blocks of NCEBLOCK */
+    cb.e0 = e0;
+    cb.e1 = e1;
+    i = 0;
+    j = 0;
+    while ((nb = PairBlock(&i, &j, nlow, nup, NCEBLOCK, 
+			   CEBlockPair, &cb)) > 0) {
+      ParallelBlock(nb, CEBlockRecord, &cb);
+      for (k = 0; k < nb; k++) {
+	if (rb[k].nsub > 0) {
+	  WriteCERecord(f, rb+k);
 	}
+	if (rb[k].params) free(rb[k].params);
+	if (rb[k].strength) free(rb[k].strength);
       }
     }
-    if (msub || qk_mode == QK_FIT) free(r.params);
-    free(r.strength);
     DeinitFile(f, &fhdr);
     e0 = e1;
     FreeExcitationQk();
@@ -2802,6 +2877,7 @@ int SaveExcitation(int nlow, int *low, int nup, int *up, int msub, char *fn) {
 
   ArrayFree(&subte, NULL);
   if (alev) free(alev);
+  free(rb);
   CloseFile(f, &fhdr);
 
   if (fpw) {
@@ -2869,7 +2945,7 @@ int SaveExcitationEB(int nlow0, int *low0, int nup0, int *up0, char *fn) {
   double e0, e1, te0, ei;
   double rmin, rmax, bethe[3];
   int nc, ilow, iup;
-  FILE *f;
+  TFILE *f;
   double qkc[MAXNE+1];
  
   if (GetLowUpEB(&nlow, &low, &nup, &up, nlow0, low0, nup0, up0) == -1)
@@ -3117,7 +3193,7 @@ int SaveExcitationEBD(int nlow0, int *low0, int nup0, int *up0, char *fn) {
   double e0, e1, te0, ei;
   double rmin, rmax;
   int nc, ilow, iup;
-  FILE *f;
+  TFILE *f;
   double *qkc;
   double *bethe, *born;
  
@@ -43,9 +43,15 @@
 
 #include "sysdef.h"
 
-#if USE_MPI == 1
+/* USE_MPI == 1 runs MPI ranks, 2 OpenMP threads, and 3 OpenMP threads
+   within each MPI rank. USE_MPIRANK and USE_OPENMP tell which of the 
+   two levels are present. */
+#if USE_MPI == 1 || USE_MPI == 3
+#define USE_MPIRANK 1
 #include <mpi.h>
-#elif USE_MPI == 2
+#endif
+#if USE_MPI == 2 || USE_MPI == 3
+#define USE_OPENMP 1
 #include <omp.h>
 #endif
 
@@ -57,6 +63,7 @@
 #define SetLockNT(x) pthread_mutex_lock((x))
 //#define SetLock(x) pthread_mutex_lock((x))
 #define SetLock(x) SetLockWT((x))
+#define TryLock(x) pthread_mutex_trylock((x))
 #define ReleaseLock(x) pthread_mutex_unlock((x))
 #define DestroyLock(x) pthread_mutex_destroy((x))
 
@@ -91,6 +91,7 @@ static struct {
   void (*function)(int, double *, int , double *, double *, 
 		   double *, double *, int, void *);
 } minpack_params;
+#pragma omp threadprivate(minpack_params)
 
 
 void spline_work(double *x, double *y, int n, 
@@ -1076,7 +1077,8 @@ int CEFCross(char *ifn, char *ofn, int i0, int i1,
 int CECross(char *ifn, char *ofn, int i0, int i1, 
 	    int negy, double *egy, int mp) {
   F_HEADER fh;
-  FILE *f1, *f2;
+  MFILE *f1;
+  FILE *f2;
   int n, swp;
   CE_HEADER h;
   CE_RECORD r;
@@ -1087,14 +1089,14 @@ int CECross(char *ifn, char *ofn, int i0, int i1,
   EN_SRECORD *mem_en_table;
   int mem_en_table_size;
   
-  f1 = fopen(ifn, "r");
+  f1 = MapFile(ifn);
   if (f1 == NULL) {
     printf("cannot open file %s\n", ifn);
     return -1;
   }
   
   f2 = NULL;
-  n = ReadFHeader(f1, &fh, &swp);
+  n = MapFHeader(f1, &fh, &swp);
   if (n == 0) {
     printf("File %s is not in FAC binary format\n", ifn);
     goto DONE;
@@ -1124,10 +1126,10 @@ int CECross(char *ifn, char *ofn, int i0, int i1,
   BornFormFactorTE(&bte);
   bms = BornMass();
   while (1) {
-    n = ReadCEHeader(f1, &h, swp);
+    n = MapCEHeader(f1, &h, swp);
     if (n == 0) break;
     for (i = 0; i < h.ntransitions; i++) {
-      n = ReadCERecord(f1, &r, swp, &h);
+      n = MapCERecord(f1, &r, swp, &h);
       if ((r.lower == i0 || i0 < 0) && (r.upper == i1 || i1 < 0)) {
 	eth = mem_en_table[r.upper].energy - mem_en_table[r.lower].energy;
 	e = eth*HARTREE_EV;
@@ -1192,16 +1194,12 @@ int CECross(char *ifn, char *ofn, int i0, int i1,
 	  fprintf(f2, "\n\n");
 	}
 	if (i0 >= 0 && i1 >= 0) {
-	  if (h.msub || h.qk_mode == QK_FIT) free(r.params);
-	  free(r.strength);
 	  free(h.tegrid);
 	  free(h.egrid);
 	  free(h.usr_egrid);
 	  goto DONE;
 	}
       }
-      if (h.msub || h.qk_mode == QK_FIT) free(r.params);
-      free(r.strength);
     }
     free(h.tegrid);
     free(h.egrid);
@@ -1209,7 +1207,7 @@ int CECross(char *ifn, char *ofn, int i0, int i1,
   }
 
  DONE:
-  fclose(f1);
+  UnmapFile(f1);
 
   if (f2) {
     if (f2 != stdout) {
@@ -1436,7 +1434,8 @@ int CEFMaxwell(char *ifn, char *ofn, int i0, int i1,
 int CEMaxwell(char *ifn, char *ofn, int i0, int i1, 
 	      int nt, double *temp) {
   F_HEADER fh;
-  FILE *f1, *f2;
+  MFILE *f1;
+  FILE *f2;
   int n, swp;
   CE_HEADER h;
   CE_RECORD r;
@@ -1447,14 +1446,14 @@ int CEMaxwell(char *ifn, char *ofn, int i0, int i1,
   EN_SRECORD *mem_en_table;
   int mem_en_table_size;
   
-  f1 = fopen(ifn, "r");
+  f1 = MapFile(ifn);
   if (f1 == NULL) {
     printf("cannot open file %s\n", ifn);
     return -1;
   }
    
   f2 = NULL;
-  n = ReadFHeader(f1, &fh, &swp);
+  n = MapFHeader(f1, &fh, &swp);
   if (n == 0) {
     printf("File %s is not in FAC binary format\n", ifn);
     goto DONE;
@@ -1483,10 +1482,10 @@ int CEMaxwell(char *ifn, char *ofn, int i0, int i1,
   }
 
   while (1) {
-    n = ReadCEHeader(f1, &h, swp);
+    n = MapCEHeader(f1, &h, swp);
     if (n == 0) break;
     for (i = 0; i < h.ntransitions; i++) {
-      n = ReadCERecord(f1, &r, swp, &h);
+      n = MapCERecord(f1, &r, swp, &h);
       if ((r.lower == i0 || i0 < 0) && (r.upper == i1 || i1 < 0)) {
 	e = mem_en_table[r.upper].energy - mem_en_table[r.lower].energy;
 	e *= HARTREE_EV;
@@ -1513,16 +1512,12 @@ int CEMaxwell(char *ifn, char *ofn, int i0, int i1,
 	  fprintf(f2, "\n\n");
 	}
 	if (i0 >= 0 && i1 >= 0) {
-	  if (h.msub || h.qk_mode == QK_FIT) free(r.params);
-	  free(r.strength);
 	  free(h.tegrid);
 	  free(h.egrid);
 	  free(h.usr_egrid);
 	  goto DONE;
 	}
       }
-      if (h.msub || h.qk_mode == QK_FIT) free(r.params);
-      free(r.strength);
     }
     free(h.tegrid);
     free(h.egrid);
@@ -1530,7 +1525,7 @@ int CEMaxwell(char *ifn, char *ofn, int i0, int i1,
   }
 
  DONE:
-  fclose(f1);
+  UnmapFile(f1);
 
   if (f2) {
     if (f2 != stdout) {
@@ -1586,7 +1581,8 @@ double InterpolateCIMCross(double e1, double eth, CIM_RECORD *r, CIM_HEADER *h,
 int TotalCICross(char *ifn, char *ofn, int ilev, 
 		 int negy, double *egy, int imin, int imax) {
   F_HEADER fh;
-  FILE *f1, *f2;
+  MFILE *f1;
+  FILE *f2;
   int n, swp;
   CI_HEADER h;
   CI_RECORD r;
@@ -1604,7 +1600,7 @@ int TotalCICross(char *ifn, char *ofn, int ilev,
 
   nb = 0;
   
-  f1 = fopen(ifn, "r");
+  f1 = MapFile(ifn);
   if (f1 == NULL) {
     printf("cannot open file %s\n", ifn);
     return -1;
@@ -1620,7 +1616,7 @@ int TotalCICross(char *ifn, char *ofn, int ilev,
     return -1;
   }
   
-  n = ReadFHeader(f1, &fh, &swp);
+  n = MapFHeader(f1, &fh, &swp);
   if (n == 0) {
     printf("File %s is not in FAC binary format\n", ifn);
     goto DONE;
@@ -1643,10 +1639,10 @@ int TotalCICross(char *ifn, char *ofn, int ilev,
   BornFormFactorTE(&bte);
   bms = BornMass();
   while (1) {
-    n = ReadCIHeader(f1, &h, swp);
+    n = MapCIHeader(f1, &h, swp);
     if (n == 0) break;
     for (i = 0; i < h.ntransitions; i++) {
-      n = ReadCIRecord(f1, &r, swp, &h);
+      n = MapCIRecord(f1, &r, swp, &h);
       if (n == 0) break;
       if (r.b != ilev) continue;
       if (r.f < imin || r.f > imax) continue;
@@ -1659,8 +1655,6 @@ int TotalCICross(char *ifn, char *ofn, int ilev,
 	tc *= AREA_AU20/(2.0*a*(mem_en_table[r.b].j + 1.0));
 	c[t] += tc;
       }
-      free(r.params);
-      free(r.strength);
     }
 
     free(h.tegrid);
@@ -1678,7 +1672,7 @@ int TotalCICross(char *ifn, char *ofn, int ilev,
   free(c);  
 
  DONE:
-  fclose(f1);
+  UnmapFile(f1);
 
   if (f2 != stdout) {
     fclose(f2);
@@ -1692,7 +1686,8 @@ int TotalCICross(char *ifn, char *ofn, int ilev,
 int CICross(char *ifn, char *ofn, int i0, int i1,
 	    int negy, double *egy, int mp) {
   F_HEADER fh;
-  FILE *f1, *f2;
+  MFILE *f1;
+  FILE *f2;
   int n, swp;
   CI_HEADER h;
   CI_RECORD r;
@@ -1710,7 +1705,7 @@ int CICross(char *ifn, char *ofn, int i0, int i1,
 
   nb = 0;
   
-  f1 = fopen(ifn, "r");
+  f1 = MapFile(ifn);
   if (f1 == NULL) {
     printf("cannot open file %s\n", ifn);
     return -1;
@@ -1726,7 +1721,7 @@ int CICross(char *ifn, char *ofn, int i0, int i1,
     return -1;
   }
   
-  n = ReadFHeader(f1, &fh, &swp);
+  n = MapFHeader(f1, &fh, &swp);
   if (n == 0) {
     printf("File %s is not in FAC binary format\n", ifn);
     goto DONE;
@@ -1743,10 +1738,10 @@ int CICross(char *ifn, char *ofn, int i0, int i1,
   BornFormFactorTE(&bte);
   bms = BornMass();
   while (1) {
-    n = ReadCIHeader(f1, &h, swp);
+    n = MapCIHeader(f1, &h, swp);
     if (n == 0) break;
     for (i = 0; i < h.ntransitions; i++) {
-      n = ReadCIRecord(f1, &r, swp, &h);
+      n = MapCIRecord(f1, &r, swp, &h);
       if (n == 0) break;      
       if ((r.b == i0 || i0 < 0) && (r.f == i1 || i1 < 0)) {
 	e = mem_en_table[r.f].energy - mem_en_table[r.b].energy;
@@ -1776,16 +1771,12 @@ int CICross(char *ifn, char *ofn, int i0, int i1,
 	fprintf(f2, "\n\n");
       
 	if (i0 >= 0 && i1 >= 0) {
-	  free(r.params);
-	  free(r.strength);
 	  free(h.tegrid);
 	  free(h.egrid);
 	  free(h.usr_egrid);
 	  goto DONE;
 	}
       }
-      free(r.params);
-      free(r.strength);
     }
 
     free(h.tegrid);
@@ -1796,7 +1787,7 @@ int CICross(char *ifn, char *ofn, int i0, int i1,
   }
 
  DONE:
-  fclose(f1);
+  UnmapFile(f1);
 
   if (f2 != stdout) {
     fclose(f2);
@@ -1810,7 +1801,8 @@ int CICross(char *ifn, char *ofn, int i0, int i1,
 int CIMaxwell(char *ifn, char *ofn, int i0, int i1,
 	      int negy, double *egy) {
   F_HEADER fh;
-  FILE *f1, *f2;
+  MFILE *f1;
+  FILE *f2;
   int n, swp;
   CI_HEADER h;
   CI_RECORD r;
@@ -1830,7 +1822,7 @@ int CIMaxwell(char *ifn, char *ofn, int i0, int i1,
 
   nb = 0;
   
-  f1 = fopen(ifn, "r");
+  f1 = MapFile(ifn);
   if (f1 == NULL) {
     printf("cannot open file %s\n", ifn);
     return -1;
@@ -1846,7 +1838,7 @@ int CIMaxwell(char *ifn, char *ofn, int i0, int i1,
     return -1;
   }
   
-  n = ReadFHeader(f1, &fh, &swp);
+  n = MapFHeader(f1, &fh, &swp);
   if (n == 0) {
     printf("File %s is not in FAC binary format\n", ifn);
     goto DONE;
@@ -1861,10 +1853,10 @@ int CIMaxwell(char *ifn, char *ofn, int i0, int i1,
     egy[i] /= HARTREE_EV;
   }
   while (1) {
-    n = ReadCIHeader(f1, &h, swp);
+    n = MapCIHeader(f1, &h, swp);
     if (n == 0) break;
     for (i = 0; i < h.ntransitions; i++) {
-      n = ReadCIRecord(f1, &r, swp, &h);
+      n = MapCIRecord(f1, &r, swp, &h);
       if (n == 0) break;      
       if ((r.b == i0 || i0 < 0) && (r.f == i1 || i1 < 0)) {
 	e = mem_en_table[r.f].energy - mem_en_table[r.b].energy;
@@ -1888,16 +1880,12 @@ int CIMaxwell(char *ifn, char *ofn, int i0, int i1,
 	fprintf(f2, "\n\n");
       
 	if (i0 >= 0 && i1 >= 0) {
-	  free(r.params);
-	  free(r.strength);
 	  free(h.tegrid);
 	  free(h.egrid);
 	  free(h.usr_egrid);
 	  goto DONE;
 	}
       }
-      free(r.params);
-      free(r.strength);
     }
 
     free(h.tegrid);
@@ -1908,7 +1896,7 @@ int CIMaxwell(char *ifn, char *ofn, int i0, int i1,
   }
 
  DONE:
-  fclose(f1);
+  UnmapFile(f1);
 
   if (f2 != stdout) {
     fclose(f2);
@@ -2036,7 +2024,8 @@ int CIMCross(char *ifn, char *ofn, int i0, int i1,
 int TotalPICross(char *ifn, char *ofn, int ilev, 
 		 int negy, double *egy, int imin, int imax) {
   F_HEADER fh;
-  FILE *f1, *f2;
+  MFILE *f1;
+  FILE *f2;
   int n, swp;
   RR_HEADER h;
   RR_RECORD r;
@@ -2057,7 +2046,7 @@ int TotalPICross(char *ifn, char *ofn, int ilev,
 
   nb = 0;
 
-  f1 = fopen(ifn, "r");
+  f1 = MapFile(ifn);
   if (f1 == NULL) {
     printf("cannot open file %s\n", ifn);
     return -1;
@@ -2073,7 +2062,7 @@ int TotalPICross(char *ifn, char *ofn, int ilev,
     return -1;
   }
 
-  n = ReadFHeader(f1, &fh, &swp);
+  n = MapFHeader(f1, &fh, &swp);
   if (n == 0) {
     printf("File %s is not in FAC binary format\n", ifn);
     goto DONE;
@@ -2094,14 +2083,14 @@ int TotalPICross(char *ifn, char *ofn, int ilev,
   if (imax < 0) imax = mem_en_table_size - 1;
 
   while(1) {
-    n = ReadRRHeader(f1, &h, swp);
+    n = MapRRHeader(f1, &h, swp);
     if (n == 0) break;
     nele = h.nele;
     xusr = (double *) malloc(sizeof(double)*h.n_usr); 
     dstrength = (double *) malloc(sizeof(double)*h.n_usr);
     emax = h.usr_egrid[h.n_usr-1];
     for (i = 0; i < h.ntransitions; i++) {
-      n = ReadRRRecord(f1, &r, swp, &h);
+      n = MapRRRecord(f1, &r, swp, &h);
       if (n == 0) break;
       if (r.b != ilev) continue;
       if (r.f < imin || r.f > imax) continue;
@@ -2134,8 +2123,6 @@ int TotalPICross(char *ifn, char *ofn, int ilev,
 	phi = 2.0*PI*FINE_STRUCTURE_CONST*tc*AREA_AU20;	
 	c[t] += phi/(mem_en_table[r.b].j + 1.0);
       }
-      if (h.qk_mode == QK_FIT) free(r.params);
-      free(r.strength);
     }
 
     free(dstrength);
@@ -2155,7 +2142,7 @@ int TotalPICross(char *ifn, char *ofn, int ilev,
   free(c);  
 
  DONE:
-  fclose(f1);
+  UnmapFile(f1);
 
   if (f2 != stdout) {
     fclose(f2);
@@ -2169,7 +2156,8 @@ int TotalPICross(char *ifn, char *ofn, int ilev,
 int RRCross(char *ifn, char *ofn, int i0, int i1,
 	    int negy, double *egy, int mp) {
   F_HEADER fh;
-  FILE *f1, *f2;
+  MFILE *f1;
+  FILE *f2;
   int n, swp;
   RR_HEADER h;
   RR_RECORD r;
@@ -2190,7 +2178,7 @@ int RRCross(char *ifn, char *ofn, int i0, int i1,
 
   nb = 0;
 
-  f1 = fopen(ifn, "r");
+  f1 = MapFile(ifn);
   if (f1 == NULL) {
     printf("cannot open file %s\n", ifn);
     return -1;
@@ -2206,7 +2194,7 @@ int RRCross(char *ifn, char *ofn, int i0, int i1,
     return -1;
   }
 
-  n = ReadFHeader(f1, &fh, &swp);
+  n = MapFHeader(f1, &fh, &swp);
   if (n == 0) {
     printf("File %s is not in FAC binary format\n", ifn);
     goto DONE;
@@ -2222,14 +2210,14 @@ int RRCross(char *ifn, char *ofn, int i0, int i1,
   }
   
   while(1) {
-    n = ReadRRHeader(f1, &h, swp);
+    n = MapRRHeader(f1, &h, swp);
     if (n == 0) break;
     nele = h.nele;
     xusr = (double *) malloc(sizeof(double)*h.n_usr); 
     dstrength = (double *) malloc(sizeof(double)*h.n_usr);
     emax = h.usr_egrid[h.n_usr-1];
     for (i = 0; i < h.ntransitions; i++) {
-      n = ReadRRRecord(f1, &r, swp, &h);
+      n = MapRRRecord(f1, &r, swp, &h);
       if (n == 0) break;
       if ((r.b == i0 || i0 < 0) && (r.f == i1 || i1 < 0)) {
 	e = mem_en_table[r.f].energy - mem_en_table[r.b].energy;
@@ -2280,8 +2268,6 @@ int RRCross(char *ifn, char *ofn, int i0, int i1,
 	fprintf(f2, "\n\n");
 
 	if (i0 >= 0 && i1 >= 0) {
-	  if (h.qk_mode == QK_FIT) free(r.params);
-	  free(r.strength);
 	  free(dstrength);
 	  free(h.tegrid);
 	  free(h.egrid);
@@ -2290,8 +2276,6 @@ int RRCross(char *ifn, char *ofn, int i0, int i1,
 	  goto DONE;
 	}
       }
-      if (h.qk_mode == QK_FIT) free(r.params);
-      free(r.strength);
     }
 
     free(dstrength);
@@ -2304,7 +2288,7 @@ int RRCross(char *ifn, char *ofn, int i0, int i1,
   }
 
  DONE:
-  fclose(f1);
+  UnmapFile(f1);
 
   if (f2 != stdout) {
     fclose(f2);
@@ -2318,7 +2302,8 @@ int RRCross(char *ifn, char *ofn, int i0, int i1,
 int RRMaxwell(char *ifn, char *ofn, int i0, int i1,
 	      int negy, double *egy) {
   F_HEADER fh;
-  FILE *f1, *f2;
+  MFILE *f1;
+  FILE *f2;
   int n, swp;
   RR_HEADER h;
   RR_RECORD r;
@@ -2341,7 +2326,7 @@ int RRMaxwell(char *ifn, char *ofn, int i0, int i1,
 
   nb = 0;
 
-  f1 = fopen(ifn, "r");
+  f1 = MapFile(ifn);
   if (f1 == NULL) {
     printf("cannot open file %s\n", ifn);
     return -1;
@@ -2357,7 +2342,7 @@ int RRMaxwell(char *ifn, char *ofn, int i0, int i1,
     return -1;
   }
 
-  n = ReadFHeader(f1, &fh, &swp);
+  n = MapFHeader(f1, &fh, &swp);
   if (n == 0) {
     printf("File %s is not in FAC binary format\n", ifn);
     goto DONE;
@@ -2372,14 +2357,14 @@ int RRMaxwell(char *ifn, char *ofn, int i0, int i1,
     egy[i] /= HARTREE_EV;
   }
   while(1) {
-    n = ReadRRHeader(f1, &h, swp);
+    n = MapRRHeader(f1, &h, swp);
     if (n == 0) break;
     nele = h.nele;
     xusr = (double *) malloc(sizeof(double)*h.n_usr); 
     dstrength = (double *) malloc(sizeof(double)*h.n_usr);
     emax = h.usr_egrid[h.n_usr-1];
     for (i = 0; i < h.ntransitions; i++) {
-      n = ReadRRRecord(f1, &r, swp, &h);
+      n = MapRRRecord(f1, &r, swp, &h);
       if (n == 0) break;
       if ((r.b == i0 || i0 < 0) && (r.f == i1 || i1 < 0)) {
 	e = mem_en_table[r.f].energy - mem_en_table[r.b].energy;
@@ -2424,8 +2409,6 @@ int RRMaxwell(char *ifn, char *ofn, int i0, int i1,
 	fprintf(f2, "\n\n");
       
 	if (i0 >= 0 && i1 >= 0) {
-	  if (h.qk_mode == QK_FIT) free(r.params);
-	  free(r.strength);
 	  free(dstrength);
 	  free(h.tegrid);
 	  free(h.egrid);
@@ -2434,8 +2417,6 @@ int RRMaxwell(char *ifn, char *ofn, int i0, int i1,
 	  goto DONE;
 	}
       }
-      if (h.qk_mode == QK_FIT) free(r.params);
-      free(r.strength);
     }
 
     free(dstrength);
@@ -2448,7 +2429,7 @@ int RRMaxwell(char *ifn, char *ofn, int i0, int i1,
   }
 
  DONE:
-  fclose(f1);
+  UnmapFile(f1);
 
   if (f2 != stdout) {
     fclose(f2);
@@ -2476,7 +2457,8 @@ int TotalRRCross(char *ifn, char *ofn, int ilev,
 		 int negy, double *egy, int n0, int n1, int nmax,
 		 int imin, int imax) {
   F_HEADER fh;
-  FILE *f1, *f2;
+  MFILE *f1;
+  FILE *f2;
   int n, swp;
   RR_HEADER h;
   RR_RECORD r;
@@ -2497,7 +2479,7 @@ int TotalRRCross(char *ifn, char *ofn, int ilev,
 
   nb = 0;
 
-  f1 = fopen(ifn, "r");
+  f1 = MapFile(ifn);
   if (f1 == NULL) {
     printf("cannot open file %s\n", ifn);
     return -1;
@@ -2513,7 +2495,7 @@ int TotalRRCross(char *ifn, char *ofn, int ilev,
     return -1;
   }
 
-  n = ReadFHeader(f1, &fh, &swp);
+  n = MapFHeader(f1, &fh, &swp);
   if (n == 0) {
     printf("File %s is not in FAC binary format\n", ifn);
     goto DONE;
@@ -2534,14 +2516,14 @@ int TotalRRCross(char *ifn, char *ofn, int ilev,
   if (imax < 0) imax = mem_en_table_size - 1;
 
   while(1) {
-    n = ReadRRHeader(f1, &h, swp);
+    n = MapRRHeader(f1, &h, swp);
     if (n == 0) break;
     nele = h.nele;
     xusr = (double *) malloc(sizeof(double)*h.n_usr); 
     dstrength = (double *) malloc(sizeof(double)*h.n_usr);
     emax = h.usr_egrid[h.n_usr-1];
     for (i = 0; i < h.ntransitions; i++) {
-      n = ReadRRRecord(f1, &r, swp, &h);
+      n = MapRRRecord(f1, &r, swp, &h);
       if (n == 0) break;
       if (r.f != ilev) continue;
       if (r.b < imin || r.b > imax) continue;
@@ -2576,8 +2558,6 @@ int TotalRRCross(char *ifn, char *ofn, int ilev,
 	rr /= (mem_en_table[r.f].j + 1.0);
 	c[t] += rr;
       }
-      if (h.qk_mode == QK_FIT) free(r.params);
-      free(r.strength);
     }  
 
     free(dstrength);
@@ -2609,7 +2589,7 @@ int TotalRRCross(char *ifn, char *ofn, int ilev,
   free(c);
 
  DONE:
-  fclose(f1);
+  UnmapFile(f1);
   if (f2 != stdout) {
     fclose(f2);
   } else {
@@ -2837,7 +2817,7 @@ int CompareModRecordI1(const void *p1, const void *p2) {
 }
 	
 void ModifyEN(int nc, MOD_RECORD *mr, int nr, MOD_RECORD *pr, 
-	      FILE *f0, FILE *f1, F_HEADER *fh, int swp) {
+	      FILE *f0, TFILE *f1, F_HEADER *fh, int swp) {
   int n, i, k;
   double e0, e1;
   EN_HEADER h;
@@ -2887,7 +2867,7 @@ void ModifyEN(int nc, MOD_RECORD *mr, int nr, MOD_RECORD *pr,
 }
 
 void ModifyTR(int nc, MOD_RECORD *mr, int nr, MOD_RECORD *pr, 
-	      FILE *f0, FILE *f1, F_HEADER *fh, int swp) {
+	      FILE *f0, TFILE *f1, F_HEADER *fh, int swp) {
   int n, i, k;
   TR_HEADER h;
   TR_RECORD r, *r0;
@@ -2936,7 +2916,7 @@ void ModifyTR(int nc, MOD_RECORD *mr, int nr, MOD_RECORD *pr,
 }
 
 void ModifyCE(int nc, MOD_RECORD *mr, int nr, MOD_RECORD *pr, 
-	      FILE *f0, FILE *f1, F_HEADER *fh, int swp) {
+	      FILE *f0, TFILE *f1, F_HEADER *fh, int swp) {
   int n, i, k, j, t, p;
   CE_HEADER h, *h0;
   CE_RECORD r, *r0;  
@@ -3304,7 +3284,8 @@ int ReadCETable(char *fn, int *nh, CE_HEADER **h,
 
 void ModifyTable(char *fn, char *fn0, char *fn1, char *fnm) {
   int nc, swp, n, nr, nh, i;
-  FILE *f0, *f1;
+  FILE *f0;
+  TFILE *f1;
   MOD_RECORD *mr, *mr0;
   F_HEADER fh;  
   EN_HEADER *eh;
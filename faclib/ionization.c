@@ -33,6 +33,8 @@ USE (rcsid);
 #define NPARAMS 4
 #define BUFSIZE 128
 #define NCBOMAX 6
+#define NCIBLOCK 4096
+#define NCIMBLOCK 64
 
 static double cbo_params[(NCBOMAX+1)*NCBOMAX/2][NPARAMS+1] = {
   /* 1s */
@@ -82,6 +84,12 @@ static double usr_egrid[MAXNUSR];
 static double log_usr[MAXNUSR];
 static double xusr[MAXNUSR];
 static double log_xusr[MAXNUSR];
+#pragma omp threadprivate(xusr,log_xusr)
+
+/* set while SaveIonization and SaveIonizationMSub run the pairs in
+   blocks, the continua are then released between the blocks instead
+   of after each integrated table. */
+static int ci_block = 0;
 
 static int n_egrid = 0;
 static double egrid[MAXNE];
@@ -553,6 +561,59 @@ int CIRadialQkBED(double *dp, double *bethe, double *b, int kl,
   return 0;
 }
 
+/* the log y-grid of the integrated tables at egrid[ie], the 
+   continua of the ejected and scattered electrons are at egrid[ie]*y
+   and egrid[ie]*(1-y/bms). */
+static void CIYegrid(int ie, double bte, double bms,
+		     double *yegrid, double *ymin, double *ymax) {
+  double dy;
+  int i;
+
+  *ymin = ((bte+tegrid[0])*YEG0)/egrid[ie];
+  *ymax = ((bte+tegrid[n_tegrid-1])*YEG1)/egrid[ie];
+  if (*ymax >= 0.99*bms) *ymax = 0.99*bms;
+  if (fabs(bms-1) < EPS3 && *ymax > 0.5) *ymax = 0.5;
+  *ymin = log(*ymin);
+  *ymax = log(*ymax);
+  dy = (*ymax - *ymin)/(NINT0-1.0);
+  yegrid[0] = *ymin;
+  for (i = 1; i < NINT0; i++) {
+    yegrid[i] = yegrid[i-1] + dy;
+  }
+}
+
+/* solve the continua on the y-grids of the integrated tables for
+   orbital angular momenta up to klmax, as PrepRecContinua does for 
+   the energy grid. */
+static int PrepCIContinua(int klmax) {
+  int kl, nk, ne, ie, i, *kappa;
+  double yegrid[NINT0], ymin, ymax, bte, bms, y, *e;
+
+  if (klmax < 0 || n_egrid <= 0 || n_tegrid <= 0) return 0;
+  bms = BornMass();
+  BornFormFactorTE(&bte);
+  e = malloc(sizeof(double)*2*NINT0*n_egrid);
+  ne = 0;
+  for (ie = 0; ie < n_egrid; ie++) {
+    CIYegrid(ie, bte, bms, yegrid, &ymin, &ymax);
+    for (i = 0; i < NINT0; i++) {
+      y = exp(yegrid[i]);
+      e[ne++] = egrid[ie]*y;
+      e[ne++] = egrid[ie]*(1.0-y/bms);
+    }
+  }
+  kappa = malloc(sizeof(int)*2*(klmax+1));
+  nk = 0;
+  for (kl = 0; kl <= klmax; kl++) {
+    kappa[nk++] = -(kl+1);
+    if (kl > 0) kappa[nk++] = kl;
+  }
+  kl = SolveContinua(nk, kappa, ne, e);
+  free(kappa);
+  free(e);
+  return kl;
+}
+
 double *CIRadialQkIntegratedTable(int kb, int kbp) {
   int index[2], ie, ite, i, j, k, nqk, qlog;
   double **p, *qkc, e1, e2;
@@ -576,8 +637,7 @@ double *CIRadialQkIntegratedTable(int kb, int kbp) {
   } 
 
   nqk = n_tegrid*n_egrid;
-  *p = (double *) malloc(sizeof(double)*nqk);
-  qkc = *p;
+  qkc = (double *) malloc(sizeof(double)*nqk);
   
   bms = BornMass();
   BornFormFactorTE(&bte);
@@ -587,17 +647,7 @@ double *CIRadialQkIntegratedTable(int kb, int kbp) {
 	qt[ite][i] = 0.0;
       }
     }
-    ymin = ((bte+tegrid[0])*YEG0)/egrid[ie];
-    ymax = ((bte+tegrid[n_tegrid-1])*YEG1)/egrid[ie];
-    if (ymax >= 0.99*bms) ymax = 0.99*bms;
-    if (fabs(bms-1) < EPS3 && ymax > 0.5) ymax = 0.5;
-    ymin = log(ymin);
-    ymax = log(ymax);
-    dy = (ymax - ymin)/(NINT0-1.0);
-    yegrid[0] = ymin;
-    for (i = 1; i < NINT0; i++) {
-      yegrid[i] = yegrid[i-1] + dy;
-    }
+    CIYegrid(ie, bte, bms, yegrid, &ymin, &ymax);
     dy = (ymax - ymin)/(NINT-1.0);
     yint[0] = ymin;
     for (i = 1; i < NINT; i++) {
@@ -644,10 +694,12 @@ double *CIRadialQkIntegratedTable(int kb, int kbp) {
       qkc[i] = 16.0*y;
     }
   }
+#pragma omp flush
+  *p = qkc;
   if (locked) ReleaseLock(lock);
 #pragma omp flush
-  ReinitRadial(1);
-  return (*p);
+  if (!ci_block) ReinitRadial(1);
+  return qkc;
 }
 
 int CIRadialQkIntegrated(double *qke, double te, int kb, int kbp) {
@@ -991,17 +1043,76 @@ int IonizeStrength(double *qku, double *qkc, double *te,
   }
 }
 
+/* compute the record of the ionization r->b -> r->f. the params and
+   strength arrays are allocated here and freed by the caller. r->kl is
+   set to -1 if the record is not to be written. */
+static void IonizeRecord(CI_RECORD *r, int nqk, int iuta) {
+  double qk[MAXNE], qku[MAXNUSR], e;
+  int nq, ip, ie;
+
+  r->params = NULL;
+  r->strength = NULL;
+  if (iuta) {
+    nq = IonizeStrengthUTA(qku, qk, &e, r->b, r->f);
+  } else {
+    nq = IonizeStrength(qku, qk, &e, r->b, r->f);
+  }
+  if (nq < 0) {
+    r->kl = -1;
+    return;
+  }
+  r->kl = nq;
+  r->params = (float *) malloc(sizeof(float)*nqk);
+  for (ip = 0; ip < nqk; ip++) {
+    r->params[ip] = (float) qk[ip];
+  }
+  r->strength = (float *) malloc(sizeof(float)*n_usr);
+  for (ie = 0; ie < n_usr; ie++) {
+    r->strength[ie] = (float) qku[ie];
+  }
+}
+
+/* the pairs of a CI block, see PairBlock */
+typedef struct _CI_BLOCK_ {
+  int *b, *f;
+  double e0, e1;
+  int nqk, iuta;
+  CI_RECORD *rb;
+} CI_BLOCK;
+
+static int CIBlockPair(int n, int i, int j, void *p) {
+  CI_BLOCK *cb;
+  LEVEL *lev1, *lev2;
+  double e;
+
+  cb = (CI_BLOCK *) p;
+  lev1 = GetLevel(cb->b[i]);
+  lev2 = GetLevel(cb->f[j]);
+  e = lev2->energy - lev1->energy;
+  if (e < cb->e0 || e >= cb->e1) return 0;
+  cb->rb[n].b = cb->b[i];
+  cb->rb[n].f = cb->f[j];
+  return 1;
+}
+
+static void CIBlockRecord(int k, void *p) {
+  CI_BLOCK *cb;
+
+  cb = (CI_BLOCK *) p;
+  IonizeRecord(cb->rb+k, cb->nqk, cb->iuta);
+}
+
 int SaveIonization(int nb, int *b, int nf, int *f, char *fn) {
-  int i, j, k;
-  int ie, ip;
-  FILE *file;
+  int i, j, k, m;
+  int ie;
+  TFILE *file;
   LEVEL *lev1, *lev2;
-  CI_RECORD r;
+  CI_RECORD *rb;
+  CI_BLOCK cb;
   CI_HEADER ci_hdr;
   F_HEADER fhdr;
   double delta, emin, emax, e, emax0;
-  double qk[MAXNE], qku[MAXNUSR];
-  int nq, nqk;  
+  int nqk;  
   ARRAY subte;
   int isub, n_tegrid0, n_egrid0, n_usr0;
   int te_set, e_set, usr_set, iuta;
@@ -1067,7 +1178,6 @@ int SaveIonization(int nb, int *b, int nf, int *f, char *fn) {
   pw_type = 0;
   if (usr_egrid_type < 0) usr_egrid_type = 1;
   nqk = NPARAMS;
-  r.params = (float *) malloc(sizeof(float)*nqk);
     
   fhdr.type = DB_CI;
   strcpy(fhdr.symbol, GetAtomicSymbol());
@@ -1079,6 +1189,12 @@ int SaveIonization(int nb, int *b, int nf, int *f, char *fn) {
   ci_hdr.egrid_type = egrid_type;
   ci_hdr.usr_egrid_type = usr_egrid_type;
   file = OpenFile(fn, &fhdr);
+  rb = (CI_RECORD *) malloc(sizeof(CI_RECORD)*NCIBLOCK);
+  cb.b = b;
+  cb.f = f;
+  cb.nqk = nqk;
+  cb.iuta = iuta;
+  cb.rb = rb;
 
   e0 = emin*0.999;
   for (isub = 1; isub < subte.dim; isub++) {
@@ -1165,6 +1281,8 @@ int SaveIonization(int nb, int *b, int nf, int *f, char *fn) {
       SetPEGridLimits(egrid_min, egrid_max, egrid_limits_type);
       SetPEGridDetail(n_egrid, egrid);
       PrepRREGrids(e, emax0);
+      PrepRecContinua(GetMaxBoundL() + 1);
+      if (qk_mode != QK_BED) PrepCIContinua(GetMaxBoundL() + 1);
     }    
 		  
     for (ie = 0; ie < n_egrid; ie++) {
@@ -1188,8 +1306,6 @@ int SaveIonization(int nb, int *b, int nf, int *f, char *fn) {
       SetCIPWGrid(0, NULL, NULL);
     }
 
-    r.strength = (float *) malloc(sizeof(float)*n_usr);
-
     ci_hdr.n_tegrid = n_tegrid;
     ci_hdr.n_egrid = n_egrid;
     ci_hdr.n_usr = n_usr;
@@ -1198,37 +1314,36 @@ int SaveIonization(int nb, int *b, int nf, int *f, char *fn) {
     ci_hdr.usr_egrid = usr_egrid;
     InitFile(file, &fhdr, &ci_hdr);
 
-    for (i = 0; i < nb; i++) {
-      lev1 = GetLevel(b[i]);
-      for (j = 0; j < nf; j++) {
-	lev2 = GetLevel(f[j]);
-	e = lev2->energy - lev1->energy;
-	if (e < e0 || e >= e1) continue;
-	if (iuta) {
-	  nq = IonizeStrengthUTA(qku, qk, &e, b[i], f[j]);
-	} else {
-	  nq = IonizeStrength(qku, qk, &e, b[i], f[j]);
-	}
-	if (nq < 0) continue;
-	r.b = b[i];
-	r.f = f[j];
-	r.kl = nq;
-	
-	for (ip = 0; ip < nqk; ip++) {
-	  r.params[ip] = (float) qk[ip];
-	}
-      
-	for (ie = 0; ie < n_usr; ie++) {
-	  r.strength[ie] = (float) qku[ie];
+    /* pairs are taken in blocks of NCIBLOCK. the integrated radial 
+       tables in qk_array are shared, each is computed once by the 
+       first thread that needs it. */
+    cb.e0 = e0;
+    cb.e1 = e1;
+    i = 0;
+    j = 0;
+    ci_block = 1;
+    while ((m = PairBlock(&i, &j, nb, nf, NCIBLOCK, 
+			  CIBlockPair, &cb)) > 0) {
+      ParallelBlock(m, CIBlockRecord, &cb);
+      for (k = 0; k < m; k++) {
+	if (rb[k].kl >= 0) {
+	  WriteCIRecord(file, rb+k);
 	}
-	
-	WriteCIRecord(file, &r);
+	if (rb[k].params) free(rb[k].params);
+	if (rb[k].strength) free(rb[k].strength);
+      }
+      /* the continua on the y-grid of the integrated tables are
+	 released between blocks */
+      if (i < nb && qk_mode != QK_CB && qk_mode != QK_BED) {
+	ReinitRadial(1);
+	PrepRecContinua(GetMaxBoundL() + 1);
+	PrepCIContinua(GetMaxBoundL() + 1);
       }
     }
+    ci_block = 0;
 
     DeinitFile(file, &fhdr);
 
-    free(r.strength);
     ReinitRadial(1);
     FreeRecQk();
     FreeRecPk();
@@ -1237,7 +1352,7 @@ int SaveIonization(int nb, int *b, int nf, int *f, char *fn) {
     e0 = e1;
   }
 
-  free(r.params);
+  free(rb);
 
   ReinitRecombination(1);
   ReinitIonization(1);
@@ -1432,7 +1547,7 @@ double CIRadialQkIntegratedMSub(int j1, int m1, int j2, int m2,
   r = Simpson(yi, 0, NINT-1);
   r *= d*e12;
   
-  ReinitRadial(1);
+  if (!ci_block) ReinitRadial(1);
   return r;
 }
 
@@ -1519,15 +1634,57 @@ int IonizeStrengthMSub(double *qku, double *te, int b, int f) {
   return i;
 }
 
+/* compute the record of the ionization r->b -> r->f with magnetic
+   sublevels. the strength array is allocated here and freed by the
+   caller. r->nsub is set to -1 if the record is not to be written. */
+static void IonizeRecordMSub(CIM_RECORD *r) {
+  double qku[MAXNUSR*MAXMSUB], e;
+  int nq, ie;
+
+  r->strength = NULL;
+  nq = IonizeStrengthMSub(qku, &e, r->b, r->f);
+  if (nq < 0) {
+    r->nsub = -1;
+    return;
+  }
+  r->nsub = nq;
+  r->strength = (float *) malloc(sizeof(float)*nq*n_usr);
+  for (ie = 0; ie < nq*n_usr; ie++) {
+    r->strength[ie] = qku[ie];
+  }
+}
+
+/* the pairs of a CI block with magnetic sublevels, see PairBlock */
+typedef struct _CIM_BLOCK_ {
+  int *b, *f;
+  CIM_RECORD *rb;
+} CIM_BLOCK;
+
+static int CIMBlockPair(int n, int i, int j, void *p) {
+  CIM_BLOCK *cb;
+
+  cb = (CIM_BLOCK *) p;
+  cb->rb[n].b = cb->b[i];
+  cb->rb[n].f = cb->f[j];
+  return 1;
+}
+
+static void CIMBlockRecord(int k, void *p) {
+  CIM_BLOCK *cb;
+
+  cb = (CIM_BLOCK *) p;
+  IonizeRecordMSub(cb->rb+k);
+}
+
 int SaveIonizationMSub(int nb, int *b, int nf, int *f, char *fn) {
-  FILE *file;
+  TFILE *file;
   LEVEL *lev1, *lev2;
-  CIM_RECORD r;
+  CIM_RECORD *rb;
+  CIM_BLOCK cb;
   CIM_HEADER ci_hdr;
   F_HEADER fhdr;
-  double qku[MAXNUSR*MAXMSUB];
   double delta, emin, emax, e, emax0;
-  int nq, i, j, k, ie;
+  int i, j, k, m;
 
   emin = 1E10;
   emax = 1E-10;
@@ -1607,24 +1764,28 @@ int SaveIonizationMSub(int nb, int *b, int nf, int *f, char *fn) {
   ci_hdr.usr_egrid = usr_egrid;
   InitFile(file, &fhdr, &ci_hdr);
   
-  for (i = 0; i < nb; i++) {
-    lev1 = GetLevel(b[i]);
-    for (j = 0; j < nf; j++) {
-      lev2 = GetLevel(f[j]);
-      e = lev2->energy - lev1->energy;
-      nq = IonizeStrengthMSub(qku, &e, b[i], f[j]);
-      if (nq < 0) continue;
-      r.b = b[i];
-      r.f = f[j];
-      r.nsub = nq;
-      r.strength = (float *) malloc(sizeof(float)*nq*n_usr);
-      for (ie = 0; ie < nq*n_usr; ie++) {
-	r.strength[ie] = qku[ie];
+  /* the continua and radial integrals of each pair are released after
+     every block, so the blocks are kept small. */
+  rb = (CIM_RECORD *) malloc(sizeof(CIM_RECORD)*NCIMBLOCK);
+  cb.b = b;
+  cb.f = f;
+  cb.rb = rb;
+  i = 0;
+  j = 0;
+  ci_block = 1;
+  while ((m = PairBlock(&i, &j, nb, nf, NCIMBLOCK, 
+			CIMBlockPair, &cb)) > 0) {
+    ParallelBlock(m, CIMBlockRecord, &cb);
+    for (k = 0; k < m; k++) {
+      if (rb[k].nsub >= 0) {
+	WriteCIMRecord(file, rb+k);
       }
-      WriteCIMRecord(file, &r);
-      free(r.strength);
+      if (rb[k].strength) free(rb[k].strength);
     }
+    ReinitRadial(1);
   }
+  ci_block = 0;
+  free(rb);
     
   DeinitFile(file, &fhdr);
   CloseFile(file, &fhdr);
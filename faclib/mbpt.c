@@ -708,8 +708,9 @@ int StructureMBPT0(char *fn, double de, double ccut, int n, int *s0, int kmax,
   double t0, t1, t2;
   int sr, nr;
   
-  sr = MyRankMPI();
-  nr = NProcMPI();
+  /* the configurations are split among the ranks, the threads of a 
+     rank work on the same ones */
+  sr = RankMPI(&nr);
   
   t0 = clock();
   t0 /= CLOCKS_PER_SEC;
@@ -950,7 +951,7 @@ int StructureMBPT0(char *fn, double de, double ccut, int n, int *s0, int kmax,
       }
     }
   }
-#if USE_MPI == 1
+#ifdef USE_MPIRANK
   if (nr > 1) {
     ncc1 = 0;
     for (p = 0; p < ccfg.dim; p++) {
@@ -1076,7 +1077,7 @@ void SolveRadialBasisMBPT(int nmax) {
     ORBITAL *orb;
     nb = 0;
     for (i = 0; i < n; i++) {
-#if USE_MPI == 1
+#ifdef USE_MPIRANK
       if (mbpt_nsplit) {
 	orb = GetOrbital(i);
 	if (orb->wfun != NULL) {
@@ -1090,8 +1091,9 @@ void SolveRadialBasisMBPT(int nmax) {
 	ib = IdxGet(&mbptjp.ibs, i);
 	if (ib < 0) continue;
       }	
-#elif USE_MPI == 2
-      if (SkipMPI()) continue;
+#endif
+#ifdef USE_OPENMP
+      if (SkipOMP()) continue;
 #endif
       orb = GetOrbitalSolved(i);
       nb++;
@@ -2355,7 +2357,7 @@ void DeltaH22M2(MBPT_EFF **meff, int ns,
 	    fm.j1 = -1;
 	    fm.j2 = -1;
 	    for (m1 = 0; m1 < mbptjp.nj; m1++) {
-	      if (SkipMPI()) continue;
+	      if (SkipMPICost(mbptjp.jp[m1+1]-mbptjp.jp[m1])) continue;
 	      for (im = mbptjp.jp[m1]; im < mbptjp.jp[m1+1]; im++) {
 		ik = im;
 		o = GetOrbital(ib1->d[im]);
@@ -2382,7 +2384,8 @@ void DeltaH22M2(MBPT_EFF **meff, int ns,
 	  fm.j2 = -1;
 	  for (m1 = 0; m1 < mbptjp.nj; m1++) {
 	    for (m2 = 0; m2 <= m1; m2++) {
-	      if (SkipMPI()) continue;
+	      if (SkipMPICost((mbptjp.jp[m1+1]-mbptjp.jp[m1])*
+			      (mbptjp.jp[m2+1]-mbptjp.jp[m2]))) continue;
 	      for (im = mbptjp.jp[m1]; im < mbptjp.jp[m1+1]; im++) {
 		o = GetOrbital(ib1->d[im]);
 		if (o->n > nmb || o->n > nmk) continue;
@@ -2500,7 +2503,7 @@ void DeltaH22M1(MBPT_EFF **meff, int ns,
 	      if (ph < 0) continue;
 	      fm.j1 = -1;
 	      for (ij = 0; ij < mbptjp.nj; ij++) {
-		if (SkipMPI()) continue;
+		if (SkipMPICost(mbptjp.jp[ij+1]-mbptjp.jp[ij])) continue;
 		for (ip = mbptjp.jp[ij]; ip < mbptjp.jp[ij+1]; ip++) {
 		  o[1] = GetOrbital(ib1->d[ip]);
 		  if (o[1]->n > nmb || o[1]->n > nmk) continue;
@@ -2715,7 +2718,7 @@ void DeltaH22M0(MBPT_EFF **meff, int ns,
 		    s[i].index = ns-s[i].index-1;
 		  }
 		  fm.j1 = -1;
-		  if (SkipMPI()) continue;
+		  if (SkipMPICost(1.0)) continue;
 		  H22Term(meff, c0, c1, ns, bra, ket, sbra, sket, 
 			  mst, bst, kst, s, ph,
 			  ks1, ks2, &fm, a, -(i1+1));
@@ -2794,7 +2797,7 @@ void DeltaH12M1(void *mptr, int ns,
 	  if (ph < 0) continue;
 	  fm.j1 = -1;
 	  for (ij = 0; ij < mbptjp.nj; ij++) {	  
-	    if (SkipMPI()) continue;
+	    if (SkipMPICost(mbptjp.jp[ij+1]-mbptjp.jp[ij])) continue;
 	    for (ik = mbptjp.jp[ij]; ik < mbptjp.jp[ij+1]; ik++) {
 	      o[1] = GetOrbital(ib1->d[ik]);
 	      if (o[1]->n > nmb || o[1]->n > nmk) continue;
@@ -2916,7 +2919,7 @@ void DeltaH12M0(void *mptr, int ns,
 		}
 	      }
 	      if (nmk <= 0) continue;
-	      if (SkipMPI()) continue;
+	      if (SkipMPICost(1.0)) continue;
 	      op[0] = ia;
 	      op[1] = im;
 	      op[2] = id;
@@ -3031,7 +3034,7 @@ void DeltaH11M1(void *mptr, int ns,
       if (ph < 0) continue;
       fm.j1 = -1;
       for (ij = 0; ij < mbptjp.nj; ij++) {
-	if (SkipMPI()) continue;
+	if (SkipMPICost(mbptjp.jp[ij+1]-mbptjp.jp[ij])) continue;
 	for (ik = mbptjp.jp[ij]; ik < mbptjp.jp[ij+1]; ik++) {
 	  o1 = GetOrbital(ib1->d[ik]);
 	  if (o1->n > nmb || o1->n > nmk) continue;
@@ -3141,7 +3144,7 @@ void DeltaH11M0(void *mptr, int ns,
 	  }
 	  nmk = ib0s[ib];
 	  if (nmk <= 0) continue;
-	  if (SkipMPI()) continue;
+	  if (SkipMPICost(1.0)) continue;
 	  /* op contains the index for the creation operators */
 	  op[0] = ia;
 	  op[1] = im;
@@ -3353,6 +3356,7 @@ int StructureMBPT1(char *fn, char *fn1, int nkg, int *kg, int nk, int *nkm,
   int i, j, k, i0, i1, n0, n1, isym, ierr, nc, m, mks, *ks;
   int pp, jj, nmax, na, *ga, k0, k1, m0, m1, nmax1, mst;
   int p0, p1, j0, j1, j2, q0, q1, ms0, ms1, *bst, *kst, *bst0, *kst0;
+  int nr, nt;
   char tfn[1024];
   SYMMETRY *sym;
   STATE *st;
@@ -3374,6 +3378,10 @@ int StructureMBPT1(char *fn, char *fn1, int nkg, int *kg, int nk, int *nkm,
   ing2.n = ing2.m = 0;
   ierr = 0;
   n3 = mbpt_n3;
+  /* the ranks share out the work and reduce the results, the threads
+     of a rank share the radial caches and add to private copies. */
+  RankMPI(&nr);
+  ThreadMPI(&nt);
   if (nkg0 <= 0 || nkg0 > nkg) nkg0 = nkg;
 
   /* construct configurations in kg, determine the maximum n-value*/
@@ -3468,7 +3476,7 @@ int StructureMBPT1(char *fn, char *fn1, int nkg, int *kg, int nk, int *nkm,
 	}
 	mbpt_rij[i][j] = m;
 	m++;
-	if (m == NProcMPI()) m = 0;
+	if (m == nr) m = 0;
       }
     }
   }
@@ -3488,7 +3496,7 @@ int StructureMBPT1(char *fn, char *fn1, int nkg, int *kg, int nk, int *nkm,
 	i0 = bas[i] - mbptjp.ibs.m0;	
 	for (j = 0; j < nb; j++) {
 	  j0 = bas[j] - mbptjp.ibs.m0;
-	  if (mbpt_rij[i][j] == MyRankMPI()) {
+	  if (mbpt_rij[i][j] == RankMPI(NULL)) {
 	    if (mbptjp.ibs.i[i0] < 0) {
 	      mbptjp.ibs.i[i0] = -1-mbptjp.ibs.i[i0];
 	    }
@@ -3681,8 +3689,8 @@ int StructureMBPT1(char *fn, char *fn1, int nkg, int *kg, int nk, int *nkm,
     {
       MBPT_EFF *imeff[MAX_SYMMETRIES];
       int cpmeff = 0;
-#if USE_MPI == 2
-      if (NProcMPI() > 1) {
+#ifdef USE_OPENMP
+      if (nt > 1) {
 	cpmeff = 1;
       }
 #endif
@@ -3933,8 +3941,8 @@ int StructureMBPT1(char *fn, char *fn1, int nkg, int *kg, int nk, int *nkm,
 	continue;
       }
       heff = meff[isym]->heff;      
-#if USE_MPI == 1
-      if (NProcMPI() > 1) {
+#ifdef USE_MPIRANK
+      if (nr > 1) {
 	for (i = 0; i < meff[isym]->hsize; i++) {
 	  if (meff[isym]->hab1[i] != NULL) {
 	    MPI_Allreduce(MPI_IN_PLACE, meff[isym]->hab[i], nhab, MPI_DOUBLE,
@@ -4062,7 +4070,7 @@ int StructureMBPT1(char *fn, char *fn1, int nkg, int *kg, int nk, int *nkm,
       fflush(stdout);
     }
   }
-#if USE_MPI == 1
+#ifdef USE_MPIRANK
   MPI_Barrier(MPI_COMM_WORLD);
 #endif
   if (mbpt_tr.mktr > 0) {
@@ -4076,8 +4084,8 @@ int StructureMBPT1(char *fn, char *fn1, int nkg, int *kg, int nk, int *nkm,
     {
       MBPT_TR *imtr;
       int cpmtr = 0;
-#if USE_MPI == 2
-      if (NProcMPI() > 1) {
+#ifdef USE_OPENMP
+      if (nt > 1) {
 	cpmtr = 1;
       }
 #endif
@@ -4226,8 +4234,8 @@ int StructureMBPT1(char *fn, char *fn1, int nkg, int *kg, int nk, int *nkm,
 	mst = mtr[j].sym0->n_states * mtr[j].sym1[m]->n_states;
 	mst *= n * mbpt_tr.naw;	
 	if (mst > 0) {
-#if USE_MPI == 1
-	  if (NProcMPI() > 1) {
+#ifdef USE_MPIRANK
+	  if (nr > 1) {
 	    MPI_Allreduce(MPI_IN_PLACE, mtr[j].tma[m], mst,
 			  MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
 	    MPI_Allreduce(MPI_IN_PLACE, mtr[j].rma[m], mst,
@@ -4518,7 +4526,7 @@ void AdjustAngularZ(MBPT_TR *mtr) {
 
 void SaveTransitionMBPT(MBPT_TR *mtr) {
   char *fn;
-  FILE *f;
+  TFILE *f;
   LEVEL *lev1, *lev2;
   SYMMETRY *sym;
   STATE *st;
@@ -25,13 +25,156 @@
 static int _initialized = 0;
 static LOCK *_plock = NULL;
 static volatile long long _cwid = -1;
-static MPID mpi = {0, 1, 0};
+static MPID mpi = {0, 1, 0, 0, 1, 0, 1, 0};
 static double _tlock = 0, _tskip = 0;
 static long long _nlock = 0;
 #pragma omp threadprivate(mpi,_tlock,_tskip, _nlock)
 
-int SkipMPI() {
+#ifdef USE_OPENMP
+/* all threads walk the same sequence of work ids. the ids are claimed
+   in chunks from _cwid, the last claimed id, with one compare-and-swap
+   per chunk. the chunk size is SKIPCHUNK divided by the cost hint of
+   the task. the owner runs the ids of its chunk [lo, hi) as it reaches
+   them, announcing the current one in pos. a thread passing through
+   the chunk of a busy owner steals the upper half of what is left by
+   lowering hi under the owner's lock, and backs off if the owner has
+   already announced an id above the new hi. the owner only takes its
+   lock once it has reached hi, so that a steal in progress is settled
+   before it moves on (the THE protocol of Cilk). */
+#define SKIPCHUNK 32
+#define SKIPSTEAL 2
+
+typedef struct _SKIPQ_ {
+  long long lo, hi, pos;
+  LOCK lock;
+  char pad[64];
+} SKIPQ;
+
+static SKIPQ *_skipq = NULL;
+static long long _skipto = 0;
+#pragma omp threadprivate(_skipto)
+
+static void SetSkipQ(SKIPQ *q, long long lo, long long hi, long long pos) {
+  SetLockNT(&q->lock);
+  __atomic_store_n(&q->pos, pos, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&q->hi, hi, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&q->lo, lo, __ATOMIC_SEQ_CST);
+  ReleaseLock(&q->lock);
+}
+
+/* try to take the upper part of the chunk of p, from the id w on.
+   returns the first stolen id, or -1. */
+static long long StealSkipQ(SKIPQ *p, long long w) {
+  long long lo, hi, pos, mid;
+
+  SetLockNT(&p->lock);
+  lo = __atomic_load_n(&p->lo, __ATOMIC_SEQ_CST);
+  hi = __atomic_load_n(&p->hi, __ATOMIC_SEQ_CST);
+  pos = __atomic_load_n(&p->pos, __ATOMIC_SEQ_CST);
+  mid = -1;
+  if (lo >= 0 && w >= lo && w < hi) {
+    mid = (pos + 1 + hi)/2;
+    if (mid < w) mid = w;
+    if (hi - mid < SKIPSTEAL/2 || mid <= pos) {
+      mid = -1;
+    } else {
+      __atomic_store_n(&p->hi, mid, __ATOMIC_SEQ_CST);
+      pos = __atomic_load_n(&p->pos, __ATOMIC_SEQ_CST);
+      if (pos >= mid) {
+	__atomic_store_n(&p->hi, hi, __ATOMIC_SEQ_CST);
+	mid = -1;
+      }
+    }
+  }
+  ReleaseLock(&p->lock);
+  if (mid >= 0) {
+    SetSkipQ(_skipq+mpi.thread, mid, hi, mid-1);
+  }
+  return mid;
+}
+
+static int SkipQueue(double c) {
+  SKIPQ *q, *p;
+  long long w, lo, hi, pos, b;
+  int i, n;
+  double t0;
+
+  mpi.wid++;
+  w = mpi.wid;
+  q = _skipq + mpi.thread;
+  lo = __atomic_load_n(&q->lo, __ATOMIC_RELAXED);
+  if (lo >= 0) {
+    if (w < lo) return 1;
+    __atomic_store_n(&q->pos, w, __ATOMIC_SEQ_CST);
+    if (w < __atomic_load_n(&q->hi, __ATOMIC_SEQ_CST)) return 0;
+    SetLockNT(&q->lock);
+    hi = __atomic_load_n(&q->hi, __ATOMIC_SEQ_CST);
+    if (w >= hi) {
+      __atomic_store_n(&q->lo, -1, __ATOMIC_SEQ_CST);
+    }
+    ReleaseLock(&q->lock);
+    if (w < hi) return 0;
+  }
+  if (w < _skipto) return 1;
+
+  t0 = WallTime();
+  b = __atomic_load_n(&_cwid, __ATOMIC_SEQ_CST);
+  if (b < w) {
+    if (c <= 0) {
+      n = 1;
+    } else {
+      n = (int) (SKIPCHUNK/c);
+      if (n < 1) n = 1;
+      else if (n > SKIPCHUNK) n = SKIPCHUNK;
+    }
+    if (__atomic_compare_exchange_n(&_cwid, &b, w+n-1, 0,
+				    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+      SetSkipQ(q, w, w+n, w);
+      _tskip += WallTime()-t0;
+      return 0;
+    }
+  }
+  /* w is claimed, look for a busy chunk around it */
+  b++;
+  for (i = 0; i < mpi.nthread; i++) {
+    p = _skipq + i;
+    if (p == q) continue;
+    lo = __atomic_load_n(&p->lo, __ATOMIC_RELAXED);
+    if (lo < 0) continue;
+    hi = __atomic_load_n(&p->hi, __ATOMIC_RELAXED);
+    if (w >= hi) continue;
+    if (w < lo) {
+      if (lo < b) b = lo;
+      continue;
+    }
+    pos = __atomic_load_n(&p->pos, __ATOMIC_RELAXED);
+    if (pos < w) pos = w-1;
+    if (hi - pos > SKIPSTEAL) {
+      lo = StealSkipQ(p, w);
+      if (lo >= 0) {
+	_tskip += WallTime()-t0;
+	if (lo > w) return 1;
+	__atomic_store_n(&q->pos, w, __ATOMIC_SEQ_CST);
+	return 0;
+      }
+    }
+    if (hi < b) b = hi;
+  }
+  _skipto = b;
+  _tskip += WallTime()-t0;
+  return 1;
+}
+#endif
+
+/* c is the estimated cost of the task, in units of a cheap one such
+   as a Hamiltonian element between two small configurations. cheap 
+   tasks are handed out in larger chunks. c <= 0 means unknown, and 
+   the tasks are handed out one at a time. in the hybrid mode, the ids
+   are dealt to the ranks in turn, and the ids of a rank are queued to
+   its threads. */
+int SkipMPICost(double c) {
   int r = 0;
+  MultiQuiescent();
 #if USE_MPI == 1
   if (mpi.nproc > 1) {
     if (mpi.wid%mpi.nproc != mpi.myrank) {
@@ -42,30 +185,96 @@ int SkipMPI() {
   return r;
 #elif USE_MPI == 2
   if (mpi.nproc > 1) {
-    double t0 = WallTime();
-#pragma omp critical  
-    {
-      mpi.wid++;      
-      if (mpi.wid <= _cwid) r = 1;
-      else _cwid = mpi.wid;
+    r = SkipQueue(c);
+  }
+  return r;
+#elif USE_MPI == 3
+  if (mpi.nrank > 1) {
+    if (mpi.rwid%mpi.nrank != mpi.rank) {
+      r = 1;
     }
-    double t1 = WallTime();
-    _tskip += t1-t0;
+    mpi.rwid++;
+    if (r) return r;
+  }
+  if (mpi.nthread > 1) {
+    r = SkipQueue(c);
   }
   return r;
 #else
   return 0;
 #endif
 }
+
+int SkipMPI() {
+  return SkipMPICost(0.0);
+}
+
+/* split the work among the threads of a rank only, for loops whose
+   results every rank keeps, such as the rate tables. like SkipMPICost,
+   it marks a quiescent point of the CMulti tables, the caller must not
+   hold pointers into them across the call. */
+int SkipOMP() {
+  MultiQuiescent();
+#ifdef USE_OPENMP
+  if (mpi.nthread > 1) {
+    return SkipQueue(0.0);
+  }
+#endif
+  return 0;
+}
+
+/* 
+** the rate tables take their (i, j) pair loops, i < ni and j < nj, in
+** blocks. the records of a block are computed in parallel by 
+** ParallelBlock and then written out in the loop order, so the files 
+** do not depend on the threads. PairBlock resumes the loop at (*i, *j)
+** and calls add(n, i, j, arg) on each pair, which sets up the n-th 
+** record of the block and returns 1, or returns 0 to skip the pair. 
+** it returns the size of the block, at most nmax, and 0 once the loop
+** is done.
+*/
+int PairBlock(int *i, int *j, int ni, int nj, int nmax,
+	      int (*add)(int, int, int, void *), void *arg) {
+  int n;
+
+  n = 0;
+  for (; *i < ni; (*i)++) {
+    for (; *j < nj && n < nmax; (*j)++) {
+      n += add(n, *i, *j, arg);
+    }
+    if (*j < nj) break;
+    *j = 0;
+  }
+  return n;
+}
+
+/* call f(k, arg) for the n records of a block, shared out among the
+   threads of the rank with SkipOMP. each record starts at a quiescent
+   point of the CMulti tables, in the serial build as well. */
+void ParallelBlock(int n, void (*f)(int, void *), void *arg) {
+  int k;
+
+#pragma omp parallel default(shared) private(k)
+  {
+    for (k = 0; k < n; k++) {
+#ifdef USE_OPENMP
+      if (SkipOMP()) continue;
+#else
+      MultiQuiescent();
+#endif
+      f(k, arg);
+    }
+  }
+}
   
 void MPISeqBeg() {
-#if USE_MPI == 1
+#ifdef USE_MPIRANK
   if (MPIReady()) {
     int myrank;
     int k;
     MPI_Status s;
     
-    myrank = MPIRank(NULL);
+    myrank = RankMPI(NULL);
     if (myrank > 0) {
       k = -1;
       MPI_Recv(&k, 1, MPI_INT, myrank-1, myrank-1, MPI_COMM_WORLD, &s);
@@ -78,12 +287,12 @@ void MPISeqBeg() {
 }
 
 void MPISeqEnd() {
-#if USE_MPI == 1
+#ifdef USE_MPIRANK
   if (MPIReady()) {
     int myrank;
     int nproc;
     
-    myrank = MPIRank(&nproc);
+    myrank = RankMPI(&nproc);
     if (myrank < nproc-1) {
       MPI_Send(&myrank, 1, MPI_INT, myrank+1, myrank, MPI_COMM_WORLD);
     }
@@ -141,6 +350,16 @@ int NProcMPI() {
   return mpi.nproc;
 }
 
+int RankMPI(int *nr) {
+  if (nr) *nr = mpi.nrank;
+  return mpi.rank;
+}
+
+int ThreadMPI(int *nt) {
+  if (nt) *nt = mpi.nthread;
+  return mpi.thread;
+}
+
 long long WidMPI() {
   return mpi.wid;
 }
@@ -159,20 +378,45 @@ int MPIReady() {
 
 void InitializeMPI(int n) {
 #ifdef USE_MPI
+#if defined(USE_MPIRANK) || defined(USE_OPENMP)
+  int rank, nrank;
+#endif
   if (_initialized) {
     printf("MPI system already initialized\n");
     return;
   }
-#if USE_MPI == 1
-  MPI_Init(NULL, NULL);
-  MPI_Comm_rank(MPI_COMM_WORLD, &mpi.myrank);
-  MPI_Comm_size(MPI_COMM_WORLD, &mpi.nproc);
+#ifdef USE_MPIRANK
+  int k;
+  MPI_Initialized(&k);
+  if (!k) {
+#ifdef USE_OPENMP
+    /* only the master thread of a rank calls MPI */
+    MPI_Init_thread(NULL, NULL, MPI_THREAD_FUNNELED, &k);
+    if (k < MPI_THREAD_FUNNELED) {
+      printf("MPI thread support level too low: %d\n", k);
+    }
+#else
+    MPI_Init(NULL, NULL);
+#endif
+  }
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nrank);
   MPI_Initialized(&_initialized);
   if (!_initialized) {
     printf("cannot initialize MPI\n");
     exit(1);
   }
-#elif USE_MPI == 2
+  mpi.wid = 0;
+  mpi.myrank = rank;
+  mpi.nproc = nrank;
+  mpi.rank = rank;
+  mpi.nrank = nrank;
+#elif defined(USE_OPENMP)
+  rank = 0;
+  nrank = 1;
+#endif
+#ifdef USE_OPENMP
+  int i, nt, r0, np;
   if (n > 0) {
     int nm = omp_get_thread_limit();
     if (n > nm) {
@@ -186,13 +430,42 @@ void InitializeMPI(int n) {
 #pragma omp parallel
   {
     mpi.wid = 0;
-    mpi.myrank = omp_get_thread_num();
-    mpi.nproc = omp_get_num_threads();
+    mpi.rwid = 0;
+    mpi.rank = rank;
+    mpi.nrank = nrank;
+    mpi.thread = omp_get_thread_num();
+    mpi.nthread = omp_get_num_threads();
     _tlock = 0;
     _tskip = 0;
+    _skipto = 0;
+  }
+  /* the workers of rank r start after those of the lower ranks,
+     which need not have the same number of threads */
+  nt = mpi.nthread;
+  r0 = 0;
+  np = nt;
+#ifdef USE_MPIRANK
+  if (nrank > 1) {
+    MPI_Exscan(&nt, &r0, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) r0 = 0;
+    MPI_Allreduce(&nt, &np, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  }
+#endif
+#pragma omp parallel
+  {
+    mpi.myrank = r0 + mpi.thread;
+    mpi.nproc = np;
+  }
+  _skipq = (SKIPQ *) malloc(sizeof(SKIPQ)*nt);
+  for (i = 0; i < nt; i++) {
+    _skipq[i].lo = -1;
+    _skipq[i].hi = -1;
+    _skipq[i].pos = -1;
+    InitLock(&_skipq[i].lock);
   }
   _initialized = 1;
-  if (mpi.nproc == 1) {
+  InitMultiEpoch(nt);
+  if (nt == 1) {
     RemoveMultiLocks();
   }
 #endif
@@ -202,7 +475,7 @@ void InitializeMPI(int n) {
     free(_plock);
     _plock = NULL;
   }
-#if USE_MPI == 2
+#ifdef USE_OPENMP
   CopyPotentialOMP(1);
 #endif
 #endif
@@ -229,7 +502,7 @@ long long NumLock() {
 }
 
 void FinalizeMPI() {
-#if USE_MPI == 1
+#ifdef USE_MPIRANK
   MPI_Finalize();
 #endif
   if (_plock) {
@@ -240,7 +513,7 @@ void FinalizeMPI() {
 }
 
 void Abort(int r) {
-#if USE_MPI == 1
+#ifdef USE_MPIRANK
   MPI_Abort(MPI_COMM_WORLD, r);
 #else
   exit(r);
@@ -248,7 +521,7 @@ void Abort(int r) {
 }
 
 double WallTime() {
-#if USE_MPI == 2
+#ifdef USE_OPENMP
   return omp_get_wtime();
 #else
   return ((double)clock())/CLOCKS_PER_SEC;
@@ -273,8 +546,8 @@ BFILE *BFileOpen(char *fn, char *md, int nb) {
     }
     return bf;
   }
-#if USE_MPI == 1
-  bf->mr = MPIRank(&bf->nr);
+#ifdef USE_MPIRANK
+  bf->mr = RankMPI(&bf->nr);
   if (bf->mr == 0) {
     bf->f = fopen(fn, md);
     if (bf->f == NULL) bf->p = -1;
@@ -310,7 +583,7 @@ BFILE *BFileOpen(char *fn, char *md, int nb) {
 
 int BFileClose(BFILE *bf) {
   int r = 0;
-#if USE_MPI == 1
+#ifdef USE_MPIRANK
   if (bf == NULL) return 0;
   if (bf->nr <= 1) {
     r = fclose(bf->f);
@@ -329,7 +602,7 @@ int BFileClose(BFILE *bf) {
 }
 
 size_t BFileRead(void *ptr, size_t size, size_t nmemb, BFILE *bf) {
-#if USE_MPI == 1
+#ifdef USE_MPIRANK
   if (bf->nr <= 1) {
     return fread(ptr, size, nmemb, bf->f);
   }
@@ -388,7 +661,7 @@ size_t BFileRead(void *ptr, size_t size, size_t nmemb, BFILE *bf) {
 }
 
 char *BFileGetLine(char *s, int size1, BFILE *bf) {
-#if USE_MPI == 1
+#ifdef USE_MPIRANK
   if (bf->nr <= 1) {
     return fgets(s, size1, bf->f);
   }
@@ -423,7 +696,7 @@ char *BFileGetLine(char *s, int size1, BFILE *bf) {
 }
 
 void BFileRewind(BFILE *bf) {
-#if USE_MPI == 1
+#ifdef USE_MPIRANK
   if (bf->nr <= 1) {
     rewind(bf->f);
     return;
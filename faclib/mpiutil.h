@@ -33,10 +33,16 @@
 
 #define BUFLN 1024
 
+/* myrank and nproc count all workers. in the hybrid mode, rank and
+   thread are the MPI rank and the OpenMP thread within it, and the 
+   workers of a rank are numbered consecutively. */
 typedef struct _MPID_ {
   int myrank;
   int nproc;
   long long wid;
+  int rank, nrank;
+  int thread, nthread;
+  long long rwid;
 } MPID;
 
 typedef struct _BFILE_ {
@@ -48,12 +54,19 @@ typedef struct _BFILE_ {
 } BFILE;
 
 int SkipMPI();
+int SkipMPICost(double c);
+int SkipOMP();
+int PairBlock(int *i, int *j, int ni, int nj, int nmax,
+	      int (*add)(int, int, int, void *), void *arg);
+void ParallelBlock(int n, void (*f)(int, void *), void *arg);
 void MPISeqBeg();
 void MPISeqEnd();
 void MPrintf(int ir, char *format, ...);
 int MPIRank(int *np);
 int MyRankMPI();
 int NProcMPI();
+int RankMPI(int *nr);
+int ThreadMPI(int *nt);
 long long WidMPI();
 void SetWidMPI(long long w);
 double WallTime();
@@ -27,15 +27,19 @@ static char *rcsid="$Id$";
 USE (rcsid);
 #endif
 
-/* the following arrays provide storage space in the calculation */
-static double _veff[MAXRP];
-static double ABAND[4*MAXRP];
-static double _dwork[MAXRP];
-static double _dwork1[MAXRP];
-static double _dwork2[MAXRP];
-static double _dwork3[MAXRP];
-
-#pragma omp threadprivate(_veff, ABAND, _dwork, _dwork1, _dwork2, _dwork3)
+/* the following arrays provide storage space in the calculation.
+   they point into one block per thread, see OrbitalWorkspace */
+static double *_veff;
+static double *ABAND;
+static double *_dwork;
+static double *_dwork1;
+static double *_dwork2;
+static double *_dwork3;
+static int *_ipiv;
+static double *_wbuf = NULL;
+static int _nwork = 0;
+
+#pragma omp threadprivate(_veff, ABAND, _dwork, _dwork1, _dwork2, _dwork3, _ipiv, _wbuf, _nwork)
 
 static int max_iteration = 512;
 static double wave_zero = 1E-10;
@@ -141,6 +145,139 @@ static double Amplitude(double *p, double e, int kl, POTENTIAL *pot, int i1);
 static int Phase(double *p, POTENTIAL *pot, int i1, double p0);
 static int DiracSmall(ORBITAL *orb, POTENTIAL *pot, int i2);
 
+/* size the scratch arrays of the calling thread for n radial points. 
+   the block only grows, a smaller grid reuses the existing one. the
+   arrays are aligned like those of RadialWorkspace. */
+int OrbitalWorkspace(int n) {
+  double *p;
+  int *ip, m;
+
+  if (n <= _nwork) return 0;
+  m = (n+7)&~7;
+  if (posix_memalign((void **) &p, 64, sizeof(double)*9*m)) {
+    printf("cannot allocate orbital workspace for %d points\n", n);
+    return -1;
+  }
+  memset(p, 0, sizeof(double)*9*m);
+  ip = (int *) malloc(sizeof(int)*m);
+  if (ip == NULL) {
+    free(p);
+    printf("cannot allocate orbital workspace for %d points\n", n);
+    return -1;
+  }
+  if (_ipiv) free(_ipiv);
+  _ipiv = ip;
+  if (_wbuf) free(_wbuf);
+  _wbuf = p;
+  _veff = p;
+  p += m;
+  ABAND = p;
+  p += 4*m;
+  _dwork = p;
+  p += m;
+  _dwork1 = p;
+  p += m;
+  _dwork2 = p;
+  p += m;
+  _dwork3 = p;
+  _nwork = n;
+  return 0;
+}
+
+#define NPOTARRAYS 20
+/* point the arrays of the potential into the block p of n points each,
+   Z comes first and owns the block. */
+static void PotentialArrays(POTENTIAL *pot, double *p, int n) {
+  pot->Z = p;
+  p += n;
+  pot->dZ = p;
+  p += n;
+  pot->dZ2 = p;
+  p += n;
+  pot->rad = p;
+  p += n;
+  pot->mqrho = p;
+  p += n;
+  pot->dr_drho = p;
+  p += n;
+  pot->dr_drho2 = p;
+  p += n;
+  pot->Vc = p;
+  p += n;
+  pot->dVc = p;
+  p += n;
+  pot->dVc2 = p;
+  p += n;
+  pot->qdist = p;
+  p += n;
+  pot->U = p;
+  p += n;
+  pot->dU = p;
+  p += n;
+  pot->dU2 = p;
+  p += n;
+  pot->W = p;
+  p += n;
+  pot->dW = p;
+  p += n;
+  pot->dW2 = p;
+  p += n;
+  pot->ZVP = p;
+  p += n;
+  pot->dZVP = p;
+  p += n;
+  pot->dZVP2 = p;
+  pot->nrp = n;
+}
+
+/* size the arrays of the potential for n radial points. the block
+   only grows, the points already set are kept. a new potential must
+   have nrp = 0 and Z = NULL. */
+int AllocPotential(POTENTIAL *pot, int n) {
+  double *p, *p0;
+  int i, n0;
+
+  if (n <= pot->nrp) return 0;
+  p = (double *) calloc(NPOTARRAYS*n, sizeof(double));
+  if (p == NULL) {
+    printf("cannot allocate potential for %d points\n", n);
+    return -1;
+  }
+  p0 = pot->Z;
+  n0 = pot->nrp;
+  if (p0) {
+    for (i = 0; i < NPOTARRAYS; i++) {
+      memcpy(p+i*n, p0+i*n0, sizeof(double)*n0);
+    }
+    free(p0);
+  }
+  PotentialArrays(pot, p, n);
+  return 0;
+}
+
+/* copy src into dst, which keeps its own arrays */
+int CopyPotential(POTENTIAL *dst, POTENTIAL *src) {
+  double *p;
+  int i, n;
+
+  if (dst == src) return 0;
+  if (AllocPotential(dst, src->maxrp) < 0) return -1;
+  p = dst->Z;
+  n = dst->nrp;
+  memcpy(dst, src, sizeof(POTENTIAL));
+  if (p == NULL) {
+    dst->Z = NULL;
+    dst->nrp = 0;
+    return 0;
+  }
+  PotentialArrays(dst, p, n);
+  if (src->Z == NULL) return 0;
+  for (i = 0; i < NPOTARRAYS; i++) {
+    memcpy(p+i*n, src->Z+i*src->nrp, sizeof(double)*src->maxrp);
+  }
+  return 0;
+}
+
 double EneTol(double e) {
   e = fabs(e);
   double d0 = e*ENERELERR;
@@ -1937,7 +2074,6 @@ static int IntegrateRadial(double *p, double e, POTENTIAL *pot,
   double a, b, r, x, y, z, p0, a1, a2;
   int kl=1, ku=1, nrhs=1;
   int i, info, n, m, j, k;
-  int ipiv[MAXRP];
   
   m = i2 - i1 - 1;
   if (m < 0) return 0;
@@ -2027,7 +2163,7 @@ static int IntegrateRadial(double *p, double e, POTENTIAL *pot,
     p[i1+1] += -a1*p1;
   }
 
-  DGBSV(m, kl, ku, nrhs, ABAND, n, ipiv, p+i1+1, m, &info);
+  DGBSV(m, kl, ku, nrhs, ABAND, n, _ipiv, p+i1+1, m, &info);
   if (info) {
     printf("Error in Integrating the radial equation: %d\n", info);
     exit(1);
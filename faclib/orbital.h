@@ -29,32 +29,33 @@ typedef struct _POTENTIAL_ {
   int flag;
   int r_core;
   int maxrp;
+  int nrp; /* points allocated for the arrays */
   int nmax;
   double hxs, ratio, asymp, rmin;
-  double Z[MAXRP]; /*effective atomic number*/
-  double dZ[MAXRP], dZ2[MAXRP];
+  double *Z; /*effective atomic number*/
+  double *dZ, *dZ2;
   double N; /*number of electrons*/
   double lambda, a; /* parameter for the Vc */
   double ar, br; /* parameter for the transformation */
   int ib, nb, ib1;
   double bqp, rb; /* boundary condition */
-  double rad[MAXRP];
-  double mqrho[MAXRP];
-  double dr_drho[MAXRP];
-  double dr_drho2[MAXRP];
-  double Vc[MAXRP];
-  double dVc[MAXRP];
-  double dVc2[MAXRP];
-  double qdist[MAXRP];
-  double U[MAXRP];
-  double dU[MAXRP];
-  double dU2[MAXRP];
-  double W[MAXRP];
-  double dW[MAXRP];
-  double dW2[MAXRP];
-  double ZVP[MAXRP];
-  double dZVP[MAXRP];
-  double dZVP2[MAXRP];
+  double *rad;
+  double *mqrho;
+  double *dr_drho;
+  double *dr_drho2;
+  double *Vc;
+  double *dVc;
+  double *dVc2;
+  double *qdist;
+  double *U;
+  double *dU;
+  double *dU2;
+  double *W;
+  double *dW;
+  double *dW2;
+  double *ZVP;
+  double *dZVP;
+  double *dZVP2;
   NUCLEUS *atom;
 } POTENTIAL;
 
@@ -67,12 +68,16 @@ typedef struct _ORBITAL_ {
   double *wfun;
   double bqp0, bqp1;
   int ilast, im, idx;
+  int inext, solved;
   struct _ORBITAL_ *horb;
 } ORBITAL;
 
 double *GetVEffective(void);
 double RadialDiracCoulomb(int npts, double *p, double *q, double *r,
 			  double z, int n, int kappa);
+int OrbitalWorkspace(int n);
+int AllocPotential(POTENTIAL *pot, int n);
+int CopyPotential(POTENTIAL *dst, POTENTIAL *src);
 int RadialSolver(ORBITAL *orb,  POTENTIAL *pot);
 int RadialBasis(ORBITAL *orb, POTENTIAL *pot);
 int RadialBasisOuter(ORBITAL *orb, POTENTIAL *pot);
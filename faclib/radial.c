@@ -20,6 +20,12 @@
 #include "mpiutil.h"
 #include "cf77.h"
 #include <errno.h>
+#include <fcntl.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RADIAL_SIMD_X86 1
+#include <immintrin.h>
+#endif
 
 static char *rcsid="$Id$";
 #if __GNUC__ == 2
@@ -41,29 +47,44 @@ static POTENTIAL *hpotential;
 static ARRAY *orbitals;
 static int n_orbitals;
 static int n_continua;
+
+/* the orbitals are indexed by (n, kappa) for the bound ones, and by
+   (kappa, energy) for the continua, with the energy binned in steps of
+   ORBEBIN. the chains run through the inext of the orbitals. the index
+   covers the first n_indexed orbitals, and is brought up to date under
+   the orbital lock. lookups walk the chains without locking. */
+#define ORBHASHSIZE 4096
+#define ORBEBIN 1E-8
+static int orb_hash[ORBHASHSIZE];
+static int n_indexed;
  
-static double _dwork[MAXRP];
-static double _dwork1[MAXRP];
-static double _dwork2[MAXRP];
-static double _dwork3[MAXRP];
-static double _dwork4[MAXRP];
-static double _dwork5[MAXRP];
-static double _dwork6[MAXRP];
-static double _dwork7[MAXRP];
-static double _dwork8[MAXRP];
-static double _dwork9[MAXRP];
-static double _dwork10[MAXRP];
-static double _dwork11[MAXRP];
-static double _dwork12[MAXRP];
-static double _dwork13[MAXRP];
-static double _phase[MAXRP];
-static double _dphase[MAXRP];
-static double _dphasep[MAXRP];
-static double _yk[MAXRP];
-static double _zk[MAXRP];
-static double _xk[MAXRP];
-
-#pragma omp threadprivate(potential,hpotential,_dwork,_dwork1,_dwork2,_dwork3,_dwork4,_dwork5,_dwork6,_dwork7,_dwork8,_dwork9,_dwork10,_dwork11,_dwork12,_dwork13,_phase,_dphase,_dphasep,_yk,_zk,_xk)
+/* per-thread scratch arrays, carved out of one block sized to the
+   radial grid, see RadialWorkspace */
+static double *_dwork;
+static double *_dwork1;
+static double *_dwork2;
+static double *_dwork3;
+static double *_dwork4;
+static double *_dwork5;
+static double *_dwork6;
+static double *_dwork7;
+static double *_dwork8;
+static double *_dwork9;
+static double *_dwork10;
+static double *_dwork11;
+static double *_dwork12;
+static double *_dwork13;
+static double *_phase;
+static double *_dphase;
+static double *_dphasep;
+static double *_yk;
+static double *_zk;
+static double *_xk;
+#define NRWORK 20
+static double *_wbuf = NULL;
+static int _nwork = 0;
+
+#pragma omp threadprivate(potential,hpotential,_dwork,_dwork1,_dwork2,_dwork3,_dwork4,_dwork5,_dwork6,_dwork7,_dwork8,_dwork9,_dwork10,_dwork11,_dwork12,_dwork13,_phase,_dphase,_dphasep,_yk,_zk,_xk,_wbuf,_nwork)
 
 static struct {
   double stabilizer;
@@ -113,10 +134,21 @@ static MULTI *moments_array;
 static MULTI *gos_array;
 static MULTI *yk_array;
 
+static struct {
+  void (*f)(int, double *, double *, double *, double *,
+	    int, double *, double *, double *);
+  int mode;
+  int check;
+  long nchk;
+  long nbad;
+  double dmax;
+} _rprod = {NULL, 0, 0, 0, 0, 0.0};
+
 static int n_awgrid = 0;
 static double awgrid[MAXNTE];
 
 static double PhaseRDependent(double x, double eta, double b);
+static double *RkTable(int k);
 
 #ifdef PERFORM_STATISTICS
 static RAD_TIMING rad_timing = {0, 0, 0, 0};
@@ -141,6 +173,10 @@ int RestorePotential(char *fn, POTENTIAL *p) {
   n = BFileRead(&p->r_core, sizeof(int), 1, f);
   n = BFileRead(&p->nmax, sizeof(int), 1, f);
   n = BFileRead(&p->maxrp, sizeof(int), 1, f);
+  if (AllocPotential(p, p->maxrp) < 0) {
+    BFileClose(f);
+    return -1;
+  }
   n = BFileRead(&p->hxs, sizeof(double), 1, f);
   n = BFileRead(&p->ratio, sizeof(double), 1, f);
   n = BFileRead(&p->asymp, sizeof(double), 1, f);
@@ -175,7 +211,7 @@ int RestorePotential(char *fn, POTENTIAL *p) {
   n = BFileRead(p->ZVP, sizeof(double), p->maxrp, f);
   n = BFileRead(p->dZVP, sizeof(double), p->maxrp, f);
   n = BFileRead(p->dZVP2, sizeof(double), p->maxrp, f);
-  for (i = p->maxrp; i < MAXRP; i++) {
+  for (i = p->maxrp; i < p->nrp; i++) {
     p->Z[i] = 0;
     p->dZ[i] = 0;
     p->dZ2[i] = 0;
@@ -207,7 +243,7 @@ int RestorePotential(char *fn, POTENTIAL *p) {
 
 void SetHydrogenicPotential(POTENTIAL *h, POTENTIAL *p) {
   int i;
-  memcpy(h, p, sizeof(POTENTIAL));
+  CopyPotential(h, p);
   h->N = 1;
   h->a = 0;
   h->lambda = 0;
@@ -339,7 +375,11 @@ static void InitOrbitalData(void *p, int n) {
   
   d = (ORBITAL *) p;
   for (i = 0; i < n; i++) {
+    d[i].n = 0;
+    d[i].kappa = 0;
     d[i].wfun = NULL;
+    d[i].solved = 0;
+    d[i].inext = -1;
     d[i].phase = NULL;
     d[i].ilast = -1;
     d[i].im = -1;
@@ -422,6 +462,385 @@ int FreeYkArray(void) {
   return 0;
 }
   
+/* 
+** the radial integral cache file starts with a header tagged by the
+** fingerprint of the potential, radial grid, and Breit and QED 
+** options, followed by the table of orbitals referred to, the 
+** multipole frequency grid, and the records of each cached array. 
+** the multipoles carry the gauge in their keys.
+** the orbital indices depend on the order in which the orbitals are
+** created in each job, they are translated when the file is loaded.
+** records involving continuum orbitals are not saved.
+*/
+#define RCACHE_MAGIC 0x52434146
+#define RCACHE_VERSION 2
+#define RCACHE_NARRAYS 5
+
+typedef struct _RCACHE_HEADER_ {
+  int magic, version;
+  unsigned long long fp;
+  int norb, naw, narr;
+} RCACHE_HEADER;
+
+typedef struct _RCACHE_ARRAY_ {
+  int id, ndim, nv, nrec;
+} RCACHE_ARRAY;
+
+typedef struct _RCACHE_WALK_ {
+  FILE *f;
+  int ndim, o0, o1, nv, nrec, err;
+} RCACHE_WALK;
+
+/* 
+** the cached arrays, the range of index dimensions holding orbitals,
+** and the number of doubles per element, 0 for the multipole arrays
+** which hold n_awgrid values through a pointer.
+*/
+static MULTI *RadialCacheArray(int id, int *o0, int *o1, int *nv) {
+  *nv = 1;
+  switch (id) {
+  case 0:
+    *o0 = 0;
+    *o1 = 3;
+    return slater_array;
+  case 1:
+    *o0 = 0;
+    *o1 = 3;
+    return breit_array;
+  case 2:
+    *o0 = 1;
+    *o1 = 2;
+    *nv = 0;
+    return multipole_array;
+  case 3:
+    *o0 = 1;
+    *o1 = 2;
+    return moments_array;
+  case 4:
+    *o0 = 0;
+    *o1 = 1;
+    return residual_array;
+  default:
+    return NULL;
+  }
+}
+
+static unsigned long long HashBytes(unsigned long long h, void *p, int n) {
+  unsigned char *c;
+  int i;
+
+  c = (unsigned char *) p;
+  for (i = 0; i < n; i++) {
+    h ^= c[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+/* FNV-1a hash of the potential and the radial grid */
+unsigned long long PotentialFingerprint(POTENTIAL *p) {
+  unsigned long long h;
+  int n;
+
+  h = 0xcbf29ce484222325ULL;
+  h = HashBytes(h, &p->mode, sizeof(int));
+  h = HashBytes(h, &p->flag, sizeof(int));
+  h = HashBytes(h, &p->maxrp, sizeof(int));
+  h = HashBytes(h, &p->hxs, sizeof(double));
+  h = HashBytes(h, &p->ratio, sizeof(double));
+  h = HashBytes(h, &p->asymp, sizeof(double));
+  h = HashBytes(h, &p->rmin, sizeof(double));
+  h = HashBytes(h, &p->N, sizeof(double));
+  h = HashBytes(h, &p->lambda, sizeof(double));
+  h = HashBytes(h, &p->a, sizeof(double));
+  h = HashBytes(h, &p->ib, sizeof(int));
+  h = HashBytes(h, &p->nb, sizeof(int));
+  h = HashBytes(h, &p->ib1, sizeof(int));
+  h = HashBytes(h, &p->bqp, sizeof(double));
+  h = HashBytes(h, &p->rb, sizeof(double));
+  n = sizeof(double)*p->maxrp;
+  h = HashBytes(h, p->rad, n);
+  h = HashBytes(h, p->dr_drho, n);
+  h = HashBytes(h, p->Z, n);
+  h = HashBytes(h, p->Vc, n);
+  h = HashBytes(h, p->U, n);
+  h = HashBytes(h, p->ZVP, n);
+  return h;
+}
+
+/* the Breit and QED options enter the cached integrals but not their
+   keys, they are part of the cache tag along with the potential. */
+static unsigned long long RadialCacheFingerprint(void) {
+  unsigned long long h;
+
+  h = PotentialFingerprint(potential);
+  h = HashBytes(h, &qed.se, sizeof(int));
+  h = HashBytes(h, &qed.mse, sizeof(int));
+  h = HashBytes(h, &qed.sse, sizeof(int));
+  h = HashBytes(h, &qed.pse, sizeof(int));
+  h = HashBytes(h, &qed.vp, sizeof(int));
+  h = HashBytes(h, &qed.nms, sizeof(int));
+  h = HashBytes(h, &qed.sms, sizeof(int));
+  h = HashBytes(h, &qed.br, sizeof(int));
+  h = HashBytes(h, &qed.mbr, sizeof(int));
+  h = HashBytes(h, &qed.nbr, sizeof(int));
+  h = HashBytes(h, &qed.xbr, sizeof(double));
+  return h;
+}
+
+static int WalkRadialCache(int *k, void *d, void *arg) {
+  RCACHE_WALK *w;
+  ORBITAL *orb;
+  double *v;
+  int i;
+
+  w = (RCACHE_WALK *) arg;
+  if (w->nv == 0) {
+    v = *((double **) d);
+    if (v == NULL) return 0;
+  } else {
+    v = (double *) d;
+    if (*v == 0) return 0;
+  }
+  for (i = w->o0; i <= w->o1; i++) {
+    if (k[i] < 0 || k[i] >= n_orbitals) return 0;
+    orb = GetOrbital(k[i]);
+    if (orb->n == 0) return 0;
+  }
+  i = w->nv?w->nv:n_awgrid;
+  if (fwrite(k, sizeof(int), w->ndim, w->f) != (size_t) w->ndim ||
+      fwrite(v, sizeof(double), i, w->f) != (size_t) i) {
+    w->err = 1;
+    return -1;
+  }
+  w->nrec++;
+  return 0;
+}
+
+/* 
+** write the radial integral arrays to fn. a short write leaves no 
+** file behind, LoadRadialCache would otherwise trust a truncated one.
+*/
+int SaveRadialCache(char *fn) {
+  FILE *f;
+  RCACHE_HEADER h;
+  RCACHE_ARRAY a;
+  RCACHE_WALK w;
+  ORBITAL *orb;
+  MULTI *ma;
+  long p0, p1;
+  int i;
+
+  if (MyRankMPI() != 0) return 0;
+  
+  f = fopen(fn, "w");
+  if (f == NULL) {
+    MPrintf(0, "cannot open radial cache file: %s\n", fn);
+    return -1;
+  }
+  h.magic = RCACHE_MAGIC;
+  h.version = RCACHE_VERSION;
+  h.fp = RadialCacheFingerprint();
+  h.norb = n_orbitals;
+  h.naw = n_awgrid;
+  h.narr = RCACHE_NARRAYS;
+  if (fwrite(&h, sizeof(RCACHE_HEADER), 1, f) != 1) goto ERROR;
+  for (i = 0; i < n_orbitals; i++) {
+    orb = GetOrbital(i);
+    if (fwrite(&orb->n, sizeof(int), 1, f) != 1) goto ERROR;
+    if (fwrite(&orb->kappa, sizeof(int), 1, f) != 1) goto ERROR;
+    if (fwrite(&orb->energy, sizeof(double), 1, f) != 1) goto ERROR;
+  }
+  if (fwrite(awgrid, sizeof(double), n_awgrid, f) != (size_t) n_awgrid) {
+    goto ERROR;
+  }
+  for (i = 0; i < RCACHE_NARRAYS; i++) {
+    ma = RadialCacheArray(i, &w.o0, &w.o1, &w.nv);
+    a.id = i;
+    a.ndim = ma->ndim;
+    a.nv = w.nv?w.nv:n_awgrid;
+    a.nrec = 0;
+    p0 = ftell(f);
+    if (fwrite(&a, sizeof(RCACHE_ARRAY), 1, f) != 1) goto ERROR;
+    w.f = f;
+    w.ndim = ma->ndim;
+    w.nrec = 0;
+    w.err = 0;
+    if (MultiWalk(ma, WalkRadialCache, &w) < 0) {
+      MPrintf(0, "radial cache not supported by the MULTI array\n");
+      fclose(f);
+      unlink(fn);
+      return -1;
+    }
+    if (w.err) goto ERROR;
+    a.nrec = w.nrec;
+    p1 = ftell(f);
+    if (p0 < 0 || p1 < 0 || fseek(f, p0, SEEK_SET) != 0) goto ERROR;
+    if (fwrite(&a, sizeof(RCACHE_ARRAY), 1, f) != 1) goto ERROR;
+    if (fseek(f, p1, SEEK_SET) != 0) goto ERROR;
+  }
+  if (fclose(f) != 0) {
+    f = NULL;
+    goto ERROR;
+  }
+  return 0;
+
+ ERROR:
+  MPrintf(0, "cannot write radial cache file: %s\n", fn);
+  if (f) fclose(f);
+  unlink(fn);
+  return -1;
+}
+
+/*
+** warm start the radial integral arrays from a cache file saved by a
+** previous job with the same potential and options. the file is 
+** mapped into memory and the records are copied into the arrays, 
+** existing values are kept. the multipole records are only loaded if their frequency grid
+** is the current one, or the multipole array is empty, in which case 
+** the grid is taken from the file. returns the number of records 
+** loaded, or -1 if the file does not match the current potential
+** or options.
+*/
+int LoadRadialCache(char *fn) {
+  int fd, i, j, m, n, o0, o1, nv, *om, *k;
+  int idx[5];
+  struct stat st;
+  char *b, *c, *e;
+  RCACHE_HEADER h;
+  RCACHE_ARRAY a;
+  MULTI *ma;
+  double *p, **pp;
+  int on, okappa, skip;
+  double oe, aw[MAXNTE];
+
+  fd = open(fn, O_RDONLY);
+  if (fd < 0) {
+    MPrintf(0, "cannot open radial cache file: %s\n", fn);
+    return -1;
+  }
+  if (fstat(fd, &st) < 0 || st.st_size < (long) sizeof(RCACHE_HEADER)) {
+    close(fd);
+    return -1;
+  }
+  b = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (b == MAP_FAILED) {
+    MPrintf(0, "cannot map radial cache file: %s\n", fn);
+    return -1;
+  }
+  e = b + st.st_size;
+  memcpy(&h, b, sizeof(RCACHE_HEADER));
+  c = b + sizeof(RCACHE_HEADER);
+  if (h.magic != RCACHE_MAGIC || h.version != RCACHE_VERSION) {
+    MPrintf(0, "invalid radial cache file: %s\n", fn);
+    munmap(b, st.st_size);
+    return -1;
+  }
+  if (h.fp != RadialCacheFingerprint()) {
+    MPrintf(0, "radial cache %s does not match the potential or options\n",
+	    fn);
+    munmap(b, st.st_size);
+    return -1;
+  }
+  m = 2*sizeof(int) + sizeof(double);
+  if (h.naw < 1 || h.naw > MAXNTE ||
+      c + ((long) h.norb)*m + sizeof(double)*h.naw > e) {
+    munmap(b, st.st_size);
+    return -1;
+  }
+  om = (int *) malloc(sizeof(int)*(h.norb+1));
+  for (i = 0; i < h.norb; i++) {
+    memcpy(&on, c, sizeof(int));
+    memcpy(&okappa, c+sizeof(int), sizeof(int));
+    memcpy(&oe, c+2*sizeof(int), sizeof(double));
+    c += m;
+    if (on == 0) {
+      om[i] = -1;
+    } else {
+      om[i] = OrbitalIndex(on, okappa, oe);
+    }
+  }
+  memcpy(aw, c, sizeof(double)*h.naw);
+  c += sizeof(double)*h.naw;
+  if (h.naw == n_awgrid) {
+    for (i = 0; i < h.naw; i++) {
+      if (aw[i] != awgrid[i]) break;
+    }
+  } else {
+    i = 0;
+  }
+  skip = 0;
+  if (i < h.naw) {
+    if (multipole_array->numelem > 0) {
+      skip = 1;
+    } else {
+      n_awgrid = h.naw;
+      for (i = 0; i < h.naw; i++) awgrid[i] = aw[i];
+    }
+  }
+  n = 0;
+  for (i = 0; i < h.narr && c + sizeof(RCACHE_ARRAY) <= e; i++) {
+    memcpy(&a, c, sizeof(RCACHE_ARRAY));
+    c += sizeof(RCACHE_ARRAY);
+    m = sizeof(int)*a.ndim + sizeof(double)*a.nv;
+    if (c + ((long) a.nrec)*m > e) break;
+    ma = RadialCacheArray(a.id, &o0, &o1, &nv);
+    if (ma == NULL || a.ndim != ma->ndim || a.ndim > 5 ||
+	a.nv != (nv?nv:n_awgrid) || (nv == 0 && skip)) {
+      c += ((long) a.nrec)*m;
+      continue;
+    }
+    for (; a.nrec > 0; a.nrec--, c += m) {
+      memcpy(idx, c, sizeof(int)*a.ndim);
+      for (j = o0; j <= o1; j++) {
+	if (idx[j] < 0 || idx[j] >= h.norb) break;
+	idx[j] = om[idx[j]];
+	if (idx[j] < 0) break;
+      }
+      if (j <= o1) continue;
+      k = idx;
+      switch (a.id) {
+      case 0:
+	SortSlaterKey(k);
+	break;
+      case 3:
+	if (k[1] > k[2]) {
+	  j = k[1];
+	  k[1] = k[2];
+	  k[2] = j;
+	}
+	break;
+      case 4:
+	if (k[0] > k[1]) {
+	  j = k[0];
+	  k[0] = k[1];
+	  k[1] = j;
+	}
+	break;
+      default:
+	break;
+      }
+      if (nv == 0) {
+	pp = (double **) MultiSet(ma, k, NULL, NULL,
+				  InitPointerData, FreeMultipole);
+	if (*pp) continue;
+	p = (double *) malloc(sizeof(double)*a.nv);
+	memcpy(p, c+sizeof(int)*a.ndim, sizeof(double)*a.nv);
+	*pp = p;
+      } else {
+	p = (double *) MultiSet(ma, k, NULL, NULL, InitDoubleData, NULL);
+	if (*p) continue;
+	memcpy(p, c+sizeof(int)*a.ndim, sizeof(double));
+      }
+      n++;
+    }
+  }
+  free(om);
+  munmap(b, st.st_size);
+  return n;
+}
+  
 double *WLarge(ORBITAL *orb) {
   return Large(orb);
 }
@@ -630,13 +1049,24 @@ void SetMS(int nms, int sms) {
   qed.sms = sms;
 }
 
+/* the multipole array is only freed when the grid actually changes */
 int SetAWGrid(int n, double awmin, double awmax) {
+  double a[MAXNTE];
   int i;
   if (awmin < 1E-3) {
     awmin = 1E-3;
     awmax = awmax + 1E-3;
   }
-  n_awgrid = SetTEGrid(awgrid, NULL, n, awmin, awmax);
+  n = SetTEGrid(a, NULL, n, awmin, awmax);
+  if (n == n_awgrid) {
+    for (i = 0; i < n; i++) {
+      if (a[i] != awgrid[i]) break;
+    }
+    if (i == n) return 0;
+  }
+  FreeMultipoleArray();
+  n_awgrid = n;
+  for (i = 0; i < n; i++) awgrid[i] = a[i];
 
   return 0;
 }
@@ -688,13 +1118,72 @@ void SetScreening(int n_screen, int *screened_n,
   optimize_control.screened_kl = kl;
 }
 
+/* size the scratch arrays of the calling thread, and those of the
+   orbital solver, for n radial points. the block only grows, so the
+   arrays stay valid when a smaller grid is set. each array starts on a
+   64 byte boundary, as the static arrays they replace did, so that the
+   vectorized loops over them are split the same way. */
+static int RadialWorkspace(int n) {
+  double *p;
+  int m;
+
+  if (n > _nwork) {
+    m = (n+7)&~7;
+    if (posix_memalign((void **) &p, 64, sizeof(double)*NRWORK*m)) {
+      printf("cannot allocate radial workspace for %d points\n", n);
+      return -1;
+    }
+    memset(p, 0, sizeof(double)*NRWORK*m);
+    if (_wbuf) free(_wbuf);
+    _wbuf = p;
+    _dwork = p;
+    p += m;
+    _dwork1 = p;
+    p += m;
+    _dwork2 = p;
+    p += m;
+    _dwork3 = p;
+    p += m;
+    _dwork4 = p;
+    p += m;
+    _dwork5 = p;
+    p += m;
+    _dwork6 = p;
+    p += m;
+    _dwork7 = p;
+    p += m;
+    _dwork8 = p;
+    p += m;
+    _dwork9 = p;
+    p += m;
+    _dwork10 = p;
+    p += m;
+    _dwork11 = p;
+    p += m;
+    _dwork12 = p;
+    p += m;
+    _dwork13 = p;
+    p += m;
+    _phase = p;
+    p += m;
+    _dphase = p;
+    p += m;
+    _dphasep = p;
+    p += m;
+    _yk = p;
+    p += m;
+    _zk = p;
+    p += m;
+    _xk = p;
+    _nwork = n;
+  }
+  return OrbitalWorkspace(n);
+}
+
 int SetRadialGrid(int maxrp, double ratio, double asymp, double rmin) {
-  if (maxrp > MAXRP) {
-    printf("MAXRP must be <= %d\n", MAXRP);
-    printf("to enlarge the limit, change MAXRP in global.h\n");
-    return -1;
-  }
   if (maxrp < 0) maxrp = DMAXRP;
+  if (AllocPotential(potential, maxrp) < 0) return -1;
+  if (RadialWorkspace(maxrp) < 0) return -1;
   potential->maxrp = maxrp;
   if (asymp < 0 && ratio < 0) {
     asymp = GRIDASYMP;
@@ -1137,27 +1626,29 @@ int OptimizeLoop(AVERAGE_CONFIG *acfg) {
 }
 
 void CopyPotentialOMP(int init) {
-#if USE_MPI == 2
+  RadialWorkspace(potential->maxrp);
+#ifdef USE_OPENMP
   if (!MPIReady()) {
     InitializeMPI(0);
     return;
   }
-  POTENTIAL pot;
-  memcpy(&pot, potential, sizeof(POTENTIAL));
+  POTENTIAL *pot;
+  pot = potential;
 #pragma omp parallel shared(pot)
   {
-    if (init && MyRankMPI() != 0) {
-      potential = malloc(sizeof(POTENTIAL));
+    if (init && ThreadMPI(NULL) != 0) {
+      potential = calloc(1, sizeof(POTENTIAL));
     }
-    memcpy(potential, &pot, sizeof(POTENTIAL));    
+    CopyPotential(potential, pot);
+    RadialWorkspace(pot->maxrp);
   }
-  memcpy(&pot, hpotential, sizeof(POTENTIAL));
+  pot = hpotential;
 #pragma omp parallel shared(pot)
   {
-    if (init && MyRankMPI() != 0) {
-      hpotential = malloc(sizeof(POTENTIAL));
+    if (init && ThreadMPI(NULL) != 0) {
+      hpotential = calloc(1, sizeof(POTENTIAL));
     }
-    memcpy(hpotential, &pot, sizeof(POTENTIAL));    
+    CopyPotential(hpotential, pot);
   }
 #endif
 }
@@ -1367,12 +1858,15 @@ int SolveDirac(ORBITAL *orb) {
 
   err = 0;  
   potential->flag = -1;
+  __atomic_store_n(&(orb->solved), 0, __ATOMIC_RELAXED);
   err = RadialSolver(orb, potential);
   if (err) { 
     printf("Error ocuured in RadialSolver, %d\n", err);
     printf("%d %d %10.3E\n", orb->n, orb->kappa, orb->energy);
     exit(1);
   }
+  /* lookups without the lock take the orbital as solved only now */
+  __atomic_store_n(&(orb->solved), orb->wfun != NULL, __ATOMIC_RELEASE);
 #ifdef PERFORM_STATISTICS
   stop = clock();
   rad_timing.dirac += stop - start;
@@ -1494,7 +1988,7 @@ double PhaseRDependent(double x, double eta, double b) {
 
 double GetPhaseShift(int k) {
   ORBITAL *orb;
-  double phase1, r, y, z, ke, e, a, b1;
+  double phase1, r, y, z, ke, e, a, b1, *ph;
   int i;
 
   orb = GetOrbitalSolved(k);
@@ -1518,8 +2012,10 @@ double GetPhaseShift(int k) {
   b1 = PhaseRDependent(a, y, b1);
   phase1 = phase1 - b1;
   
-  orb->phase = malloc(sizeof(double));
-  *(orb->phase) = phase1;
+  ph = malloc(sizeof(double));
+  *ph = phase1;
+#pragma omp flush
+  orb->phase = ph;
 
   return phase1;  
 }
@@ -1536,70 +2032,246 @@ int GetNumContinua(void) {
   return n_continua;
 }
 
-int OrbitalIndexNoLock(int n, int kappa, double energy) {
-  int i, j;
+/* the largest orbital angular momentum of the bound orbitals */
+int GetMaxBoundL(void) {
+  int i, kl, klmax;
   ORBITAL *orb;
-  int resolve_dirac;
 
-  resolve_dirac = 0;
+  klmax = 0;
   for (i = 0; i < n_orbitals; i++) {
     orb = GetOrbital(i);
-    if (n == 0) {
-      if (orb->n == 0 &&
-	  orb->kappa == kappa && 
-	  orb->energy > 0.0 &&
-	  fabs(orb->energy - energy) < EPS10) {
-	if (orb->wfun == NULL) {
-	  resolve_dirac = 1;
-	  break;
-	}
-	return i;
-      }
-    } else if (orb->n == n && orb->kappa == kappa) {
-      if (orb->wfun == NULL) {
-	resolve_dirac = 1;
-	break;
-      }
-      return i;
+    if (orb->n <= 0) continue;
+    kl = GetLFromKappa(orb->kappa)/2;
+    if (kl > klmax) klmax = kl;
+  }
+  return klmax;
+}
+
+static int OrbitalHash(int n, int kappa, long long b) {
+  unsigned long long h;
+
+  h = ((unsigned long long) b)*0x9E3779B97F4A7C15ULL;
+  h ^= ((unsigned long long) (n*1024 + kappa + 512))*0xC2B2AE3D27D4EB4FULL;
+  return (int) ((h >> 40) & (ORBHASHSIZE-1));
+}
+
+static long long OrbitalEBin(double e) {
+  return (long long) floor(e/ORBEBIN);
+}
+
+/* forget the index, it is rebuilt on the next lookup under the lock */
+static void ResetOrbitalIndex(void) {
+  int i;
+
+  for (i = 0; i < ORBHASHSIZE; i++) orb_hash[i] = -1;
+  n_indexed = 0;
+}
+
+/* add the orbitals appended since the last call. an orbital whose 
+   kappa is not set yet stops the scan, it is searched linearly. */
+static void IndexOrbitals(void) {
+  ORBITAL *orb;
+  int h;
+
+  while (n_indexed < n_orbitals) {
+    orb = GetOrbital(n_indexed);
+    if (orb->kappa == 0) break;
+    if (orb->n == 0) {
+      h = OrbitalHash(0, orb->kappa, OrbitalEBin(orb->energy));
+    } else {
+      h = OrbitalHash(orb->n, orb->kappa, 0);
     }
-  }    
-  if (!resolve_dirac) {
+    orb->inext = orb_hash[h];
+    __atomic_store_n(&(orb_hash[h]), n_indexed, __ATOMIC_RELEASE);
+    n_indexed++;
+  }
+}
+
+static int OrbitalMatch(ORBITAL *orb, int n, int kappa, double energy) {
+  if (n == 0) {
+    return (orb->n == 0 &&
+	    orb->kappa == kappa && 
+	    orb->energy > 0.0 &&
+	    fabs(orb->energy - energy) < EPS10);
+  }
+  return (orb->n == n && orb->kappa == kappa);
+}
+
+/* the lowest indexed orbital matching n, kappa and energy, -1 if none.
+   the continua within EPS10 of energy may lie in two adjacent bins. */
+static int FindOrbital(int n, int kappa, double energy) {
+  ORBITAL *orb;
+  long long b0, b1, b;
+  int i, k;
+
+  k = -1;
+  if (n == 0) {
+    b0 = OrbitalEBin(energy - EPS10);
+    b1 = OrbitalEBin(energy + EPS10);
+  } else {
+    b0 = 0;
+    b1 = 0;
+  }
+  for (b = b0; b <= b1; b++) {
+    i = __atomic_load_n(&(orb_hash[OrbitalHash(n, kappa, b)]),
+			__ATOMIC_ACQUIRE);
+    while (i >= 0) {
+      orb = GetOrbital(i);
+      if ((k < 0 || i < k) && OrbitalMatch(orb, n, kappa, energy)) k = i;
+      i = orb->inext;
+    }
+  }
+  return k;
+}
+
+/* as FindOrbital, but also searches the orbitals not yet indexed. 
+   must be called with the orbital lock held. */
+static int FindOrbitalNoLock(int n, int kappa, double energy) {
+  int i;
+
+  IndexOrbitals();
+  i = FindOrbital(n, kappa, energy);
+  if (i >= 0) return i;
+  for (i = n_indexed; i < n_orbitals; i++) {
+    if (OrbitalMatch(GetOrbital(i), n, kappa, energy)) return i;
+  }
+  return -1;
+}
+
+int OrbitalIndexNoLock(int n, int kappa, double energy) {
+  int i, j;
+  ORBITAL *orb;
+
+  i = FindOrbitalNoLock(n, kappa, energy);
+  if (i >= 0) {
+    orb = GetOrbital(i);
+    if (orb->wfun != NULL) return i;
+  } else {
     orb = GetNewOrbitalNoLock();
-  } 
-  orb->n = n;
-  orb->kappa = kappa;
+    i = orb->idx;
+    orb->n = n;
+    orb->kappa = kappa;
+    if (n == 0) n_continua++;
+  }
   orb->energy = energy;
   j = SolveDirac(orb);
   if (j < 0) {
     MPrintf(-1, "Error occured in solving Dirac eq. err = %d\n", j);
     Abort(1);
   }
-  if (n == 0 && !resolve_dirac) {
-    n_continua++;
-  }
 #pragma omp flush
   return i;
 }
 
 int OrbitalIndex(int n, int kappa, double energy) {
   int i;
+
+  /* a solved orbital is found without the lock */
+  i = FindOrbital(n, kappa, energy);
+  if (i >= 0 && __atomic_load_n(&(GetOrbital(i)->solved), __ATOMIC_ACQUIRE)) {
+    return i;
+  }
   if (orbitals->lock) SetLock(orbitals->lock);
   i = OrbitalIndexNoLock(n, kappa, energy);
   if (orbitals->lock) ReleaseLock(orbitals->lock);
   return i;
 }
 
+static int CompareInt(const void *a, const void *b) {
+  return *((int *) a) - *((int *) b);
+}
+
+/* solve the continuum orbitals of nk kappas at ne energies ahead of
+   their use in the rate calculations. the pairs not already solved are
+   picked out without the lock. the missing orbitals are then appended 
+   to the table under the orbital lock, and all are solved in parallel
+   outside of it, so that OrbitalIndex later finds them without calling
+   the solver. returns the number of orbitals solved. */
+int SolveContinua(int nk, int *kappa, int ne, double *e) {
+  int i, j, k, t, m, np, *idx, *ip;
+  ORBITAL *orb;
+
+  if (nk <= 0 || ne <= 0) return 0;
+  ip = malloc(sizeof(int)*2*nk*ne);
+  np = 0;
+  for (i = 0; i < nk; i++) {
+    for (j = 0; j < ne; j++) {
+      if (e[j] <= 0.0) continue;
+      k = FindOrbital(0, kappa[i], e[j]);
+      if (k >= 0 &&
+	  __atomic_load_n(&(GetOrbital(k)->solved), __ATOMIC_ACQUIRE)) {
+	continue;
+      }
+      ip[2*np] = i;
+      ip[2*np+1] = j;
+      np++;
+    }
+  }
+  if (np == 0) {
+    free(ip);
+    return 0;
+  }
+  
+  idx = malloc(sizeof(int)*np);
+  m = 0;
+  if (orbitals->lock) SetLock(orbitals->lock);
+  for (t = 0; t < np; t++) {
+    i = ip[2*t];
+    j = ip[2*t+1];
+    k = FindOrbitalNoLock(0, kappa[i], e[j]);
+    if (k < 0) {
+      orb = GetNewOrbitalNoLock();
+      orb->n = 0;
+      orb->kappa = kappa[i];
+      orb->energy = e[j];
+      n_continua++;
+      idx[m++] = orb->idx;
+    } else if (GetOrbital(k)->wfun == NULL) {
+      idx[m++] = k;
+    }
+  }
+  if (orbitals->lock) ReleaseLock(orbitals->lock);
+  free(ip);
+
+  /* an orbital not solved before may be listed more than once */
+  qsort(idx, m, sizeof(int), CompareInt);
+  for (i = 0, t = 0; i < m; i++) {
+    if (t == 0 || idx[i] != idx[t-1]) idx[t++] = idx[i];
+  }
+  m = t;
+  
+  if (m > 0) {
+    CopyPotentialOMP(0);
+#pragma omp parallel default(shared) private(i, orb)
+    {
+      for (i = 0; i < m; i++) {
+#ifdef USE_OPENMP
+	if (SkipOMP()) continue;
+#endif
+	orb = GetOrbital(idx[i]);
+	if (SolveDirac(orb) < 0) {
+	  MPrintf(-1, "Error occured in solving Dirac eq. %d %d %g\n",
+		  orb->n, orb->kappa, orb->energy);
+	  Abort(1);
+	}
+      }
+    }
+#pragma omp flush
+  }
+  free(idx);
+  return m;
+}
+
 int OrbitalExistsNoLock(int n, int kappa, double energy) {
-  int i;
   ORBITAL *orb;
+  int i;
+
+  if (n != 0) return FindOrbitalNoLock(n, kappa, energy);
+  /* any orbital of the energy, bound or free */
   for (i = 0; i < n_orbitals; i++) {
     orb = GetOrbital(i);
-    if (n == 0) {
-      if (orb->kappa == kappa &&
-	  fabs(orb->energy - energy) < EPS10) {
-	return i;
-      }
-    } else if (orb->n == n && orb->kappa == kappa) {
+    if (orb->kappa == kappa &&
+	fabs(orb->energy - energy) < EPS10) {
       return i;
     }
   }
@@ -1624,6 +2296,8 @@ int AddOrbital(ORBITAL *orb) {
     Abort(1);
   }
   orb->idx = n_orbitals;
+  orb->inext = -1;
+  orb->solved = (orb->wfun != NULL);
   if (orb->n == 0) {
     n_continua++;
   }
@@ -1641,8 +2315,9 @@ ORBITAL *GetOrbitalSolved(int k) {
   ORBITAL *orb;
   int i;
   
-  if (orbitals->lock) SetLock(orbitals->lock);
   orb = (ORBITAL *) ArrayGet(orbitals, k);
+  if (__atomic_load_n(&(orb->solved), __ATOMIC_ACQUIRE)) return orb;
+  if (orbitals->lock) SetLock(orbitals->lock);
   if (orb->wfun == NULL) {
     i = SolveDirac(orb);
     if (i < 0) {
@@ -1683,6 +2358,7 @@ void FreeOrbitalData(void *p) {
   ORBITAL *orb;
 
   orb = (ORBITAL *) p;
+  orb->solved = 0;
   if (orb->wfun) free(orb->wfun);
   if (orb->phase) free(orb->phase);
   orb->wfun = NULL;
@@ -1700,6 +2376,7 @@ int ClearOrbitalTable(int m) {
   int i;
 
   if (orbitals->lock) SetLock(orbitals->lock);
+  ResetOrbitalIndex();
   if (m == 0) {
     n_orbitals = 0;
     n_continua = 0;
@@ -2990,6 +3667,7 @@ int MultipoleRadialFRGrid(double **p0, int m, int k1, int k2, int gauge) {
   }
   index[1] = k1;
   index[2] = k2;
+  index[3] = gauge;
   LOCK *lock = NULL;
   p1 = (double **) MultiSet(multipole_array, index, NULL, &lock,
 			    InitPointerData, FreeMultipole);
@@ -3019,7 +3697,7 @@ int MultipoleRadialFRGrid(double **p0, int m, int k1, int k2, int gauge) {
     ef = 0.0;
   }
 
-  *p1 = (double *) malloc(sizeof(double)*n_awgrid);
+  *p0 = (double *) malloc(sizeof(double)*n_awgrid);
   
   npts = potential->maxrp-1;
   if (orb1->n > 0) npts = Min(npts, orb1->ilast);
@@ -3030,7 +3708,7 @@ int MultipoleRadialFRGrid(double **p0, int m, int k1, int k2, int gauge) {
   for (i = 0; i < n_awgrid; i++) {
     r = 0.0;
     a = awgrid[i];
-    (*p1)[i] = 0.0;
+    (*p0)[i] = 0.0;
     if (ef > 0.0) a += ef;
     if (m > 0) {
       t = kappa1 + kappa2;
@@ -3044,7 +3722,7 @@ int MultipoleRadialFRGrid(double **p0, int m, int k1, int k2, int gauge) {
 	r *= t;
 	r *= (2*m + 1.0)/sqrt(m*(m+1.0));
 	r /= pow(a, m);
-	(*p1)[i] = r*rcl;
+	(*p0)[i] = r*rcl;
       }
     } else {
       if (gauge == G_COULOMB) {
@@ -3071,7 +3749,7 @@ int MultipoleRadialFRGrid(double **p0, int m, int k1, int k2, int gauge) {
 	}
 	r += rp;
 	if (am > 1) r /= pow(a, am-1);
-	(*p1)[i] = r*rcl;
+	(*p0)[i] = r*rcl;
       } else if (gauge == G_BABUSHKIN) {
 	t = kappa1 - kappa2;
 	for (j = 0; j < npts; j++) {
@@ -3096,7 +3774,7 @@ int MultipoleRadialFRGrid(double **p0, int m, int k1, int k2, int gauge) {
 	q /= pow(a, am);
 	r *= q;
 	rp *= q;
-	(*p1)[i] = (r+rp)*rcl;
+	(*p0)[i] = (r+rp)*rcl;
       }
     }
   }
@@ -3107,7 +3785,8 @@ int MultipoleRadialFRGrid(double **p0, int m, int k1, int k2, int gauge) {
   rad_timing.radial_1e += stop - start;
 #endif
 
-  *p0 = *p1;
+#pragma omp flush
+  *p1 = *p0;
   if (locked) ReleaseLock(lock);
 #pragma omp flush
   return n_awgrid;
@@ -3186,6 +3865,7 @@ double MultipoleRadialFR0(double aw, int m, int k1, int k2, int gauge) {
   
   index[1] = k1;
   index[2] = k2;
+  index[3] = gauge;
   kappa1 = orb1->kappa;
   kappa2 = orb2->kappa;
   rcl = ReducedCL(GetJFromKappa(kappa1), abs(2*m), 
@@ -3317,7 +3997,7 @@ double *GeneralizedMoments(int k1, int k2, int m) {
   double x, r, r0;
   double *p1, *p2, *q1, *q2;
   int index[3], t;
-  double **p, k, *kg;
+  double **p, k, *kg, *g;
   double amin, amax, kmin, kmax;
   
   index[0] = m;
@@ -3346,14 +4026,15 @@ double *GeneralizedMoments(int k1, int k2, int m) {
   }
 
   nk = NGOSK;
-  *p = (double *) malloc(sizeof(double)*nk*2);
-  kg = *p + nk;
+  g = (double *) malloc(sizeof(double)*nk*2);
+  kg = g + nk;
 
   if (orb1->wfun == NULL || orb2->wfun == NULL || 
       (orb1->n <= 0 && orb2->n <= 0)) {
     for (t = 0; t < nk*2; t++) {
-      (*p)[t] = 0.0;
+      g[t] = 0.0;
     }
+    *p = g;
     if (locked) ReleaseLock(lock);
 #pragma omp flush
     return *p;
@@ -3411,7 +4092,7 @@ double *GeneralizedMoments(int k1, int k2, int m) {
       }
       r = Simpson(_dphase, 0, n1);
       
-      (*p)[t] = (r - r0)/k;
+      g[t] = (r - r0)/k;
     }
   } else {
     if (orb1->n > 0) n1 = orb1->ilast;
@@ -3423,9 +4104,10 @@ double *GeneralizedMoments(int k1, int k2, int m) {
 	_yk[i] = BESLJN(jy, m, x);
       }
       Integrate(_yk, orb1, orb2, 1, &r, 0);
-      (*p)[t] = r/k;
+      g[t] = r/k;
     }
   }
+  *p = g;
   if (locked) ReleaseLock(lock);
 #pragma omp flush
   return *p;
@@ -4023,7 +4705,7 @@ double BreitC(int n, int m, int k, int k0, int k1, int k2, int k3) {
 double BreitS(int k0, int k1, int k2, int k3, int k) {
   ORBITAL *orb0, *orb1, *orb2, *orb3;
   int index[5], i;
-  double *p0, *z, r;
+  double *p0, *z, r, *rk;
   FLTARY *byk;
   
   index[0] = k0;
@@ -4058,14 +4740,18 @@ double BreitS(int k0, int k1, int k2, int k3, int k) {
       for (i = 0; i < byk->npts; i++) {
 	z[i] = byk->yk[i];
       }
+      for (; i < potential->maxrp; i++) {
+	z[i] = 0.0;
+      }
     }
   }
   int npts;
   if (byk == NULL || byk->npts < 0) {
     orb0 = GetOrbitalSolved(k0);
     orb1 = GetOrbitalSolved(k1);
+    rk = RkTable(k);
     for (i = 0; i < potential->maxrp; i++) {
-      _dwork1[i] = pow(potential->rad[i], k);
+      _dwork1[i] = rk[i];
     }    
     Integrate(_dwork1, orb0, orb1, -6, z, 0);    
     for (i = 0; i < potential->maxrp; i++) {
@@ -4079,8 +4765,10 @@ double BreitS(int k0, int k1, int k2, int k3, int k) {
       int size = sizeof(float)*npts;
       byk->yk = malloc(size);
       AddMultiSize(xbreit_array[4], size);
+      /* the filler integrates the stored floats as the later callers do */
       for (i = 0; i < npts; i++) {
 	byk->yk[i] = z[i];
+	z[i] = byk->yk[i];
       }
       byk->npts = npts;
     }
@@ -4136,13 +4824,14 @@ int BreitX(ORBITAL *orb0, ORBITAL *orb1, int k, int m, int w, int mbr,
 	   double e, double *y) {
   int i;
   double kf = 1.0;
-  double x, r, b;
+  double x, r, b, *rk;
   int k2 = 2*k;
   int jy, k1, fd, rs;
   int index[3];  
   FLTARY *byk;
 
   if (y == NULL) y = _xk;
+  rk = RkTable(k);
   if (e < 0) e = fabs(orb0->energy-orb1->energy);
   byk = NULL;
   LOCK *lock = NULL;
@@ -4165,7 +4854,7 @@ int BreitX(ORBITAL *orb0, ORBITAL *orb1, int k, int m, int w, int mbr,
 	} else {
 	  _dwork1[i] = 0;
 	}
-	_dwork2[i] = pow(potential->rad[i], k);
+	_dwork2[i] = rk[i];
 	y[i] = byk->yk[i];
       }
       if (locked) ReleaseLock(lock);
@@ -4187,7 +4876,7 @@ int BreitX(ORBITAL *orb0, ORBITAL *orb1, int k, int m, int w, int mbr,
       x = 0;
       _dwork1[i] = 0;
     }
-    _dwork2[i] = pow(potential->rad[i], k);
+    _dwork2[i] = rk[i];
     switch (m) {
     case 0:
       if (x < qed.xbr) {
@@ -4256,8 +4945,10 @@ int BreitX(ORBITAL *orb0, ORBITAL *orb1, int k, int m, int w, int mbr,
     int size = sizeof(float)*npts;
     byk->yk = malloc(size);
     AddMultiSize(xbreit_array[m], size);
+    /* the filler returns the stored floats as the later callers get them */
     for (i = 0; i < npts; i++) {
       byk->yk[i] = y[i];
+      y[i] = byk->yk[i];
     }
     byk->npts = npts;
   }
@@ -4615,6 +5306,12 @@ int Slater(double *s, int k0, int k1, int k2, int k3, int k, int mode) {
   int locked = 0;
   if (abs(mode) < 2) {
     SortSlaterKey(index);
+    /* evaluate the cached integral in the order of its key, so that the
+       value does not depend on which permutation is requested first. */
+    k0 = index[0];
+    k1 = index[1];
+    k2 = index[2];
+    k3 = index[3];
     p = (double *) MultiSet(slater_array, index, NULL, &lock,
 			    InitDoubleData, NULL);
     if (lock && !(p && *p)) {
@@ -4731,13 +5428,15 @@ void SortSlaterKey(int *kd) {
 
 void PrepSlater(int ib0, int iu0, int ib1, int iu1,
 		int ib2, int iu2, int ib3, int iu3) {
-  int k, kmax, kk, i, j, p, q, m, ilast;
+  int k, kmax, kk, i, j, p, q, m, ilast, npts, nyk;
   int j0, j1, j2, j3, k0, k1, k2, k3;
-  int index[6];
-  double *dp;
+  int index[5];
+  double *dp, *yk, s;
   ORBITAL *orb0, *orb1, *orb2, *orb3;
   int c = 0;
 
+  npts = potential->maxrp;
+  yk = _xk;
   kmax = GetMaxRank();
   for (kk = 0; kk <= kmax; kk += 2) {
     k = kk/2;
@@ -4749,11 +5448,7 @@ void PrepSlater(int ib0, int iu0, int ib1, int iu1,
 	orb2 = GetOrbital(p);
 	GetJLFromKappa(orb2->kappa, &j2, &k2);
 	if (k0 > slater_cut.kl0 || k2 > slater_cut.kl0) continue;
-	GetYk(k, _yk, orb0, orb2, i, p, -1);
-	ilast = potential->maxrp-1;
-	for (m = 0; m <= ilast; m++) {
-	  _yk[m] /= potential->rad[m];
-	}
+	nyk = 0;
 	for (j = ib1; j <= iu1; j++) {
 	  if (j < i) continue;
 	  orb1 = GetOrbital(j);
@@ -4767,18 +5462,41 @@ void PrepSlater(int ib0, int iu0, int ib1, int iu1,
 		IsOdd((k1+k3)/2+k) ||
 		!Triangle(j0, j2, kk) ||
 		!Triangle(j1, j3, kk)) continue;	     
+	    c++;
 	    index[0] = i;
 	    index[1] = j;
 	    index[2] = p;
 	    index[3] = q;
 	    index[4] = k;
-	    index[5] = 0;
+	    SortSlaterKey(index);
+	    if (index[0] != i || index[1] != j ||
+		index[2] != p || index[3] != q) {
+	      /* Slater evaluates the integral in the order of its key,
+	      ** and overwrites the saved Yk. */
+	      Slater(&s, i, j, p, q, k, 0);
+	      nyk = 0;
+	      continue;
+	    }
 	    LOCK *lock = NULL;
 	    dp = MultiSet(slater_array, index, NULL, &lock,
 			  InitDoubleData, NULL);
-	    c++;
 	    if (lock) SetLock(lock);
 	    if (*dp == 0) {
+	      /* the Yk of (i, p) is shared by all pairs (j, q) */
+	      if (nyk == 0) {
+		GetYk(k, _yk, orb0, orb2, i, p, -1);
+		memcpy(yk, _yk, sizeof(double)*npts);
+		nyk = 1;
+	      }
+	      if (orb1->n > 0) ilast = orb1->ilast;
+	      else ilast = npts-1;
+	      if (orb3->n > 0) ilast = Min(ilast, orb3->ilast);
+	      for (m = 0; m <= ilast; m++) {
+		_yk[m] = yk[m]/potential->rad[m];
+	      }
+	      for (; m < npts; m++) {
+		_yk[m] = yk[m];
+	      }
 	      Integrate(_yk, orb1, orb3, 1, dp, 0);
 	    }
 	    if (lock) ReleaseLock(lock);
@@ -4790,12 +5508,105 @@ void PrepSlater(int ib0, int iu0, int ib1, int iu1,
   printf("PrepSlater: %d\n", c);
 }
       
+/*
+** tables of r^k on the radial grid of each thread, for all ranks up
+** to the maximum. the grid is fully determined by its first point, the
+** mapping parameters and the number of points, the tables are rebuilt
+** whenever one of these changes. the negative powers are not tabulated,
+** r^-(k+1) overflows near the origin for large k, the kernels that need
+** them use the bounded ratios instead.
+*/
+typedef struct _RKTABLE_ {
+  int maxrp, kmax;
+  double rmin, ar, br;
+  double *rk;
+} RKTABLE;
+
+static RKTABLE _rktable = {0, -1, 0.0, 0.0, 0.0, NULL};
+#pragma omp threadprivate(_rktable)
+
+/* returns the row of r^k */
+static double *RkTable(int k) {
+  RKTABLE *t;
+  int i, j, n, m;
+  double *p;
+
+  t = &_rktable;
+  n = potential->maxrp;
+  if (k > t->kmax || n != t->maxrp || potential->rad[0] != t->rmin ||
+      potential->ar != t->ar || potential->br != t->br) {
+    m = Max(k, GetMaxRank());
+    if (n*(m+1) > t->maxrp*(t->kmax+1)) {
+      t->rk = (double *) realloc(t->rk, sizeof(double)*n*(m+1));
+    }
+    for (j = 0; j <= m; j++) {
+      p = t->rk + j*n;
+      for (i = 0; i < n; i++) {
+	p[i] = pow(potential->rad[i], j);
+      }
+    }
+    t->maxrp = n;
+    t->kmax = m;
+    t->rmin = potential->rad[0];
+    t->ar = potential->ar;
+    t->br = potential->br;
+  }
+  return t->rk + k*n;
+}
+
+/*
+** GetYk1 scales r^k by r0 = sqrt(r[0]*r[ilast]) to keep it bounded, so
+** its rows depend on ilast as well as k. only a few ilast occur in a
+** calculation, the rows are kept in a small hashed cache per thread,
+** a row is recomputed when its slot is taken by another (k, ilast) or
+** the grid changes.
+*/
+#define NRKRATIO 64
+typedef struct _RKRATIO_ {
+  int k, ilast, maxrp, np;
+  double rmin, ar, br;
+  double *p;
+} RKRATIO;
+
+static RKRATIO _rkratio[NRKRATIO];
+#pragma omp threadprivate(_rkratio)
+
+/* returns the row of (r/r0)^k, with r0 = sqrt(r[0]*r[ilast]) */
+static double *RkRatio(int k, int ilast) {
+  RKRATIO *t;
+  int i, n;
+  double r0;
+
+  t = &_rkratio[(k*NRKRATIO/4 + ilast)%NRKRATIO];
+  n = potential->maxrp;
+  if (t->p == NULL || t->k != k || t->ilast != ilast || n != t->maxrp ||
+      potential->rad[0] != t->rmin ||
+      potential->ar != t->ar || potential->br != t->br) {
+    if (n > t->np) {
+      t->p = (double *) realloc(t->p, sizeof(double)*n);
+      t->np = n;
+    }
+    r0 = sqrt(potential->rad[0]*potential->rad[ilast]);
+    for (i = 0; i < n; i++) {
+      t->p[i] = pow(potential->rad[i]/r0, k);
+    }
+    t->k = k;
+    t->ilast = ilast;
+    t->maxrp = n;
+    t->rmin = potential->rad[0];
+    t->ar = potential->ar;
+    t->br = potential->br;
+  }
+  return t->p;
+}
+
 int GetYk0(int k, double *yk, ORBITAL *orb1, ORBITAL *orb2, int type) {
   int i, ilast, i0;
-  double a, max;
+  double a, max, *rk;
 
+  rk = RkTable(k);
   for (i = 0; i < potential->maxrp; i++) {
-    _dwork1[i] = pow(potential->rad[i], k);
+    _dwork1[i] = rk[i];
   }
   Integrate(_dwork1, orb1, orb2, type, _zk, 0);
   for (i = 0; i < potential->maxrp; i++) {
@@ -4837,12 +5648,13 @@ int GetYk0(int k, double *yk, ORBITAL *orb1, ORBITAL *orb2, int type) {
 */      
 int GetYk1(int k, double *yk, ORBITAL *orb1, ORBITAL *orb2, int type) {
   int i, ilast;
-  double r0, a;
+  double r0, a, *rk;
   
   ilast = Min(orb1->ilast, orb2->ilast);
   r0 = sqrt(potential->rad[0]*potential->rad[ilast]);  
+  rk = RkRatio(k, ilast);
   for (i = 0; i < potential->maxrp; i++) {
-    _dwork1[i] = pow(potential->rad[i]/r0, k);
+    _dwork1[i] = rk[i];
   }
   Integrate(_dwork1, orb1, orb2, type, _zk, 0);
   a = pow(r0, k);
@@ -4862,6 +5674,43 @@ int GetYk1(int k, double *yk, ORBITAL *orb1, ORBITAL *orb2, int type) {
   return 0;
 }
       
+/* 
+** rebuild yk from its compact form in yk_array. the first npts points
+** are stored as floats, beyond them r^k*yk approaches its asymptotic 
+** value exponentially, with the fitted exponent.
+*/
+static void YkFromCache(FLTARY *syk, int k, double *yk) {
+  int i, i0, npts, ic0, ic1;
+  double a, b, *rk;
+
+  rk = RkTable(k);
+  npts = syk->npts-2;
+  for (i = 0; i < npts; i++) {
+    yk[i] = syk->yk[i];
+  }
+  ic0 = npts;
+  ic1 = npts+1;
+  i0 = npts-1;
+  a = syk->yk[i0]*rk[i0];
+  for (i = npts; i < potential->maxrp; i++) {
+    b = potential->rad[i] - potential->rad[i0];
+    b = syk->yk[ic1]*b;
+    if (b < -20) {
+      yk[i] = syk->yk[ic0];
+    } else {
+      yk[i] = (a - syk->yk[ic0])*exp(b);
+      yk[i] += syk->yk[ic0];
+    }
+    yk[i] /= rk[i];
+  }    
+}
+
+/* 
+** the caller that fills an entry of yk_array also returns the yk 
+** rebuilt from the compact form, so that every caller gets the same 
+** values whichever one has filled the cache. the type is part of the
+** key, the full and quasi relativistic yk of the same pair differ.
+*/
 int GetYk(int k, double *yk, ORBITAL *orb1, ORBITAL *orb2, 
 	  int k1, int k2, int type) {
   int i, i0, i1, n, npts, ic0, ic1;
@@ -4880,7 +5729,7 @@ int GetYk(int k, double *yk, ORBITAL *orb1, ORBITAL *orb2,
       index[0] = k2;
       index[1] = k1;
     }
-    index[2] = k;
+    index[2] = 2*k - type - 1;
     syk = (FLTARY *) MultiSet(yk_array, index, NULL, &lock,
 			      InitFltAryData, FreeFltAryData);
     if (lock && syk->npts <= 0) {
@@ -4888,28 +5737,7 @@ int GetYk(int k, double *yk, ORBITAL *orb1, ORBITAL *orb2,
       locked = 1;
     }
     if (syk->npts > 0) {
-      npts = syk->npts-2;
-      for (i = npts-1; i < potential->maxrp; i++) {
-	_dwork1[i] = pow(potential->rad[i], k);
-      }
-      for (i = 0; i < npts; i++) {
-	yk[i] = syk->yk[i];
-      }
-      ic0 = npts;
-      ic1 = npts+1;
-      i0 = npts-1;
-      a = syk->yk[i0]*_dwork1[i0];
-      for (i = npts; i < potential->maxrp; i++) {
-	b = potential->rad[i] - potential->rad[i0];
-	b = syk->yk[ic1]*b;
-	if (b < -20) {
-	  yk[i] = syk->yk[ic0];
-	} else {
-	  yk[i] = (a - syk->yk[ic0])*exp(b);
-	  yk[i] += syk->yk[ic0];
-	}
-	yk[i] /= _dwork1[i];
-      }    
+      YkFromCache(syk, k, yk);
     }
   }
   if (syk == NULL || syk->npts <= 0) {
@@ -4922,7 +5750,6 @@ int GetYk(int k, double *yk, ORBITAL *orb1, ORBITAL *orb2,
     }
     max1 = max*EPS5;
     max = max*EPS4;
-    int maxrp = potential->maxrp;
     a = _zk[potential->maxrp-1];
     for (i = potential->maxrp-2; i >= 0; i--) {
       if (fabs(_zk[i] - a) > max1) {
@@ -4982,7 +5809,9 @@ int GetYk(int k, double *yk, ORBITAL *orb1, ORBITAL *orb2,
       if (syk->yk[ic1] >= 0) {
 	syk->yk[ic1] = -10.0/(potential->rad[i1]-potential->rad[i0]);
       }
+#pragma omp flush
       syk->npts = npts+2;
+      YkFromCache(syk, k, yk);
     }
   }
   if (locked) ReleaseLock(lock);
@@ -4990,6 +5819,212 @@ int GetYk(int k, double *yk, ORBITAL *orb1, ORBITAL *orb2,
   return 0;
 }  
 
+/* product kernels for the m = 0 and -1 paths of IntegrateSubRegion.
+   x = (a1*b1 + s*a2*b2)*(f*dr), the second term is absent if a2 is NULL.
+   the vector versions perform the same operations in the same order 
+   without contraction, so their results are identical to the scalar one. */
+static void RProdScalar(int n, double *a1, double *b1, double *a2, double *b2,
+			int s, double *f, double *dr, double *x) {
+  int i;
+
+  if (a2 == NULL) {
+    for (i = 0; i < n; i++) {
+      x[i] = a1[i] * b1[i];
+      x[i] *= f[i]*dr[i];
+    }
+  } else if (s > 0) {
+    for (i = 0; i < n; i++) {
+      x[i] = a1[i] * b1[i];
+      x[i] += a2[i] * b2[i];
+      x[i] *= f[i]*dr[i];
+    }
+  } else {
+    for (i = 0; i < n; i++) {
+      x[i] = a1[i] * b1[i];
+      x[i] -= a2[i] * b2[i];
+      x[i] *= f[i]*dr[i];
+    }
+  }
+}
+
+#ifdef RADIAL_SIMD_X86
+__attribute__((target("avx2")))
+static void RProdAVX2(int n, double *a1, double *b1, double *a2, double *b2,
+		      int s, double *f, double *dr, double *x) {
+  int i, n4;
+  __m256d p, q, w;
+
+  n4 = n & ~3;
+  for (i = 0; i < n4; i += 4) {
+    p = _mm256_mul_pd(_mm256_loadu_pd(a1+i), _mm256_loadu_pd(b1+i));
+    if (a2) {
+      q = _mm256_mul_pd(_mm256_loadu_pd(a2+i), _mm256_loadu_pd(b2+i));
+      if (s > 0) p = _mm256_add_pd(p, q);
+      else p = _mm256_sub_pd(p, q);
+    }
+    w = _mm256_mul_pd(_mm256_loadu_pd(f+i), _mm256_loadu_pd(dr+i));
+    _mm256_storeu_pd(x+i, _mm256_mul_pd(p, w));
+  }
+  if (n4 < n) {
+    RProdScalar(n-n4, a1+n4, b1+n4, a2?a2+n4:NULL, a2?b2+n4:NULL,
+		s, f+n4, dr+n4, x+n4);
+  }
+}
+
+/* avx512f enables fma, the explicit rounding forms keep the compiler from 
+   contracting the products */
+#define RPROD_RND _MM_FROUND_CUR_DIRECTION
+__attribute__((target("avx512f")))
+static void RProdAVX512(int n, double *a1, double *b1, double *a2, double *b2,
+			int s, double *f, double *dr, double *x) {
+  int i, n8;
+  __m512d p, q, w;
+
+  n8 = n & ~7;
+  for (i = 0; i < n8; i += 8) {
+    p = _mm512_mul_round_pd(_mm512_loadu_pd(a1+i), _mm512_loadu_pd(b1+i),
+			    RPROD_RND);
+    if (a2) {
+      q = _mm512_mul_round_pd(_mm512_loadu_pd(a2+i), _mm512_loadu_pd(b2+i),
+			      RPROD_RND);
+      if (s > 0) p = _mm512_add_round_pd(p, q, RPROD_RND);
+      else p = _mm512_sub_round_pd(p, q, RPROD_RND);
+    }
+    w = _mm512_mul_round_pd(_mm512_loadu_pd(f+i), _mm512_loadu_pd(dr+i),
+			    RPROD_RND);
+    _mm512_storeu_pd(x+i, _mm512_mul_round_pd(p, w, RPROD_RND));
+  }
+  if (n8 < n) {
+    RProdScalar(n-n8, a1+n8, b1+n8, a2?a2+n8:NULL, a2?b2+n8:NULL,
+		s, f+n8, dr+n8, x+n8);
+  }
+}
+#endif
+
+static int RadialSIMDSupported(int m) {
+#ifdef RADIAL_SIMD_X86
+  __builtin_cpu_init();
+  if (m == 2) return __builtin_cpu_supports("avx512f");
+  if (m == 1) return __builtin_cpu_supports("avx2");
+#endif
+  return m == 0;
+}
+
+/* m < 0 selects the widest kernel supported by the cpu, 
+   m = 0, 1, 2 requests the scalar, avx2, and avx512 kernels.
+   the scalar kernel is the default, under -Ofast the compiler 
+   vectorizes it inline, and the calls into the vector kernels made 
+   the radial integrals slower in the benchmarks.
+   if c is nonzero, each vector product is checked against the scalar 
+   kernel, turning the check off reports the mismatches found. 
+   returns the kernel in use. */
+int SetRadialSIMD(int m, int c) {
+  if (m < 0) {
+    for (m = 2; m > 0; m--) {
+      if (RadialSIMDSupported(m)) break;
+    }
+  } else if (m > 2 || !RadialSIMDSupported(m)) {
+    printf("SIMD kernel %d not supported, using scalar\n", m);
+    m = 0;
+  }
+  switch (m) {
+#ifdef RADIAL_SIMD_X86
+  case 2:
+    _rprod.f = RProdAVX512;
+    break;
+  case 1:
+    _rprod.f = RProdAVX2;
+    break;
+#endif
+  default:
+    _rprod.f = RProdScalar;
+    break;
+  }
+  _rprod.mode = m;
+  if (_rprod.check && !c) {
+    printf("SIMD check: %ld products, %ld mismatches, max rel diff %g\n",
+	   _rprod.nchk, _rprod.nbad, _rprod.dmax);
+  }
+  if (c && !_rprod.check) {
+    _rprod.nchk = 0;
+    _rprod.nbad = 0;
+    _rprod.dmax = 0.0;
+  }
+  _rprod.check = c;
+  return m;
+}
+
+/* the main products of the m = 0 and -1 paths of IntegrateSubRegion, 
+   for points i0 through i1 */
+static int RadialProduct(int type, int i0, int i1, 
+			 double *large1, double *large2, 
+			 double *small1, double *small2,
+			 double *f, double *x) {
+  double *a1, *b1, *a2, *b2, *y, d, e;
+  int i, n, s, k;
+
+  a2 = NULL;
+  b2 = NULL;
+  s = 1;
+  switch (type) {
+  case 1:
+    a1 = large1;
+    b1 = large2;
+    a2 = small1;
+    b2 = small2;
+    break;
+  case 2:
+    a1 = large1;
+    b1 = large2;
+    break;
+  case 3:
+    a1 = small1;
+    b1 = small2;
+    break;
+  case 4:
+  case 5:
+    a1 = large1;
+    b1 = small2;
+    a2 = small1;
+    b2 = large2;
+    if (type == 5) s = -1;
+    break;
+  case 6:
+    a1 = large1;
+    b1 = small2;
+    break;
+  default:
+    return -1;
+  }
+  n = i1 - i0 + 1;
+  if (a2) {
+    a2 += i0;
+    b2 += i0;
+  }
+  _rprod.f(n, a1+i0, b1+i0, a2, b2, s, f+i0, potential->dr_drho+i0, x+i0);
+  if (_rprod.check && _rprod.mode > 0) {
+    y = _dwork10;
+    RProdScalar(n, a1+i0, b1+i0, a2, b2, s, f+i0, 
+		potential->dr_drho+i0, y+i0);
+    k = 0;
+    e = 0.0;
+    for (i = i0; i <= i1; i++) {
+      if (memcmp(x+i, y+i, sizeof(double)) == 0) continue;
+      k++;
+      d = fabs(x[i]-y[i]);
+      if (y[i]) d /= fabs(y[i]);
+      if (d > e) e = d;
+    }
+    __atomic_fetch_add(&_rprod.nchk, 1, __ATOMIC_RELAXED);
+    if (k) {
+      __atomic_fetch_add(&_rprod.nbad, k, __ATOMIC_RELAXED);
+#pragma omp critical(rprod)
+      if (e > _rprod.dmax) _rprod.dmax = e;
+    }
+  }
+  return 0;
+}
+
 /* integrate a function given by f with two orbitals. */
 /* type indicates the type of integral */
 /* type = 1,    P1*P2 + Q1*Q2 */
@@ -5126,13 +6161,11 @@ int IntegrateSubRegion(int i0, int i1,
     large2 = Large(orb2);
     small1 = Small(orb1);
     small2 = Small(orb2);
+    if (RadialProduct(type, i0, i1, large1, large2, small1, small2, 
+		      f, x) < 0) return -1;
+    i = i1+1;
     switch (type) {
     case 1: /* type = 1 */
-      for (i = i0; i <= i1; i++) {
-	x[i] = large1[i] * large2[i];
-	x[i] += small1[i] * small2[i];
-	x[i] *= f[i]*potential->dr_drho[i];
-      }
       if (i1 == orb1->ilast && orb1->n == 0 && i < potential->maxrp) {
 	if (i <= orb2->ilast) {
 	  ip = i+1;
@@ -5176,10 +6209,6 @@ int IntegrateSubRegion(int i0, int i1,
       }
       break;
     case 2: /* type = 2 */
-      for (i = i0; i <= i1; i++) {
-	x[i] = large1[i] * large2[i];
-	x[i] *= f[i]*potential->dr_drho[i];
-      }
       if (i1 == orb1->ilast && orb1->n == 0 && i < potential->maxrp) {
 	if (i <= orb2->ilast) {
 	  ip = i+1;
@@ -5219,10 +6248,6 @@ int IntegrateSubRegion(int i0, int i1,
       }
       break;
     case 3: /*type = 3 */
-      for (i = i0; i <= i1; i++) {
-	x[i] = small1[i] * small2[i];
-	x[i] *= f[i]*potential->dr_drho[i];
-      }
       if (i1 == orb1->ilast && orb1->n == 0 && i < potential->maxrp) {
 	if (i <= orb2->ilast) {
 	  ip = i+1;
@@ -5262,11 +6287,6 @@ int IntegrateSubRegion(int i0, int i1,
       }
       break;
     case 4: /*type = 4 */
-      for (i = i0; i <= i1; i++) {
-	x[i] = large1[i] * small2[i];
-	x[i] += small1[i] * large2[i];
-	x[i] *= f[i]*potential->dr_drho[i];
-      }
       if (i1 == orb1->ilast && orb1->n == 0 && i < potential->maxrp) {
 	if (i <= orb2->ilast) {
 	  ip = i+1;
@@ -5310,11 +6330,6 @@ int IntegrateSubRegion(int i0, int i1,
       }
       break;
     case 5: /* type = 5 */
-      for (i = i0; i <= i1; i++) {
-	x[i] = large1[i] * small2[i];
-	x[i] -= small1[i] * large2[i];
-	x[i] *= f[i]*potential->dr_drho[i];
-      } 
       if (i1 == orb1->ilast && orb1->n == 0 && i < potential->maxrp) {
 	if (i <= orb2->ilast) {
 	  ip = i+1;
@@ -5358,10 +6373,6 @@ int IntegrateSubRegion(int i0, int i1,
       }
       break;
     case 6: /* type = 6 */
-      for (i = i0; i <= i1; i++) {
-	x[i] = large1[i] * small2[i];
-	x[i] *= f[i]*potential->dr_drho[i];
-      }
       if (i1 == orb1->ilast && orb1->n == 0 && i < potential->maxrp) {
 	if (i <= orb2->ilast) {
 	  ip = i+1;
@@ -6069,55 +7080,63 @@ int IntegrateSinCos(int j, double *x, double *y,
   return 0;
 }
 
-void LimitArrayRadial(int m, double n) {
+void LimitArrayRadial(int m, double n, int e) {
+  MULTI *ma[5];
+  int i, k;
+
   n *= 1e6;
+  k = 0;
   switch (m) {
   case -1:
-    LimitMultiSize(NULL, n);
+    ma[k++] = NULL;
     break;
   case 0:
-    LimitMultiSize(yk_array, n);
+    ma[k++] = yk_array;
     break;
   case 1:
-    LimitMultiSize(slater_array, n);
+    ma[k++] = slater_array;
     break;
   case 2:
-    LimitMultiSize(breit_array, n);
-    LimitMultiSize(wbreit_array, n);
+    ma[k++] = breit_array;
+    ma[k++] = wbreit_array;
     break;
   case 3:
-    LimitMultiSize(gos_array, n);
+    ma[k++] = gos_array;
     break;
   case 4:
-    LimitMultiSize(moments_array, n);
+    ma[k++] = moments_array;
     break;
   case 5:
-    LimitMultiSize(multipole_array, n);
+    ma[k++] = multipole_array;
     break;
   case 6:
-    LimitMultiSize(residual_array, n);
+    ma[k++] = residual_array;
     break;
   case 7:
-    for (int i = 0; i < 5; i++) {
-      LimitMultiSize(xbreit_array[i], n);
+    for (i = 0; i < 5; i++) {
+      ma[k++] = xbreit_array[i];
     }
     break;
   case 8:
-    LimitMultiSize(vinti_array, n);
-    LimitMultiSize(qed1e_array, n);
+    ma[k++] = vinti_array;
+    ma[k++] = qed1e_array;
     break;
   default:
     printf("nothing is done\n");
     break;
   }
+  for (i = 0; i < k; i++) {
+    LimitMultiSize(ma[i], n);
+    if (e >= 0) SetMultiEvict(ma[i], e);
+  }
 }
 
 int InitRadial(void) {
   int ndim, i;
   int blocks[5] = {MULTI_BLOCK6,MULTI_BLOCK6,MULTI_BLOCK6,
 		   MULTI_BLOCK6,MULTI_BLOCK6};
-  potential = malloc(sizeof(POTENTIAL));
-  hpotential = malloc(sizeof(POTENTIAL));
+  potential = calloc(1, sizeof(POTENTIAL));
+  hpotential = calloc(1, sizeof(POTENTIAL));
   potential->mode = POTMODE;
   if ((potential->mode%10)%2 > 0) {
     potential->hxs = POTHXS;
@@ -6130,6 +7149,8 @@ int InitRadial(void) {
   SetBoundaryMaster(0, 1.0, -1.0);
   n_orbitals = 0;
   n_continua = 0;
+  ResetOrbitalIndex();
+  SetRadialSIMD(0, 0);
   
   orbitals = malloc(sizeof(ARRAY));
   if (!orbitals) return -1;
@@ -6166,8 +7187,8 @@ int InitRadial(void) {
   qed1e_array = (MULTI *) malloc(sizeof(MULTI));
   MultiInit(qed1e_array, sizeof(double), ndim, blocks, "qed1e_array");
   
-  ndim = 3;
-  for (i = 0; i < ndim; i++) blocks[i] = MULTI_BLOCK3;
+  ndim = 4;
+  for (i = 0; i < ndim; i++) blocks[i] = MULTI_BLOCK4;
   multipole_array = (MULTI *) malloc(sizeof(MULTI));
   MultiInit(multipole_array, sizeof(double *), ndim, blocks, "multipole_array");
 
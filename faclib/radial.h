@@ -74,6 +74,7 @@ int WaveFuncTable(char *s, int n, int kappa, double e);
 /* get the index of the given orbital in the table */
 int OrbitalIndexNoLock(int n, int kappa, double energy);
 int OrbitalIndex(int n, int kappa, double energy);
+int SolveContinua(int nk, int *kappa, int ne, double *e);
 int OrbitalExistsNoLock(int n, int kappa, double energy);
 int OrbitalExists(int n, int kappa, double energy);
 int AddOrbital(ORBITAL *orb);
@@ -84,6 +85,7 @@ ORBITAL *GetNewOrbital(void);
 int GetNumBounds(void);
 int GetNumOrbitals(void);
 int GetNumContinua(void);
+int GetMaxBoundL(void);
 
 double CoulombEnergyShell(CONFIG *cfg, int i);
 void ShiftOrbitalEnergy(CONFIG *cfg);
@@ -116,6 +118,7 @@ void DiExAvgConfig(AVERAGE_CONFIG *cfg, double *d0, double *d1);
 /* routines for radial integral calculations */
 int GetYk(int k, double *yk, ORBITAL *orb1, ORBITAL *orb2, 
 	  int k1, int k2, int type);
+int SetRadialSIMD(int m, int c);
 int Integrate(double *f, ORBITAL *orb1, ORBITAL *orb2, int type, double *r, int id);
 int IntegrateSubRegion(int i0, int i1, 
 		       double *f, ORBITAL *orb1, ORBITAL *orb2,
@@ -166,13 +169,16 @@ int SaveContinua(double e, int mode);
 int FreeAllContinua(void);
 int FreeContinua(double e);
 int ClearOrbitalTable(int m);
-void LimitArrayRadial(int m, double n);
+void LimitArrayRadial(int m, double n, int e);
 int InitRadial(void);
 int ReinitRadial(int m);
 int TestIntegrate(void);
 int RestorePotential(char *fn, POTENTIAL *p);
 int SavePotential(char *fn, POTENTIAL *p);
 int ModifyPotential(char *fn, POTENTIAL *p);
+unsigned long long PotentialFingerprint(POTENTIAL *p);
+int SaveRadialCache(char *fn);
+int LoadRadialCache(char *fn);
 
 #endif
 
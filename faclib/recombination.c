@@ -37,6 +37,7 @@ static double egrid[MAXNE];
 static double log_egrid[MAXNE];
 static double xegrid[MAXNE];
 static double log_xegrid[MAXNE];
+#pragma omp threadprivate(xegrid,log_xegrid)
 static double egrid_min;
 static double egrid_max;
 static int egrid_limits_type = 0;
@@ -56,6 +57,8 @@ static MULTI *qk_array;
 
 #define MAXAIM 1024
 #define NPARAMS 3
+#define NRRBLOCK 4096
+#define NAIBLOCK 4096
 static ARRAY *hyd_qk_array;
 
 static struct {
@@ -414,6 +417,9 @@ void RRRadialQkHydrogenicParams(int np, double *p,
   double tol;
   int i, j, k, ne;
 
+  /* the table and the PIXZ1 setup are shared by the threads, the
+     lookup and the first fit of each n are done under the array lock */
+  if (hyd_qk_array->lock) SetLock(hyd_qk_array->lock);
   qk = (double **) ArraySet(hyd_qk_array, n, NULL, InitPointerData);
   if (*qk == NULL) {
     tol = 1E-4;
@@ -464,6 +470,7 @@ void RRRadialQkHydrogenicParams(int np, double *p,
   for (i = 1; i < np; i++) {
     p[i] = t[i];
   }
+  if (hyd_qk_array->lock) ReleaseLock(hyd_qk_array->lock);
 #undef NNE
 }  
 
@@ -548,7 +555,7 @@ double RRCrossH(double z, int n0, int kl0, double e) {
 
 int RRRadialMultipoleTable(double *qr, int k0, int k1, int m) {
   int index[3], k, nqk;
-  double **p, *qk;
+  double **p, *qk, *q0;
   int kappaf, jf, klf, kf;
   int ite, ie, i;
   double aw, e, pref;
@@ -592,9 +599,8 @@ int RRRadialMultipoleTable(double *qr, int k0, int k1, int m) {
   gauge = GetTransitionGauge();
   mode = GetTransitionMode();
 
-  *p = (double *) malloc(sizeof(double)*nqk);
-  
-  qk = *p;
+  qk = (double *) malloc(sizeof(double)*nqk);
+  q0 = qk;
   /* the factor 2 comes from the conitinuum norm */
   pref = sqrt(2.0);  
   for (ite = 0; ite < n_tegrid; ite++) {
@@ -613,8 +619,10 @@ int RRRadialMultipoleTable(double *qr, int k0, int k1, int m) {
   }
   
   for (i = 0; i < nqk; i++) {
-    qr[i] = (*p)[i];
+    qr[i] = q0[i];
   }
+#pragma omp flush
+  *p = q0;
   if (locked) ReleaseLock(lock);
 #pragma omp flush
   return 0;
@@ -622,7 +630,7 @@ int RRRadialMultipoleTable(double *qr, int k0, int k1, int m) {
     
 int RRRadialQkTable(double *qr, int k0, int k1, int m) {
   int index[3], k, nqk;
-  double **p, *qk, tq[MAXNE];
+  double **p, *qk, *q0, tq[MAXNE];
   double r0, r1, tq0[MAXNE];
   ORBITAL *orb;
   int kappa0, jb0, klb02, klb0;
@@ -680,7 +688,10 @@ int RRRadialQkTable(double *qr, int k0, int k1, int m) {
   nqk = n_tegrid*n_egrid;
   p = (double **) MultiSet(qk_array, index, NULL, &lock,
 			   InitPointerData, FreeRecPkData);
-  if (lock && !(*p)) SetLock(lock);
+  if (lock && !(*p)) {
+    SetLock(lock);
+    locked = 1;
+  }
   if (*p) {
     for (i = 0; i < nqk; i++) {
       qr[i] = (*p)[i];
@@ -692,9 +703,8 @@ int RRRadialQkTable(double *qr, int k0, int k1, int m) {
   gauge = GetTransitionGauge();
   mode = GetTransitionMode();
 
-  *p = (double *) malloc(sizeof(double)*nqk);
-  
-  qk = *p;
+  qk = (double *) malloc(sizeof(double)*nqk);
+  q0 = qk;
   /* the factor 2 comes from the conitinuum norm */
   pref = 2.0/((k+1.0)*(jb0+1.0));
   
@@ -744,8 +754,10 @@ int RRRadialQkTable(double *qr, int k0, int k1, int m) {
   }
   
   for (i = 0; i < nqk; i++) {
-    qr[i] = (*p)[i];
+    qr[i] = q0[i];
   }
+#pragma omp flush
+  *p = q0;
   if (locked) ReleaseLock(lock);
 #pragma omp flush
   return 0;
@@ -1448,8 +1460,7 @@ int AIRadialPk(double **ai_pk, int k0, int k1, int kb, int kappaf, int k) {
     if (locked) ReleaseLock(lock);
     return 0;
   } 
-  (*p) = (double *) malloc(sizeof(double)*n_egrid);
-  *ai_pk = *p;
+  *ai_pk = (double *) malloc(sizeof(double)*n_egrid);
   for (i = 0; i < n_egrid; i++) {
     e = egrid[i];
     kf = OrbitalIndex(0, kappaf, e);
@@ -1460,6 +1471,9 @@ int AIRadialPk(double **ai_pk, int k0, int k1, int kb, int kappaf, int k) {
     SlaterTotal(&sd, &se, NULL, ks, k, 0);
     (*ai_pk)[i] = sd+se;
   }
+  /* other threads test *p without the lock, publish it when filled */
+#pragma omp flush
+  (*p) = *ai_pk;
   if (locked) ReleaseLock(lock);
 #pragma omp flush
   return 0;
@@ -1515,6 +1529,24 @@ int PrepRREGrids(double e, double emax0) {
   return 0;
 }
 
+/* solve the continua of the partial waves up to klmax at the 
+   photo-electron energy grid in one parallel pass, ahead of the 
+   RR, PI and AI loops */
+int PrepRecContinua(int klmax) {
+  int kl, nk, *kappa;
+
+  if (klmax < 0 || n_egrid <= 0) return 0;
+  kappa = malloc(sizeof(int)*2*(klmax+1));
+  nk = 0;
+  for (kl = 0; kl <= klmax; kl++) {
+    kappa[nk++] = -(kl+1);
+    if (kl > 0) kappa[nk++] = kl;
+  }
+  kl = SolveContinua(nk, kappa, n_egrid, egrid);
+  free(kappa);
+  return kl;
+}
+
 int SaveRRMultipole(int nlow, int *low, int nup, int *up, char *fn, int m) {
   int i, j, k;
   FILE *f;
@@ -1633,7 +1665,6 @@ int SaveRRMultipole(int nlow, int *low, int nup, int *up, char *fn, int m) {
 	  SetRRTEGrid(n_tegrid, emin, emax);
 	}
       }
-      FreeMultipoleArray();
       awmin = emin * FINE_STRUCTURE_CONST;
       awmax = emax * FINE_STRUCTURE_CONST;
       if (e < 0.3) {
@@ -1678,19 +1709,81 @@ int SaveRRMultipole(int nlow, int *low, int nup, int *up, char *fn, int m) {
   return 0;
 }
     
-int SaveRecRR(int nlow, int *low, int nup, int *up, 
-	      char *fn, int m) {
-  int i, j, k, ie, ip;
-  FILE *f;
+/* compute the record of the recombination r->f -> r->b. the params
+   and strength arrays are allocated here and freed by the caller.
+   r->kl is set to -1 if the record is not to be written. */
+static void RecombinationRecord(RR_RECORD *r, int m, int nqk, int iuta) {
   double rqu[MAXNUSR], qc[NPARAMS+1];
   double eb;
+  int nq, ie, ip;
+
+  r->params = NULL;
+  r->strength = NULL;
+  if (iuta) {
+    nq = BoundFreeOSUTA(rqu, qc, &eb, r->b, r->f, m);
+  } else {
+    nq = BoundFreeOS(rqu, qc, &eb, r->b, r->f, m);
+  }
+  r->kl = nq;
+  if (nq < 0) {
+    r->kl = -1;
+    return;
+  }
+
+  if (qk_mode == QK_FIT) {
+    r->params = (float *) malloc(sizeof(float)*nqk);
+    for (ip = 0; ip < nqk; ip++) {
+      r->params[ip] = (float) qc[ip];
+    }
+  }
+  r->strength = (float *) malloc(sizeof(float)*n_usr);
+  for (ie = 0; ie < n_usr; ie++) {
+    r->strength[ie] = (float) rqu[ie];
+  }
+}
+
+/* the pairs of an RR block, see PairBlock */
+typedef struct _RR_BLOCK_ {
+  int *low, *up;
+  double e0, e1;
+  int m, nqk, iuta;
+  RR_RECORD *rb;
+} RR_BLOCK;
+
+static int RRBlockPair(int n, int i, int j, void *p) {
+  RR_BLOCK *b;
+  LEVEL *lev1, *lev2;
+  double e;
+
+  b = (RR_BLOCK *) p;
+  lev1 = GetLevel(b->up[i]);
+  lev2 = GetLevel(b->low[j]);
+  e = lev1->energy - lev2->energy;
+  if (e < b->e0 || e >= b->e1) return 0;
+  b->rb[n].b = b->low[j];
+  b->rb[n].f = b->up[i];
+  return 1;
+}
+
+static void RRBlockRecord(int k, void *p) {
+  RR_BLOCK *b;
+
+  b = (RR_BLOCK *) p;
+  RecombinationRecord(b->rb+k, b->m, b->nqk, b->iuta);
+}
+
+int SaveRecRR(int nlow, int *low, int nup, int *up, 
+	      char *fn, int m) {
+  int i, j, k, nb;
+  TFILE *f;
   LEVEL *lev1, *lev2;
-  RR_RECORD r;
+  RR_RECORD *rb;
+  RR_BLOCK cb;
   RR_HEADER rr_hdr;
   F_HEADER fhdr;
   double e, emin, emax, emax0;
   double awmin, awmax;
-  int nq, nqk;
+  int nqk;
   ARRAY subte;
   int isub, n_tegrid0, n_egrid0, n_usr0;
   int te_set, e_set, usr_set, iuta;
@@ -1759,7 +1852,6 @@ int SaveRecRR(int nlow, int *low, int nup, int *up,
 
   if (qk_mode == QK_FIT) {
     nqk = NPARAMS+1;
-    r.params = (float *) malloc(sizeof(float)*nqk);
   } else {
     nqk = 0;
   }
@@ -1772,6 +1864,13 @@ int SaveRecRR(int nlow, int *low, int nup, int *up,
   rr_hdr.nparams = nqk;
   rr_hdr.multipole = m;
   f = OpenFile(fn, &fhdr);
+  rb = (RR_RECORD *) malloc(sizeof(RR_RECORD)*NRRBLOCK);
+  cb.low = low;
+  cb.up = up;
+  cb.m = m;
+  cb.nqk = nqk;
+  cb.iuta = iuta;
+  cb.rb = rb;
   
   e0 = emin*0.999;
   for (isub = 1; isub < subte.dim; isub++) {
@@ -1810,7 +1909,6 @@ int SaveRecRR(int nlow, int *low, int nup, int *up,
 	  SetRRTEGrid(n_tegrid, emin, emax);
 	}
       }
-      FreeMultipoleArray();
       awmin = emin * FINE_STRUCTURE_CONST;
       awmax = emax * FINE_STRUCTURE_CONST;
       if (e < 0.3) {
@@ -1844,42 +1942,30 @@ int SaveRecRR(int nlow, int *low, int nup, int *up,
     rr_hdr.egrid_type = egrid_type;
     rr_hdr.usr_egrid_type = usr_egrid_type;
     
-    r.strength = (float *) malloc(sizeof(float)*n_usr);
-    
     InitFile(f, &fhdr, &rr_hdr);
+    PrepRecContinua(GetMaxBoundL() + abs(m));
     
-    for (i = 0; i < nup; i++) {
-      lev1 = GetLevel(up[i]);
-      for (j = 0; j < nlow; j++) {
-	lev2 = GetLevel(low[j]);
-	e = lev1->energy - lev2->energy;
-	if (e < e0 || e >= e1) continue;
-	if (iuta) {
-	  nq = BoundFreeOSUTA(rqu, qc, &eb, low[j], up[i], m);
-	} else {
-	  nq = BoundFreeOS(rqu, qc, &eb, low[j], up[i], m);
-	}
-	if (nq < 0) continue;
-	r.b = low[j];
-	r.f = up[i];
-	r.kl = nq;
-	
-	if (qk_mode == QK_FIT) {
-	  for (ip = 0; ip < nqk; ip++) {
-	    r.params[ip] = (float) qc[ip];
-	  }
+    /* pairs are taken in blocks of NRRBLOCK. the radial tables in 
+       qk_array are shared, each is computed once by the first thread
+       that needs it. */
+    cb.e0 = e0;
+    cb.e1 = e1;
+    i = 0;
+    j = 0;
+    while ((nb = PairBlock(&i, &j, nup, nlow, NRRBLOCK, 
+			   RRBlockPair, &cb)) > 0) {
+      ParallelBlock(nb, RRBlockRecord, &cb);
+      for (k = 0; k < nb; k++) {
+	if (rb[k].kl >= 0) {
+	  WriteRRRecord(f, rb+k);
 	}
-	
-	for (ie = 0; ie < n_usr; ie++) {
-	  r.strength[ie] = (float) rqu[ie];
-	}
-	WriteRRRecord(f, &r);
+	if (rb[k].params) free(rb[k].params);
+	if (rb[k].strength) free(rb[k].strength);
       }
-    }      
+    }
 
     DeinitFile(f, &fhdr);
     
-    free(r.strength);
     ReinitRadial(1);
     FreeRecQk();
     FreeRecPk();
@@ -1887,18 +1973,88 @@ int SaveRecRR(int nlow, int *low, int nup, int *up,
     e0 = e1;
   }
 
-  if (qk_mode == QK_FIT) {
-    free(r.params);
-  }
-      
   ReinitRecombination(1);
 
   ArrayFree(&subte, NULL);
+  free(rb);
   CloseFile(f, &fhdr);
 
   return 0;
 }
       
+/* compute the autoionization record of r->b -> r->f. the rate array
+   is allocated here and freed by the caller. without msub it holds
+   the total rate only. r->nsub is set to 0 if the record is not to be
+   written. */
+static void AutoionizeRecord(AIM_RECORD *r, double eref, int msub, 
+			     int iuta) {
+  LEVEL *lev1, *lev2;
+  double e, s, s1[MAXAIM];
+  int k, t;
+
+  r->nsub = 0;
+  r->rate = NULL;
+  lev1 = GetLevel(r->b);
+  lev2 = GetLevel(r->f);
+  e = lev1->energy - lev2->energy;
+  if (e < 0 && lev1->ibase != r->f) e -= eref;
+  if (!msub) {
+    if (iuta) {
+      k = AutoionizeRateUTA(&s, &e, r->b, r->f);
+    } else {
+      k = AutoionizeRate(&s, &e, r->b, r->f, msub);
+    }
+    if (k < 0) return;
+    if (s < ai_cut) return;
+    s1[0] = s;
+    k = 1;
+  } else {
+    k = AutoionizeRate(s1, &e, r->b, r->f, msub);
+    if (k < 0) return;
+    s = 0;
+    for (t = 0; t < k; t++) {
+      s += s1[t];
+    }
+    if (s < ai_cut) return;
+  }
+  r->rate = (float *) malloc(sizeof(float)*k);
+  for (t = 0; t < k; t++) {
+    r->rate[t] = s1[t];
+  }
+  r->nsub = k;
+}
+
+/* the pairs of an AI block, see PairBlock */
+typedef struct _AI_BLOCK_ {
+  int *low, *up;
+  double e0, e1, eref;
+  int msub, iuta;
+  AIM_RECORD *rb;
+} AI_BLOCK;
+
+static int AIBlockPair(int n, int i, int j, void *p) {
+  AI_BLOCK *b;
+  LEVEL *lev1, *lev2;
+  double e;
+
+  b = (AI_BLOCK *) p;
+  lev1 = GetLevel(b->low[i]);
+  lev2 = GetLevel(b->up[j]);
+  e = lev1->energy - lev2->energy;
+  if (e < 0 && lev1->ibase != b->up[j]) e -= b->eref;
+  if (e < b->e0 || e >= b->e1) return 0;
+  b->rb[n].b = b->low[i];
+  b->rb[n].f = b->up[j];
+  return 1;
+}
+
+static void AIBlockRecord(int k, void *p) {
+  AI_BLOCK *b;
+
+  b = (AI_BLOCK *) p;
+  AutoionizeRecord(b->rb+k, b->eref, b->msub, b->iuta);
+}
+
 int SaveAI(int nlow, int *low, int nup, int *up, char *fn, 
 	   double eref, int msub) {
 #ifdef PERFORM_STATISTICS
@@ -1907,17 +2063,17 @@ int SaveAI(int nlow, int *low, int nup, int *up, char *fn,
   RECOUPLE_TIMING recouplet;
   RAD_TIMING radt;
 #endif
-  int i, j, k, t;
+  int i, j, k, t, j1, j2, jmax, nb;
   LEVEL *lev1, *lev2;
   AI_RECORD r;
-  AIM_RECORD r1;
+  AIM_RECORD *rb;
+  AI_BLOCK cb;
   AI_HEADER ai_hdr;
   AIM_HEADER ai_hdr1;
   F_HEADER fhdr;
   double emin, emax;
-  double e, s, tai, a, s1[MAXAIM];
-  float rt[MAXAIM];
-  FILE *f;
+  double tai, a;
+  TFILE *f;
   ARRAY subte;
   double c, e0, e1, b;
   int isub, n_egrid0;
@@ -1949,6 +2105,18 @@ int SaveAI(int nlow, int *low, int nup, int *up, char *fn,
   if (k == 0) {
     return 0;
   }
+  /* the free electron couples the two levels, 2j <= 2J1 + 2J2 */
+  j1 = 0;
+  for (i = 0; i < nlow; i++) {
+    DecodePJ(GetLevel(low[i])->pj, NULL, &t);
+    if (t > j1) j1 = t;
+  }
+  j2 = 0;
+  for (j = 0; j < nup; j++) {
+    DecodePJ(GetLevel(up[j])->pj, NULL, &t);
+    if (t > j2) j2 = t;
+  }
+  jmax = j1 + j2;
 
   if (egrid[0] < 0) {
     e_set = 0;
@@ -1985,6 +2153,13 @@ int SaveAI(int nlow, int *low, int nup, int *up, char *fn,
     ai_hdr1.emin = eref;
   }
   f = OpenFile(fn, &fhdr);
+  rb = (AIM_RECORD *) malloc(sizeof(AIM_RECORD)*NAIBLOCK);
+  cb.low = low;
+  cb.up = up;
+  cb.eref = eref;
+  cb.msub = msub;
+  cb.iuta = iuta;
+  cb.rb = rb;
 
   e0 = emin*0.999;
   for (isub = 1; isub < subte.dim; isub++) {
@@ -2036,40 +2211,27 @@ int SaveAI(int nlow, int *low, int nup, int *up, char *fn,
       ai_hdr1.egrid = egrid;
       InitFile(f, &fhdr, &ai_hdr1);
     }
-    for (i = 0; i < nlow; i++) {
-      lev1 = GetLevel(low[i]);
-      for (j = 0; j < nup; j++) {
-	lev2 = GetLevel(up[j]);
-	e = lev1->energy - lev2->energy;
-	if (e < 0 && lev1->ibase != up[j]) e -= eref;
-	if (e < e0 || e >= e1) continue;
-	if (!msub) {
-	  if (iuta) {
-	    k = AutoionizeRateUTA(&s, &e, low[i], up[j]);
+    PrepRecContinua((jmax+1)/2);
+    /* pairs are taken in blocks of NAIBLOCK */
+    cb.e0 = e0;
+    cb.e1 = e1;
+    i = 0;
+    j = 0;
+    while ((nb = PairBlock(&i, &j, nlow, nup, NAIBLOCK, 
+			   AIBlockPair, &cb)) > 0) {
+      ParallelBlock(nb, AIBlockRecord, &cb);
+      for (k = 0; k < nb; k++) {
+	if (rb[k].nsub > 0) {
+	  if (!msub) {
+	    r.b = rb[k].b;
+	    r.f = rb[k].f;
+	    r.rate = rb[k].rate[0];
+	    WriteAIRecord(f, &r);
 	  } else {
-	    k = AutoionizeRate(&s, &e, low[i], up[j], msub);
-	  }
-	  if (k < 0) continue;
-	  if (s < ai_cut) continue;
-	  r.b = low[i];
-	  r.f = up[j];
-	  r.rate = s;
-	  WriteAIRecord(f, &r);
-	} else {
-	  k = AutoionizeRate(s1, &e, low[i], up[j], msub);
-	  if (k < 0) continue;
-	  r1.rate = rt;
-	  s = 0;
-	  for (t = 0; t < k; t++) {
-	    r1.rate[t] = s1[t];
-	    s += s1[t];
+	    WriteAIMRecord(f, rb+k);
 	  }
-	  if (s < ai_cut) continue;
-	  r1.b = low[i];
-	  r1.f = up[j];
-	  r1.nsub = k;
-	  WriteAIMRecord(f, &r1);
 	}
+	if (rb[k].rate) free(rb[k].rate);
       }
     }
 
@@ -2085,6 +2247,7 @@ int SaveAI(int nlow, int *low, int nup, int *up, char *fn,
   ReinitRecombination(1);
   
   ArrayFree(&subte, NULL);
+  free(rb);
   CloseFile(f, &fhdr);
 
 #ifdef PERFORM_STATISTICS
@@ -2409,7 +2572,6 @@ int FreeRecPk(void) {
 }
 
 int FreeRecQk(void) {
-  if (qk_array->array == NULL) return 0;
   MultiFreeData(qk_array, FreeRecPkData);
   return 0;
 }
@@ -71,6 +71,7 @@ int BoundFreeMultipole(FILE *fp, int rec, int f, int m);
 int BoundFreeOS(double *rqu, double *p, 
 		double *eb, int rec, int f, int m);
 int PrepRREGrids(double eth, double emax0);
+int PrepRecContinua(int klmax);
 int SaveRRMultipole(int nlow, int *low, int nup, int *up, char *fn, int m);
 int SaveRecRR(int nlow, int *low, int nup, int *up, char *fn, int m);
 int SaveAI(int nlow, int *low, int nup, int *up, char *fn, 
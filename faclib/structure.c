@@ -43,8 +43,11 @@ USE (rcsid);
 static int nhams = 0;
 static SHAMILTON hams[MAX_HAMS];
 
+/* each thread builds and diagonalizes its own Hamiltonian when the 
+   small symmetry blocks are farmed out in SolveStructure */
 static HAMILTON _ham = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-			NULL, NULL, NULL, NULL, NULL, NULL};
+			NULL, NULL, NULL, NULL, NULL, NULL, 0};
+#pragma omp threadprivate(_ham)
 
 static ARRAY levels_per_ion[N_ELEMENTS+1];
 static ARRAY *levels;
@@ -53,10 +56,19 @@ static ARRAY *eblevels;
 static int n_eblevels;
 
 static int mbpt_mk = 0;
-static int angz_dim, angz_dim2;
-static ANGZ_DATUM *angz_array;
-static ANGZ_DATUM *angzxz_array;
-static ANGZ_DATUM *angmz_array;
+/* sparse tables of ANGZ_DATUM indexed by the pair of hamiltonians,
+   only the pairs that are actually used take memory. callers hold the
+   entries for long, so the tables are exempt from the size limits. */
+static MULTI *angz_array = NULL;
+static MULTI *angzxz_array = NULL;
+static MULTI *angmz_array = NULL;
+/* the angz_array and angzxz_array entries are built on first use by
+   whichever thread asks for them. the builders of an entry are
+   serialized by one of NANGZLOCK locks, and its ns is set only after
+   angz and nz are filled. */
+#define NANGZLOCK 64
+static LOCK angz_lock[NANGZLOCK];
+static int angz_lock_init = 0;
 static ANGULAR_FROZEN ang_frozen;
 
 static int ncorrections = 0;
@@ -68,6 +80,10 @@ static double angz_cut = ANGZCUT;
 static double mix_cut = MIXCUT;
 static double mix_cut2 = MIXCUT2;
 
+static int davidson_nroots = 0;
+static int davidson_nmin = DAVIDSONNMIN;
+static double davidson_tol = DAVIDSONTOL;
+
 static int sym_pp = -1;
 static int sym_njj = 0;
 static int *sym_jj = NULL;
@@ -230,6 +246,18 @@ int SetMixCut(double cut, double cut2) {
   return 0;
 }
 
+/* solve for the lowest n levels of each symmetry block with at least
+   nmin states by the Davidson iteration, until the residual norms 
+   are below tol. n <= 0 diagonalizes all blocks in full. */
+int SetDavidson(int n, int nmin, double tol) {
+  davidson_nroots = n;
+  if (nmin > 0) davidson_nmin = nmin;
+  else davidson_nmin = DAVIDSONNMIN;
+  if (tol > 0) davidson_tol = tol;
+  else davidson_tol = DAVIDSONTOL;
+  return 0;
+}
+
 int SetAngZOptions(int n, double mix, double cut) {
   rydberg_ignored = n;
   mix_cut = mix;
@@ -528,6 +556,42 @@ int ConstructHamiltonEB(int n, int *ilev) {
   return -1;
 }
 
+static void HamiltonConfigBlock(HAMILTON *h, int isym, 
+				int i0, int i1, int j0, int j1);
+
+/* the elements between the states of the block. they are computed in
+   sub-blocks of states from a pair of configurations, at most 
+   HAMCFGBLOCK states on each side. with sk set, the sub-blocks are 
+   shared out among the threads of the enclosing parallel region. */
+static void HamiltonBlock(HAMILTON *h, int isym, int sk) {
+  int i, j, n, *r, kg, kc;
+  SYMMETRY *sym;
+  STATE *s;
+
+  sym = GetSymmetry(isym);
+  r = malloc(sizeof(int)*(h->dim+1));
+  n = 0;
+  kg = 0;
+  kc = 0;
+  for (i = 0; i < h->dim; i++) {
+    s = (STATE *) ArrayGet(&(sym->states), h->basis[i]);
+    if (n == 0 || s->kgroup != kg || s->kcfg != kc ||
+	i - r[n-1] >= HAMCFGBLOCK) {
+      r[n++] = i;
+      kg = s->kgroup;
+      kc = s->kcfg;
+    }
+  }
+  r[n] = h->dim;
+  for (j = 0; j < n; j++) {
+    for (i = 0; i <= j; i++) {
+      if (sk && SkipMPICost((r[i+1]-r[i])*(r[j+1]-r[j]))) continue;
+      HamiltonConfigBlock(h, isym, r[i], r[i+1], r[j], r[j+1]);
+    }
+  }
+  free(r);
+}
+
 int ConstructHamilton(int isym, int k0, int k, int *kg,
 		      int kp, int *kgp, int md) {
   int i, j, j0, t, ti, jp, m1, m2, m3;
@@ -609,23 +673,15 @@ int ConstructHamilton(int isym, int k0, int k, int *kg,
     for (j = 0; j < h->hsize; j++) {
       h->hamilton[j] = 0;
     }
+    /* most elements are cheap, they are handed out in chunks */
 #pragma omp parallel default(shared) private(i,j,t,r)
     {
-      for (j = 0; j < h->dim; j++) {
-	t = j*(j+1)/2;
-	for (i = 0; i <= j; i++) {
-	  int skip;
-	  skip = SkipMPI();
-	  if (skip) continue;
-	  r = HamiltonElement(isym, h->basis[i], h->basis[j]);
-	  h->hamilton[i+t] = r;
-	}
-      }
+      HamiltonBlock(h, isym, 1);
       if (jp > 0) {
 	t = ((h->dim+1)*(h->dim))/2;
 	for (i = 0; i < h->dim; i++) {
 	  for (j = h->dim; j < h->n_basis; j++) {
-	    if (SkipMPI()) {
+	    if (SkipMPICost(1.0)) {
 	      t++;
 	      continue;
 	    }
@@ -636,7 +692,7 @@ int ConstructHamilton(int isym, int k0, int k, int *kg,
 	  ReinitRadial(1);
 	}
 	for (j = h->dim; j < h->n_basis; j++) {
-	  if (SkipMPI()) {
+	  if (SkipMPICost(1.0)) {
 	    t++;
 	    continue;
 	  }
@@ -647,12 +703,15 @@ int ConstructHamilton(int isym, int k0, int k, int *kg,
 	ReinitRadial(1);
       }
     }
-#if USE_MPI == 1    
-    if (NProcMPI() > 1) {
+#ifdef USE_MPIRANK
+    /* outside the parallel region, once per rank */
+    RankMPI(&i);
+    if (i > 1) {
       MPI_Allreduce(MPI_IN_PLACE, h->hamilton, h->hsize, MPI_DOUBLE,
 		    MPI_SUM, MPI_COMM_WORLD);
     }
-#elif USE_MPI == 2
+#endif
+#ifdef USE_OPENMP
 #pragma omp barrier
 #pragma omp flush
 #endif
@@ -1795,6 +1854,323 @@ double Hamilton2E(int n_shells, SHELL_STATE *sbra, SHELL_STATE *sket,
   return x;
 }
 
+/*
+** one term of the Hamiltonian elements between the states of two 
+** configurations. the radial integrals depend only on the orbitals, 
+** they are kept for all pairs of states of the configurations.
+*/
+typedef struct _HAM_TERM_ {
+  INTERACT_SHELL s[4];
+  int type; /* 1: one-body, 2: two-body, 0: vanishing one-body */
+  int ks[4];
+  double r0;
+  int nk, *kd;
+  double *sd, *se;
+} HAM_TERM;
+
+static void HamTerm1E(HAM_TERM *t, INTERACT_SHELL *s) {
+  int k1, k2;
+  double r0;
+
+  memcpy(t->s, s, sizeof(INTERACT_SHELL)*4);
+  t->nk = 0;
+  if (s[0].j != s[1].j ||
+      s[0].kl != s[1].kl) {
+    t->type = 0;
+    return;
+  }
+  t->type = 1;
+  k1 = OrbitalIndex(s[0].n, s[0].kappa, 0.0);
+  k2 = OrbitalIndex(s[1].n, s[1].kappa, 0.0);
+  ResidualPotential(&r0, k1, k2);
+  if (k1 == k2) {
+    r0 += (GetOrbital(k1))->energy;
+  }
+  r0 += QED1E(k1, k2);
+  t->r0 = r0;
+}
+
+static void HamTerm2E(HAM_TERM *t, INTERACT_SHELL *s) {
+  memcpy(t->s, s, sizeof(INTERACT_SHELL)*4);
+  t->type = 2;
+  t->ks[0] = OrbitalIndex(s[0].n, s[0].kappa, 0.0);
+  t->ks[1] = OrbitalIndex(s[2].n, s[2].kappa, 0.0);
+  t->ks[2] = OrbitalIndex(s[1].n, s[1].kappa, 0.0);
+  t->ks[3] = OrbitalIndex(s[3].n, s[3].kappa, 0.0);
+  /* the ranks of AngularZxZ0 do not exceed this */
+  t->nk = Min(s[0].j+s[1].j, s[2].j+s[3].j)/2 + 1;
+  t->kd = calloc(t->nk, sizeof(int));
+  t->sd = malloc(sizeof(double)*t->nk);
+  t->se = malloc(sizeof(double)*t->nk);
+}
+
+/* the terms in the order HamiltonElement1E2E adds them up */
+static int HamiltonTerms(HAM_TERM *t, int n_shells, INTERACT_DATUM *idatum) {
+  INTERACT_SHELL s[4];
+  SHELL *bra;
+  int i, j, n;
+
+  memcpy(s, idatum->s, sizeof(INTERACT_SHELL)*4);
+  bra = idatum->bra;
+  n = 0;
+  if (s[0].index >= 0 && s[3].index >= 0) {
+    HamTerm2E(t+n++, s);
+  } else if (s[0].index >= 0) {
+    HamTerm1E(t+n++, s);
+    for (i = 0; i < n_shells; i++) {
+      s[2].index = n_shells - i - 1;
+      s[3].index = s[2].index;
+      s[2].n = bra[i].n;
+      s[3].n = s[2].n;
+      s[2].kappa = bra[i].kappa;
+      s[3].kappa = s[2].kappa;
+      s[2].j = GetJ(bra+i);
+      s[3].j = s[2].j;
+      s[2].kl = GetL(bra+i);
+      s[3].kl = s[2].kl;
+      s[2].nq_bra = GetNq(bra+i);
+      if (s[2].index == s[0].index) {
+	s[2].nq_ket = s[2].nq_bra - 1;
+      } else if (s[2].index == s[1].index) {
+	s[2].nq_ket = s[2].nq_bra + 1;
+      } else {
+	s[2].nq_ket = s[2].nq_bra;
+      }
+      if (s[2].nq_bra <= 0 || s[2].nq_ket <= 0 ||
+	  s[2].nq_bra > s[2].j+1 || s[2].nq_ket > s[2].j+1) {
+	continue;
+      }
+      s[3].nq_bra = s[2].nq_bra;
+      s[3].nq_ket = s[2].nq_ket;
+      HamTerm2E(t+n++, s);
+    }
+  } else {
+    for (i = 0; i < n_shells; i++) {
+      s[0].index = n_shells - i - 1;
+      s[1].index = s[0].index;
+      s[0].n = bra[i].n;
+      s[1].n = s[0].n;
+      s[0].kappa = bra[i].kappa;
+      s[1].kappa = s[0].kappa;
+      s[0].j = GetJ(bra+i);
+      s[1].j = s[0].j;
+      s[0].kl = GetL(bra+i);
+      s[1].kl = s[0].kl;
+      s[0].nq_bra = GetNq(bra+i);
+      s[0].nq_ket = s[0].nq_bra;
+      s[1].nq_bra = s[0].nq_bra;
+      s[1].nq_ket = s[1].nq_bra;      
+      HamTerm1E(t+n++, s);
+      for (j = 0; j <= i; j++) {
+	s[2].nq_bra = GetNq(bra+j);
+	if (j == i && s[2].nq_bra < 2) continue;
+	s[2].nq_ket = s[2].nq_bra;
+	s[3].nq_bra = s[2].nq_bra;
+	s[3].nq_ket = s[3].nq_bra;
+	s[2].index = n_shells - j - 1;
+	s[3].index = s[2].index;
+	s[2].n = bra[j].n;
+	s[3].n = s[2].n;
+	s[2].kappa = bra[j].kappa;
+	s[3].kappa = s[2].kappa;
+	s[2].j = GetJ(bra+j);
+	s[3].j = s[2].j;
+	s[2].kl = GetL(bra+j);
+	s[3].kl = s[2].kl;
+	HamTerm2E(t+n++, s);
+      }
+    }
+  }
+  return n;
+}
+
+static void FreeHamTerms(HAM_TERM *t, int n) {
+  int i;
+
+  for (i = 0; i < n; i++) {
+    if (t[i].nk > 0) {
+      free(t[i].kd);
+      free(t[i].sd);
+      free(t[i].se);
+    }
+  }
+  free(t);
+}
+
+/* SlaterTotal of the term, computed once for each rank */
+static void HamTermSlater(HAM_TERM *t, int k, double *sd, double *se) {
+  int js[4] = {0, 0, 0, 0};
+  int m;
+
+  m = k/2;
+  if (m >= t->nk) {
+    SlaterTotal(sd, se, js, t->ks, k, 0);
+    return;
+  }
+  if (t->kd[m] < (se?2:1)) {
+    SlaterTotal(t->sd+m, se?(t->se+m):NULL, js, t->ks, k, 0);
+    t->kd[m] = se?2:1;
+  }
+  *sd = t->sd[m];
+  if (se) *se = t->se[m];
+}
+
+/* the same as Hamilton1E and Hamilton2E, with the radial part of t */
+static double HamTermElement(HAM_TERM *t, int n_shells,
+			     SHELL_STATE *sbra, SHELL_STATE *sket) {
+  INTERACT_SHELL *s;
+  int nk0, nk, *kk, k, *kk0, i;
+  double *ang, se, sd, x, z0, *y;
+
+  s = t->s;
+  if (t->type == 0) return 0.0;
+  if (t->type == 1) {
+    k = 0;
+    kk0 = &k;
+    y = &z0;
+    AngularZ(&y, &kk0, 1, n_shells, sbra, sket, s, s+1);
+    if (fabs(z0) < EPS30) return 0.0;
+    z0 *= sqrt(s[0].j + 1.0);
+    return t->r0*z0;
+  }
+
+  z0 = 0.0;
+  nk0 = 0;
+  if (t->ks[1] == t->ks[2]) {
+    nk0 = 1;
+    k = 0;
+    kk0 = &k;
+    y = &z0;
+    nk0 = AngularZ(&y, &kk0, nk0, n_shells, sbra, sket, s, s+3);
+    if (nk0 > 0) {
+      z0 /= sqrt(s[0].j + 1.0);
+      if (IsOdd((s[0].j - s[2].j)/2)) z0 = -z0;
+    }
+  }
+
+  x = 0.0;    
+  nk = AngularZxZ0(&ang, &kk, 0, n_shells, sbra, sket, s);
+  for (i = 0; i < nk; i++) {
+    sd = 0;
+    se = 0;
+    if (fabs(ang[i]) > EPS30) {
+      HamTermSlater(t, kk[i], &sd, &se);
+      x += ang[i] * (sd+se);
+    } else if (nk0 > 0) {
+      HamTermSlater(t, kk[i], &sd, NULL);
+    }
+    if (nk0 > 0) x -= z0 * sd;
+  }
+
+  if (nk > 0) {
+    free(ang);
+    free(kk);
+  }
+  return x;
+}
+
+/* 
+** the elements of h between the states i0 <= i < i1 and j0 <= j < j1,
+** i <= j, which must each be from one configuration. the interacting 
+** shells and the radial integrals are found once for the sub-block, 
+** only the angular coefficients are computed for each pair of states.
+** the elements are the same as given by HamiltonElement.
+*/
+static void HamiltonConfigBlock(HAMILTON *h, int isym, 
+				int i0, int i1, int j0, int j1) {
+  SYMMETRY *sym;
+  STATE *si, *sj;
+  CONFIG *ci, *cj;
+  SHELL_STATE *sbra, *sket;
+  INTERACT_DATUM *idatum;
+  HAM_TERM *t;
+  int i, j, k, nt, n_shells, p;
+  double x, x1, x2, r;
+
+  sym = GetSymmetry(isym);
+  si = (STATE *) ArrayGet(&(sym->states), h->basis[i0]);
+  sj = (STATE *) ArrayGet(&(sym->states), h->basis[j0]);
+  ci = GetConfig(si);
+  cj = GetConfig(sj);
+  
+  n_shells = 0;
+  if (ci->n_shells > 0 && cj->n_shells > 0) n_shells = 1;
+  switch (ci_level) {
+  case 1:
+    if (ci != cj) {
+      n_shells = 0;
+      break;
+    }
+  case 2:
+    if (ci->nnrs != cj->nnrs ||
+	memcmp(ci->nrs, cj->nrs, sizeof(int)*ci->nnrs)) {
+      n_shells = 0;
+      break;
+    }
+  case 3:
+    if (si->kgroup != sj->kgroup) n_shells = 0;
+  }
+  if (n_shells > 0 && (ci->n_csfs == 0 || cj->n_csfs == 0)) {
+    for (j = j0; j < j1; j++) {
+      p = j*(j+1)/2;
+      for (i = i0; i < i1 && i <= j; i++) {
+	h->hamilton[i+p] = HamiltonElement(isym, h->basis[i], h->basis[j]);
+      }
+    }
+    return;
+  }
+
+  t = NULL;
+  nt = 0;
+  idatum = NULL;
+  if (n_shells > 0) {
+    n_shells = GetInteract(&idatum, &sbra, &sket, 
+			   si->kgroup, sj->kgroup,
+			   si->kcfg, sj->kcfg,
+			   si->kstate, sj->kstate, 0);
+    if (n_shells > 0) {
+      free(sbra);
+      free(sket);
+      t = malloc(sizeof(HAM_TERM)*(n_shells*(n_shells+3)/2 + 1));
+      nt = HamiltonTerms(t, n_shells, idatum);
+    }
+  }
+
+  for (j = j0; j < j1; j++) {
+    p = j*(j+1)/2;
+    for (i = i0; i < i1 && i <= j; i++) {
+      if (n_shells <= 0) {
+	h->hamilton[i+p] = 0.0;
+	continue;
+      }
+      si = (STATE *) ArrayGet(&(sym->states), h->basis[i]);
+      sj = (STATE *) ArrayGet(&(sym->states), h->basis[j]);
+      GetInteract(&idatum, &sbra, &sket, 
+		  si->kgroup, sj->kgroup,
+		  si->kcfg, sj->kcfg,
+		  si->kstate, sj->kstate, 0);
+      x1 = 0.0;
+      x2 = 0.0;
+      for (k = 0; k < nt; k++) {
+	r = HamTermElement(t+k, n_shells, sbra, sket);
+	if (t[k].type == 2) x2 += r;
+	else x1 += r;
+      }
+      x = sqrt(sbra[0].totalJ + 1.0);
+      if (IsOdd(idatum->phase)) x = -x;
+      x1 /= x;
+      x2 /= x;
+      if (h->basis[i] == h->basis[j]) {
+	x1 += ci->delta;
+      }
+      h->hamilton[i+p] = x1 + x2;
+      free(sbra);
+      free(sket);
+    }
+  }
+  if (t) FreeHamTerms(t, nt);
+}
+
 int TestHamilton(void) {
   CONFIG_GROUP *g;
   CONFIG *c;
@@ -1815,6 +2191,171 @@ int TestHamilton(void) {
   return 0;
 }
 
+/* 
+** block Davidson iteration for the k lowest eigenpairs of the packed
+** h->hamilton, with the diagonal preconditioner. the eigenvalues and
+** vectors are stored in h->mixing as DiagnolizeHamilton does. 
+** returns -1 if not converged, and h->hamilton is then intact.
+*/
+static int DavidsonHamilton(HAMILTON *h, int k) {
+  char jobz[] = "V";
+  char uplo[] = "U";
+  char trans[] = "N";
+  char transt[] = "T";
+  int n, mmax, nv, nw, nc, i, j, p, t, it, one, info, ierr;
+  int *idx;
+  double *ap, *d, *v, *av, *tm, *tp, *th, *y, *x, *ax, *r, *c, *wk;
+  double d_one, d_zero, a, b;
+
+  n = h->dim;
+  ap = h->hamilton;
+  mmax = 3*k;
+  if (mmax < k+32) mmax = k+32;
+  if (mmax > n) mmax = n;
+  d = malloc(sizeof(double)*n);
+  v = malloc(sizeof(double)*n*mmax);
+  av = malloc(sizeof(double)*n*mmax);
+  x = malloc(sizeof(double)*n*k);
+  ax = malloc(sizeof(double)*n*k);
+  r = malloc(sizeof(double)*n*k);
+  tm = malloc(sizeof(double)*mmax*mmax);
+  tp = malloc(sizeof(double)*mmax*(mmax+1)/2);
+  th = malloc(sizeof(double)*mmax);
+  y = malloc(sizeof(double)*mmax*mmax);
+  wk = malloc(sizeof(double)*3*mmax);
+  idx = malloc(sizeof(int)*n);
+  one = 1;
+  d_one = 1.0;
+  d_zero = 0.0;
+
+  /* start from the basis states of the k lowest diagonal elements */
+  for (i = 0; i < n; i++) {
+    d[i] = ap[i*(i+1)/2 + i];
+    idx[i] = i;
+  }
+  for (i = 0; i < k; i++) {
+    p = i;
+    for (j = i+1; j < n; j++) {
+      if (d[idx[j]] < d[idx[p]]) p = j;
+    }
+    t = idx[i];
+    idx[i] = idx[p];
+    idx[p] = t;
+  }
+  for (i = 0; i < k*n; i++) v[i] = 0.0;
+  for (i = 0; i < k; i++) v[i*n+idx[i]] = 1.0;
+  nv = 0;
+  nw = k;
+  ierr = -1;
+  for (it = 0; it < DAVIDSONMAXITER; it++) {
+    /* extend the projected matrix by the nw new vectors */
+    for (j = nv; j < nv+nw; j++) {
+      DSPMV(uplo, n, d_one, ap, v+j*n, one, d_zero, av+j*n, one);
+      for (i = 0; i <= j; i++) {
+	a = DDOT(n, v+i*n, one, av+j*n, one);
+	tm[i*mmax+j] = a;
+	tm[j*mmax+i] = a;
+      }
+    }
+    nv += nw;
+    for (j = 0, p = 0; j < nv; j++) {
+      for (i = 0; i <= j; i++) {
+	tp[p++] = tm[i*mmax+j];
+      }
+    }
+    DSPEV(jobz, uplo, nv, tp, th, y, nv, wk, &info);
+    if (info) break;
+    /* ritz vectors and residuals of the k lowest */
+    nc = 0;
+    for (i = 0; i < k; i++) {
+      DGEMV(trans, n, nv, d_one, v, n, y+i*nv, one, d_zero, x+i*n, one);
+      DGEMV(trans, n, nv, d_one, av, n, y+i*nv, one, d_zero, ax+i*n, one);
+      for (j = 0; j < n; j++) {
+	r[nc*n+j] = ax[i*n+j] - th[i]*x[i*n+j];
+      }
+      a = sqrt(DDOT(n, r+nc*n, one, r+nc*n, one));
+      if (a < davidson_tol) continue;
+      for (j = 0; j < n; j++) {
+	b = th[i] - d[j];
+	if (fabs(b) < 1E-8) b = b < 0? -1E-8:1E-8;
+	r[nc*n+j] /= b;
+      }
+      nc++;
+    }
+    if (nc == 0) {
+      ierr = 0;
+      break;
+    }
+    /* restart from the ritz vectors */
+    if (nv + nc > mmax) {
+      memcpy(v, x, sizeof(double)*n*k);
+      memcpy(av, ax, sizeof(double)*n*k);
+      for (i = 0; i < k; i++) {
+	for (j = 0; j < k; j++) {
+	  tm[i*mmax+j] = i==j?th[i]:0.0;
+	}
+      }
+      nv = k;
+    }
+    /* orthonormalize the corrections, twice against v for stability */
+    nw = 0;
+    for (i = 0; i < nc; i++) {
+      c = r + i*n;
+      for (p = 0; p < 2; p++) {
+	DGEMV(transt, n, nv+nw, d_one, v, n, c, one, d_zero, wk, one);
+	for (j = 0; j < nv+nw; j++) {
+	  a = -wk[j];
+	  for (t = 0; t < n; t++) c[t] += a*v[j*n+t];
+	}
+      }
+      a = sqrt(DDOT(n, c, one, c, one));
+      if (a < 1E-10) continue;
+      a = 1.0/a;
+      for (t = 0; t < n; t++) v[(nv+nw)*n+t] = a*c[t];
+      nw++;
+    }
+    if (nw == 0) break;
+  }
+  if (ierr == 0) {
+    memcpy(h->mixing, th, sizeof(double)*k);
+    memcpy(h->mixing+n, x, sizeof(double)*n*k);
+    h->neig = k;
+  }
+  free(d);
+  free(v);
+  free(av);
+  free(x);
+  free(ax);
+  free(r);
+  free(tm);
+  free(tp);
+  free(th);
+  free(y);
+  free(wk);
+  free(idx);
+  return ierr;
+}
+
+/*
+** diagonalize the current Hamiltonian for the lowest levels set by 
+** SetDavidson, or in full if the block is small or has perturbing
+** states or an effective Hamiltonian.
+*/
+int DiagnolizeHamiltonLowest(void) {
+  HAMILTON *h;
+  int k;
+
+  h = &_ham;
+  k = davidson_nroots;
+  if (ci_level != -1 && h->heff == NULL && h->n_basis == h->dim &&
+      k > 0 && 2*k <= h->dim && h->dim >= davidson_nmin) {
+    if (DavidsonHamilton(h, k) == 0) return 0;
+    MPrintf(0, "Davidson not converged, use full diagonalization %d %d\n",
+	    h->pj, h->dim);
+  }
+  return DiagnolizeHamilton();
+}
+
 /* 
 ** be careful that the h->hamilton or h->heff is overwritten
 ** after the DiagnolizeHamilton call
@@ -1859,6 +2400,7 @@ int DiagnolizeHamilton(void) {
 	mixing++;
       }
     }
+    h->neig = n;
     return 0;
   }
 
@@ -1879,6 +2421,7 @@ int DiagnolizeHamilton(void) {
     if (info) {
       goto ERROR;
     }
+    h->neig = n;
   } else {
     ap = h->heff;
     wi = h->work + lwork;
@@ -1888,6 +2431,7 @@ int DiagnolizeHamilton(void) {
       printf("dgeev Error: %d\n", info);	
       goto ERROR;
     }
+    h->neig = n;
   }
 
   if (m > n) {
@@ -2009,7 +2553,7 @@ int AddToLevels(int ng, int *kg) {
 
   if (h->pj < 0) {
     j = n_eblevels;
-    for (i = 0; i < d; i++) {
+    for (i = 0; i < h->neig; i++) {
       k = GetPrincipleBasis(mix, d, NULL);
       lev.energy = h->mixing[i];
       lev.pj = h->pj;
@@ -2044,7 +2588,7 @@ int AddToLevels(int ng, int *kg) {
 
   j = n_levels;
   sym = GetSymmetry(h->pj);  
-  for (i = 0; i < d; i++) {
+  for (i = 0; i < h->neig; i++) {
     k = GetPrincipleBasis(mix, d, NULL);
     s = (STATE *) ArrayGet(&(sym->states), h->basis[k]);
     if (ng > 0) {      
@@ -2440,8 +2984,82 @@ int SortLevels(int start, int n, int m) {
   return 0;
 }
 
+/* DLAMCH and DLARTG set up their saved constants on the first call
+   without a lock. call DSPEV once before the threads do. */
+static void InitDSPEV(void) {
+  static int done = 0;
+  char jobz[] = "V";
+  char uplo[] = "U";
+  double ap[10] = {2.0, 1.0, 2.0, 0.0, 1.0, 2.0, 0.0, 0.0, 1.0, 2.0};
+  double w[4], z[16], wk[12];
+  int info;
+
+  if (done) return;
+  DSPEV(jobz, uplo, 4, ap, w, z, 4, wk, &info);
+  done = 1;
+}
+
+/* build and diagonalize the block isym in the Hamiltonian of the 
+   calling thread, and keep the levels in r for AddToLevels. */
+static int FarmHamilton(int isym, int k0, int k, int *kg, HAMILTON *r) {
+  HAMILTON *h;
+  int m;
+
+  h = &_ham;
+  r->neig = -1;
+  if (ConstructHamilton(isym, k0, k, kg, 0, NULL, 100) < 0) return -1;
+  HamiltonBlock(h, isym, 0);
+  if (DiagnolizeHamiltonLowest() < 0) return -1;
+  r->pj = h->pj;
+  r->dim = h->dim;
+  r->n_basis = h->n_basis;
+  r->basis = malloc(sizeof(int)*h->n_basis);
+  memcpy(r->basis, h->basis, sizeof(int)*h->n_basis);
+  m = h->dim + h->neig*h->n_basis;
+  r->mixing = malloc(sizeof(double)*m);
+  memcpy(r->mixing, h->mixing, sizeof(double)*m);
+  r->neig = h->neig;
+  return 0;
+}
+
+/* move the levels kept by FarmHamilton back to the Hamiltonian */
+static int RestoreHamilton(HAMILTON *r) {
+  HAMILTON *h;
+  int k;
+
+  if (r->neig < 0) return -1;
+  h = &_ham;
+  k = AllocHamMem(r->dim, r->n_basis);
+  if (k >= 0) {
+    h->pj = r->pj;
+    memcpy(h->basis, r->basis, sizeof(int)*r->n_basis);
+    memcpy(h->mixing, r->mixing, 
+	   sizeof(double)*(r->dim + r->neig*r->n_basis));
+    h->neig = r->neig;
+  }
+  free(r->basis);
+  free(r->mixing);
+  r->neig = 0;
+  return k < 0? -1 : 0;
+}
+
+/* free the levels kept by FarmHamilton and not yet restored */
+static void FreeFarmed(HAMILTON *hf, int ns) {
+  int i;
+
+  if (hf == NULL) return;
+  for (i = 0; i < ns; i++) {
+    if (hf[i].neig > 0) {
+      free(hf[i].basis);
+      free(hf[i].mixing);
+    }
+  }
+  free(hf);
+}
+
 int SolveStructure(char *fn, int ng, int *kg, int ngp, int *kgp, int ip) {
-  int ng0, nlevels, ns, k, i;
+  int ng0, nlevels, ns, k, i, nt, nf;
+  HAMILTON *hf;
   
   if (ngp < 0) return 0;  
   ng0 = ng;
@@ -2461,11 +3079,49 @@ int SolveStructure(char *fn, int ng, int *kg, int ngp, int *kgp, int ip) {
     AddToLevels(ng0, kg);
   } else {
     ns = MAX_SYMMETRIES;
+    /* the small blocks without perturbing states are built and 
+       diagonalized whole by one thread each, the large ones in turn
+       with the elements shared out among the threads. */
+    hf = NULL;
+    nf = 0;
+    ThreadMPI(&nt);
+    if (nt > 1 && ci_level != -1) {
+      hf = malloc(sizeof(HAMILTON)*ns);
+      for (i = 0; i < ns; i++) {
+	hf[i].neig = 0;
+	k = ConstructHamilton(i, ng0, ng, kg, ngp, kgp, 100);
+	if (k < 0) continue;
+	if (_ham.n_basis == _ham.dim && _ham.dim <= SMALLHAM) {
+	  hf[i].neig = 1;
+	  nf++;
+	}
+      }
+    }
+    if (nf > 0) {
+      InitDSPEV();
+#pragma omp parallel default(shared) private(i)
+      {
+	for (i = 0; i < ns; i++) {
+	  if (hf[i].neig == 0) continue;
+	  if (SkipOMP()) continue;
+	  FarmHamilton(i, ng0, ng, kg, hf+i);
+	}
+      }
+    }
     for (i = 0; i < ns; i++) {
-      k = ConstructHamilton(i, ng0, ng, kg, ngp, kgp, 111);
-      if (k < 0) continue;
-      if (DiagnolizeHamilton() < 0) {
-	return -1;
+      if (nf > 0 && hf[i].neig != 0) {
+	if (RestoreHamilton(hf+i) < 0) {
+	  FreeFarmed(hf, ns);
+	  return -1;
+	}
+	ConstructHamilton(i, ng0, ng, kg, ngp, kgp, 1);
+      } else {
+	k = ConstructHamilton(i, ng0, ng, kg, ngp, kgp, 111);
+	if (k < 0) continue;
+	if (DiagnolizeHamiltonLowest() < 0) {
+	  FreeFarmed(hf, ns);
+	  return -1;
+	}
       }
       if (ng0 < ng) {
 	AddToLevels(ng0, kg);
@@ -2473,6 +3129,7 @@ int SolveStructure(char *fn, int ng, int *kg, int ngp, int *kgp, int ip) {
 	AddToLevels(0, kg);
       }
     }
+    FreeFarmed(hf, ns);
   }
 
   SortLevels(nlevels, -1, 0);
@@ -2509,7 +3166,7 @@ int GetNumElectrons(int k) {
 
 int SaveEBLevels(char *fn, int m, int n) {
   int n0, k, i, ilev, mlev, nele;
-  FILE *f;
+  TFILE *f;
   LEVEL *lev;
   F_HEADER fhdr;
   ENF_HEADER enf_hdr;
@@ -2560,7 +3217,7 @@ int SaveLevels(char *fn, int m, int n) {
   char name[LEVEL_NAME_LEN];
   char sname[LEVEL_NAME_LEN];
   char nc[LEVEL_NAME_LEN];
-  FILE *f;
+  TFILE *f;
   int i, k, p, j0;
   int nele, nele0, vnl, ib, dn, ik;
   int si, ms, mst, t, q, nk, n0;
@@ -3098,6 +3755,42 @@ void StructureEB(char *fn, int n, int *ilev) {
   SaveEBLevels(fn, k, -1);
 }
 
+static void InitAngZData(void *p, int n) {
+  ANGZ_DATUM *d;
+  int i;
+
+  d = (ANGZ_DATUM *) p;
+  for (i = 0; i < n; i++) {
+    d[i].ns = 0;
+    d[i].nz = NULL;
+    d[i].angz = NULL;
+    d[i].mk = NULL;
+  }
+}
+
+static void FreeAngZData(void *p) {
+  FreeAngZDatum((ANGZ_DATUM *) p);
+}
+
+/* the entry of the pair ih1, ih2 in ma, created empty on first use */
+static ANGZ_DATUM *AngZDatum(MULTI *ma, int ih1, int ih2) {
+  int index[2];
+
+  index[0] = ih1;
+  index[1] = ih2;
+  return (ANGZ_DATUM *) MultiSet(ma, index, NULL, NULL, 
+				 InitAngZData, FreeAngZData);
+}
+
+/* the entry of the pair ih1, ih2 in ma, NULL if it is not there */
+static ANGZ_DATUM *FindAngZDatum(MULTI *ma, int ih1, int ih2) {
+  int index[2];
+
+  index[0] = ih1;
+  index[1] = ih2;
+  return (ANGZ_DATUM *) MultiGet(ma, index, NULL);
+}
+
 int AngularZMixStates(ANGZ_DATUM **ad, int ih1, int ih2) {
   int kg1, kg2, kc1, kc2;
   int ns, n, p, q, nz, iz, iz1, iz2;
@@ -3116,13 +3809,14 @@ int AngularZMixStates(ANGZ_DATUM **ad, int ih1, int ih2) {
   SHELL *bra;
   SHELL_STATE *sbra, *sket;
   ANGULAR_ZMIX **a, *ang;
+  LOCK *lock;
 #ifdef PERFORM_STATISTICS
   clock_t start, stop;
   start = clock();
 #endif
   
-  iz = ih1*angz_dim + ih2;
-  *ad = &(angz_array[iz]);
+  iz = ih1*MAX_HAMS + ih2;
+  *ad = AngZDatum(angz_array, ih1, ih2);
   ns = (*ad)->ns;
   if (ns < 0) {
 #ifdef PERFORM_STATISTICS
@@ -3142,17 +3836,21 @@ int AngularZMixStates(ANGZ_DATUM **ad, int ih1, int ih2) {
     return ns;
   }
 
+  lock = &(angz_lock[iz%NANGZLOCK]);
+  SetLock(lock);
+  ns = (*ad)->ns;
+  if (ns != 0) {
+    ReleaseLock(lock);
+    return ns;
+  }
   ns1 = hams[ih1].nbasis;
   ns2 = hams[ih2].nbasis;
-  (*ad)->ns = ns1*ns2;
-  ns = (*ad)->ns;
-  (*ad)->angz = malloc(sizeof(ANGULAR_ZMIX *)*ns);
-  (*ad)->nz = (int *) malloc(sizeof(int)*ns);
+  ns = ns1*ns2;
+  a = (ANGULAR_ZMIX **) malloc(sizeof(ANGULAR_ZMIX *)*ns);
+  pnz = (int *) malloc(sizeof(int)*ns);
   iz = 0;
   iz1 = 0;
   iz2 = 0;
-  a = (ANGULAR_ZMIX **) (*ad)->angz;
-  pnz = (*ad)->nz;
 
   for (i1 = 0; i1 < ns1; i1++) {
     s1 = hams[ih1].basis[i1];
@@ -3286,7 +3984,13 @@ int AngularZMixStates(ANGZ_DATUM **ad, int ih1, int ih2) {
   timing.n_angz_states++;
 #endif
 
-  return (*ad)->ns;
+  (*ad)->angz = (void **) a;
+  (*ad)->nz = pnz;
+#pragma omp flush
+  (*ad)->ns = ns;
+  ReleaseLock(lock);
+#pragma omp flush
+  return ns;
 }
 
 int AngZSwapBraKet(int nz, ANGULAR_ZMIX *ang, int p) {
@@ -3324,14 +4028,15 @@ int AngularZFreeBoundStates(ANGZ_DATUM **ad, int ih1, int ih2) {
   SHELL_STATE *sbra, *sket;
   CONFIG *c1, *c2;
   ANGULAR_ZFB *ang, **a;
+  LOCK *lock;
   
 #ifdef PERFORM_STATISTICS
   clock_t start, stop;
   start = clock();
 #endif
   
-  iz = ih1*angz_dim + ih2;
-  *ad = &(angz_array[iz]);
+  iz = ih1*MAX_HAMS + ih2;
+  *ad = AngZDatum(angz_array, ih1, ih2);
   ns = (*ad)->ns;
 
   if (ns < 0) {
@@ -3349,18 +4054,22 @@ int AngularZFreeBoundStates(ANGZ_DATUM **ad, int ih1, int ih2) {
     return ns;
   }
 
+  lock = &(angz_lock[iz%NANGZLOCK]);
+  SetLock(lock);
+  ns = (*ad)->ns;
+  if (ns != 0) {
+    ReleaseLock(lock);
+    return ns;
+  }
   ns1 = hams[ih1].nbasis;
   ns2 = hams[ih2].nbasis;
-  (*ad)->ns = ns1 * ns2;
-  ns = (*ad)->ns;
-  (*ad)->angz = malloc(sizeof(ANGULAR_ZMIX *)*ns);
-  (*ad)->nz = (int *) malloc(sizeof(int)*ns);
+  ns = ns1*ns2;
+  a = (ANGULAR_ZFB **) malloc(sizeof(ANGULAR_ZFB *)*ns);
+  pnz = (int *) malloc(sizeof(int)*ns);
   
   kmax = GetMaxRank();
 
   iz = 0;
-  a = (ANGULAR_ZFB **) (*ad)->angz;
-  pnz = (*ad)->nz;
     
   for (i1 = 0; i1 < ns1; i1++) {
     s1 = hams[ih1].basis[i1];
@@ -3442,7 +4151,13 @@ int AngularZFreeBoundStates(ANGZ_DATUM **ad, int ih1, int ih2) {
   stop = clock();
   timing.angzfb_states += stop-start;
 #endif
-  return (*ad)->ns;
+  (*ad)->angz = (void **) a;
+  (*ad)->nz = pnz;
+#pragma omp flush
+  (*ad)->ns = ns;
+  ReleaseLock(lock);
+#pragma omp flush
+  return ns;
 }
 
 int AngularZxZMixStates(ANGZ_DATUM **ad, int ih1, int ih2) {
@@ -3465,14 +4180,15 @@ int AngularZxZFreeBoundStates(ANGZ_DATUM **ad, int ih1, int ih2) {
   CONFIG *c1, *c2;
   STATE *s1, *s2;
   ANGULAR_ZxZMIX **a, *ang;
+  LOCK *lock;
 
 #ifdef PERFORM_STATISTICS
   clock_t start, stop; 
   start = clock();
 #endif
 
-  iz = ih1 * angz_dim + ih2;
-  *ad = &(angzxz_array[iz]);
+  iz = ih1*MAX_HAMS + ih2;
+  *ad = AngZDatum(angzxz_array, ih1, ih2);
   ns = (*ad)->ns;
 
   if (ns < 0) { 
@@ -3491,16 +4207,20 @@ int AngularZxZFreeBoundStates(ANGZ_DATUM **ad, int ih1, int ih2) {
     return ns;
   }
   
+  lock = &(angz_lock[iz%NANGZLOCK]);
+  SetLock(lock);
+  ns = (*ad)->ns;
+  if (ns != 0) {
+    ReleaseLock(lock);
+    return ns;
+  }
   ns1 = hams[ih1].nbasis;
   ns2 = hams[ih2].nbasis;
-  (*ad)->ns = ns1*ns2;
-  ns = (*ad)->ns;
-  (*ad)->angz = malloc(sizeof(ANGULAR_ZxZMIX *)*ns);
-  (*ad)->nz = (int *) malloc(sizeof(int)*ns);
+  ns = ns1*ns2;
+  a = (ANGULAR_ZxZMIX **) malloc(sizeof(ANGULAR_ZxZMIX *)*ns);
+  pnz = (int *) malloc(sizeof(int)*ns);
   
   iz = 0;
-  a = (ANGULAR_ZxZMIX **) (*ad)->angz;
-  pnz = (*ad)->nz;  
 
 
   for (i1 = 0; i1 < ns1; i1++) {
@@ -3598,26 +4318,27 @@ int AngularZxZFreeBoundStates(ANGZ_DATUM **ad, int ih1, int ih2) {
   timing.angzfb_states += stop-start;
 #endif
 
-  return (*ad)->ns;
+  (*ad)->angz = (void **) a;
+  (*ad)->nz = pnz;
+#pragma omp flush
+  (*ad)->ns = ns;
+  ReleaseLock(lock);
+#pragma omp flush
+  return ns;
 }
 
 int PrepAngular(int n1, int *is1, int n2, int *is2) {
   int i1, i2, ih1, ih2, ns1, ns2, ne1, ne2;
-  int iz, is, i, nz, ns;
+  int is, i, nz, ns, blocks[2] = {MAX_HAMS, MAX_HAMS};
   SYMMETRY *sym1, *sym2;
   STATE *s1, *s2;
   LEVEL *lev1, *lev2;
   ANGZ_DATUM *ad;
 
   if (angmz_array == NULL) {
-    angmz_array = malloc(sizeof(ANGZ_DATUM)*angz_dim2);
-    if (!angmz_array) {
-      printf("cannot allocate memory for angmz_array %d\n", angz_dim2);
-    }
-    for (i = 0; i < angz_dim2; i++) {
-      angmz_array[i].ns = 0;
-      angmz_array[i].mk = NULL;
-    }
+    angmz_array = malloc(sizeof(MULTI));
+    MultiInit(angmz_array, sizeof(ANGZ_DATUM), 2, blocks, "angmz_array");
+    SetMultiKeep(angmz_array, 1);
   }
 
   if (n2 == 0) {
@@ -3645,22 +4366,21 @@ int PrepAngular(int n1, int *is1, int n2, int *is2) {
       ns = ns1*ns2;
       if (ne1 == ne2) {
 	if (ih1 > ih2) {
-	  iz = ih2 * MAX_HAMS + ih1;
+	  ad = AngZDatum(angmz_array, ih2, ih1);
 	  is = lev2->ilev * hams[ih1].nlevs + lev1->ilev;
 	} else {
-	  iz = ih1 * MAX_HAMS + ih2;
+	  ad = AngZDatum(angmz_array, ih1, ih2);
 	  is = lev1->ilev *hams[ih2].nlevs + lev2->ilev;
 	}
       } else {
 	if (ne1 > ne2) {
-	  iz = ih2 * MAX_HAMS + ih1;
+	  ad = AngZDatum(angmz_array, ih2, ih1);
 	  is = lev2->ilev * hams[ih1].nlevs + lev1->ilev;
 	} else {
-	  iz = ih1 * MAX_HAMS + ih2;
+	  ad = AngZDatum(angmz_array, ih1, ih2);
 	  is = lev1->ilev *hams[ih2].nlevs + lev2->ilev;
 	}
       }
-      ad = &(angmz_array[iz]);
       if (ad->ns == 0) {
 	if (ne1 == ne2) {
 	  ad->angz = malloc(sizeof(ANGULAR_ZMIX *)*ns);
@@ -3724,10 +4444,9 @@ int AngularZFreeBound(ANGULAR_ZFB **ang, int lower, int upper) {
     ih1 = lev1->iham;
     ih2 = lev2->iham;
     if (ih1 >= 0 && ih2 >= 0) {
-      isz = ih1 * MAX_HAMS + ih2;
-      ad = &(angmz_array[isz]);
+      ad = FindAngZDatum(angmz_array, ih1, ih2);
       nz = 0;
-      if (ad->ns > 0) {
+      if (ad && ad->ns > 0) {
 	isz0 = lev1->ilev * hams[ih2].nlevs + lev2->ilev;
 	nz = (ad->nz)[isz0];
 	if (nz > 0) {
@@ -3854,13 +4573,12 @@ int AngularZMix(ANGULAR_ZMIX **ang, int lower, int upper, int mink, int maxk,
     ih2 = lev2->iham;
     if (ih1 >= 0 && ih2 >= 0) {
       if (ih1 > ih2) {
-	isz = ih2 * MAX_HAMS + ih1;
+	ad = FindAngZDatum(angmz_array, ih2, ih1);
       } else {
-	isz = ih1 * MAX_HAMS + ih2;
+	ad = FindAngZDatum(angmz_array, ih1, ih2);
       }
-      ad = &(angmz_array[isz]);
       nz = 0;
-      if (ad->ns > 0) {
+      if (ad && ad->ns > 0) {
 	if (ih1 > ih2) {
 	  isz0 = lev2->ilev * hams[ih1].nlevs + lev1->ilev;
 	} else {
@@ -4541,49 +5259,35 @@ void FreeAngZDatum(ANGZ_DATUM *ap) {
 }
 
 int InitAngZArray(void) {
-  int i;
+  int i, blocks[2] = {MAX_HAMS, MAX_HAMS};
 
-  angz_dim = MAX_HAMS;
-  angz_dim2 = angz_dim*angz_dim;
-  
-  angz_array = malloc(sizeof(ANGZ_DATUM)*angz_dim2);
-  if (!angz_array) {
-    printf("cannot allocate memory for angz_array %d\n", angz_dim2);
+  /* the tables are kept across reinitializations, only their data 
+     are freed by FreeAngZArray */
+  if (angz_array == NULL) {
+    angz_array = malloc(sizeof(MULTI));
+    MultiInit(angz_array, sizeof(ANGZ_DATUM), 2, blocks, "angz_array");
+    SetMultiKeep(angz_array, 1);
+    angzxz_array = malloc(sizeof(MULTI));
+    MultiInit(angzxz_array, sizeof(ANGZ_DATUM), 2, blocks, "angzxz_array");
+    SetMultiKeep(angzxz_array, 1);
   }
-  angzxz_array = malloc(sizeof(ANGZ_DATUM)*angz_dim2);
-  if (!angzxz_array) {
-    printf("cannot allocate memory for angzxz_array %d\n", angz_dim2);
-  }
-
-  angmz_array = NULL;
-  for (i = 0; i < angz_dim2; i++) {
-    angz_array[i].ns = 0;
-    angzxz_array[i].ns = 0;
-    angz_array[i].mk = NULL;
-    angzxz_array[i].mk = NULL;
+  if (!angz_lock_init) {
+    for (i = 0; i < NANGZLOCK; i++) {
+      InitLock(&(angz_lock[i]));
+    }
+    angz_lock_init = 1;
   }
   
   return 0;
 }
   
 int FreeAngZArray(void) {  
-  int i;
-  
-  if (angz_dim2 > 0) {
-    for (i = 0; i < angz_dim2; i++) {
-      FreeAngZDatum(&(angz_array[i]));
-      FreeAngZDatum(&(angzxz_array[i]));
-    }
-    free(angz_array);
-    free(angzxz_array);
-    if (angmz_array) {
-      for (i = 0; i < angz_dim2; i++) {
-	FreeAngZDatum(&(angmz_array[i]));
-      }
-      free(angmz_array);
-    }
-    angz_dim = 0;
-    angz_dim2 = 0;
+  if (angz_array) {
+    MultiFreeData(angz_array, FreeAngZData);
+    MultiFreeData(angzxz_array, FreeAngZData);
+  }
+  if (angmz_array) {
+    MultiFreeData(angmz_array, FreeAngZData);
   }
   
   return 0;
@@ -47,6 +47,7 @@ typedef struct _HAMILTON_ {
   double *work;
   int *iwork;
   double *heff;
+  int neig;
 } HAMILTON;
 
 typedef struct _SHAMILTON_ {
@@ -163,6 +164,7 @@ double Hamilton1E(int n_shells, SHELL_STATE *sbra,
 HAMILTON *GetHamilton(void);
 SHAMILTON *GetSHamilton(int *n);
 int DiagnolizeHamilton(void);
+int DiagnolizeHamiltonLowest(void);
 int AddToLevels(int ng, int *kg);
 int AddECorrection(int kref, int k, double e, int nmin);
 LEVEL *GetLevel(int k);
@@ -212,6 +214,8 @@ int SetAngZOptions(int n, double mc, double c);
 int SetAngZCut(double c);
 int SetCILevel(int m);
 int SetMixCut(double c, double c2);
+int SetDavidson(int n, int nmin, double tol);
+void FreeAngZDatum(ANGZ_DATUM *ap);
 int FreeAngZArray(void);
 int InitAngZArray(void);
 void ClearRMatrixLevels(int n);
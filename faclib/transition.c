@@ -44,12 +44,20 @@ static struct {
   double eps;
 } transition_option = {DGAUGE, DMODE, ERANK, MRANK, TRCUT0, TRCUT};
 
+#define NTRBLOCK 1024
+
 typedef struct {
   TR_RECORD r;
   TR_EXTRA rx;
   int ks[2];
 } TR_DATUM;
 
+typedef struct {
+  int upper;
+  int n;
+  TR_RECORD *r;
+} TR_UPPER;
+
 int SetTransitionCut(double c0, double c) {
   if (c0 >= 0) {
     transition_option.eps0 = c0;
@@ -402,7 +410,7 @@ int SaveTransitionEB0(int nlow, int *low, int nup, int *up,
   TRF_HEADER tr_hdr;
   TRF_RECORD r;
   LEVEL *lev1, *lev2;
-  FILE *f;
+  TFILE *f;
   
   if (nlow <= 0 || nup <= 0) return -1;
   if (m == 1 || transition_option.mode == M_FR) {
@@ -428,7 +436,6 @@ int SaveTransitionEB0(int nlow, int *low, int nup, int *up,
     emax *= FINE_STRUCTURE_CONST;
     e0 = 2.0*(emax-emin)/(emin+emax);
     
-    FreeMultipoleArray();
     if (e0 < EPS3) {
       SetAWGrid(1, 0.5*(emin+emax), emax);
     } else if (e0 < 1.0) {
@@ -480,16 +487,76 @@ int SaveTransitionEB0(int nlow, int *low, int nup, int *up,
   return 0;
 }
       
+/* compute the transitions from the level ru->upper to the nlow lower 
+   levels. the records passing the transition_option.eps cut are 
+   allocated in ru->r and freed by the caller. */
+static void TransitionUpper(TR_UPPER *ru, int m, int nlow, int *low) {
+  int i, k, jup;
+  double trd, *s, *et, *a;
+
+  ru->n = 0;
+  ru->r = NULL;
+  s = malloc(sizeof(double)*nlow*3);
+  et = s + nlow;
+  a = et + nlow;
+  jup = LevelTotalJ(ru->upper);
+  trd = 0.0;
+  for (i = 0; i < nlow; i++) {
+    a[i] = 0.0;
+    et[i] = 0.0;
+    k = TRMultipole(s+i, et+i, m, low[i], ru->upper);
+    if (k != 0) continue;
+    OscillatorStrength(m, et[i], s[i], &(a[i]));
+    a[i] /= jup+1.0;
+    trd += a[i];
+  } 
+  if (trd < 1E-30) {
+    free(s);
+    return;
+  }
+  for (i = 0; i < nlow; i++) {
+    if (a[i] <= 0 || a[i] < (transition_option.eps * trd)) continue;
+    ru->n++;
+  }
+  if (ru->n == 0) {
+    free(s);
+    return;
+  }
+  ru->r = (TR_RECORD *) malloc(sizeof(TR_RECORD)*ru->n);
+  k = 0;
+  for (i = 0; i < nlow; i++) {
+    if (a[i] <= 0 || a[i] < (transition_option.eps * trd)) continue;
+    ru->r[k].lower = low[i];
+    ru->r[k].upper = ru->upper;
+    ru->r[k].strength = s[i];
+    k++;
+  }
+  free(s);
+}
+
+/* the upper levels of a TR block */
+typedef struct _TR_BLOCK_ {
+  int m, nlow, *low;
+  TR_UPPER *rb;
+} TR_BLOCK;
+
+static void TRBlockRecord(int k, void *p) {
+  TR_BLOCK *b;
+
+  b = (TR_BLOCK *) p;
+  TransitionUpper(b->rb+k, b->m, b->nlow, b->low);
+}
+
 int SaveTransition0(int nlow, int *low, int nup, int *up, 
 		    char *fn, int m) {
-  int i, j, k, jup;
-  FILE *f;
+  int i, j, k, nb;
+  TFILE *f;
   LEVEL *lev1, *lev2;
-  TR_RECORD r;
-  TR_EXTRA rx;
+  TR_UPPER *rb;
+  TR_BLOCK tb;
   TR_HEADER tr_hdr;
   F_HEADER fhdr;
-  double *s, *et, *a, trd, gf;
+  double gf;
   double e0, emin, emax;
   int ic0, ic1, nic0, nic1, *nc0, *nc1, j0, j1, ntr;
   int imin, imax, jmin, jmax, nrs0, nrs1, ir, ir0;
@@ -528,7 +595,6 @@ int SaveTransition0(int nlow, int *low, int nup, int *up,
   emax *= FINE_STRUCTURE_CONST;
   e0 = 2.0*(emax-emin)/(emin+emax);
     
-  FreeMultipoleArray();
   if (e0 < EPS3) {
     SetAWGrid(1, 0.5*(emin+emax), emax);
   } else if (e0 < 1.0) {
@@ -695,34 +761,28 @@ int SaveTransition0(int nlow, int *low, int nup, int *up,
     free(nc0);
     if (up != low) free(nc1);
   } else {
-    a = malloc(sizeof(double)*nlow);
-    s = malloc(sizeof(double)*nlow);
-    et = malloc(sizeof(double)*nlow);
-    for (j = 0; j < nup; j++) {
-      jup = LevelTotalJ(up[j]);
-      trd = 0.0;
-      for (i = 0; i < nlow; i++) {
-	a[i] = 0.0;
-	et[i] = 0.0;
-	k = TRMultipole(s+i, et+i, m, low[i], up[j]);
-	if (k != 0) continue;
-	gf = OscillatorStrength(m, et[i], s[i], &(a[i]));
-	a[i] /= jup+1.0;
-	trd += a[i];
-      } 
-      if (trd < 1E-30) continue;
-      r.upper = up[j];
-      for (i = 0; i < nlow; i++) {
-	if (a[i] <= 0 || a[i] < (transition_option.eps * trd)) continue;
-	r.lower = low[i];
-	r.strength = s[i];
-	WriteTRRecord(f, &r, NULL);
+    /* upper levels are taken in blocks of NTRBLOCK, see PairBlock */
+    rb = (TR_UPPER *) malloc(sizeof(TR_UPPER)*NTRBLOCK);
+    tb.m = m;
+    tb.nlow = nlow;
+    tb.low = low;
+    tb.rb = rb;
+    for (j = 0; j < nup; j += nb) {
+      nb = Min(NTRBLOCK, nup-j);
+      for (k = 0; k < nb; k++) {
+	rb[k].upper = up[j+k];
+	rb[k].n = 0;
+	rb[k].r = NULL;
+      }
+      ParallelBlock(nb, TRBlockRecord, &tb);
+      for (k = 0; k < nb; k++) {
+	for (i = 0; i < rb[k].n; i++) {
+	  WriteTRRecord(f, rb[k].r+i, NULL);
+	}
+	if (rb[k].r) free(rb[k].r);
       }
     }
-    
-    free(a);
-    free(s);
-    free(et);
+    free(rb);
   }
 
   DeinitFile(f, &fhdr);
@@ -201,7 +201,7 @@ C***END PROLOGUE  DXSET
 C
       DIMENSION LOG102(20), LGTEMP(20)
       SAVE LOG102
-!$OMP THREADPRIVATE(/DXBLK1/,/DXBLK2/,/DXBLK3/)
+!$OMP THREADPRIVATE(/DXBLK1/,/DXBLK2/,/DXBLK3/,IFLAG)
 C
 C   LOG102 CONTAINS THE FIRST 60 DIGITS OF LOG10(2) FOR USE IN
 C CONVERSION OF EXTENDED-RANGE NUMBERS TO BASE 10 .
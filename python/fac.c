@@ -898,6 +898,25 @@ static PyObject *PSetMixCut(PyObject *self, PyObject *args) {
   return Py_None;
 }
 
+static PyObject *PSetDavidson(PyObject *self, PyObject *args) {
+  int n, nmin;
+  double tol;
+
+  if (sfac_file) {
+    SFACStatement("SetDavidson", args, NULL);
+    Py_INCREF(Py_None);
+    return Py_None;
+  }
+
+  nmin = 0;
+  tol = 0.0;
+  if (!PyArg_ParseTuple(args, "i|id", &n, &nmin, &tol))
+    return NULL;
+  SetDavidson(n, nmin, tol);
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
 /** coeff. of fractional parentage **/
 static PyObject *PGetCFPOld(PyObject *self, PyObject *args) {
   int j2, q, dj, dw, pj, pw;
@@ -1249,6 +1268,23 @@ static PyObject *PSetTRF(PyObject *self, PyObject *args) {
   return Py_None;
 }
 
+static PyObject *PSetTableCompression(PyObject *self, PyObject *args) {
+  int m;
+
+  if (sfac_file) {
+    SFACStatement("SetTableCompression", args, NULL);
+    Py_INCREF(Py_None);
+    return Py_None;
+  }
+  
+  if (!PyArg_ParseTuple(args, "i", &m)) return NULL;
+  
+  SetTableCompression(m);
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
 static PyObject *PTestHamilton(PyObject *self, PyObject *args) {
   
   TestHamilton();
@@ -4775,6 +4811,24 @@ static PyObject *PSetSlaterCut(PyObject *self, PyObject *args) {
   return Py_None;
 }  
 
+static PyObject *PSetRadialSIMD(PyObject *self, PyObject *args) {
+  int m, c;
+  
+  if (sfac_file) {
+    SFACStatement("SetRadialSIMD", args, NULL);
+    Py_INCREF(Py_None);
+    return Py_None;
+  }
+
+  c = 0;
+  if (!PyArg_ParseTuple(args, "i|i", &m, &c)) return NULL;
+  
+  SetRadialSIMD(m, c);
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}  
+
 static PyObject *PPropogateDirection(PyObject *self, PyObject *args) {
   int m;
 
@@ -4859,6 +4913,21 @@ static PyObject *PAppendTable(PyObject *self, PyObject *args) {
   return Py_None;
 }
 
+static PyObject *PIndexTable(PyObject *self, PyObject *args) {
+  char *fn;  
+  
+  if (sfac_file) {
+    SFACStatement("IndexTable", args, NULL);
+    Py_INCREF(Py_None);
+    return Py_None;
+  }
+  if (!PyArg_ParseTuple(args, "s", &fn)) return NULL;
+  IndexTable(fn);
+  
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
 static PyObject *PJoinTable(PyObject *self, PyObject *args) {
   char *fn, *fn1, *fn2;  
   
@@ -4892,7 +4961,7 @@ static PyObject *PModifyTable(PyObject *self, PyObject *args) {
 }
 
 static PyObject *PLimitArray(PyObject *self, PyObject *args) {
-  int m;
+  int m, e;
   double n;
   
   if (sfac_file) {
@@ -4900,8 +4969,9 @@ static PyObject *PLimitArray(PyObject *self, PyObject *args) {
     Py_INCREF(Py_None);
     return Py_None;
   }
-  if (!PyArg_ParseTuple(args, "id", &m, &n)) return NULL;
-  LimitArrayRadial(m, n);
+  e = -1;
+  if (!PyArg_ParseTuple(args, "id|i", &m, &n, &e)) return NULL;
+  LimitArrayRadial(m, n, e);
   
   Py_INCREF(Py_None);
   return Py_None;
@@ -5079,6 +5149,44 @@ static PyObject *PSavePotential(PyObject *self, PyObject *args) {
   return Py_None;
 }
  
+static PyObject *PSaveRadialCache(PyObject *self, PyObject *args) {
+  char *fn;
+   
+  if (sfac_file) {
+    SFACStatement("SaveRadialCache", args, NULL);
+    Py_INCREF(Py_None);
+    return Py_None;
+  }
+  
+  if (!(PyArg_ParseTuple(args, "s", &fn))) {
+    return NULL;
+  }
+
+  SaveRadialCache(fn);
+  
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+ 
+static PyObject *PLoadRadialCache(PyObject *self, PyObject *args) {
+  char *fn;
+   
+  if (sfac_file) {
+    SFACStatement("LoadRadialCache", args, NULL);
+    Py_INCREF(Py_None);
+    return Py_None;
+  }
+  
+  if (!(PyArg_ParseTuple(args, "s", &fn))) {
+    return NULL;
+  }
+
+  LoadRadialCache(fn);
+  
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+ 
 static PyObject *PRestorePotential(PyObject *self, PyObject *args) {
   char *fn;
   POTENTIAL *p;
@@ -5159,7 +5267,7 @@ static PyObject *PFinalizeMPI(PyObject *self, PyObject *args) {
     return Py_None;
   }
 
-#if USE_MPI == 1
+#ifdef USE_MPIRANK
   FinalizeMPI();
 #endif
   
@@ -5173,8 +5281,10 @@ static struct PyMethodDef fac_methods[] = {
   {"PropogateDirection", PPropogateDirection, METH_VARARGS}, 
   {"SetUTA", PSetUTA, METH_VARARGS}, 
   {"SetTRF", PSetTRF, METH_VARARGS}, 
+  {"SetTableCompression", PSetTableCompression, METH_VARARGS}, 
   {"SetCEPWFile", PSetCEPWFile, METH_VARARGS}, 
   {"AppendTable", PAppendTable, METH_VARARGS}, 
+  {"IndexTable", PIndexTable, METH_VARARGS}, 
   {"JoinTable", PJoinTable, METH_VARARGS}, 
   {"ModifyTable", PModifyTable, METH_VARARGS},
   {"LimitArray", PLimitArray, METH_VARARGS},
@@ -5186,6 +5296,7 @@ static struct PyMethodDef fac_methods[] = {
   {"RMatrixCE", PRMatrixCE, METH_VARARGS}, 
   {"TestRMatrix", PTestRMatrix, METH_VARARGS}, 
   {"SetSlaterCut", PSetSlaterCut, METH_VARARGS}, 
+  {"SetRadialSIMD", PSetRadialSIMD, METH_VARARGS}, 
   {"RMatrixBoundary", PRMatrixBoundary, METH_VARARGS}, 
   {"RMatrixTargets", PRMatrixTargets, METH_VARARGS}, 
   {"RMatrixBasis", PRMatrixBasis, METH_VARARGS}, 
@@ -5267,6 +5378,7 @@ static struct PyMethodDef fac_methods[] = {
   {"SetAngZCut", PSetAngZCut, METH_VARARGS},
   {"SetCILevel", PSetCILevel, METH_VARARGS},
   {"SetMixCut", PSetMixCut, METH_VARARGS},
+  {"SetDavidson", PSetDavidson, METH_VARARGS},
   {"SetAtom", PSetAtom, METH_VARARGS},
   {"SetAvgConfig", PSetAvgConfig, METH_VARARGS},
   {"SetBoundary", PSetBoundary, METH_VARARGS},
@@ -5366,6 +5478,8 @@ static struct PyMethodDef fac_methods[] = {
   {"PrintNucleus", PPrintNucleus, METH_VARARGS},
   {"SavePotential", PSavePotential, METH_VARARGS},
   {"RestorePotential", PRestorePotential, METH_VARARGS},
+  {"SaveRadialCache", PSaveRadialCache, METH_VARARGS},
+  {"LoadRadialCache", PLoadRadialCache, METH_VARARGS},
   {"ModifyPotential", PModifyPotential, METH_VARARGS},
   {"InitializeMPI", PInitializeMPI, METH_VARARGS},
   {"MPIRank", PMPIRank, METH_VARARGS},
@@ -21,17 +21,22 @@
 #include <Python.h>
 #include "sysdef.h"
 
-#ifdef USE_MPI
+#if USE_MPI == 1 || USE_MPI == 3
 #include <mpi.h>
 #endif
 
 extern DL_EXPORT(int) Py_Main();
 
 int main(int argc, char *argv[]) {
-#if USE_MPI == 1
+#if USE_MPI == 1 || USE_MPI == 3
   int rc;
   
+#if USE_MPI == 3
+  int k;
+  rc = MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &k);
+#else
   rc = MPI_Init(&argc, &argv);
+#endif
   if (rc != MPI_SUCCESS) {
     fprintf(stderr, "MPI Initialization failed: error code %d\n",
 	    rc);
@@ -41,7 +46,7 @@ int main(int argc, char *argv[]) {
 
   Py_Main(argc, argv);
   
-#if USE_MPI == 1
+#if USE_MPI == 1 || USE_MPI == 3
   MPI_Finalize();
 #endif
   
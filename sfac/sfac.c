@@ -1414,6 +1414,29 @@ static int PSetMixCut(int argc, char *argv[], int argt[],
   return 0;
 }
 
+static int PSetDavidson(int argc, char *argv[], int argt[], 
+			ARRAY *variables) {
+  int n, nmin;
+  double tol;
+  
+  if (argc < 1 || argc > 3) return -1;
+  if (argt[0] != NUMBER) return -1;
+  n = atoi(argv[0]);
+  nmin = 0;
+  tol = 0.0;
+  if (argc > 1) {
+    if (argt[1] != NUMBER) return -1;
+    nmin = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    if (argt[2] != NUMBER) return -1;
+    tol = atof(argv[2]);
+  }
+  SetDavidson(n, nmin, tol);
+  
+  return 0;
+}
+
 static int PSetAtom(int argc, char *argv[], int argt[], 
 		    ARRAY *variables) {
   double z, mass, rn, a;
@@ -2890,6 +2913,16 @@ static int PSetTRF(int argc, char *argv[], int argt[],
   return 0;
 }
 
+static int PSetTableCompression(int argc, char *argv[], int argt[], 
+				ARRAY *variables) {
+  
+  if (argc != 1 || argt[0] != NUMBER) return -1;
+  
+  SetTableCompression(atoi(argv[0]));
+  
+  return 0;
+}
+
 static int PCoulombBethe(int argc, char *argv[], int argt[], 
 			ARRAY *variables) {
   double z, te, e1;
@@ -3506,6 +3539,21 @@ static int PSetSlaterCut(int argc, char *argv[], int argt[],
   return 0;
 }
 
+static int PSetRadialSIMD(int argc, char *argv[], int argt[], 
+			  ARRAY *variables) {
+  int m, c;
+
+  if (argc < 1 || argc > 2) return -1;
+  
+  m = atoi(argv[0]);
+  c = 0;
+  if (argc > 1) c = atoi(argv[1]);
+  
+  SetRadialSIMD(m, c);
+  
+  return 0;
+}
+
 static int PTestRMatrix(int argc, char *argv[], int argt[], 
 			ARRAY *variables) {
   int m;
@@ -3583,6 +3631,14 @@ static int PAppendTable(int argc, char *argv[], int argt[],
   return 0;
 }
 
+static int PIndexTable(int argc, char *argv[], int argt[], 
+		       ARRAY *variables) {  
+  if (argc != 1) return -1;
+  IndexTable(argv[0]);
+  
+  return 0;
+}
+
 static int PJoinTable(int argc, char *argv[], int argt[], 
 		      ARRAY *variables) {
   if (argc != 3) return -1;
@@ -3608,14 +3664,16 @@ static int PModifyTable(int argc, char *argv[], int argt[],
 
 static int PLimitArray(int argc, char *argv[], int argt[], 
 		       ARRAY *variables) {
-  int m;
+  int m, e;
   double n;
 
-  if (argc != 2) return -1;
+  if (argc != 2 && argc != 3) return -1;
   m = atoi(argv[0]);
   n = atof(argv[1]);
+  e = -1;
+  if (argc == 3) e = atoi(argv[2]);
 
-  LimitArrayRadial(m, n);
+  LimitArrayRadial(m, n, e);
   
   return 0;
 }
@@ -3844,6 +3902,24 @@ static int PRestorePotential(int argc, char *argv[], int argt[],
   return 0;
 } 
  
+static int PSaveRadialCache(int argc, char *argv[], int argt[], 
+			    ARRAY *variables) {
+  if (argc != 1) return -1;
+  
+  SaveRadialCache(argv[0]);
+
+  return 0;
+}
+ 
+static int PLoadRadialCache(int argc, char *argv[], int argt[], 
+			    ARRAY *variables) {
+  if (argc != 1) return -1;
+  
+  LoadRadialCache(argv[0]);
+
+  return 0;
+}
+ 
 static int PModifyPotential(int argc, char *argv[], int argt[], 
 			  ARRAY *variables) {
   char *fn;
@@ -3880,7 +3956,7 @@ static int PMPIRank(int argc, char *argv[], int argt[],
 
 static int PFinalizeMPI(int argc, char *argv[], int argt[], 
 			ARRAY *variables) {
-#if USE_MPI == 1
+#ifdef USE_MPIRANK
   FinalizeMPI();
 #endif
   return 0;
@@ -3892,8 +3968,10 @@ static METHOD methods[] = {
   {"PropogateDirection", PPropogateDirection, METH_VARARGS}, 
   {"SetUTA", PSetUTA, METH_VARARGS}, 
   {"SetTRF", PSetTRF, METH_VARARGS}, 
+  {"SetTableCompression", PSetTableCompression, METH_VARARGS}, 
   {"SetCEPWFile", PSetCEPWFile, METH_VARARGS}, 
   {"AppendTable", PAppendTable, METH_VARARGS}, 
+  {"IndexTable", PIndexTable, METH_VARARGS}, 
   {"JoinTable", PJoinTable, METH_VARARGS}, 
   {"ModifyTable", PModifyTable, METH_VARARGS},
   {"LimitArray", PLimitArray, METH_VARARGS},
@@ -3905,6 +3983,7 @@ static METHOD methods[] = {
   {"TestRMatrix", PTestRMatrix, METH_VARARGS}, 
   {"RMatrixCE", PRMatrixCE, METH_VARARGS}, 
   {"SetSlaterCut", PSetSlaterCut, METH_VARARGS}, 
+  {"SetRadialSIMD", PSetRadialSIMD, METH_VARARGS}, 
   {"RMatrixBoundary", PRMatrixBoundary, METH_VARARGS}, 
   {"RMatrixBasis", PRMatrixBasis, METH_VARARGS}, 
   {"RMatrixTargets", PRMatrixTargets, METH_VARARGS}, 
@@ -3971,6 +4050,7 @@ static METHOD methods[] = {
   {"SetCILevel", PSetCILevel, METH_VARARGS},
   {"SetBoundary", PSetBoundary, METH_VARARGS},
   {"SetMixCut", PSetMixCut, METH_VARARGS},
+  {"SetDavidson", PSetDavidson, METH_VARARGS},
   {"SetAtom", PSetAtom, METH_VARARGS},
   {"SetAvgConfig", PSetAvgConfig, METH_VARARGS},
   {"SetCEGrid", PSetCEGrid, METH_VARARGS},
@@ -4055,6 +4135,8 @@ static METHOD methods[] = {
   {"PrintQED", PPrintQED, METH_VARARGS},
   {"SavePotential", PSavePotential, METH_VARARGS},
   {"RestorePotential", PRestorePotential, METH_VARARGS},
+  {"SaveRadialCache", PSaveRadialCache, METH_VARARGS},
+  {"LoadRadialCache", PLoadRadialCache, METH_VARARGS},
   {"ModifyPotential", PModifyPotential, METH_VARARGS},
   {"InitializeMPI", PInitializeMPI, METH_VARARGS},
   {"MPIRank", PMPIRank, METH_VARARGS},